@@ -0,0 +1,79 @@
+/**
+ * @file bench_common.hpp
+ * @brief Minimal timing helpers shared by the embsh benchmarks.
+ */
+
+#ifndef EMBSH_BENCH_COMMON_HPP_
+#define EMBSH_BENCH_COMMON_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace bench {
+
+inline uint64_t NowNs() noexcept {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+/// @brief Keep @p value alive so the compiler cannot drop the work producing it.
+template <typename T>
+inline void DoNotOptimize(const T& value) noexcept {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief Time @p fn over @p iters calls and print ns/op.
+ *
+ * A short warm-up run precedes the measurement. @p fn takes no arguments.
+ */
+template <typename F>
+inline double Run(const char* name, uint64_t iters, F&& fn) {
+  for (uint64_t i = 0; i < iters / 10 + 1; ++i) {
+    fn();
+  }
+  const uint64_t start = NowNs();
+  for (uint64_t i = 0; i < iters; ++i) {
+    fn();
+  }
+  const double ns = static_cast<double>(NowNs() - start) / static_cast<double>(iters);
+  std::printf("  %-44s %10.1f ns/op\n", name, ns);
+  return ns;
+}
+
+/// @brief Latency samples in nanoseconds with percentile reporting.
+struct Samples {
+  std::vector<uint64_t> ns;
+
+  void Add(uint64_t v) { ns.push_back(v); }
+
+  uint64_t Percentile(double p) {
+    if (ns.empty())
+      return 0;
+    std::sort(ns.begin(), ns.end());
+    size_t idx = static_cast<size_t>(p * static_cast<double>(ns.size() - 1) + 0.5);
+    return ns[idx];
+  }
+
+  void Report(const char* name) {
+    const uint64_t p50 = Percentile(0.50);
+    const uint64_t p99 = Percentile(0.99);
+    std::printf("  %-44s p50 %8.1f us   p99 %8.1f us   (n=%zu)\n", name, static_cast<double>(p50) / 1000.0,
+                static_cast<double>(p99) / 1000.0, ns.size());
+  }
+};
+
+/// @brief Print a throughput line.
+inline void ReportRate(const char* name, uint64_t bytes, uint64_t elapsed_ns) {
+  const double sec = static_cast<double>(elapsed_ns) / 1e9;
+  std::printf("  %-44s %10.2f MB/s   (%llu bytes)\n", name, static_cast<double>(bytes) / sec / 1e6,
+              static_cast<unsigned long long>(bytes));
+}
+
+}  // namespace bench
+
+#endif  // EMBSH_BENCH_COMMON_HPP_
@@ -0,0 +1,188 @@
+/**
+ * @file bench_kernels.cpp
+ * @brief ns/op for the editor, tokenizer and registry hot paths.
+ *
+ * Registry kernels run at several table sizes; each size is measured in a
+ * forked child because the registry is a process-wide singleton.
+ */
+
+#include "bench_common.hpp"
+
+#include "embsh/line_editor.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+ssize_t NullWrite(int /*fd*/, const void* /*buf*/, size_t len) {
+  return static_cast<ssize_t>(len);
+}
+
+int NopCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  return 0;
+}
+
+void InitSession(embsh::Session& s) {
+  s.write_fd = -1;
+  s.write_fn = NullWrite;
+  s.active.store(true, std::memory_order_relaxed);
+}
+
+// ============================================================================
+// Editor and tokenizer
+// ============================================================================
+
+void BenchEditor() {
+  std::printf("editor / tokenizer\n");
+  (void)embsh::CommandRegistry::Instance().Register("nop", NopCmd, "bench");
+
+  static embsh::Session s;
+  InitSession(s);
+
+  bench::Run("ProcessByte (printable, per byte)", 20000000, [] {
+    if (s.line_pos >= EMBSH_LINE_BUF_SIZE - 2) {
+      s.line_pos = 0;
+      s.tx_len = 0;
+    }
+    bench::DoNotOptimize(embsh::editor::ProcessByte(s, 'a', "> "));
+  });
+
+  static const char kLine[] = "nop arg1 arg2 arg3 \"quoted arg\" 0x1234\r";
+  bench::Run("ProcessBytes (40-byte line + execute)", 1000000, [] {
+    bench::DoNotOptimize(embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(kLine), sizeof(kLine) - 1,
+                                                      "> "));
+  });
+
+  // Bracketed paste of 8 provisioning lines.
+  static const char kPaste[] =
+      "\x1b[200~nop set net.ip 192.168.1.10\r\nnop set net.mask 255.255.255.0\r\nnop set net.gw 192.168.1.1\r\n"
+      "nop set log.level 3\r\nnop set uart.baud 115200\r\nnop set uart.parity none\r\nnop save\r\nnop reboot\r\n"
+      "\x1b[201~";
+  bench::Run("ProcessBytes (8-line bracketed paste)", 200000, [] {
+    bench::DoNotOptimize(embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(kPaste), sizeof(kPaste) - 1,
+                                                      "> "));
+  });
+
+  // A 200-byte line pasted without bracketed-paste markers (one terminal read).
+  static char long_line[EMBSH_LINE_BUF_SIZE];
+  static size_t long_len = 0;
+  long_len = static_cast<size_t>(std::snprintf(long_line, sizeof(long_line), "nop "));
+  while (long_len < 199) {
+    long_line[long_len] = static_cast<char>('a' + long_len % 26);
+    ++long_len;
+  }
+  long_line[long_len++] = '\r';
+  bench::Run("ProcessBytes (200-byte line + execute)", 1000000, [] {
+    bench::DoNotOptimize(embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(long_line), long_len, "> "));
+  });
+
+  static const char kPlain[] = "set key value 1 2 3 4 5 6 7 8 9 10";
+  bench::Run("ShellSplit (plain, 11 args)", 5000000, [] {
+    char buf[sizeof(kPlain)];
+    char* argv[EMBSH_MAX_ARGS];
+    std::memcpy(buf, kPlain, sizeof(buf));
+    bench::DoNotOptimize(embsh::ShellSplit(buf, sizeof(buf) - 1, argv));
+  });
+
+  // A 200-byte JSON-like argument with an escape every other byte.
+  static char escaped[EMBSH_LINE_BUF_SIZE];
+  static uint32_t escaped_len = 0;
+  escaped_len = static_cast<uint32_t>(std::snprintf(escaped, sizeof(escaped), "json \""));
+  while (escaped_len < 200) {
+    escaped[escaped_len++] = '\\';
+    escaped[escaped_len++] = '"';
+  }
+  escaped[escaped_len++] = '"';
+  escaped[escaped_len] = '\0';
+  bench::Run("ShellSplit (escape-heavy, 200 bytes)", 1000000, [] {
+    char buf[EMBSH_LINE_BUF_SIZE];
+    char* argv[EMBSH_MAX_ARGS];
+    std::memcpy(buf, escaped, escaped_len + 1);
+    bench::DoNotOptimize(embsh::ShellSplit(buf, escaped_len, argv));
+  });
+
+  // Command output into tx_buf; NullWrite absorbs the flushes.
+  embsh::editor::BindOutput(s, nullptr);
+  bench::Run("ShellPrintf (row: %4u %-12s 0x%08x)", 2000000,
+             [] { bench::DoNotOptimize(embsh::ShellPrintf("%4u %-12s 0x%08x\r\n", 42U, "counter", 0xdeadU)); });
+  bench::Run("ShellWrite + ShellWriteUint/Hex (same row)", 2000000, [] {
+    embsh::ShellWriteUint(42);
+    embsh::ShellWrite(std::string_view(" counter      0x"));
+    embsh::ShellWriteHex(0xdead, 8);
+    embsh::ShellWrite("\r\n", 2);
+  });
+  embsh::detail::CurrentOutput() = embsh::detail::SessionOutput{};
+  s.tx_len = 0;
+}
+
+// ============================================================================
+// Registry at a given size
+// ============================================================================
+
+char g_names[EMBSH_MAX_COMMANDS][16];
+
+void BenchRegistry(uint32_t size) {
+  static uint32_t next = 0;
+  static uint32_t n = 0;
+  auto& reg = embsh::CommandRegistry::Instance();
+  while (reg.Count() < size && reg.Register(g_names[n], NopCmd, "bench").has_value()) {
+    ++n;
+  }
+  reg.Freeze();
+  std::printf("registry, %u commands\n", reg.Count());
+  char label[64];
+
+  bench::Run("Find (hit)", 5000000, [] {
+    bench::DoNotOptimize(embsh::CommandRegistry::Instance().Find(g_names[next]));
+    next = (next + 1 == n) ? 0 : next + 1;
+  });
+  bench::Run("Find (miss)", 5000000,
+             [] { bench::DoNotOptimize(embsh::CommandRegistry::Instance().Find("cmd_zzzz")); });
+  bench::Run("MatchPrefix (unique)", 2000000, [] {
+    bench::DoNotOptimize(embsh::CommandRegistry::Instance().MatchPrefix(g_names[next], 8));
+    next = (next + 1 == n) ? 0 : next + 1;
+  });
+  std::snprintf(label, sizeof(label), "AutoComplete (\"cmd_\", %u matches)", n);
+  bench::Run(label, 2000000, [] {
+    char out[32];
+    bench::DoNotOptimize(embsh::CommandRegistry::Instance().AutoComplete("cmd_", out, sizeof(out)));
+  });
+  bench::Run("Execute (line into OutputSink)", 2000000, [] {
+    char buf[64];
+    embsh::OutputSink sink(buf, sizeof(buf));
+    bench::DoNotOptimize(embsh::CommandRegistry::Instance().Execute(g_names[next], sink).has_value());
+    next = (next + 1 == n) ? 0 : next + 1;
+  });
+}
+
+}  // namespace
+
+int main() {
+  BenchEditor();
+
+  for (uint32_t i = 0; i < EMBSH_MAX_COMMANDS; ++i) {
+    std::snprintf(g_names[i], sizeof(g_names[i]), "cmd_%04u", i);
+  }
+  static const uint32_t kSizes[] = {16, 64, 256, EMBSH_MAX_COMMANDS};
+  for (uint32_t size : kSizes) {
+    std::fflush(stdout);
+    pid_t pid = ::fork();
+    if (pid < 0) {
+      std::perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      BenchRegistry(size);
+      std::fflush(stdout);
+      _exit(0);
+    }
+    int status = 0;
+    (void)::waitpid(pid, &status, 0);
+  }
+  return 0;
+}
@@ -0,0 +1,301 @@
+/**
+ * @file bench_transport.cpp
+ * @brief End-to-end command latency and output throughput per transport.
+ *
+ * Drives a loopback telnet session (thread-per-session and reactor mode)
+ * a pty-backed UartShell and a shared-memory ShmShell the way a user
+ * would: send a command line, read until the next prompt. Connection setup
+ * (connect until first prompt) is measured per telnet mode as well.
+ */
+
+#include "bench_common.hpp"
+
+#include "embsh/shm_transport.hpp"
+#include "embsh/telnet_server.hpp"
+#include "embsh/uart_shell.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr const char* kPrompt = "bench> ";
+constexpr uint32_t kLatencyRuns = 2000;
+constexpr uint32_t kBulkRuns = 200;
+constexpr uint32_t kBulkLines = 64;  ///< bench_bulk prints kBulkLines x 64 bytes.
+constexpr uint32_t kBinRuns = 50;
+constexpr uint32_t kConnectRuns = 300;
+constexpr size_t kBinBytes = 64 * 1024;  ///< bench_bin sends this much raw data.
+
+int NopCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  return 0;
+}
+
+int BulkCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  for (uint32_t i = 0; i < kBulkLines; ++i) {
+    embsh::ShellPrintf("%04u 0123456789abcdef0123456789abcdef0123456789abcdef012345678\r\n", i);
+  }
+  return 0;
+}
+
+int BinCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  static uint8_t trace[kBinBytes];
+  for (size_t i = 0; i < sizeof(trace); ++i)
+    trace[i] = static_cast<uint8_t>(i * 7);  // Every byte value, including IAC.
+  (void)embsh::ShellWriteBinary(trace, sizeof(trace));
+  return 0;
+}
+
+/**
+ * @brief Read from @p fd until @p marker has been seen.
+ * @return Bytes read including the marker, or -1 on error / 2 s timeout.
+ */
+ssize_t ReadUntil(int fd, const char* marker) {
+  const size_t mlen = std::strlen(marker);
+  char win[4096 + 64];
+  size_t carry = 0;
+  ssize_t total = 0;
+  for (;;) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (::poll(&pfd, 1, 2000) <= 0)
+      return -1;
+    ssize_t n = ::read(fd, win + carry, 4096);
+    if (n <= 0)
+      return -1;
+    total += n;
+    const size_t have = carry + static_cast<size_t>(n);
+    if (::memmem(win, have, marker, mlen) != nullptr)
+      return total;
+    carry = (have < mlen - 1) ? have : mlen - 1;
+    std::memmove(win, win + have - carry, carry);
+  }
+}
+
+bool SendAll(int fd, const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, data, len);
+    if (n <= 0)
+      return false;
+    data += n;
+    len -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+/// @brief Throughput of @p runs executions of @p cmd; false if the session failed.
+bool Throughput(const char* label, int fd, const char* cmd, const char* eol, uint32_t runs, const char* what) {
+  char line[64];
+  char name[96];
+  int len = std::snprintf(line, sizeof(line), "%s%s", cmd, eol);
+  uint64_t bytes = 0;
+  const uint64_t t0 = bench::NowNs();
+  for (uint32_t i = 0; i < runs; ++i) {
+    ssize_t n = -1;
+    if (!SendAll(fd, line, static_cast<size_t>(len)) || (n = ReadUntil(fd, kPrompt)) < 0) {
+      std::printf("  %s: session failed\n", label);
+      return false;
+    }
+    bytes += static_cast<uint64_t>(n);
+  }
+  std::snprintf(name, sizeof(name), "%s %s", label, what);
+  bench::ReportRate(name, bytes, bench::NowNs() - t0);
+  return true;
+}
+
+/// @brief Latency of a no-op command, then text and raw output throughput on @p fd.
+void Measure(const char* label, int fd, const char* eol) {
+  char line[64];
+  char name[96];
+
+  int len = std::snprintf(line, sizeof(line), "bench_nop%s", eol);
+  bench::Samples lat;
+  for (uint32_t i = 0; i < kLatencyRuns; ++i) {
+    const uint64_t t0 = bench::NowNs();
+    if (!SendAll(fd, line, static_cast<size_t>(len)) || ReadUntil(fd, kPrompt) < 0) {
+      std::printf("  %s: session failed\n", label);
+      return;
+    }
+    lat.Add(bench::NowNs() - t0);
+  }
+  std::snprintf(name, sizeof(name), "%s command round-trip", label);
+  lat.Report(name);
+
+  if (Throughput(label, fd, "bench_bulk", eol, kBulkRuns, "output throughput")) {
+    (void)Throughput(label, fd, "bench_bin", eol, kBinRuns, "binary throughput");
+  }
+}
+
+int TcpConnect(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int i = 0; i < 50; ++i) {
+    if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0)
+      return fd;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  ::close(fd);
+  return -1;
+}
+
+/// @brief Connect-to-prompt latency; each client disconnects before the next connects.
+void MeasureConnect(const char* label, uint16_t port) {
+  bench::Samples lat;
+  for (uint32_t i = 0; i < kConnectRuns; ++i) {
+    const uint64_t t0 = bench::NowNs();
+    int fd = TcpConnect(port);
+    if (fd < 0 || ReadUntil(fd, kPrompt) < 0) {
+      std::printf("  %s: connect failed\n", label);
+      if (fd >= 0)
+        ::close(fd);
+      return;
+    }
+    lat.Add(bench::NowNs() - t0);
+    ::close(fd);
+  }
+  char name[96];
+  std::snprintf(name, sizeof(name), "%s connect to prompt", label);
+  lat.Report(name);
+}
+
+void BenchTelnet(const char* label, uint16_t port, bool reactor, bool prespawn = false) {
+  embsh::ServerConfig cfg;
+  cfg.port = port;
+  cfg.prompt = kPrompt;
+  cfg.reactor_mode = reactor;
+  cfg.prespawn = prespawn;
+  cfg.backlog = 64;
+  embsh::TelnetServer server(cfg);
+  if (!server.Start().has_value()) {
+    std::printf("  %s: cannot listen on port %u\n", label, port);
+    return;
+  }
+  MeasureConnect(label, port);
+  int fd = TcpConnect(port);
+  if (fd >= 0 && ReadUntil(fd, kPrompt) > 0) {
+    Measure(label, fd, "\r\n");
+  } else {
+    std::printf("  %s: connect failed\n", label);
+  }
+  if (fd >= 0)
+    ::close(fd);
+  server.Stop();
+}
+
+void BenchUart() {
+  int master = -1;
+  int slave = -1;
+  if (::openpty(&master, &slave, nullptr, nullptr, nullptr) != 0) {
+    std::printf("  uart (pty): openpty failed\n");
+    return;
+  }
+  struct termios tty = {};
+  (void)::tcgetattr(slave, &tty);
+  ::cfmakeraw(&tty);
+  (void)::tcsetattr(slave, TCSANOW, &tty);
+
+  embsh::UartShell::Config cfg;
+  cfg.override_fd = slave;
+  cfg.prompt = kPrompt;
+  embsh::UartShell shell(cfg);
+  if (shell.Start().has_value() && ReadUntil(master, kPrompt) > 0) {
+    Measure("uart (pty)", master, "\r");
+  } else {
+    std::printf("  uart (pty): start failed\n");
+  }
+  shell.Stop();
+  ::close(master);
+  ::close(slave);
+}
+
+/// @brief ReadUntil() for a ShmClient.
+ssize_t ShmReadUntil(embsh::ShmClient& client, const char* marker) {
+  const size_t mlen = std::strlen(marker);
+  char win[4096 + 64];
+  size_t carry = 0;
+  ssize_t total = 0;
+  for (;;) {
+    ssize_t n = client.Read(win + carry, 4096, 2000);
+    if (n <= 0)
+      return -1;
+    total += n;
+    const size_t have = carry + static_cast<size_t>(n);
+    if (::memmem(win, have, marker, mlen) != nullptr)
+      return total;
+    carry = (have < mlen - 1) ? have : mlen - 1;
+    std::memmove(win, win + have - carry, carry);
+  }
+}
+
+void BenchShm() {
+  char path[64];
+  std::snprintf(path, sizeof(path), "/tmp/embsh_bench_%d.sock", static_cast<int>(::getpid()));
+  embsh::ShmShell::Config cfg;
+  cfg.path = path;
+  cfg.prompt = kPrompt;
+  embsh::ShmShell shell(cfg);
+  embsh::ShmClient client;
+  if (!shell.Start().has_value() || !client.Connect(path).has_value() || ShmReadUntil(client, kPrompt) < 0) {
+    std::printf("  shm: start failed\n");
+    return;
+  }
+
+  const char nop[] = "bench_nop\r";
+  bench::Samples lat;
+  for (uint32_t i = 0; i < kLatencyRuns; ++i) {
+    const uint64_t t0 = bench::NowNs();
+    if (client.Write(nop, sizeof(nop) - 1) < 0 || ShmReadUntil(client, kPrompt) < 0) {
+      std::printf("  shm: session failed\n");
+      return;
+    }
+    lat.Add(bench::NowNs() - t0);
+  }
+  lat.Report("shm command round-trip");
+
+  const char bulk[] = "bench_bulk\r";
+  uint64_t bytes = 0;
+  const uint64_t t0 = bench::NowNs();
+  for (uint32_t i = 0; i < kBulkRuns; ++i) {
+    ssize_t n = -1;
+    if (client.Write(bulk, sizeof(bulk) - 1) < 0 || (n = ShmReadUntil(client, kPrompt)) < 0) {
+      std::printf("  shm: session failed\n");
+      return;
+    }
+    bytes += static_cast<uint64_t>(n);
+  }
+  bench::ReportRate("shm output throughput", bytes, bench::NowNs() - t0);
+  client.Close();
+  shell.Stop();
+}
+
+}  // namespace
+
+int main() {
+  auto& reg = embsh::CommandRegistry::Instance();
+  (void)reg.Register("bench_nop", NopCmd, "No-op");
+  (void)reg.Register("bench_bulk", BulkCmd, "Print 4 KiB");
+  (void)reg.Register("bench_bin", BinCmd, "Send 64 KiB raw");
+  reg.Freeze();
+
+  std::printf("transports\n");
+  BenchTelnet("telnet (thread)", 23400, false);
+  BenchTelnet("telnet (reactor)", 23401, true);
+  BenchTelnet("telnet (prespawn)", 23402, false, true);
+  BenchUart();
+  BenchShm();
+  return 0;
+}
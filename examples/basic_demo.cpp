@@ -65,6 +65,8 @@ int main() {
   cfg.banner = "\r\n=== embsh basic demo ===\r\n\r\n";
 
   embsh::TelnetServer server(cfg);
+  // All commands are registered by now; lookups skip the reader bookkeeping.
+  embsh::CommandRegistry::Instance().Freeze();
   auto r = server.Start();
   if (!r.has_value()) {
     std::fprintf(stderr, "Failed to start server (error %d)\n", static_cast<int>(r.error_value()));
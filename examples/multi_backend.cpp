@@ -40,8 +40,8 @@ static int cmd_version(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
   return 0;
 }
 
-EMBSH_CMD(cmd_info, "Show backend information");
-EMBSH_CMD(cmd_version, "Show version");
+EMBSH_CMD_STATIC(cmd_info, "Show backend information");
+EMBSH_CMD_STATIC(cmd_version, "Show version");
 
 int main() {
   std::signal(SIGINT, SignalHandler);
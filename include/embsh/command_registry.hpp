@@ -3,20 +3,31 @@
  * @brief Global command registry with context pointer, auto-complete, and
  *        in-place command line tokenizer.
  *
- * Provides a fixed-capacity (EMBSH_MAX_COMMANDS) command table, thread-safe
- * registration, tab completion, and the EMBSH_CMD auto-registration macro.
+ * Provides a fixed-capacity (EMBSH_MAX_COMMANDS) command table with a hashed
+ * name index, thread-safe registration, tab completion, and the EMBSH_CMD
+ * auto-registration macro.
  */
 
 #ifndef EMBSH_COMMAND_REGISTRY_HPP_
 #define EMBSH_COMMAND_REGISTRY_HPP_
 
 #include "embsh/platform.hpp"
+#include "embsh/shell_output.hpp"
+#include "embsh/stats.hpp"
 #include "embsh/types.hpp"
 
-#include <cstdarg>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <mutex>
+#include <string_view>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #ifndef EMBSH_MAX_COMMANDS
 #define EMBSH_MAX_COMMANDS 64
@@ -26,8 +37,51 @@
 #define EMBSH_MAX_ARGS 32
 #endif
 
+#ifndef EMBSH_ENABLE_PIPES
+#define EMBSH_ENABLE_PIPES 0  ///< ShellSplit() treats unquoted `|`, `>` and `>>` as operators (opt-in).
+#endif
+
+// EMBSH_PIPE_FILE_DIR: directory `> name` / `>> name` write into, e.g. "/var/log/embsh".
+// Left undefined, redirection is rejected. Targets are plain file names there.
+
+#ifndef EMBSH_PIPE_MAX_STAGES
+#define EMBSH_PIPE_MAX_STAGES 4  ///< Commands in one pipeline.
+#endif
+
+#ifndef EMBSH_PIPE_BUF_SIZE
+#define EMBSH_PIPE_BUF_SIZE 1024  ///< Per stage: grep line, tail window, or input of a plain command.
+#endif
+
+#ifndef EMBSH_EXEC_LINE_SIZE
+#define EMBSH_EXEC_LINE_SIZE 256  ///< Longest line CommandRegistry::Execute() accepts, including the NUL.
+#endif
+
+static_assert(EMBSH_MAX_COMMANDS > 0 && EMBSH_MAX_COMMANDS < 0xFFFF, "EMBSH_MAX_COMMANDS must fit in uint16_t");
+
 namespace embsh {
 
+namespace detail {
+
+/// @brief 32-bit FNV-1a hash of a NUL-terminated name.
+constexpr uint32_t HashName(const char* name) noexcept {
+  uint32_t h = 2166136261U;
+  for (; *name != '\0'; ++name) {
+    h ^= static_cast<uint8_t>(*name);
+    h *= 16777619U;
+  }
+  return h;
+}
+
+/// @brief Smallest power of two >= @p v.
+constexpr uint32_t NextPow2(uint32_t v) noexcept {
+  uint32_t p = 1;
+  while (p < v)
+    p <<= 1;
+  return p;
+}
+
+}  // namespace detail
+
 // ============================================================================
 // Command types
 // ============================================================================
@@ -35,70 +89,198 @@ namespace embsh {
 /// @brief Unified command function signature with context pointer.
 using CmdFn = int (*)(int argc, char* argv[], void* ctx);
 
+/// @brief CmdEntry::flags: long-running command, run on the WorkerPool; Ctrl+C requests cancellation.
+constexpr uint8_t kCmdAsync = 0x01;
+
 /// @brief Descriptor for a registered shell command.
 struct CmdEntry {
   const char* name = nullptr;  ///< Command name (must be static storage).
   const char* desc = nullptr;  ///< Human-readable description.
   CmdFn fn = nullptr;          ///< Callback to invoke.
   void* ctx = nullptr;         ///< User context passed to fn.
+  uint8_t flags = 0;           ///< kCmd* bits.
+};
+
+// ============================================================================
+// Static command table (linker section)
+// ============================================================================
+
+#if EMBSH_HAS_CMD_SECTION
+/// Bounds of the "embsh_cmd" section, provided by the linker; null when no static commands exist.
+extern "C" const CmdEntry __start_embsh_cmd[] __attribute__((weak, visibility("hidden")));
+extern "C" const CmdEntry __stop_embsh_cmd[] __attribute__((weak, visibility("hidden")));
+#endif
+
+namespace detail {
+
+/// @brief First entry placed by EMBSH_CMD_STATIC (link order).
+inline const CmdEntry* StaticCmdBegin() noexcept {
+#if EMBSH_HAS_CMD_SECTION
+  return __start_embsh_cmd;
+#else
+  return nullptr;
+#endif
+}
+
+/// @brief Number of entries placed by EMBSH_CMD_STATIC.
+inline uint32_t StaticCmdCount() noexcept {
+#if EMBSH_HAS_CMD_SECTION
+  return (__start_embsh_cmd == nullptr) ? 0U : static_cast<uint32_t>(__stop_embsh_cmd - __start_embsh_cmd);
+#else
+  return 0U;
+#endif
+}
+
+}  // namespace detail
+
+/// @brief Contiguous run of names sharing a prefix in a sorted name table.
+struct PrefixMatch {
+  uint32_t first = 0;   ///< Sorted position of the first match.
+  uint32_t count = 0;   ///< Number of matches.
+  uint32_t common = 0;  ///< Length of the longest common prefix of all matches.
 };
 
+namespace detail {
+
+/**
+ * @brief Prefix range search over any lexicographically sorted name table.
+ *
+ * Shared by the command index and usable for sub-command / argument tables.
+ *
+ * @param n        Number of names.
+ * @param name_at  Callable returning the i-th name in sorted order.
+ */
+template <typename NameAt>
+inline PrefixMatch MatchSortedPrefix(uint32_t n, NameAt name_at, const char* prefix, uint32_t prefix_len) noexcept {
+  // First position whose name compares >= prefix (or > prefix when upper).
+  auto bound = [&](bool upper) {
+    uint32_t lo = 0;
+    uint32_t hi = n;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      int c = std::strncmp(name_at(mid), prefix, prefix_len);
+      if (c < 0 || (upper && c == 0)) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  };
+
+  PrefixMatch m;
+  m.first = bound(false);
+  m.count = bound(true) - m.first;
+  if (m.count > 0) {
+    const char* a = name_at(m.first);
+    const char* b = name_at(m.first + m.count - 1);
+    uint32_t j = 0;
+    while (a[j] != '\0' && a[j] == b[j])
+      ++j;
+    m.common = j;
+  }
+  return m;
+}
+
+}  // namespace detail
+
 // ============================================================================
 // ShellSplit - In-place command line tokenizer
 // ============================================================================
 
+/// @brief argv entries ShellSplit() yields for unquoted `|`, `>` and `>>`; compare by address.
+inline constexpr char kShellPipe[] = "|";
+inline constexpr char kShellRedirect[] = ">";
+inline constexpr char kShellAppend[] = ">>";
+
+inline bool IsShellOperator(const char* arg) noexcept {
+  return arg == kShellPipe || arg == kShellRedirect || arg == kShellAppend;
+}
+
 /**
  * @brief Split a command line in-place into argc / argv.
  *
  * Replaces whitespace with NUL bytes and fills @p argv with pointers into
- * @p cmd.  Supports single-quoted, double-quoted strings and backslash escape.
+ * @p cmd.  Supports single-quoted, double-quoted strings and backslash escape
+ * (inside quotes, a backslash takes the next byte literally).
+ *
+ * With EMBSH_ENABLE_PIPES, an unquoted `|`, `>` or `>>` ends the word before
+ * it and becomes its own entry pointing at kShellPipe / kShellRedirect /
+ * kShellAppend (read-only storage), so a quoted "|" stays a plain argument.
+ * Such argv must go through RunPipeline() rather than to a command.
+ *
+ * Single pass: a read cursor scans the input while a write cursor compacts
+ * unescaped bytes behind it, so the cost is O(length) however many escapes
+ * an argument holds.
  *
  * @param cmd    Mutable command line buffer (modified in-place).
  * @param length Length of @p cmd in bytes (excluding NUL terminator).
  * @param argv   Output array of argument pointers; must hold EMBSH_MAX_ARGS.
- * @return Number of arguments parsed (argc), or -1 on overflow.
+ * @return Number of arguments parsed (argc), or -1 if more than
+ *         EMBSH_MAX_ARGS arguments are present (argv then holds the first
+ *         EMBSH_MAX_ARGS).
  */
 inline int ShellSplit(char* cmd, uint32_t length, char* argv[EMBSH_MAX_ARGS]) noexcept {
   int argc = 0;
-  uint32_t i = 0;
+  uint32_t rd = 0;
 
-  while (i < length && argc < EMBSH_MAX_ARGS) {
+  while (rd < length) {
     // Skip leading whitespace.
-    while (i < length && (cmd[i] == ' ' || cmd[i] == '\t')) {
-      cmd[i] = '\0';
-      ++i;
+    while (rd < length && (cmd[rd] == ' ' || cmd[rd] == '\t')) {
+      cmd[rd] = '\0';
+      ++rd;
     }
-    if (i >= length)
+    if (rd >= length)
       break;
+    if (argc >= EMBSH_MAX_ARGS)
+      return -1;
 
-    if (cmd[i] == '"' || cmd[i] == '\'') {
-      // Quoted argument.
-      char quote = cmd[i];
-      cmd[i] = '\0';
-      ++i;
-      if (i >= length)
+    if (cmd[rd] == '"' || cmd[rd] == '\'') {
+      // Quoted argument: compact escapes with a trailing write cursor.
+      const char quote = cmd[rd];
+      cmd[rd] = '\0';
+      ++rd;
+      if (rd >= length)
         break;
-      argv[argc++] = &cmd[i];
-      while (i < length && cmd[i] != quote) {
-        if (cmd[i] == '\\' && (i + 1) < length) {
-          // Shift left to remove backslash.
-          std::memmove(&cmd[i], &cmd[i + 1], length - i - 1);
-          --length;
-        } else {
-          ++i;
+      uint32_t wr = rd;
+      argv[argc++] = &cmd[wr];
+      while (rd < length && cmd[rd] != quote) {
+        if (cmd[rd] == '\\' && (rd + 1) < length) {
+          ++rd;
         }
+        cmd[wr++] = cmd[rd++];
+      }
+      if (rd < length) {
+        ++rd;  // Closing quote.
+      }
+      if (wr < length) {
+        cmd[wr] = '\0';
+      }
+#if EMBSH_ENABLE_PIPES
+    } else if (cmd[rd] == '|' || cmd[rd] == '>') {
+      // Operator: a token of its own, with or without surrounding blanks.
+      const bool append = cmd[rd] == '>' && (rd + 1) < length && cmd[rd + 1] == '>';
+      argv[argc++] = const_cast<char*>((cmd[rd] == '|') ? kShellPipe : (append ? kShellAppend : kShellRedirect));
+      cmd[rd++] = '\0';
+      if (append) {
+        cmd[rd++] = '\0';
       }
-      if (i < length) {
-        cmd[i] = '\0';
-        ++i;
+    } else {
+      // Unquoted argument.
+      argv[argc++] = &cmd[rd];
+      while (rd < length && cmd[rd] != ' ' && cmd[rd] != '\t' && cmd[rd] != '|' && cmd[rd] != '>') {
+        ++rd;
       }
+    }
+#else
     } else {
       // Unquoted argument.
-      argv[argc++] = &cmd[i];
-      while (i < length && cmd[i] != ' ' && cmd[i] != '\t') {
-        ++i;
+      argv[argc++] = &cmd[rd];
+      while (rd < length && cmd[rd] != ' ' && cmd[rd] != '\t') {
+        ++rd;
       }
     }
+#endif
   }
 
   return argc;
@@ -111,8 +293,28 @@ inline int ShellSplit(char* cmd, uint32_t length, char* argv[EMBSH_MAX_ARGS]) no
 /**
  * @brief Global command registry.
  *
- * Thread-safe for registration (mutex-protected). Lookup and enumeration are
- * read-only after registration phase. Capacity: EMBSH_MAX_COMMANDS.
+ * Registration is serialized by a mutex; lookups never lock. Entries are
+ * append-only and published with a release store of count_, so readers that
+ * acquire count_ (or an index slot) always see fully written entries. After
+ * Freeze() the table is immutable and Register() fails with kRegistryFrozen.
+ * Capacity: EMBSH_MAX_COMMANDS, shared by static and dynamic commands.
+ *
+ * Commands declared with EMBSH_CMD_STATIC live in a read-only linker
+ * section and are never copied; the constructor (first Instance() call)
+ * only hashes them into the indexes. Positions below static_count_ refer to
+ * that section, the rest to cmds_.
+ *
+ * Names are indexed in an open-addressing table (linear probing, load
+ * factor <= 1/2) keyed by FNV-1a hash, so Find() and the duplicate check in
+ * Register() cost O(1) on average without heap allocation. A second,
+ * name-sorted index serves prefix queries (MatchPrefix / ForEachMatch /
+ * AutoComplete) in O(log n). The constructor sorts the static section in
+ * one pass; Register() inserts its name under the registration mutex. The
+ * index is double-buffered: Register() writes the idle copy once no reader
+ * holds it and then swaps, readers only pin the active copy with an atomic
+ * reader count and never lock. Once frozen, readers skip the pin. A
+ * ForEachMatch() visitor must not call Register(): the writer would wait for
+ * the copy the visitor itself pins.
  */
 class CommandRegistry final {
  public:
@@ -125,21 +327,35 @@ class CommandRegistry final {
    * @brief Register a command.
    * @return success or ShellError on failure.
    */
-  inline expected<void, ShellError> Register(const char* name, CmdFn fn, void* ctx, const char* desc) noexcept {
+  inline expected<void, ShellError> Register(const char* name, CmdFn fn, void* ctx, const char* desc,
+                                             uint8_t flags = 0) noexcept {
+    if (name == nullptr || name[0] == '\0') {
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
     std::lock_guard<std::mutex> lock(mtx_);
-    for (uint32_t i = 0; i < count_; ++i) {
-      if (std::strcmp(cmds_[i].name, name) == 0) {
-        return expected<void, ShellError>::error(ShellError::kDuplicateName);
-      }
+    if (frozen_.load(std::memory_order_relaxed)) {
+      return expected<void, ShellError>::error(ShellError::kRegistryFrozen);
     }
-    if (count_ >= EMBSH_MAX_COMMANDS) {
+    const uint32_t hash = detail::HashName(name);
+    uint32_t pos = hash & kIndexMask;
+    if (Probe(name, hash, pos) != nullptr) {
+      return expected<void, ShellError>::error(ShellError::kDuplicateName);
+    }
+    const uint32_t n = count_.load(std::memory_order_relaxed);
+    if (static_count_ + n >= EMBSH_MAX_COMMANDS) {
       return expected<void, ShellError>::error(ShellError::kRegistryFull);
     }
-    cmds_[count_].name = name;
-    cmds_[count_].desc = desc;
-    cmds_[count_].fn = fn;
-    cmds_[count_].ctx = ctx;
-    ++count_;
+    cmds_[n].name = name;
+    cmds_[n].desc = desc;
+    cmds_[n].fn = fn;
+    cmds_[n].ctx = ctx;
+    cmds_[n].flags = flags;
+
+    // Publish: entry and sorted index first, then the count and the hash slot.
+    InsertSorted(static_cast<uint16_t>(static_count_ + n));
+    count_.store(n + 1, std::memory_order_release);
+    index_hash_[pos] = hash;
+    index_slot_[pos].store(static_cast<uint16_t>(static_count_ + n + 1), std::memory_order_release);
     return expected<void, ShellError>::success();
   }
 
@@ -148,14 +364,69 @@ class CommandRegistry final {
     return Register(name, fn, nullptr, desc);
   }
 
-  /// @brief Find a command by exact name.
+  /**
+   * @brief End the registration phase.
+   *
+   * After this call the table is immutable: Register() returns
+   * kRegistryFrozen and lookups no longer touch any shared counter.
+   */
+  inline void Freeze() noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    frozen_.store(true, std::memory_order_release);
+  }
+
+  bool IsFrozen() const noexcept { return frozen_.load(std::memory_order_acquire); }
+
+  /// @brief Find a command by exact name (O(1) average, lock-free).
   inline const CmdEntry* Find(const char* name) const noexcept {
-    for (uint32_t i = 0; i < count_; ++i) {
-      if (std::strcmp(cmds_[i].name, name) == 0) {
-        return &cmds_[i];
+    if (name == nullptr)
+      return nullptr;
+    const uint32_t hash = detail::HashName(name);
+    uint32_t pos = hash & kIndexMask;
+    return Probe(name, hash, pos);
+  }
+
+  /// @brief Commands sharing a prefix; see MatchPrefix().
+  struct Match {
+    const CmdEntry* first = nullptr;  ///< Match with the smallest name.
+    uint32_t count = 0;               ///< Number of matches.
+    uint32_t common = 0;              ///< Longest common prefix length.
+  };
+
+  /**
+   * @brief Locate every command whose name starts with @p prefix.
+   *
+   * Two binary searches over the sorted index; the longest common prefix of
+   * the run is the common prefix of its first and last names.
+   */
+  inline Match MatchPrefix(const char* prefix, uint32_t prefix_len) const noexcept {
+    Match out;
+    ReadSorted([&](const uint16_t* sorted, uint32_t n) {
+      const PrefixMatch m = detail::MatchSortedPrefix(
+          n, [&](uint32_t i) { return At(sorted[i]).name; }, prefix, prefix_len);
+      out.count = m.count;
+      out.common = m.common;
+      out.first = (m.count > 0) ? &At(sorted[m.first]) : nullptr;
+    });
+    return out;
+  }
+
+  /**
+   * @brief Visit every command whose name starts with @p prefix, in name order.
+   * @return Number of commands visited.
+   */
+  inline uint32_t ForEachMatch(const char* prefix, uint32_t prefix_len,
+                               function_ref<void(const CmdEntry&)> visitor) const noexcept {
+    uint32_t count = 0;
+    ReadSorted([&](const uint16_t* sorted, uint32_t n) {
+      const PrefixMatch m = detail::MatchSortedPrefix(
+          n, [&](uint32_t i) { return At(sorted[i]).name; }, prefix, prefix_len);
+      for (uint32_t i = m.first; i < m.first + m.count; ++i) {
+        visitor(At(sorted[i]));
       }
-    }
-    return nullptr;
+      count = m.count;
+    });
+    return count;
   }
 
   /**
@@ -166,123 +437,859 @@ class CommandRegistry final {
     if (buf_size == 0 || prefix == nullptr || out_buf == nullptr)
       return 0;
 
-    const uint32_t prefix_len = static_cast<uint32_t>(std::strlen(prefix));
-    uint32_t match_idx[EMBSH_MAX_COMMANDS];
-    uint32_t match_count = 0;
-
-    for (uint32_t i = 0; i < count_; ++i) {
-      if (std::strncmp(cmds_[i].name, prefix, prefix_len) == 0) {
-        match_idx[match_count++] = i;
-      }
-    }
-
-    if (match_count == 0) {
+    const Match m = MatchPrefix(prefix, static_cast<uint32_t>(std::strlen(prefix)));
+    if (m.count == 0) {
       out_buf[0] = '\0';
       return 0;
     }
 
-    if (match_count == 1) {
-      const char* full = cmds_[match_idx[0]].name;
-      uint32_t len = static_cast<uint32_t>(std::strlen(full));
-      uint32_t n = (len < buf_size - 1) ? len : (buf_size - 1);
-      std::memcpy(out_buf, full, n);
-      out_buf[n] = '\0';
-      return 1;
-    }
-
-    // Multiple matches: longest common prefix.
-    const char* first = cmds_[match_idx[0]].name;
-    uint32_t common = static_cast<uint32_t>(std::strlen(first));
-    for (uint32_t m = 1; m < match_count; ++m) {
-      const char* other = cmds_[match_idx[m]].name;
-      uint32_t j = 0;
-      while (j < common && first[j] == other[j])
-        ++j;
-      common = j;
-    }
-    uint32_t n = (common < buf_size - 1) ? common : (buf_size - 1);
-    std::memcpy(out_buf, first, n);
+    // Single match: the whole name; multiple: the longest common prefix.
+    uint32_t n = (m.common < buf_size - 1) ? m.common : (buf_size - 1);
+    std::memcpy(out_buf, m.first->name, n);
     out_buf[n] = '\0';
-    return match_count;
+    return m.count;
   }
 
-  /// @brief Iterate over all registered commands.
+  /// @brief Iterate over all commands: static table (link order), then registration order.
   inline void ForEach(function_ref<void(const CmdEntry&)> visitor) const noexcept {
-    for (uint32_t i = 0; i < count_; ++i) {
+    for (uint32_t i = 0; i < static_count_; ++i) {
+      visitor(static_cmds_[i]);
+    }
+    const uint32_t n = count_.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < n; ++i) {
       visitor(cmds_[i]);
     }
   }
 
-  uint32_t Count() const noexcept { return count_; }
+  uint32_t Count() const noexcept { return static_count_ + count_.load(std::memory_order_acquire); }
+
+  /// @brief Number of commands taken from the EMBSH_CMD_STATIC section.
+  uint32_t StaticCount() const noexcept { return static_count_; }
+
+#if EMBSH_ENABLE_STATS
+  /// @brief Execution counters of @p cmd (an entry returned by Find() / ForEach()).
+  inline CmdStats* StatsFor(const CmdEntry* cmd) noexcept {
+    if (cmd >= static_cmds_ && cmd < static_cmds_ + static_count_)
+      return &stats_[cmd - static_cmds_];
+    if (cmd >= cmds_ && cmd < cmds_ + EMBSH_MAX_COMMANDS)
+      return &stats_[static_count_ + static_cast<uint32_t>(cmd - cmds_)];
+    return nullptr;
+  }
+#endif
+
+  /**
+   * @brief Call @p cmd, timing it into its CmdStats when EMBSH_ENABLE_STATS is set.
+   * @return The command's return value.
+   */
+  inline int Invoke(const CmdEntry* cmd, int argc, char* argv[]) noexcept {
+#if EMBSH_ENABLE_STATS
+    const uint64_t t0 = detail::StatsNowNs();
+    const int rc = cmd->fn(argc, argv, cmd->ctx);
+    CmdStats* st = StatsFor(cmd);
+    if (st != nullptr)
+      st->Record(detail::StatsNowNs() - t0);
+    return rc;
+#else
+    return cmd->fn(argc, argv, cmd->ctx);
+#endif
+  }
+
+  /**
+   * @brief Run a command line from code, with its output captured in @p sink.
+   *
+   * No session and no fd: ShellPrintf in the command writes into the sink
+   * (see OutputSink), and whatever binding the calling thread had is
+   * restored afterwards, so commands may call this too. kCmdAsync commands
+   * run synchronously on the calling thread. Safe to call from any number
+   * of threads at once, provided the commands themselves are. A sink with
+   * a flush callback is flushed before returning.
+   *
+   * @param line NUL-terminated line, tokenized like interactive input
+   *             (copied; at most EMBSH_EXEC_LINE_SIZE - 1 bytes); may be a
+   *             pipeline (see RunPipeline()).
+   * @return The command's exit status, kInvalidArgument (empty line, too
+   *         long, too many arguments, pipeline syntax) or kCommandNotFound.
+   */
+  inline expected<int, ShellError> Execute(const char* line, OutputSink& sink) noexcept {
+    if (line == nullptr) {
+      return expected<int, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    char buf[EMBSH_EXEC_LINE_SIZE];
+    const size_t len = strnlen(line, sizeof(buf));
+    if (len == sizeof(buf)) {
+      return expected<int, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    std::memcpy(buf, line, len + 1);
+    char* argv[EMBSH_MAX_ARGS + 1] = {};
+    const int argc = ShellSplit(buf, static_cast<uint32_t>(len), argv);
+    if (argc <= 0) {
+      return expected<int, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    return Execute(argc, argv, sink);
+  }
+
+  /**
+   * @brief Execute() on an argument vector that is already split; argv[0]
+   *        names the command. Operator entries make it a pipeline.
+   */
+  inline expected<int, ShellError> Execute(int argc, char* argv[], OutputSink& sink) noexcept;
 
  private:
-  CommandRegistry() = default;
+  /// Index the linker-section table; duplicates there are already link errors.
+  CommandRegistry() noexcept : static_cmds_(detail::StaticCmdBegin()), static_count_(detail::StaticCmdCount()) {
+    EMBSH_ASSERT(static_count_ <= EMBSH_MAX_COMMANDS);
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < static_count_; ++i) {
+      const uint32_t hash = detail::HashName(static_cmds_[i].name);
+      uint32_t pos = hash & kIndexMask;
+      if (Probe(static_cmds_[i].name, hash, pos) != nullptr)
+        continue;
+      index_hash_[pos] = hash;
+      index_slot_[pos].store(static_cast<uint16_t>(i + 1), std::memory_order_relaxed);
+      sorted_[0][n++] = static_cast<uint16_t>(i);
+    }
+    std::sort(sorted_[0], sorted_[0] + n, [this](uint16_t a, uint16_t b) { return NameLess(a, b); });
+    sorted_count_[0] = n;
+  }
   CommandRegistry(const CommandRegistry&) = delete;
   CommandRegistry& operator=(const CommandRegistry&) = delete;
 
+  static constexpr uint32_t kIndexSize = detail::NextPow2(EMBSH_MAX_COMMANDS * 2);
+  static constexpr uint32_t kIndexMask = kIndexSize - 1;
+
+  /**
+   * @brief Linear probe for @p name starting at @p pos.
+   * @return Matching entry, or nullptr with @p pos left on the empty slot
+   *         where the name would be inserted.
+   */
+  inline const CmdEntry* Probe(const char* name, uint32_t hash, uint32_t& pos) const noexcept {
+    for (;; pos = (pos + 1) & kIndexMask) {
+      const uint16_t slot = index_slot_[pos].load(std::memory_order_acquire);
+      if (slot == 0)
+        return nullptr;
+      if (index_hash_[pos] == hash && std::strcmp(At(slot - 1).name, name) == 0)
+        return &At(slot - 1);
+    }
+  }
+
+  /// @brief Entry at unified position @p pos (static section first, then cmds_).
+  inline const CmdEntry& At(uint32_t pos) const noexcept {
+    return (pos < static_count_) ? static_cmds_[pos] : cmds_[pos - static_count_];
+  }
+
+  inline bool NameLess(uint16_t a, uint16_t b) const noexcept { return std::strcmp(At(a).name, At(b).name) < 0; }
+
+  /**
+   * @brief Copy the active sorted index into the idle one with @p pos
+   *        inserted, then make it active (mutex held).
+   */
+  inline void InsertSorted(uint16_t pos) noexcept {
+    const uint32_t cur = sorted_active_.load(std::memory_order_relaxed);
+    const uint32_t nxt = cur ^ 1U;
+    // Wait for readers still pinning the copy we are about to overwrite.
+    while (sorted_readers_[nxt].load(std::memory_order_seq_cst) != 0) {
+      std::this_thread::yield();
+    }
+    const uint16_t* src = sorted_[cur];
+    const uint32_t n = sorted_count_[cur];
+    const uint16_t* at =
+        std::upper_bound(src, src + n, pos, [this](uint16_t a, uint16_t b) { return NameLess(a, b); });
+    uint16_t* dst = std::copy(src, at, sorted_[nxt]);
+    *dst++ = pos;
+    (void)std::copy(at, src + n, dst);
+    sorted_count_[nxt] = n + 1;
+    sorted_active_.store(nxt, std::memory_order_seq_cst);
+  }
+
+  /// @brief Run @p fn(sorted, n) on a consistent snapshot of the sorted index.
+  template <typename F>
+  inline void ReadSorted(F&& fn) const noexcept {
+    if (frozen_.load(std::memory_order_acquire)) {
+      const uint32_t k = sorted_active_.load(std::memory_order_relaxed);
+      fn(sorted_[k], sorted_count_[k]);
+      return;
+    }
+    uint32_t k;
+    for (;;) {
+      k = sorted_active_.load(std::memory_order_seq_cst);
+      sorted_readers_[k].fetch_add(1, std::memory_order_seq_cst);
+      if (sorted_active_.load(std::memory_order_seq_cst) == k)
+        break;
+      sorted_readers_[k].fetch_sub(1, std::memory_order_release);
+    }
+    fn(sorted_[k], sorted_count_[k]);
+    sorted_readers_[k].fetch_sub(1, std::memory_order_release);
+  }
+
+  const CmdEntry* const static_cmds_;  ///< EMBSH_CMD_STATIC section (read-only).
+  const uint32_t static_count_;
   CmdEntry cmds_[EMBSH_MAX_COMMANDS] = {};
-  uint32_t count_ = 0;
-  mutable std::mutex mtx_;
+  std::atomic<uint32_t> count_{0};
+  uint32_t index_hash_[kIndexSize] = {};                ///< Name hash per index slot.
+  std::atomic<uint16_t> index_slot_[kIndexSize] = {};   ///< Unified position + 1; 0 = empty.
+  uint16_t sorted_[2][EMBSH_MAX_COMMANDS] = {};           ///< Unified positions in name order (double-buffered).
+  uint32_t sorted_count_[2] = {};                         ///< Entries in each sorted copy.
+  std::atomic<uint32_t> sorted_active_{0};                ///< Copy readers should use.
+  mutable std::atomic<uint32_t> sorted_readers_[2] = {};  ///< Readers pinning each copy (writers wait on it).
+  std::atomic<bool> frozen_{false};
+  std::mutex mtx_;
+#if EMBSH_ENABLE_STATS
+  CmdStats stats_[EMBSH_MAX_COMMANDS];  ///< By unified position.
+#endif
 };
 
 // ============================================================================
-// Built-in help command
+// Pipelines - `cmd | filter ... > file`
 // ============================================================================
 
 namespace detail {
 
-/// @brief Session write callback type (forward declaration for help command).
-using SessionWriteFn = void (*)(const char* str, void* session_ctx);
-
-/// @brief Thread-local session write context for Printf routing.
-struct SessionOutput {
-  SessionWriteFn write = nullptr;
-  void* ctx = nullptr;
+/// @brief Text piped into the running command; see ShellPipeInput().
+struct PipeInput {
+  const char* data = nullptr;
+  size_t len = 0;
+  bool piped = false;
 };
 
-inline SessionOutput& CurrentOutput() noexcept {
-  static thread_local SessionOutput out;
-  return out;
+inline PipeInput& CurrentPipeInput() noexcept {
+  static thread_local PipeInput in;
+  return in;
 }
 
 }  // namespace detail
 
-/// @brief Printf into the current session's output.
-inline int ShellPrintf(const char* fmt, ...)
-#if defined(__GNUC__) || defined(__clang__)
-    __attribute__((format(printf, 1, 2)))
+/**
+ * @brief Output of the previous pipeline stage, for a command run as `a | cmd`.
+ *
+ * Holds at most EMBSH_PIPE_BUF_SIZE bytes (the built-in filters stream and
+ * have no such limit).
+ *
+ * @return false (and @p data left empty) if the command is not downstream of a pipe.
+ */
+inline bool ShellPipeInput(std::string_view& data) noexcept {
+  const auto& in = detail::CurrentPipeInput();
+  data = std::string_view(in.data != nullptr ? in.data : "", in.len);
+  return in.piped;
+}
+
+namespace detail {
+
+/// @brief Where a filter sends what it lets through.
+using PipeEmitFn = void (*)(const char* data, size_t len, void* ctx);
+
+/**
+ * @brief Streaming state of one built-in filter (grep, head, tail, wc).
+ *
+ * Input arrives in arbitrary chunks; grep and tail look at whole lines
+ * ('\n'-terminated), so a grep line longer than EMBSH_PIPE_BUF_SIZE is cut
+ * and tail returns at most the last EMBSH_PIPE_BUF_SIZE bytes.
+ */
+struct PipeFilter {
+  enum class Kind : uint8_t { kNone, kGrep, kHead, kTail, kWc };
+
+  Kind kind = Kind::kNone;
+  bool invert = false;      ///< grep -v
+  bool icase = false;       ///< grep -i
+  bool count_only = false;  ///< grep -c
+  bool clipped = false;     ///< Current line (grep) or input (plain command) overflowed buf.
+  bool in_word = false;     ///< wc
+  uint8_t wc_fields = 0;    ///< wc: 1 = lines, 2 = words, 4 = bytes; 0 = all.
+  const char* pattern = "";
+  size_t pattern_len = 0;
+  uint64_t limit = 10;  ///< head / tail line count.
+  uint64_t lines = 0;
+  uint64_t words = 0;
+  uint64_t bytes = 0;
+  uint64_t matches = 0;
+  uint32_t len = 0;  ///< Bytes in buf.
+  PipeEmitFn emit = nullptr;
+  void* emit_ctx = nullptr;
+  char buf[EMBSH_PIPE_BUF_SIZE];
+
+  /// @brief Parse the filter's arguments; prints usage and returns false on error.
+  inline bool Parse(Kind k, int argc, char* argv[]) noexcept;
+  inline void Feed(const char* data, size_t n) noexcept;
+  /// @brief End of input: emit what is held back. @return Exit status.
+  inline int Finish() noexcept;
+
+ private:
+  void Emit(const char* data, size_t n) const noexcept { emit(data, n, emit_ctx); }
+  inline bool Matches(const char* line, size_t n) const noexcept;
+  inline void EndLine() noexcept;
+};
+
+inline bool PipeFilter::Parse(Kind k, int argc, char* argv[]) noexcept {
+  kind = k;
+  int i = 1;
+  for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; ++i) {
+    const char* opt = argv[i] + 1;
+    if ((k == Kind::kHead || k == Kind::kTail) && (*opt == 'n' || (*opt >= '0' && *opt <= '9'))) {
+      const char* num = (*opt == 'n') ? ((opt[1] != '\0') ? opt + 1 : (i + 1 < argc ? argv[++i] : "")) : opt;
+      char* end = nullptr;
+      limit = std::strtoull(num, &end, 10);
+      if (end == num || *end != '\0')
+        break;
+      continue;
+    }
+    for (; *opt != '\0'; ++opt) {
+      if (k == Kind::kGrep && (*opt == 'v' || *opt == 'i' || *opt == 'c')) {
+        invert |= (*opt == 'v');
+        icase |= (*opt == 'i');
+        count_only |= (*opt == 'c');
+      } else if (k == Kind::kWc && (*opt == 'l' || *opt == 'w' || *opt == 'c')) {
+        wc_fields |= static_cast<uint8_t>((*opt == 'l') ? 1 : (*opt == 'w') ? 2 : 4);
+      } else {
+        break;
+      }
+    }
+    if (*opt != '\0')
+      break;
+  }
+  const bool ok = (k == Kind::kGrep) ? (i + 1 == argc) : (i == argc);
+  if (!ok) {
+    static const char* const kUsage[] = {"", "grep [-vic] <text>", "head [-n N]", "tail [-n N]", "wc [-lwc]"};
+    ShellPrintf("usage: %s\r\n", kUsage[static_cast<int>(k)]);
+    return false;
+  }
+  if (k == Kind::kGrep) {
+    pattern = argv[i];
+    pattern_len = std::strlen(pattern);
+  }
+  return true;
+}
+
+inline bool PipeFilter::Matches(const char* line, size_t n) const noexcept {
+  if (pattern_len > n)
+    return false;
+  for (size_t at = 0; at + pattern_len <= n; ++at) {
+    size_t j = 0;
+    while (j < pattern_len) {
+      char a = line[at + j];
+      char b = pattern[j];
+      if (icase) {
+        a = (a >= 'A' && a <= 'Z') ? static_cast<char>(a - 'A' + 'a') : a;
+        b = (b >= 'A' && b <= 'Z') ? static_cast<char>(b - 'A' + 'a') : b;
+      }
+      if (a != b)
+        break;
+      ++j;
+    }
+    if (j == pattern_len)
+      return true;
+  }
+  return false;
+}
+
+/// @brief grep: decide on the line collected in buf (without its '\n').
+inline void PipeFilter::EndLine() noexcept {
+  size_t n = len;
+  if (n > 0 && buf[n - 1] == '\r')
+    --n;  // Match on the text only; the line goes out as it came.
+  if (Matches(buf, n) != invert) {
+    ++matches;
+    if (!count_only) {
+      Emit(buf, len);
+      Emit("\n", 1);
+    }
+  }
+  len = 0;
+  clipped = false;
+}
+
+inline void PipeFilter::Feed(const char* data, size_t n) noexcept {
+  switch (kind) {
+    case Kind::kGrep:
+      while (n > 0) {
+        const char* nl = static_cast<const char*>(std::memchr(data, '\n', n));
+        const size_t part = (nl != nullptr) ? static_cast<size_t>(nl - data) : n;
+        const size_t take = (part < sizeof(buf) - len) ? part : sizeof(buf) - len;
+        std::memcpy(buf + len, data, take);
+        len += static_cast<uint32_t>(take);
+        clipped |= (take < part);
+        if (nl == nullptr)
+          return;
+        EndLine();
+        data += part + 1;
+        n -= part + 1;
+      }
+      return;
+    case Kind::kHead:
+      while (n > 0 && lines < limit) {
+        const char* nl = static_cast<const char*>(std::memchr(data, '\n', n));
+        const size_t part = (nl != nullptr) ? static_cast<size_t>(nl - data) + 1 : n;
+        Emit(data, part);
+        lines += (nl != nullptr) ? 1U : 0U;
+        data += part;
+        n -= part;
+      }
+      return;  // Past the limit: dropped.
+    case Kind::kTail:
+      if (n >= sizeof(buf)) {
+        data += n - sizeof(buf);
+        n = sizeof(buf);
+      }
+      if (n > sizeof(buf) - len) {
+        // Slide the window, keeping whole lines where possible.
+        size_t drop = len + n - sizeof(buf);
+        const char* nl = static_cast<const char*>(std::memchr(buf + drop, '\n', len - drop));
+        if (nl != nullptr)
+          drop = static_cast<size_t>(nl - buf) + 1;
+        std::memmove(buf, buf + drop, len - drop);
+        len -= static_cast<uint32_t>(drop);
+      }
+      std::memcpy(buf + len, data, n);
+      len += static_cast<uint32_t>(n);
+      return;
+    case Kind::kWc:
+      bytes += n;
+      for (size_t i = 0; i < n; ++i) {
+        const char c = data[i];
+        lines += (c == '\n') ? 1U : 0U;
+        const bool blank = (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+        words += (!blank && !in_word) ? 1U : 0U;
+        in_word = !blank;
+      }
+      return;
+    case Kind::kNone:
+      return;
+  }
+}
+
+inline int PipeFilter::Finish() noexcept {
+  char tmp[80];
+  int n = 0;
+  switch (kind) {
+    case Kind::kGrep:
+      if (len > 0 || clipped)
+        EndLine();
+      if (count_only) {
+        n = std::snprintf(tmp, sizeof(tmp), "%llu\r\n", static_cast<unsigned long long>(matches));
+      }
+      break;
+    case Kind::kTail: {
+      // Start of the last `limit` lines; a final line without '\n' counts too.
+      size_t start = len;
+      uint64_t seen = 0;
+      if (start > 0 && buf[start - 1] == '\n')
+        --start;
+      while (start > 0 && (buf[start - 1] != '\n' || ++seen < limit)) {
+        --start;
+      }
+      if (limit > 0)
+        Emit(buf + start, len - start);
+      break;
+    }
+    case Kind::kWc: {
+      const unsigned long long v[3] = {static_cast<unsigned long long>(lines),
+                                       static_cast<unsigned long long>(words),
+                                       static_cast<unsigned long long>(bytes)};
+      const uint8_t f = (wc_fields != 0) ? wc_fields : 7;
+      for (int i = 0; i < 3; ++i) {
+        if ((f & (1U << i)) != 0) {
+          n += std::snprintf(tmp + n, sizeof(tmp) - static_cast<size_t>(n), (n > 0) ? " %llu" : "%llu", v[i]);
+        }
+      }
+      n += std::snprintf(tmp + n, sizeof(tmp) - static_cast<size_t>(n), "\r\n");
+      break;
+    }
+    default:
+      break;
+  }
+  if (n > 0)
+    Emit(tmp, static_cast<size_t>(n));
+  return (kind == Kind::kGrep && matches == 0) ? 1 : 0;
+}
+
+/// @brief Body of the filter commands when run on ShellPipeInput() rather than streamed.
+inline int RunFilterCommand(PipeFilter::Kind kind, int argc, char* argv[]) noexcept {
+  std::string_view in;
+  if (!ShellPipeInput(in)) {
+    ShellPrintf("%s: reads piped input, e.g. help | %s ...\r\n", argv[0], argv[0]);
+    return 2;
+  }
+  PipeFilter f;
+  if (!f.Parse(kind, argc, argv))
+    return 2;
+  f.emit = [](const char* data, size_t len, void* /*ctx*/) noexcept { ShellWrite(data, len); };
+  f.Feed(in.data(), in.size());
+  return f.Finish();
+}
+
+inline int GrepCommand(int argc, char* argv[], void* /*ctx*/) {
+  return RunFilterCommand(PipeFilter::Kind::kGrep, argc, argv);
+}
+
+inline int HeadCommand(int argc, char* argv[], void* /*ctx*/) {
+  return RunFilterCommand(PipeFilter::Kind::kHead, argc, argv);
+}
+
+inline int TailCommand(int argc, char* argv[], void* /*ctx*/) {
+  return RunFilterCommand(PipeFilter::Kind::kTail, argc, argv);
+}
+
+inline int WcCommand(int argc, char* argv[], void* /*ctx*/) {
+  return RunFilterCommand(PipeFilter::Kind::kWc, argc, argv);
+}
+
+/**
+ * @brief Table of the built-in filters (@p count entries).
+ *
+ * The filters take no registry slots: a pipeline stage is looked up in the
+ * registry first (FindFilter() only after that), so a registered command of
+ * the same name always wins, whatever the static-init order.
+ */
+inline const CmdEntry* BuiltinFilters(uint32_t& count) noexcept {
+  static const CmdEntry filters[] = {
+      {"grep", "Filter piped lines: grep [-vic] <text>", GrepCommand, nullptr, 0},
+      {"head", "First lines of piped output: head [-n N]", HeadCommand, nullptr, 0},
+      {"tail", "Last lines of piped output: tail [-n N]", TailCommand, nullptr, 0},
+      {"wc", "Count piped lines, words, bytes: wc [-lwc]", WcCommand, nullptr, 0},
+  };
+  count = static_cast<uint32_t>(sizeof(filters) / sizeof(filters[0]));
+  return filters;
+}
+
+/// @brief Built-in filter named @p name, or nullptr.
+inline const CmdEntry* FindFilter(const char* name) noexcept {
+  uint32_t n = 0;
+  const CmdEntry* filters = BuiltinFilters(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    if (std::strcmp(filters[i].name, name) == 0)
+      return &filters[i];
+  }
+  return nullptr;
+}
+
+inline PipeFilter::Kind FilterKindOf(const CmdEntry* cmd) noexcept {
+  if (cmd->fn == GrepCommand)
+    return PipeFilter::Kind::kGrep;
+  if (cmd->fn == HeadCommand)
+    return PipeFilter::Kind::kHead;
+  if (cmd->fn == TailCommand)
+    return PipeFilter::Kind::kTail;
+  if (cmd->fn == WcCommand)
+    return PipeFilter::Kind::kWc;
+  return PipeFilter::Kind::kNone;
+}
+
+/**
+ * @brief One pipeline run: stages, their buffers and the final destination.
+ *
+ * The first command's output is captured in 256-byte chunks and pushed
+ * stage by stage: built-in filters stream, so `dump | grep x` needs no
+ * buffer for the dump. A plain command after `|` gets everything before
+ * it collected in its stage buffer (ShellPipeInput()) and runs once that
+ * input ends. The last stage writes to the output bound when the
+ * pipeline started, or to the redirect file.
+ */
+class Pipeline final {
+ public:
+  /// @brief Parse, then run; messages go to the current output. @see RunPipeline()
+  inline expected<int, ShellError> Run(int argc, char* argv[]) noexcept;
+
+ private:
+  struct Hop {
+    Pipeline* pipe;
+    uint32_t next;  ///< Stage receiving the output; count_ = destination.
+  };
+
+  struct Stage {
+    const CmdEntry* cmd;
+    int argc;
+    char** argv;
+    Hop hop;  ///< Where this stage's output goes.
+    PipeFilter filter;  ///< Filter state, or (kNone) the input buffer of a plain command.
+  };
+
+  Stage stages_[EMBSH_PIPE_MAX_STAGES];
+  uint32_t count_ = 0;
+  SessionOutput dest_;  ///< Binding at the start of Run().
+  int fd_ = -1;         ///< Redirect target, if any.
+  bool fd_failed_ = false;
+
+  inline expected<void, ShellError> Parse(int argc, char* argv[], const char** target, bool* append) noexcept;
+  inline void Emit(uint32_t stage, const char* data, size_t len) noexcept;
+  inline int RunCommand(uint32_t stage, const char* in, size_t in_len, bool piped) noexcept;
+
+  static void EmitHop(const char* data, size_t len, void* ctx) noexcept {
+    auto* hop = static_cast<Hop*>(ctx);
+    hop->pipe->Emit(hop->next, data, len);
+  }
+};
+
+inline expected<void, ShellError> Pipeline::Parse(int argc, char* argv[], const char** target, bool* append) noexcept {
+  auto& reg = CommandRegistry::Instance();
+  int i = 0;
+  while (i < argc) {
+    // One stage: words up to the next operator.
+    int end = i;
+    while (end < argc && !IsShellOperator(argv[end])) {
+      ++end;
+    }
+    if (end == i) {
+      ShellPrintf("syntax error near '%s'\r\n", argv[i]);
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    if (count_ == EMBSH_PIPE_MAX_STAGES) {
+      ShellPrintf("pipeline: more than %d commands\r\n", EMBSH_PIPE_MAX_STAGES);
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    Stage& st = stages_[count_];
+    st.cmd = reg.Find(argv[i]);
+    if (st.cmd == nullptr) {
+      st.cmd = FindFilter(argv[i]);
+    }
+    if (st.cmd == nullptr) {
+      ShellPrintf("unknown command: %s\r\n", argv[i]);
+      return expected<void, ShellError>::error(ShellError::kCommandNotFound);
+    }
+    st.argc = end - i;
+    st.argv = argv + i;
+    st.hop = Hop{this, count_ + 1};
+    st.filter.emit = EmitHop;
+    st.filter.emit_ctx = &st.hop;
+    // The first command has no input; filters there run as commands and say so.
+    const PipeFilter::Kind kind = (count_ > 0) ? FilterKindOf(st.cmd) : PipeFilter::Kind::kNone;
+    if (kind != PipeFilter::Kind::kNone && !st.filter.Parse(kind, st.argc, st.argv)) {
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    ++count_;
+    if (end == argc)
+      return expected<void, ShellError>::success();
+    if (argv[end] != kShellPipe) {
+      // Redirect: exactly one target word, and nothing after it.
+      if (end + 2 != argc || IsShellOperator(argv[end + 1])) {
+        ShellPrintf("syntax error near '%s'\r\n", argv[end]);
+        return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+      }
+      *target = argv[end + 1];
+      *append = (argv[end] == kShellAppend);
+      return expected<void, ShellError>::success();
+    }
+    i = end + 1;
+    if (i == argc) {
+      ShellPrintf("syntax error near '|'\r\n");
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
+  }
+  return expected<void, ShellError>::success();
+}
+
+inline void Pipeline::Emit(uint32_t stage, const char* data, size_t len) noexcept {
+  if (stage == count_) {
+    if (fd_ < 0) {
+      OutputWrite(dest_, data, len);
+      return;
+    }
+    while (len > 0 && !fd_failed_) {
+      ssize_t n = ::write(fd_, data, len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      fd_failed_ = (n <= 0);
+      data += (n > 0) ? n : 0;
+      len -= (n > 0) ? static_cast<size_t>(n) : 0;
+    }
+    return;
+  }
+  PipeFilter& f = stages_[stage].filter;
+  if (f.kind != PipeFilter::Kind::kNone) {
+    f.Feed(data, len);
+    return;
+  }
+  const size_t take = (len < sizeof(f.buf) - f.len) ? len : sizeof(f.buf) - f.len;
+  std::memcpy(f.buf + f.len, data, take);
+  f.len += static_cast<uint32_t>(take);
+  f.clipped |= (take < len);
+}
+
+inline int Pipeline::RunCommand(uint32_t stage, const char* in, size_t in_len, bool piped) noexcept {
+  Stage& st = stages_[stage];
+  char chunk[256];
+  OutputSink sink(chunk, sizeof(chunk), [](const char* data, size_t len, void* ctx) noexcept {
+    EmitHop(data, len, ctx);
+    return true;
+  }, &st.hop);
+  PipeInput& cur = CurrentPipeInput();
+  const PipeInput saved = cur;
+  cur = PipeInput{in, in_len, piped};
+  int rc;
+  {
+    ScopedSinkOutput bind(sink);
+    rc = CommandRegistry::Instance().Invoke(st.cmd, st.argc, st.argv);
+  }
+  (void)sink.Flush();
+  cur = saved;
+  return rc;
+}
+
+inline expected<int, ShellError> Pipeline::Run(int argc, char* argv[]) noexcept {
+  const char* target = nullptr;
+  bool append = false;
+  auto parsed = Parse(argc, argv, &target, &append);
+  if (!parsed) {
+    return expected<int, ShellError>::error(parsed.error_value());
+  }
+  if (target != nullptr) {
+#ifdef EMBSH_PIPE_FILE_DIR
+    // Any session may redirect, so stay inside the configured directory: no
+    // path separators, no "." / "..", and no symlink as the final name.
+    if (std::strchr(target, '/') != nullptr || std::strcmp(target, ".") == 0 || std::strcmp(target, "..") == 0) {
+      ShellPrintf("redirect target must be a file name: %s\r\n", target);
+      return expected<int, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    const int dir = ::open(EMBSH_PIPE_FILE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+      fd_ = ::openat(dir, target, O_WRONLY | O_CREAT | O_CLOEXEC | O_NOFOLLOW | (append ? O_APPEND : O_TRUNC), 0600);
+      ::close(dir);
+    }
+    if (fd_ < 0) {
+      ShellPrintf("cannot open %s\r\n", target);
+      return expected<int, ShellError>::error(ShellError::kFileOpenFailed);
+    }
+#else
+    (void)append;
+    ShellPrintf("redirection is disabled\r\n");
+    return expected<int, ShellError>::error(ShellError::kInvalidArgument);
 #endif
-    ;
+  }
+  dest_ = CurrentOutput();
+
+  int rc = RunCommand(0, nullptr, 0, false);
+  for (uint32_t i = 1; i < count_; ++i) {
+    PipeFilter& f = stages_[i].filter;
+    if (f.kind != PipeFilter::Kind::kNone) {
+      rc = f.Finish();
+      continue;
+    }
+    rc = RunCommand(i, f.buf, f.len, true);
+    if (f.clipped) {
+      ShellPrintf("%s: input cut to %u bytes\r\n", stages_[i].argv[0], static_cast<unsigned>(sizeof(f.buf)));
+    }
+  }
+  if (fd_ >= 0) {
+    if (fd_failed_) {
+      ShellPrintf("write to %s failed\r\n", target);
+    }
+    ::close(fd_);
+    fd_ = -1;
+  }
+  return expected<int, ShellError>::success(rc);
+}
+
+inline bool HasShellOperator(int argc, char* const argv[]) noexcept {
+  for (int i = 0; i < argc; ++i) {
+    if (IsShellOperator(argv[i]))
+      return true;
+  }
+  return false;
+}
+
+/// @brief True if a stage of the pipeline in @p argv is a kCmdAsync command.
+inline bool PipelineIsAsync(int argc, char* const argv[]) noexcept {
+  auto& reg = CommandRegistry::Instance();
+  for (int i = 0; i < argc; ++i) {
+    if (i == 0 || argv[i - 1] == kShellPipe) {
+      const CmdEntry* cmd = IsShellOperator(argv[i]) ? nullptr : reg.Find(argv[i]);
+      if (cmd != nullptr && (cmd->flags & kCmdAsync) != 0)
+        return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace detail
 
-inline int ShellPrintf(const char* fmt, ...) {
-  auto& out = detail::CurrentOutput();
-  if (out.write == nullptr)
-    return -1;
+/**
+ * @brief Run a split command line containing `|` / `>` / `>>` into the current output.
+ *
+ * `a | b | c` feeds each command's output to the next; `> file` or
+ * `>> file` after the last command writes the result to a file instead,
+ * created 0600 in EMBSH_PIPE_FILE_DIR (redirection is rejected without it).
+ * Up to EMBSH_PIPE_MAX_STAGES commands; kCmdAsync commands run in place.
+ * Syntax and lookup errors are reported on the current output.
+ *
+ * @return Status of the last command (grep: 1 when nothing matched),
+ *         kInvalidArgument, kCommandNotFound or kFileOpenFailed.
+ */
+inline expected<int, ShellError> RunPipeline(int argc, char* argv[]) noexcept {
+  detail::Pipeline pipe;
+  return pipe.Run(argc, argv);
+}
+
+/**
+ * @brief Stack a pipeline takes on the thread running it, beyond its commands' own use.
+ *
+ * The stage buffers (EMBSH_PIPE_MAX_STAGES x EMBSH_PIPE_BUF_SIZE) and the
+ * 256-byte output chunk live on the stack: about 4.7 KB with the defaults.
+ * Size ThreadOptions::stack_size of shell threads and WorkerPool with it.
+ */
+inline constexpr size_t kPipelineStackSize = sizeof(detail::Pipeline) + 256;
+
+namespace detail {
+
+inline int PipelineCommand(int argc, char* argv[], void* /*ctx*/) {
+  auto r = RunPipeline(argc, argv);
+  return r.has_value() ? r.value() : -1;
+}
+
+/// @brief Pseudo-command that runs a whole pipeline, for the async dispatch of one.
+inline const CmdEntry* PipelineEntry() noexcept {
+  static const CmdEntry entry = {"|", "pipeline", PipelineCommand, nullptr, kCmdAsync};
+  return &entry;
+}
 
-  char buf[512];
-  va_list args;
-  va_start(args, fmt);
-  int n = std::vsnprintf(buf, sizeof(buf), fmt, args);
-  va_end(args);
+}  // namespace detail
 
-  if (n > 0) {
-    buf[sizeof(buf) - 1] = '\0';
-    out.write(buf, out.ctx);
+inline expected<int, ShellError> CommandRegistry::Execute(int argc, char* argv[], OutputSink& sink) noexcept {
+  if (argc <= 0 || argc > EMBSH_MAX_ARGS || argv == nullptr) {
+    return expected<int, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  if (detail::HasShellOperator(argc, argv)) {
+    expected<int, ShellError> r = expected<int, ShellError>::error(ShellError::kInvalidArgument);
+    {
+      ScopedSinkOutput bind(sink);
+      r = RunPipeline(argc, argv);
+    }
+    (void)sink.Flush();
+    return r;
+  }
+  const CmdEntry* cmd = Find(argv[0]);
+  if (cmd == nullptr) {
+    return expected<int, ShellError>::error(ShellError::kCommandNotFound);
+  }
+  int rc;
+  {
+    ScopedSinkOutput bind(sink);
+    rc = Invoke(cmd, argc, argv);
   }
-  return n;
+  (void)sink.Flush();
+  return expected<int, ShellError>::success(rc);
 }
 
+// ============================================================================
+// Built-in help command
+// ============================================================================
+
 namespace detail {
 
 inline int HelpCommand(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
-  CommandRegistry::Instance().ForEach(
-      [](const CmdEntry& cmd) { ShellPrintf("  %-16s - %s\r\n", cmd.name, cmd.desc ? cmd.desc : ""); });
+  auto& reg = CommandRegistry::Instance();
+  reg.ForEach([](const CmdEntry& cmd) { ShellPrintf("  %-16s - %s\r\n", cmd.name, cmd.desc ? cmd.desc : ""); });
+#if EMBSH_ENABLE_PIPES
+  uint32_t n = 0;
+  const CmdEntry* filters = BuiltinFilters(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    if (reg.Find(filters[i].name) == nullptr)  // Otherwise listed above, and used in pipelines.
+      ShellPrintf("  %-16s - %s\r\n", filters[i].name, filters[i].desc);
+  }
+#endif
   return 0;
 }
 
 inline bool RegisterHelpOnce() noexcept {
   static const bool done = []() {
-    CommandRegistry::Instance().Register("help", HelpCommand, "List all commands");
+    auto& reg = CommandRegistry::Instance();
+    reg.Register("help", HelpCommand, "List all commands");
     return true;
   }();
   return done;
@@ -303,6 +1310,9 @@ class CmdAutoReg {
     CommandRegistry::Instance().Register(name, fn, ctx, desc);
   }
   CmdAutoReg(const char* name, CmdFn fn, const char* desc) { CommandRegistry::Instance().Register(name, fn, desc); }
+  CmdAutoReg(const char* name, CmdFn fn, const char* desc, uint8_t flags) {
+    CommandRegistry::Instance().Register(name, fn, nullptr, desc, flags);
+  }
 };
 
 /**
@@ -316,13 +1326,45 @@ class CmdAutoReg {
  */
 #define EMBSH_CMD(cmd, desc) static ::embsh::CmdAutoReg EMBSH_CONCAT(_embsh_reg_, cmd)(#cmd, cmd, desc)
 
+/**
+ * @brief Register a long-running command (kCmdAsync).
+ *
+ * The command runs on the WorkerPool while its session keeps reading
+ * input; Ctrl+C sets ShellCancelled().
+ */
+#define EMBSH_CMD_ASYNC(cmd, desc) \
+  static ::embsh::CmdAutoReg EMBSH_CONCAT(_embsh_reg_, cmd)(#cmd, cmd, desc, ::embsh::kCmdAsync)
+
+/**
+ * @brief Place a command in the link-time table (no static constructor).
+ *
+ * The entry is constant-initialized into the "embsh_cmd" section, so there
+ * is no startup work, no static-init ordering and nothing to lock. A second
+ * EMBSH_CMD_STATIC of the same name fails to compile (same file) or to link
+ * (extern "C" symbol embsh_cmd_name_<cmd> defined twice). Falls back to
+ * EMBSH_CMD where the toolchain has no section support.
+ *
+ * @code
+ *   static int reboot(int argc, char* argv[], void* ctx) { ... }
+ *   EMBSH_CMD_STATIC(reboot, "Reboot the system");
+ * @endcode
+ */
+#if EMBSH_HAS_CMD_SECTION
+#define EMBSH_CMD_STATIC(cmd, desc)                                                \
+  extern "C" const char EMBSH_CONCAT(embsh_cmd_name_, cmd) = 0;                    \
+  __attribute__((used, section("embsh_cmd"), aligned(alignof(::embsh::CmdEntry)))) \
+  static const ::embsh::CmdEntry EMBSH_CONCAT(_embsh_cmd_, cmd) = {#cmd, desc, cmd, nullptr}
+#else
+#define EMBSH_CMD_STATIC(cmd, desc) EMBSH_CMD(cmd, desc)
+#endif
+
 /**
  * @brief RT-Thread MSH compatible registration macro.
  *
- * Maps to EMBSH_CMD for source-level compatibility with RT-Thread finsh.
+ * Maps to EMBSH_CMD_STATIC, which mirrors finsh's section-based table.
  * On RT-Thread, replace this header with <finsh.h>.
  */
-#define MSH_CMD_EXPORT(cmd, desc) EMBSH_CMD(cmd, desc)
+#define MSH_CMD_EXPORT(cmd, desc) EMBSH_CMD_STATIC(cmd, desc)
 
 }  // namespace embsh
 
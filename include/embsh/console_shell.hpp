@@ -6,10 +6,12 @@
 #ifndef EMBSH_CONSOLE_SHELL_HPP_
 #define EMBSH_CONSOLE_SHELL_HPP_
 
+#include "embsh/history_file.hpp"
 #include "embsh/line_editor.hpp"
+#include "embsh/multiplexer.hpp"
+#include "embsh/thread.hpp"
 
 #include <atomic>
-#include <thread>
 
 #include <poll.h>
 #include <termios.h>
@@ -30,8 +32,20 @@ class ConsoleShell final {
     int read_fd;
     int write_fd;
     bool raw_mode;
-
-    Config() noexcept : prompt("embsh> "), read_fd(STDIN_FILENO), write_fd(STDOUT_FILENO), raw_mode(true) {}
+    bool bracketed_paste;  ///< Enable xterm bracketed paste while the shell runs.
+    const char* history_file;  ///< Persistent history log (nullptr = in memory only).
+    ShellMultiplexer* mux;     ///< Started multiplexer to serve Start() (nullptr = own thread).
+    ThreadOptions thread;      ///< Scheduling, affinity and stack of the shell thread.
+
+    Config() noexcept
+        : prompt("embsh> "),
+          read_fd(STDIN_FILENO),
+          write_fd(STDOUT_FILENO),
+          raw_mode(true),
+          bracketed_paste(false),
+          history_file(nullptr),
+          mux(nullptr),
+          thread() {}
   };
 
   explicit ConsoleShell(const Config& cfg = Config{}) : cfg_(cfg) { detail::RegisterHelpOnce(); }
@@ -55,11 +69,17 @@ class ConsoleShell final {
  private:
   Config cfg_;
   Session session_ = {};
-  std::thread thread_;
+  Thread thread_;
   std::atomic<bool> running_{false};
+  WakeEvent wake_;  ///< Signalled by Stop() to end the blocking poll.
+  WakeEvent done_;  ///< Async command finished; owned by RunLoop().
   struct termios orig_termios_ = {};
   bool termios_saved_ = false;
+  HistoryFile* history_file_ = nullptr;
+  HistoryStore history_;  ///< Full-size in-memory history when no history_file is set.
+  uint32_t mux_handle_ = 0;  ///< Attachment on cfg_.mux; 0 = own thread.
 
+  inline bool AttachHistory() noexcept;
   inline void SetRawMode() noexcept;
   inline void RestoreTermios() noexcept;
   inline void RunLoop() noexcept;
@@ -92,10 +112,19 @@ inline void ConsoleShell::RestoreTermios() noexcept {
   }
 }
 
+inline bool ConsoleShell::AttachHistory() noexcept {
+  history_file_ = (cfg_.history_file != nullptr) ? HistoryFile::Shared(cfg_.history_file) : nullptr;
+  session_.history = (history_file_ != nullptr) ? &history_file_->Store() : &history_;
+  return cfg_.history_file == nullptr || history_file_ != nullptr;
+}
+
 inline expected<void, ShellError> ConsoleShell::Start() noexcept {
   if (running_.load(std::memory_order_relaxed)) {
     return expected<void, ShellError>::error(ShellError::kAlreadyRunning);
   }
+  if (!AttachHistory()) {
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
 
   SetRawMode();
 
@@ -103,14 +132,49 @@ inline expected<void, ShellError> ConsoleShell::Start() noexcept {
   session_.write_fd = cfg_.write_fd;
   session_.write_fn = io::PosixWrite;
   session_.read_fn = io::PosixRead;
+  session_.writev_fn = io::PosixWriteV;
+  session_.tx_len = 0;
   session_.telnet_mode = false;
   session_.line_pos = 0;
+  session_.cursor_back = 0;
+  session_.skip_lf = false;
+  session_.rx_pos = 0;
+  session_.rx_len = 0;
   session_.hist_browsing = false;
   session_.esc_state = Session::EscState::kNone;
+  session_.pasting = false;
+  session_.searching = false;
   session_.active.store(true, std::memory_order_release);
 
+  if (cfg_.mux != nullptr) {
+    if (cfg_.bracketed_paste) {
+      SessionWrite(session_, editor::kBracketedPasteOn);
+    }
+    SessionWrite(session_, cfg_.prompt);
+    SessionFlush(session_);
+    auto h = cfg_.mux->Attach(session_, cfg_.prompt, cfg_.bracketed_paste ? editor::kBracketedPasteOff : nullptr);
+    if (!h.has_value()) {
+      RestoreTermios();
+      return expected<void, ShellError>::error(h.error_value());
+    }
+    mux_handle_ = h.value();
+    running_.store(true, std::memory_order_release);
+    return expected<void, ShellError>::success();
+  }
+
+  if (!wake_.Open()) {
+    RestoreTermios();
+    return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+  }
+
   running_.store(true, std::memory_order_release);
-  thread_ = std::thread([this]() { RunLoop(); });
+  if (!thread_.Start(cfg_.thread, [this]() { RunLoop(); })) {
+    running_.store(false, std::memory_order_release);
+    session_.active.store(false, std::memory_order_relaxed);
+    wake_.Close();
+    RestoreTermios();
+    return expected<void, ShellError>::error(ShellError::kThreadStartFailed);
+  }
 
   return expected<void, ShellError>::success();
 }
@@ -119,66 +183,91 @@ inline void ConsoleShell::Stop() noexcept {
   if (!running_.load(std::memory_order_relaxed))
     return;
   running_.store(false, std::memory_order_release);
+  if (mux_handle_ != 0) {
+    cfg_.mux->Detach(mux_handle_);
+    mux_handle_ = 0;
+  }
   session_.active.store(false, std::memory_order_release);
+  wake_.Signal();
 
-  if (thread_.joinable()) {
-    thread_.join();
+  if (thread_.Joinable()) {
+    thread_.Join();
+    wake_.Close();  // Run() closes its own.
   }
   RestoreTermios();
+  if (history_file_ != nullptr) {
+    history_file_->Flush();
+  }
 }
 
 inline void ConsoleShell::Run() noexcept {
+  (void)AttachHistory();  // Without the file, history stays in memory.
   SetRawMode();
 
   session_.read_fd = cfg_.read_fd;
   session_.write_fd = cfg_.write_fd;
   session_.write_fn = io::PosixWrite;
   session_.read_fn = io::PosixRead;
+  session_.writev_fn = io::PosixWriteV;
+  session_.tx_len = 0;
   session_.telnet_mode = false;
   session_.line_pos = 0;
+  session_.cursor_back = 0;
+  session_.skip_lf = false;
+  session_.rx_pos = 0;
+  session_.rx_len = 0;
   session_.active.store(true, std::memory_order_release);
+  (void)wake_.Open();  // Without it Stop() still works via active, once input arrives.
   running_.store(true, std::memory_order_release);
 
   RunLoop();
 
+  wake_.Close();
   RestoreTermios();
+  if (history_file_ != nullptr) {
+    history_file_->Flush();
+  }
   running_.store(false, std::memory_order_release);
 }
 
 inline void ConsoleShell::RunLoop() noexcept {
   auto& s = session_;
+  // Without the event, parked input waits for the next keystroke instead.
+  s.notify = done_.Open() ? &done_ : nullptr;
+  if (cfg_.bracketed_paste) {
+    SessionWrite(s, editor::kBracketedPasteOn);
+  }
   SessionWrite(s, cfg_.prompt);
+  SessionFlush(s);
 
   while (running_.load(std::memory_order_relaxed) && s.active.load(std::memory_order_acquire)) {
-    struct pollfd pfd;
-    pfd.fd = s.read_fd;
-    pfd.events = POLLIN;
-    int pr = ::poll(&pfd, 1, 200);
-    if (pr == 0)
+    int wr = editor::WaitInput(s.read_fd, wake_.fd(), done_.fd());
+    if (wr == 0) {
+      done_.Drain();
+      editor::ResumeInput(s, cfg_.prompt);
       continue;
-    if (pr < 0) {
+    }
+    if (wr < 0) {
       if (errno == EINTR)
         continue;
       break;
     }
 
-    uint8_t byte;
-    ssize_t n = s.read_fn(s.read_fd, &byte, 1);
+    ssize_t n = editor::ReadInput(s, cfg_.prompt);
     if (n <= 0) {
       if (n < 0 && errno == EINTR)
         continue;
       break;
     }
+  }
 
-    if (editor::ProcessByte(s, byte, cfg_.prompt)) {
-      editor::ExecuteLine(s);
-      s.line_pos = 0;
-      s.line_buf[0] = '\0';
-      if (s.active.load(std::memory_order_acquire)) {
-        SessionWrite(s, cfg_.prompt);
-      }
-    }
+  editor::WaitIdle(s);
+  if (cfg_.bracketed_paste) {
+    SessionWrite(s, editor::kBracketedPasteOff);
+    SessionFlush(s);
   }
+  s.notify = nullptr;
+  done_.Close();
 }
 
 }  // namespace embsh
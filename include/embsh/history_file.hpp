@@ -0,0 +1,382 @@
+/**
+ * @file history_file.hpp
+ * @brief Persistent command history: an append-only log behind a HistoryStore.
+ *
+ * The file is an 8-byte header followed by records of
+ * `u16 len | len bytes | u16 len` (host byte order). The trailing length
+ * lets Open() walk back from the end over the mapped file and load only the
+ * newest entries the store can hold. New entries are staged in memory by
+ * the store's append hook and written in batches by a WorkerPool job, so a
+ * slow flash write never stalls the session that pressed Enter. When the
+ * log outgrows its limit the job rewrites it with the retained tail.
+ */
+
+#ifndef EMBSH_HISTORY_FILE_HPP_
+#define EMBSH_HISTORY_FILE_HPP_
+
+#include "embsh/line_editor.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef EMBSH_HISTORY_FILE_PENDING
+#define EMBSH_HISTORY_FILE_PENDING 1024  ///< Staged record bytes awaiting the writer job.
+#endif
+
+#ifndef EMBSH_HISTORY_FILE_MAX
+#define EMBSH_HISTORY_FILE_MAX (4 * EMBSH_HISTORY_BYTES)  ///< Log size that triggers compaction.
+#endif
+
+#ifndef EMBSH_HISTORY_FILES
+#define EMBSH_HISTORY_FILES 2  ///< Distinct paths HistoryFile::Shared() can hold.
+#endif
+
+#ifndef EMBSH_HISTORY_PATH_MAX
+#define EMBSH_HISTORY_PATH_MAX 128
+#endif
+
+namespace embsh {
+
+// ============================================================================
+// HistoryFile - append-only history log
+// ============================================================================
+
+/**
+ * @brief A HistoryStore whose entries survive restarts.
+ *
+ * Open() loads the tail of the log into Store() and hooks the store, so
+ * every Push() (from any session using it) is appended to the file. A torn
+ * last record, as left by a power cut, is detected and truncated on open.
+ * Staged records that do not fit in EMBSH_HISTORY_FILE_PENDING while the
+ * writer is stalled are dropped and counted rather than blocking the caller.
+ *
+ * Use one HistoryFile per path; Shared() hands out one instance per path
+ * for backends configured with the same file.
+ */
+class HistoryFile final {
+ public:
+  HistoryFile() = default;
+  ~HistoryFile() { Close(); }
+
+  HistoryFile(const HistoryFile&) = delete;
+  HistoryFile& operator=(const HistoryFile&) = delete;
+
+  /**
+   * @brief Open (or create) @p path and load its newest entries.
+   * @param max_bytes Log size at which the writer compacts it.
+   */
+  inline expected<void, ShellError> Open(const char* path, uint32_t max_bytes = EMBSH_HISTORY_FILE_MAX) noexcept;
+
+  /// @brief Write staged entries now and close the file (the store keeps its entries).
+  inline void Close() noexcept;
+
+  /// @brief Write staged entries now. Blocks on file I/O; not for the command path.
+  inline void Flush() noexcept;
+
+  HistoryStore& Store() noexcept { return store_; }
+  bool IsOpen() const noexcept { return fd_ >= 0; }
+  const char* Path() const noexcept { return path_; }
+
+  /// @brief Entries lost because the staging buffer was full.
+  uint32_t Dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Process-wide instance for @p path, opened on first use.
+   * @return nullptr if the file cannot be opened or all EMBSH_HISTORY_FILES are taken.
+   */
+  static inline HistoryFile* Shared(const char* path) noexcept;
+
+ private:
+  static constexpr char kMagic[8] = {'E', 'M', 'B', 'S', 'H', 'H', '1', '\n'};
+  static constexpr uint32_t kRecordOverhead = 4;
+
+  /// @brief HistoryStore append hook: stage one record, schedule the writer.
+  static inline void OnAppend(const char* line, uint32_t len, void* ctx) noexcept;
+  static inline void FlushJob(void* arg) noexcept;
+
+  inline void WriteStaged() noexcept;  ///< Caller holds io_mtx_.
+  inline bool Load() noexcept;         ///< Caller holds io_mtx_.
+  inline bool Compact() noexcept;      ///< Caller holds io_mtx_.
+
+  /**
+   * @brief Offsets of the newest valid records of a mapped log, oldest first.
+   * @param[out] end End of the last valid record (shorter than @p size if the tail is torn).
+   * @return Number of records stored in @p offs.
+   */
+  static inline uint32_t ScanTail(const char* map, size_t size, uint32_t* offs, size_t& end) noexcept;
+
+  HistoryStore store_;
+  int fd_ = -1;
+  size_t file_size_ = 0;
+  uint32_t max_bytes_ = EMBSH_HISTORY_FILE_MAX;
+  char path_[EMBSH_HISTORY_PATH_MAX] = {};
+
+  std::mutex io_mtx_;  ///< Serialises file writes, compaction and Close().
+  std::mutex stage_mtx_;
+  char stage_[EMBSH_HISTORY_FILE_PENDING] = {};
+  uint32_t stage_len_ = 0;
+  std::atomic<bool> job_queued_{false};
+  std::atomic<uint32_t> dropped_{0};
+};
+
+// ============================================================================
+// HistoryFile implementation
+// ============================================================================
+
+inline uint32_t HistoryFile::ScanTail(const char* map, size_t size, uint32_t* offs, size_t& end) noexcept {
+  // Validate forward only if the backward walk hits a torn record.
+  end = size;
+  for (int pass = 0; pass < 2; ++pass) {
+    uint32_t n = 0;
+    uint32_t bytes = 0;
+    size_t pos = end;
+    bool torn = false;
+    while (pos > sizeof(kMagic) && n < EMBSH_HISTORY_SIZE) {
+      uint16_t len = 0;
+      if (pos < sizeof(kMagic) + kRecordOverhead) {
+        torn = true;
+        break;
+      }
+      std::memcpy(&len, map + pos - 2, 2);
+      uint16_t head = 0;
+      if (len == 0 || len >= EMBSH_LINE_BUF_SIZE || pos < sizeof(kMagic) + kRecordOverhead + len) {
+        torn = true;
+        break;
+      }
+      std::memcpy(&head, map + pos - kRecordOverhead - len, 2);
+      if (head != len) {
+        torn = true;
+        break;
+      }
+      if (bytes + len + 1 > EMBSH_HISTORY_BYTES)
+        break;  // The store could not hold older entries anyway.
+      bytes += len + 1U;
+      pos -= kRecordOverhead + len;
+      offs[n++] = static_cast<uint32_t>(pos);
+    }
+    if (!torn || pass == 1) {
+      // Reverse into oldest-first order.
+      for (uint32_t i = 0; i < n / 2; ++i) {
+        const uint32_t t = offs[i];
+        offs[i] = offs[n - 1 - i];
+        offs[n - 1 - i] = t;
+      }
+      return n;
+    }
+    // Torn tail: find the end of the valid prefix, then walk back from there.
+    size_t fwd = sizeof(kMagic);
+    while (fwd + kRecordOverhead <= size) {
+      uint16_t len = 0;
+      uint16_t tail = 0;
+      std::memcpy(&len, map + fwd, 2);
+      if (len == 0 || len >= EMBSH_LINE_BUF_SIZE || fwd + kRecordOverhead + len > size)
+        break;
+      std::memcpy(&tail, map + fwd + 2 + len, 2);
+      if (tail != len)
+        break;
+      fwd += kRecordOverhead + len;
+    }
+    end = fwd;
+  }
+  return 0;
+}
+
+inline bool HistoryFile::Load() noexcept {
+  struct stat st;
+  if (::fstat(fd_, &st) != 0)
+    return false;
+  file_size_ = static_cast<size_t>(st.st_size);
+  if (file_size_ < sizeof(kMagic)) {
+    // New (or cut before the header was complete): start over.
+    if (::ftruncate(fd_, 0) != 0 || ::write(fd_, kMagic, sizeof(kMagic)) != static_cast<ssize_t>(sizeof(kMagic)))
+      return false;
+    file_size_ = sizeof(kMagic);
+    return true;
+  }
+
+  void* map = ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (map == MAP_FAILED)
+    return false;
+  const char* text = static_cast<const char*>(map);
+  if (std::memcmp(text, kMagic, sizeof(kMagic)) != 0) {
+    ::munmap(map, file_size_);
+    return false;  // Not a history log; leave it alone.
+  }
+  uint32_t offs[EMBSH_HISTORY_SIZE];
+  size_t end = 0;
+  const uint32_t n = ScanTail(text, file_size_, offs, end);
+  for (uint32_t i = 0; i < n; ++i) {
+    uint16_t len = 0;
+    std::memcpy(&len, text + offs[i], 2);
+    store_.Push(text + offs[i] + 2, len);
+  }
+  ::munmap(map, file_size_);
+  if (end < file_size_) {
+    if (::ftruncate(fd_, static_cast<off_t>(end)) != 0)
+      return false;
+    file_size_ = end;
+  }
+  return true;
+}
+
+inline expected<void, ShellError> HistoryFile::Open(const char* path, uint32_t max_bytes) noexcept {
+  if (path == nullptr || std::strlen(path) >= sizeof(path_)) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  Close();
+  std::lock_guard<std::mutex> lock(io_mtx_);
+  fd_ = ::open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (fd_ < 0) {
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
+  std::strcpy(path_, path);
+  max_bytes_ = (max_bytes < 2 * EMBSH_HISTORY_BYTES) ? 2 * EMBSH_HISTORY_BYTES : max_bytes;
+  store_.SetAppendHook(nullptr, nullptr);
+  store_.Clear();
+  if (!Load()) {
+    ::close(fd_);
+    fd_ = -1;
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
+  store_.SetAppendHook(OnAppend, this);
+  return expected<void, ShellError>::success();
+}
+
+inline void HistoryFile::OnAppend(const char* line, uint32_t len, void* ctx) noexcept {
+  auto* self = static_cast<HistoryFile*>(ctx);
+  {
+    std::lock_guard<std::mutex> lock(self->stage_mtx_);
+    if (self->stage_len_ + kRecordOverhead + len > sizeof(self->stage_)) {
+      self->dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    const uint16_t n = static_cast<uint16_t>(len);
+    char* p = self->stage_ + self->stage_len_;
+    std::memcpy(p, &n, 2);
+    std::memcpy(p + 2, line, len);
+    std::memcpy(p + 2 + len, &n, 2);
+    self->stage_len_ += kRecordOverhead + len;
+  }
+  if (!self->job_queued_.exchange(true, std::memory_order_acq_rel)) {
+    if (!WorkerPool::Instance().Submit(FlushJob, self)) {
+      self->job_queued_.store(false, std::memory_order_release);  // The next entry retries.
+    }
+  }
+}
+
+inline void HistoryFile::FlushJob(void* arg) noexcept {
+  auto* self = static_cast<HistoryFile*>(arg);
+  std::lock_guard<std::mutex> lock(self->io_mtx_);
+  // Cleared under io_mtx_: once Close() sees it false, no job touches the file.
+  self->job_queued_.store(false, std::memory_order_release);
+  self->WriteStaged();
+}
+
+inline void HistoryFile::WriteStaged() noexcept {
+  char batch[EMBSH_HISTORY_FILE_PENDING];
+  uint32_t len = 0;
+  {
+    std::lock_guard<std::mutex> lock(stage_mtx_);
+    len = stage_len_;
+    std::memcpy(batch, stage_, len);
+    stage_len_ = 0;
+  }
+  if (len == 0 || fd_ < 0)
+    return;
+  // One write per batch; O_APPEND keeps the records contiguous.
+  const ssize_t n = ::write(fd_, batch, len);
+  if (n > 0) {
+    file_size_ += static_cast<size_t>(n);
+  }
+  (void)::fdatasync(fd_);
+  if (file_size_ > max_bytes_) {
+    (void)Compact();
+  }
+}
+
+inline bool HistoryFile::Compact() noexcept {
+  void* map = ::mmap(nullptr, file_size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (map == MAP_FAILED)
+    return false;
+  const char* text = static_cast<const char*>(map);
+  uint32_t offs[EMBSH_HISTORY_SIZE];
+  size_t end = 0;
+  const uint32_t n = ScanTail(text, file_size_, offs, end);
+
+  char tmp[EMBSH_HISTORY_PATH_MAX + 4];
+  std::snprintf(tmp, sizeof(tmp), "%s.tmp", path_);
+  int out = ::open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  bool ok = (out >= 0);
+  size_t size = sizeof(kMagic);
+  if (ok) {
+    // The retained records are contiguous at the end of the valid log.
+    const size_t from = (n > 0) ? offs[0] : end;
+    ok = ::write(out, kMagic, sizeof(kMagic)) == static_cast<ssize_t>(sizeof(kMagic)) &&
+         ::write(out, text + from, end - from) == static_cast<ssize_t>(end - from) && ::fsync(out) == 0;
+    size += end - from;
+    ::close(out);
+  }
+  ::munmap(map, file_size_);
+  if (!ok || ::rename(tmp, path_) != 0) {
+    (void)::unlink(tmp);
+    return false;
+  }
+  const int fd = ::open(path_, O_RDWR | O_APPEND | O_CLOEXEC);
+  if (fd < 0)
+    return false;  // Keep appending to the old (now unlinked) inode rather than losing entries.
+  ::close(fd_);
+  fd_ = fd;
+  file_size_ = size;
+  return true;
+}
+
+inline void HistoryFile::Flush() noexcept {
+  std::lock_guard<std::mutex> lock(io_mtx_);
+  WriteStaged();
+}
+
+inline void HistoryFile::Close() noexcept {
+  store_.SetAppendHook(nullptr, nullptr);
+  while (job_queued_.load(std::memory_order_acquire)) {
+    std::this_thread::yield();  // A queued writer job still references this object.
+  }
+  std::lock_guard<std::mutex> lock(io_mtx_);
+  WriteStaged();
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+inline HistoryFile* HistoryFile::Shared(const char* path) noexcept {
+  // Constructed after the pool, so the pool (and any queued writer job)
+  // is destroyed after these files at exit.
+  (void)WorkerPool::Instance();
+  static HistoryFile files[EMBSH_HISTORY_FILES];
+  static std::mutex mtx;
+  if (path == nullptr)
+    return nullptr;
+  std::lock_guard<std::mutex> lock(mtx);
+  for (auto& f : files) {
+    if (f.IsOpen() && std::strcmp(f.path_, path) == 0)
+      return &f;
+  }
+  for (auto& f : files) {
+    if (!f.IsOpen())
+      return f.Open(path).has_value() ? &f : nullptr;
+  }
+  return nullptr;
+}
+
+}  // namespace embsh
+
+#endif  // EMBSH_HISTORY_FILE_HPP_
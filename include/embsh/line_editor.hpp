@@ -9,23 +9,62 @@
 
 #include "embsh/command_registry.hpp"
 #include "embsh/platform.hpp"
+#include "embsh/rate_limit.hpp"
+#include "embsh/worker_pool.hpp"
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
+#include <mutex>
+#include <string_view>
+#include <thread>
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #ifndef EMBSH_LINE_BUF_SIZE
 #define EMBSH_LINE_BUF_SIZE 256
 #endif
 
 #ifndef EMBSH_HISTORY_SIZE
-#define EMBSH_HISTORY_SIZE 16
+#define EMBSH_HISTORY_SIZE 256  ///< Maximum entries per HistoryStore (shared and backend stores).
+#endif
+
+#ifndef EMBSH_HISTORY_BYTES
+#define EMBSH_HISTORY_BYTES 8192  ///< Packed text per HistoryStore.
+#endif
+
+#ifndef EMBSH_LOCAL_HISTORY_SIZE
+#define EMBSH_LOCAL_HISTORY_SIZE 16  ///< Maximum entries in each Session::local_history.
+#endif
+
+#ifndef EMBSH_LOCAL_HISTORY_BYTES
+#define EMBSH_LOCAL_HISTORY_BYTES 1024  ///< Packed text in each Session::local_history.
+#endif
+
+#ifndef EMBSH_SEARCH_MAX
+#define EMBSH_SEARCH_MAX 32  ///< Longest Ctrl+R search pattern.
+#endif
+
+#ifndef EMBSH_RX_BUF_SIZE
+#define EMBSH_RX_BUF_SIZE 128
+#endif
+
+#ifndef EMBSH_TX_BUF_SIZE
+#define EMBSH_TX_BUF_SIZE 512
 #endif
 
 namespace embsh {
@@ -40,6 +79,33 @@ using WriteFn = ssize_t (*)(int fd, const void* buf, size_t len);
 /// @brief Read function: ssize_t read(int fd, void* buf, size_t len).
 using ReadFn = ssize_t (*)(int fd, void* buf, size_t len);
 
+/// @brief Vectored write function: ssize_t writev(int fd, const iovec* iov, int iovcnt).
+using WriteVFn = ssize_t (*)(int fd, const struct iovec* iov, int iovcnt);
+
+/**
+ * @brief Operations of a transport that is not a plain fd (USB gadget
+ *        endpoint, SEGGER RTT, shared-memory ring to a co-processor).
+ *
+ * Set Session::transport and transport_ctx; read_fn / write_fn / writev_fn
+ * are then unused. Session::read_fd becomes a readiness descriptor that the
+ * backends poll in place of a device fd: typically an eventfd the
+ * transport keeps readable while input is pending (level-triggered, as for
+ * a tty). write_fd is only polled when writev() can fail with EAGAIN; with
+ * -1 such a transport gets no retry. Return values follow readv() / writev():
+ * bytes moved, -1 with errno EAGAIN when nothing can move now, and 0 from
+ * readv() at end of stream.
+ */
+struct Transport {
+  ssize_t (*readv)(void* ctx, const struct iovec* iov, int iovcnt);   ///< Required.
+  ssize_t (*writev)(void* ctx, const struct iovec* iov, int iovcnt);  ///< Required; partial writes allowed.
+
+  /// Optional zero-copy input: point @p *data at contiguous pending bytes and
+  /// return their count (readv() conventions). The editor works on them in
+  /// place, then calls release() with the number it consumed.
+  ssize_t (*borrow)(void* ctx, const uint8_t** data);
+  void (*release)(void* ctx, size_t len);  ///< Required with borrow.
+};
+
 // ============================================================================
 // Built-in I/O backends
 // ============================================================================
@@ -56,6 +122,14 @@ inline ssize_t TcpRead(int fd, void* buf, size_t len) {
   return ::recv(fd, buf, len, 0);
 }
 
+/// @brief TCP backend: sendmsg() with MSG_NOSIGNAL.
+inline ssize_t TcpWriteV(int fd, const struct iovec* iov, int iovcnt) {
+  struct msghdr msg = {};
+  msg.msg_iov = const_cast<struct iovec*>(iov);
+  msg.msg_iovlen = static_cast<size_t>(iovcnt);
+  return ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+}
+
 /// @brief POSIX backend: write() for stdin/stdout/UART.
 inline ssize_t PosixWrite(int fd, const void* buf, size_t len) {
   return ::write(fd, buf, len);
@@ -66,71 +140,810 @@ inline ssize_t PosixRead(int fd, void* buf, size_t len) {
   return ::read(fd, buf, len);
 }
 
+/// @brief POSIX backend: writev() for stdout/UART.
+inline ssize_t PosixWriteV(int fd, const struct iovec* iov, int iovcnt) {
+  return ::writev(fd, iov, iovcnt);
+}
+
 }  // namespace io
 
+// ============================================================================
+// WakeEvent - Interrupt a blocked poll() / epoll_wait()
+// ============================================================================
+
+/**
+ * @brief eventfd that loops add to their poll set so they can sleep with no
+ *        timeout and still be interrupted.
+ *
+ * Signal() is sticky until Drain(): a shutdown signal wakes every thread
+ * polling the same event, each of which then sees its running flag cleared.
+ */
+class WakeEvent final {
+ public:
+  WakeEvent() = default;
+  ~WakeEvent() { Close(); }
+
+  WakeEvent(const WakeEvent&) = delete;
+  WakeEvent& operator=(const WakeEvent&) = delete;
+
+  /// @brief Create the eventfd (idempotent). @return false on failure.
+  inline bool Open() noexcept {
+    if (fd_ < 0)
+      fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return fd_ >= 0;
+  }
+
+  inline void Close() noexcept {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  /// @brief Make the fd readable (async-signal-safe).
+  inline void Signal() noexcept {
+    const uint64_t one = 1;
+    if (fd_ >= 0)
+      (void)::write(fd_, &one, sizeof(one));
+  }
+
+  /// @brief Reset the fd to non-readable.
+  inline void Drain() noexcept {
+    uint64_t value = 0;
+    if (fd_ >= 0)
+      (void)::read(fd_, &value, sizeof(value));
+  }
+
+  int fd() const noexcept { return fd_; }
+
+ private:
+  int fd_ = -1;
+};
+
+// ============================================================================
+// HistoryRing - Packed command history ring
+// ============================================================================
+
+/**
+ * @brief Variable-length command history over caller-provided storage.
+ *
+ * Entries are stored back-to-back, NUL-terminated, in a byte ring; a slot
+ * ring records each entry's offset and length. An entry never straddles
+ * the end of the byte ring: if it does not fit at the tail it starts again
+ * at offset 0. The oldest entries are evicted when either ring runs out of
+ * room, so memory tracks the actual length of the commands rather than a
+ * fixed row size. The rings live in the derived HistoryBuffer, so stores of
+ * different sizes share this code and one pointer type.
+ *
+ * Entries are addressed by a monotonically increasing sequence number, so
+ * a navigation cursor stays valid while other sessions push into a shared
+ * store. All methods take an internal mutex; it is uncontended unless the
+ * store is shared, and only touched on Enter and history navigation.
+ */
+class HistoryRing {
+ public:
+  /// @brief Called under the store lock with each entry Push() adds (see HistoryFile).
+  using AppendFn = void (*)(const char* line, uint32_t len, void* ctx);
+
+  HistoryRing(const HistoryRing&) = delete;
+  HistoryRing& operator=(const HistoryRing&) = delete;
+
+  /// @brief Maximum number of entries.
+  uint32_t Capacity() const noexcept { return entries_; }
+
+  /// @brief Size of the packed text ring in bytes.
+  uint32_t Bytes() const noexcept { return bytes_; }
+
+  /**
+   * @brief Append a line, evicting the oldest entries as needed.
+   *
+   * Empty lines and repeats of the newest entry are ignored. Lines longer
+   * than EMBSH_LINE_BUF_SIZE - 1 are truncated.
+   */
+  inline void Push(const char* line, uint32_t len) noexcept {
+    if (len == 0)
+      return;
+    if (len > EMBSH_LINE_BUF_SIZE - 1)
+      len = EMBSH_LINE_BUF_SIZE - 1;
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (count_ > 0) {
+      const uint32_t last = Slot(count_ - 1);
+      if (len_[last] == len && std::memcmp(&data_[off_[last]], line, len) == 0)
+        return;
+    }
+
+    const uint32_t need = len + 1;
+    uint32_t pos = 0;
+    while (!FindSpace(need, pos)) {
+      EvictOldest();
+    }
+    std::memcpy(&data_[pos], line, len);
+    data_[pos + len] = '\0';
+    const uint32_t slot = Slot(count_);
+    off_[slot] = static_cast<uint16_t>(pos);
+    len_[slot] = static_cast<uint16_t>(len);
+    ++count_;
+    ++next_seq_;
+    tail_ = pos + need;
+    if (append_fn_ != nullptr) {
+      append_fn_(line, len, append_ctx_);
+    }
+  }
+
+  /// @brief Install (or with nullptr remove) the hook called for every new entry.
+  inline void SetAppendHook(AppendFn fn, void* ctx) noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    append_fn_ = fn;
+    append_ctx_ = ctx;
+  }
+
+  /**
+   * @brief Copy entry @p seq into @p out (NUL-terminated).
+   * @return Length copied, or -1 if @p seq was evicted or not yet written.
+   */
+  inline int32_t Load(uint32_t seq, char* out, uint32_t out_size) const noexcept {
+    if (out_size == 0)
+      return -1;
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (seq >= next_seq_ || next_seq_ - seq > count_)
+      return -1;
+    const uint32_t slot = Slot(count_ - (next_seq_ - seq));
+    uint32_t n = len_[slot];
+    if (n >= out_size)
+      n = out_size - 1;
+    std::memcpy(out, &data_[off_[slot]], n);
+    out[n] = '\0';
+    return static_cast<int32_t>(n);
+  }
+
+  /**
+   * @brief Find the newest entry older than @p before that contains @p pat.
+   *
+   * Walks the slot index newest first and matches against the packed text
+   * in place; nothing is copied.
+   *
+   * @param[out] seq Sequence number of the match.
+   * @return true if an entry matched.
+   */
+  inline bool Find(const char* pat, uint32_t len, uint32_t before, uint32_t& seq) const noexcept {
+    const std::string_view needle(pat, len);
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (before > next_seq_)
+      before = next_seq_;
+    const uint32_t begin = next_seq_ - count_;
+    for (uint32_t q = before; q > begin; --q) {
+      const uint32_t slot = Slot(count_ - (next_seq_ - (q - 1)));
+      if (std::string_view(&data_[off_[slot]], len_[slot]).find(needle) != std::string_view::npos) {
+        seq = q - 1;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// @brief Sequence number the next Push() will get (newest is End() - 1).
+  uint32_t End() const noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return next_seq_;
+  }
+
+  /// @brief Sequence number of the oldest retained entry.
+  uint32_t Begin() const noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return next_seq_ - count_;
+  }
+
+  /// @brief Number of retained entries.
+  uint32_t Count() const noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return count_;
+  }
+
+  /// @brief Drop all entries (sequence numbers keep increasing).
+  inline void Clear() noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    head_ = 0;
+    count_ = 0;
+    tail_ = 0;
+  }
+
+ protected:
+  HistoryRing(char* data, uint16_t* off, uint16_t* len, uint32_t entries, uint32_t bytes) noexcept
+      : data_(data), off_(off), len_(len), entries_(entries), bytes_(bytes) {}
+  ~HistoryRing() = default;
+
+ private:
+  uint32_t Slot(uint32_t i) const noexcept { return (head_ + i) % entries_; }
+
+  /// @brief Find @p need contiguous free bytes; false if an eviction is required.
+  inline bool FindSpace(uint32_t need, uint32_t& pos) const noexcept {
+    if (count_ == 0) {
+      pos = 0;
+      return true;
+    }
+    if (count_ == entries_)
+      return false;
+    const uint32_t oldest = off_[head_];
+    if (oldest < tail_) {
+      // Live bytes are [oldest, tail_); free space is above and below.
+      if (tail_ + need <= bytes_) {
+        pos = tail_;
+        return true;
+      }
+      pos = 0;
+      return need <= oldest;
+    }
+    // Wrapped: free space is [tail_, oldest).
+    pos = tail_;
+    return tail_ + need <= oldest;
+  }
+
+  inline void EvictOldest() noexcept {
+    head_ = (head_ + 1) % entries_;
+    if (--count_ == 0)
+      tail_ = 0;
+  }
+
+  char* data_;
+  uint16_t* off_;  ///< Byte offset per slot.
+  uint16_t* len_;  ///< Entry length per slot (excluding NUL).
+  uint32_t entries_;
+  uint32_t bytes_;
+  uint32_t head_ = 0;  ///< Slot of the oldest entry.
+  uint32_t count_ = 0;
+  uint32_t tail_ = 0;      ///< One past the newest entry's NUL.
+  uint32_t next_seq_ = 0;  ///< Sequence number of the next entry.
+  AppendFn append_fn_ = nullptr;
+  void* append_ctx_ = nullptr;
+  mutable std::mutex mtx_;
+};
+
+/// @brief HistoryRing with inline storage for @p kEntries entries in @p kBytes of text.
+template <uint32_t kEntries, uint32_t kBytes>
+class HistoryBuffer final : public HistoryRing {
+ public:
+  static_assert(kBytes >= EMBSH_LINE_BUF_SIZE, "history bytes must hold one full line");
+  static_assert(kBytes <= 0xFFFF, "history bytes must fit in uint16_t");
+  static_assert(kEntries > 0, "history entries must be > 0");
+
+  HistoryBuffer() noexcept : HistoryRing(data_, off_, len_, kEntries, kBytes) {}
+
+ private:
+  char data_[kBytes] = {};
+  uint16_t off_[kEntries] = {};
+  uint16_t len_[kEntries] = {};
+};
+
+/// @brief Full-size store: shared telnet history, HistoryFile and single-session backends.
+using HistoryStore = HistoryBuffer<EMBSH_HISTORY_SIZE, EMBSH_HISTORY_BYTES>;
+
+/// @brief Small store embedded in every Session for unshared history.
+using LocalHistoryStore = HistoryBuffer<EMBSH_LOCAL_HISTORY_SIZE, EMBSH_LOCAL_HISTORY_BYTES>;
+
 // ============================================================================
 // Session - Per-connection state
 // ============================================================================
 
-/// @brief Session state shared by all backends.
+/// @brief What a session does when its output queue cannot take more data.
+enum class TxPolicy : uint8_t {
+  kBlock = 0,   ///< Wait up to Session::tx_timeout_ms for the peer, then disconnect (kDisconnect on a shared loop).
+  kDrop,        ///< Discard the output that does not fit.
+  kDisconnect,  ///< Close the session.
+};
+
+/**
+ * @brief Session state shared by all backends.
+ *
+ * Fields touched on every byte (transport, cursors, FSM states) come first
+ * so they share the leading cache line; buffers follow, and authentication
+ * and history, used once per line at most, sit at the end.
+ */
 struct Session {
+  // Hot: transport and per-byte state.
   int read_fd = -1;
   int write_fd = -1;
   WriteFn write_fn = nullptr;
   ReadFn read_fn = nullptr;
-
-  // Line editing
-  char line_buf[EMBSH_LINE_BUF_SIZE] = {};
+  WriteVFn writev_fn = nullptr;  ///< Optional; coalesces buffer + large fragment.
+  const Transport* transport = nullptr;  ///< Non-fd transport; replaces the three functions above.
+  void* transport_ctx = nullptr;
   uint32_t line_pos = 0;
+  uint32_t cursor_back = 0;  ///< Characters right of the cursor (0 = cursor at end of line).
+  uint32_t rx_pos = 0;  ///< Next unconsumed byte in rx_buf.
+  uint32_t rx_len = 0;  ///< Valid bytes in rx_buf.
+  uint32_t tx_len = 0;  ///< Buffered bytes in tx_buf.
+  uint32_t hist_nav = 0;  ///< Sequence number shown while browsing history.
 
-  // History
-  char history[EMBSH_HISTORY_SIZE][EMBSH_LINE_BUF_SIZE] = {};
-  uint32_t hist_count = 0;
-  uint32_t hist_write = 0;     ///< Next write index (ring).
-  uint32_t hist_nav = 0;       ///< Current navigation index.
-  bool hist_browsing = false;  ///< True while navigating history.
-
-  // Telnet IAC state
+  enum class EscState : uint8_t { kNone = 0, kEsc, kBracket, kSs3 };
+  enum class IacState : uint8_t { kNormal = 0, kIac, kNego, kSub };
+  EscState esc_state = EscState::kNone;
+  IacState iac_state = IacState::kNormal;
+  uint8_t iac_verb = 0;  ///< WILL/WONT/DO/DONT awaiting its option byte.
+  uint16_t esc_param = 0;  ///< Numeric parameter of the CSI sequence being parsed.
+  bool skip_lf = false;  ///< Swallow the '\n' / '\0' that follows a '\r'.
   bool telnet_mode = false;
-
-  // Authentication
+  bool telnet_binary = false;  ///< Peer accepted WILL BINARY (RFC 856).
+  bool hist_browsing = false;  ///< True while navigating history.
+  bool pasting = false;  ///< Inside ESC[200~ ... ESC[201~ (bracketed paste).
+  bool searching = false;  ///< Ctrl+R incremental history search in progress.
   bool auth_required = false;
   bool authenticated = false;
+  std::atomic<bool> active{false};
+  std::atomic<bool> busy{false};    ///< An async command owns line/tx state.
+  std::atomic<bool> cancel{false};  ///< Ctrl+C seen while busy.
+  std::atomic<bool> job_live{false};  ///< Worker still references this session.
+
+  // Buffers.
+  char line_buf[EMBSH_LINE_BUF_SIZE] = {};
+  uint8_t rx_buf[EMBSH_RX_BUF_SIZE] = {};  ///< One read() fills it, the editor drains it.
+  char tx_buf[EMBSH_TX_BUF_SIZE] = {};     ///< SessionWrite() appends, SessionFlush() sends.
+
+  // Cold: authentication.
+  enum class AuthPhase : uint8_t { kUser = 0, kPass };
   uint8_t auth_attempts = 0;
-  char auth_user_buf[64] = {};  ///< Buffer for username input.
+  AuthPhase auth_phase = AuthPhase::kUser;
   uint32_t auth_user_pos = 0;
+  uint32_t auth_pass_pos = 0;
+  char auth_user_buf[64] = {};  ///< Buffer for username input.
+  char auth_pass_buf[64] = {};  ///< Buffer for password input.
+
+  // Cold: asynchronous command (valid while busy).
+  WakeEvent* notify = nullptr;  ///< Signalled when an async command finishes.
+  const CmdEntry* job_cmd = nullptr;
+  const char* job_prompt = nullptr;
+  int job_argc = 0;
+  char* job_argv[EMBSH_MAX_ARGS] = {};  ///< Points into line_buf.
+
+  // Cold: output queue, filled when a non-blocking transport is full.
+  char* txq_buf = nullptr;  ///< Ring provided by the backend; nullptr = no queue.
+  uint32_t txq_cap = 0;
+  uint32_t txq_head = 0;
+  uint32_t txq_len = 0;  ///< Queued bytes; sent before any newer output.
+  TxPolicy tx_policy = TxPolicy::kBlock;
+  int tx_timeout_ms = 2000;  ///< kBlock: longest stall before disconnecting.
+
+  // Cold: rate limits.
+  SessionBudget* budget = nullptr;  ///< Input and command budget; nullptr = unlimited.
+
+#if EMBSH_ENABLE_STATS
+  // Cold: counters.
+  SessionStats stats;
+#endif
 
-  // ESC sequence state
-  enum class EscState : uint8_t { kNone = 0, kEsc, kBracket };
-  EscState esc_state = EscState::kNone;
-
-  // IAC state
-  enum class IacState : uint8_t { kNormal = 0, kIac, kNego, kSub };
-  IacState iac_state = IacState::kNormal;
+  // Cold: incremental history search (valid while searching).
+  uint32_t search_seq = 0;  ///< Entry shown in line_buf; HistoryRing::End() if none yet.
+  uint32_t search_len = 0;
+  char search_buf[EMBSH_SEARCH_MAX] = {};
 
-  // Session control
-  std::atomic<bool> active{false};
+  // Cold: history.
+  HistoryRing* history = nullptr;  ///< Backend or shared store; nullptr selects local_history.
+  LocalHistoryStore local_history;
 };
 
+/// @brief History store used by a session (shared if set, else its own).
+inline HistoryRing& SessionHistory(Session& s) noexcept {
+  return (s.history != nullptr) ? *s.history : s.local_history;
+}
+
 // ============================================================================
 // Session I/O helpers
 // ============================================================================
 
-inline void SessionWrite(Session& s, const char* str) noexcept {
-  if (s.write_fn != nullptr && str != nullptr) {
-    size_t len = std::strlen(str);
-    if (len > 0) {
-      (void)s.write_fn(s.write_fd, str, len);
+namespace detail {
+
+/// @brief Account one transport read in the session counters.
+inline void CountRead(Session& s, ssize_t n) noexcept {
+#if EMBSH_ENABLE_STATS
+  StatsAdd(s.stats.read_calls);
+  if (n > 0)
+    StatsAdd(s.stats.bytes_in, static_cast<uint64_t>(n));
+#else
+  (void)s;
+  (void)n;
+#endif
+}
+
+/// @brief Account one transport write or sendfile() result.
+inline void CountWrite(Session& s, ssize_t n) noexcept {
+#if EMBSH_ENABLE_STATS
+  StatsAdd(s.stats.write_calls);
+  if (n > 0)
+    StatsAdd(s.stats.bytes_out, static_cast<uint64_t>(n));
+#else
+  (void)s;
+  (void)n;
+#endif
+}
+
+/// @brief Account output discarded by TxPolicy::kDrop.
+inline void CountDrop(Session& s, size_t n) noexcept {
+#if EMBSH_ENABLE_STATS
+  StatsAdd(s.stats.tx_dropped, static_cast<uint64_t>(n));
+#else
+  (void)s;
+  (void)n;
+#endif
+}
+
+/// @brief Longest a bulk transfer waits for a non-blocking transport to drain.
+constexpr int kBulkStallMs = 5000;
+
+/**
+ * @brief True on a thread that serves many sessions (telnet reactor, ShellMultiplexer).
+ *
+ * Output written on such a thread never waits for the peer, so one stalled
+ * client cannot hold up the others; worker and per-session threads may wait.
+ */
+inline bool& SharedLoopThread() noexcept {
+  static thread_local bool shared = false;
+  return shared;
+}
+
+/// @brief Per-stall wait for bulk output: kBulkStallMs, or 0 (queue, then tx_policy) on a shared loop.
+inline int BulkStallMs() noexcept {
+  return SharedLoopThread() ? 0 : kBulkStallMs;
+}
+
+/// @brief True if the session has somewhere to send output.
+inline bool CanWrite(const Session& s) noexcept {
+  return s.write_fn != nullptr || s.transport != nullptr;
+}
+
+/// @brief One gather write through the session's transport.
+inline ssize_t TransportWrite(Session& s, const struct iovec* iov, int iovcnt) noexcept {
+  if (s.transport != nullptr)
+    return s.transport->writev(s.transport_ctx, iov, iovcnt);
+  return (s.writev_fn != nullptr && iovcnt > 1) ? s.writev_fn(s.write_fd, iov, iovcnt)
+                                                : s.write_fn(s.write_fd, iov[0].iov_base, iov[0].iov_len);
+}
+
+/// @brief One read through the session's transport.
+inline ssize_t TransportRead(Session& s, void* buf, size_t len) noexcept {
+  if (s.transport != nullptr) {
+    struct iovec iov = {buf, len};
+    return s.transport->readv(s.transport_ctx, &iov, 1);
+  }
+  return s.read_fn(s.read_fd, buf, len);
+}
+
+/// @brief Block until @p fd is writable or @p timeout_ms passes.
+inline bool WaitWritable(int fd, int timeout_ms) noexcept {
+  struct pollfd pfd = {fd, POLLOUT, 0};
+  int pr;
+  do {
+    pr = ::poll(&pfd, 1, timeout_ms);
+  } while (pr < 0 && errno == EINTR);
+  return pr == 1 && (pfd.revents & POLLOUT) != 0;
+}
+
+/**
+ * @brief Send queued output until the transport would block.
+ * @return false on a transport error.
+ */
+inline bool DrainTxQueue(Session& s) noexcept {
+  while (s.txq_len > 0) {
+    const uint32_t first = (s.txq_len < s.txq_cap - s.txq_head) ? s.txq_len : s.txq_cap - s.txq_head;
+    struct iovec iov[2] = {{s.txq_buf + s.txq_head, first}, {s.txq_buf, s.txq_len - first}};
+    ssize_t n = TransportWrite(s, iov, (iov[1].iov_len > 0) ? 2 : 1);
+    CountWrite(s, n);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return true;
+    if (n <= 0)
+      return false;
+    s.txq_head = (s.txq_head + static_cast<uint32_t>(n)) % s.txq_cap;
+    s.txq_len -= static_cast<uint32_t>(n);
+  }
+  s.txq_head = 0;
+  return true;
+}
+
+/**
+ * @brief Drain the output queue completely, waiting for the transport.
+ * @return false on error or if one wait exceeded @p stall_ms.
+ */
+inline bool WaitTxQueue(Session& s, int stall_ms) noexcept {
+  while (s.txq_len > 0) {
+    if (!WaitWritable(s.write_fd, stall_ms) || !DrainTxQueue(s))
+      return false;
+  }
+  return true;
+}
+
+/// @brief Drop queued output and end the session (TxPolicy::kDisconnect and failed kBlock).
+inline void TxDisconnect(Session& s) noexcept {
+  s.txq_len = 0;
+  s.txq_head = 0;
+  s.cancel.store(true, std::memory_order_release);  // Stop an async producer.
+  s.active.store(false, std::memory_order_release);
+}
+
+inline bool SessionWriteAll(Session& s, struct iovec* iov, int iovcnt, int stall_ms = 0) noexcept;
+
+/**
+ * @brief Queue what the transport did not take, applying Session::tx_policy when it does not fit.
+ * @return false if the session was disconnected.
+ */
+inline bool QueueOutput(Session& s, struct iovec* iov, int iovcnt) noexcept {
+  size_t need = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    need += iov[i].iov_len;
+  }
+  if (need > s.txq_cap - s.txq_len) {
+    switch (s.tx_policy) {
+      case TxPolicy::kDrop:
+        CountDrop(s, need);
+        return true;
+      case TxPolicy::kBlock:
+        // A shared loop cannot wait for one peer without stalling the rest.
+        if (!SharedLoopThread() && WaitTxQueue(s, s.tx_timeout_ms) &&
+            SessionWriteAll(s, iov, iovcnt, s.tx_timeout_ms))
+          return true;
+        TxDisconnect(s);
+        return false;
+      case TxPolicy::kDisconnect:
+      default:
+        TxDisconnect(s);
+        return false;
+    }
+  }
+  for (int i = 0; i < iovcnt; ++i) {
+    const char* src = static_cast<const char*>(iov[i].iov_base);
+    uint32_t len = static_cast<uint32_t>(iov[i].iov_len);
+    while (len > 0) {
+      const uint32_t tail = (s.txq_head + s.txq_len) % s.txq_cap;
+      const uint32_t chunk = (len < s.txq_cap - tail) ? len : s.txq_cap - tail;
+      std::memcpy(s.txq_buf + tail, src, chunk);
+      s.txq_len += chunk;
+      src += chunk;
+      len -= chunk;
     }
   }
+  return true;
 }
 
+/**
+ * @brief Write an iovec array completely, retrying partial writes and EINTR.
+ *
+ * Output already queued goes first. When a non-blocking transport is full
+ * (EAGAIN) the rest is queued for DrainTxQueue() (see QueueOutput()), or,
+ * with @p stall_ms > 0, waited on for up to that long per stall instead.
+ *
+ * @return false if the transport reported an error or the session was
+ *         disconnected (remaining data is lost).
+ */
+inline bool SessionWriteAll(Session& s, struct iovec* iov, int iovcnt, int stall_ms) noexcept {
+  if (s.txq_len > 0) {
+    if (!DrainTxQueue(s))
+      return false;
+    if (s.txq_len > 0) {
+      if (stall_ms == 0)
+        return QueueOutput(s, iov, iovcnt);
+      if (!WaitTxQueue(s, stall_ms))
+        return false;
+    }
+  }
+  while (iovcnt > 0) {
+    if (iov[0].iov_len == 0) {
+      ++iov;
+      --iovcnt;
+      continue;
+    }
+    ssize_t n = TransportWrite(s, iov, iovcnt);
+    CountWrite(s, n);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (stall_ms == 0)
+        return QueueOutput(s, iov, iovcnt);
+      if (WaitWritable(s.write_fd, stall_ms))
+        continue;
+    }
+    if (n <= 0)
+      return false;
+    size_t done = static_cast<size_t>(n);
+    while (iovcnt > 0 && done >= iov[0].iov_len) {
+      done -= iov[0].iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov[0].iov_base = static_cast<char*>(iov[0].iov_base) + done;
+      iov[0].iov_len -= done;
+    }
+  }
+  return true;
+}
+
+}  // namespace detail
+
+/// @brief Send everything buffered by SessionWrite()/SessionWriteN().
+inline void SessionFlush(Session& s) noexcept {
+  if (s.tx_len == 0 || !detail::CanWrite(s))
+    return;
+  struct iovec iov = {s.tx_buf, s.tx_len};
+  (void)detail::SessionWriteAll(s, &iov, 1);
+  s.tx_len = 0;
+}
+
+/**
+ * @brief Queue @p len bytes of output for the session.
+ *
+ * Data is coalesced in Session::tx_buf and sent on SessionFlush() or when
+ * the buffer fills. A fragment that does not fit is sent together with the
+ * pending buffer in one gather write when the transport has one.
+ */
 inline void SessionWriteN(Session& s, const char* buf, size_t len) noexcept {
-  if (s.write_fn != nullptr && len > 0) {
-    (void)s.write_fn(s.write_fd, buf, len);
+  if (!detail::CanWrite(s) || len == 0)
+    return;
+  if (len <= sizeof(s.tx_buf) - s.tx_len) {
+    std::memcpy(s.tx_buf + s.tx_len, buf, len);
+    s.tx_len += static_cast<uint32_t>(len);
+    return;
+  }
+  if (s.writev_fn != nullptr || s.transport != nullptr || len >= sizeof(s.tx_buf)) {
+    struct iovec iov[2] = {{s.tx_buf, s.tx_len}, {const_cast<char*>(buf), len}};
+    (void)detail::SessionWriteAll(s, iov, 2);
+    s.tx_len = 0;
+    return;
+  }
+  SessionFlush(s);
+  std::memcpy(s.tx_buf, buf, len);
+  s.tx_len = static_cast<uint32_t>(len);
+}
+
+inline void SessionWrite(Session& s, const char* str) noexcept {
+  if (str != nullptr) {
+    SessionWriteN(s, str, std::strlen(str));
   }
 }
 
+// ============================================================================
+// Bulk output - raw bytes and fd-backed data
+// ============================================================================
+
+/**
+ * @brief Send raw bytes, bypassing tx_buf (pending text is flushed first).
+ *
+ * Waits up to detail::kBulkStallMs per stall for a full transport, except
+ * on a shared event loop (detail::SharedLoopThread()), where what does not
+ * fit is queued like any other output and Session::tx_policy applies.
+ * Commands that stream large output there should be registered async.
+ *
+ * On telnet sessions 0xFF is doubled (IAC IAC) and, unless the peer
+ * accepted BINARY, a CR not followed by LF is sent as CR NUL (RFC 854).
+ * Escapes are extra iovec entries pointing into @p data; nothing is copied.
+ *
+ * @return false on a transport error.
+ */
+inline bool SessionWriteBinary(Session& s, const void* data, size_t len) noexcept {
+  if (!detail::CanWrite(s))
+    return false;
+  SessionFlush(s);
+  auto* p = static_cast<uint8_t*>(const_cast<void*>(data));
+  if (!s.telnet_mode) {
+    struct iovec iov = {p, len};
+    return detail::SessionWriteAll(s, &iov, 1, detail::BulkStallMs());
+  }
+
+  static char nul = '\0';
+  constexpr int kMaxIov = 64;
+  struct iovec iov[kMaxIov];
+  int n = 0;
+  size_t start = 0;
+  size_t i = 0;
+  while (i < len) {
+    if (s.telnet_binary) {
+      const void* hit = std::memchr(p + i, 0xFF, len - i);
+      if (hit == nullptr)
+        break;
+      i = static_cast<size_t>(static_cast<const uint8_t*>(hit) - p);
+    } else if (p[i] != 0xFF && p[i] != '\r') {
+      ++i;
+      continue;
+    }
+    if (p[i] == 0xFF) {
+      // The run ends with the IAC; the next one restarts on it, doubling it.
+      iov[n++] = {p + start, i + 1 - start};
+      start = i;
+    } else if (i + 1 < len && p[i + 1] == '\n') {
+      ++i;
+      continue;
+    } else {
+      iov[n++] = {p + start, i + 1 - start};
+      iov[n++] = {&nul, 1};
+      start = i + 1;
+    }
+    ++i;
+    if (n >= kMaxIov - 2) {
+      if (!detail::SessionWriteAll(s, iov, n, detail::BulkStallMs()))
+        return false;
+      n = 0;
+    }
+  }
+  if (start < len) {
+    iov[n++] = {p + start, len - start};
+  }
+  return n == 0 || detail::SessionWriteAll(s, iov, n, detail::BulkStallMs());
+}
+
+/**
+ * @brief Stream up to @p count bytes from @p fd to the session.
+ *
+ * Reads from @p *offset (advanced) or, when @p offset is nullptr, from the
+ * file position. Non-telnet sessions on plain descriptors use sendfile(),
+ * so the data never enters user space; telnet sessions need escaping and
+ * go through SessionWriteBinary() in chunks. On a shared event loop
+ * sendfile() stops at the first stall and the rest is copied into the
+ * output queue by the same path, so the loop never waits.
+ *
+ * @return Bytes sent (less than @p count at end of file), or -1 on error.
+ */
+inline ssize_t SessionSendFd(Session& s, int fd, off_t* offset, size_t count) noexcept {
+  if (!detail::CanWrite(s))
+    return -1;
+  SessionFlush(s);
+  const int stall_ms = detail::BulkStallMs();
+  if (stall_ms > 0 ? !detail::WaitTxQueue(s, stall_ms) : !detail::DrainTxQueue(s))
+    return -1;
+  size_t total = 0;
+  // sendfile() bypasses the queue, so it only runs while the queue is empty.
+  if (!s.telnet_mode && s.txq_len == 0 && s.transport == nullptr &&
+      (s.write_fn == io::PosixWrite || s.write_fn == io::TcpWrite)) {
+    while (total < count) {
+      ssize_t n = ::sendfile(s.write_fd, fd, offset, count - total);
+      detail::CountWrite(s, n);
+      if (n > 0) {
+        total += static_cast<size_t>(n);
+        continue;
+      }
+      if (n == 0)
+        return static_cast<ssize_t>(total);
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (stall_ms == 0)
+          break;  // Shared loop: the copy path below queues the rest.
+        if (detail::WaitWritable(s.write_fd, stall_ms))
+          continue;
+        return -1;
+      }
+      if (total == 0 && (errno == EINVAL || errno == ENOSYS))
+        break;  // Source cannot be sendfile()d (e.g. a pipe): copy instead.
+      return -1;
+    }
+  }
+
+  uint8_t chunk[2048];
+  // A CR ending a chunk is held back until the next byte shows whether LF
+  // follows; escaped on its own it would put CR NUL LF on the wire.
+  const bool escape_cr = s.telnet_mode && !s.telnet_binary;
+  size_t held = 0;
+  while (total < count) {
+    size_t room = sizeof(chunk) - held;
+    size_t want = (count - total < room) ? count - total : room;
+    ssize_t n = (offset != nullptr) ? ::pread(fd, chunk + held, want, *offset) : ::read(fd, chunk + held, want);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    if (n == 0)
+      break;
+    if (offset != nullptr)
+      *offset += n;
+    total += static_cast<size_t>(n);
+    const size_t len = held + static_cast<size_t>(n);
+    held = (escape_cr && chunk[len - 1] == '\r' && total < count) ? 1U : 0U;
+    if (!SessionWriteBinary(s, chunk, len - held))
+      return -1;
+    chunk[0] = '\r';  // Only read again when held.
+  }
+  if (held != 0 && !SessionWriteBinary(s, chunk, 1))
+    return -1;
+  return static_cast<ssize_t>(total);
+}
+
 // ============================================================================
 // LineEditor - History, completion, ESC sequences
 // ============================================================================
@@ -142,107 +955,206 @@ inline void SessionWriteN(Session& s, const char* buf, size_t len) noexcept {
  */
 namespace editor {
 
-/// @brief Push a command line into the history ring buffer.
+/// @brief Ask the terminal to wrap pastes in ESC[200~ / ESC[201~ (xterm bracketed paste).
+constexpr const char kBracketedPasteOn[] = "\x1b[?2004h";
+constexpr const char kBracketedPasteOff[] = "\x1b[?2004l";
+
+/// @brief Push a command line into the session's history store.
 inline void PushHistory(Session& s) noexcept {
-  if (s.line_pos == 0)
+  SessionHistory(s).Push(s.line_buf, s.line_pos);
+}
+
+/// @brief Append a cursor move of @p n columns: CSI n <dir>, or @p n literal
+/// bytes when that is shorter (backspaces left, the line's own text right).
+inline void CursorMove(Session& s, uint32_t n, char dir) noexcept {
+  if (n == 0)
     return;
-  // Skip duplicate of the last entry.
-  if (s.hist_count > 0) {
-    uint32_t last = (s.hist_write + EMBSH_HISTORY_SIZE - 1) % EMBSH_HISTORY_SIZE;
-    if (std::strcmp(s.history[last], s.line_buf) == 0)
-      return;
+  if (n < 4) {
+    if (dir == 'D') {
+      SessionWriteN(s, "\b\b\b", n);
+    } else {
+      SessionWriteN(s, s.line_buf + (s.line_pos - s.cursor_back), n);
+    }
+    return;
+  }
+  char seq[16] = {'\x1b', '['};
+  char digits[10];
+  uint32_t nd = 0;
+  while (n != 0) {
+    digits[nd++] = static_cast<char>('0' + n % 10);
+    n /= 10;
+  }
+  uint32_t len = 2;
+  while (nd != 0) {
+    seq[len++] = digits[--nd];
+  }
+  seq[len++] = dir;
+  SessionWriteN(s, seq, len);
+}
+
+/// @brief Move the cursor @p n columns left (n <= cursor column).
+inline void CursorLeft(Session& s, uint32_t n) noexcept {
+  CursorMove(s, n, 'D');
+  s.cursor_back += n;
+}
+
+/// @brief Move the cursor @p n columns right (n <= cursor_back).
+inline void CursorRight(Session& s, uint32_t n) noexcept {
+  CursorMove(s, n, 'C');
+  s.cursor_back -= n;
+}
+
+/**
+ * @brief Replace the line with @p text and put the cursor @p back columns
+ *        before its end, sending only the difference.
+ *
+ * Moves to the first differing column, rewrites from there, and clears
+ * leftovers with CSI K, so recalling a similar history entry costs a few
+ * bytes instead of erasing and retyping the whole line.
+ */
+inline void RedrawLine(Session& s, const char* text, uint32_t len, uint32_t back) noexcept {
+  if (len >= EMBSH_LINE_BUF_SIZE)
+    len = EMBSH_LINE_BUF_SIZE - 1;
+  if (back > len)
+    back = len;
+  const uint32_t limit = (len < s.line_pos) ? len : s.line_pos;
+  uint32_t same = 0;
+  while (same < limit && s.line_buf[same] == text[same]) {
+    ++same;
   }
-  std::memcpy(s.history[s.hist_write], s.line_buf, s.line_pos);
-  s.history[s.hist_write][s.line_pos] = '\0';
-  s.hist_write = (s.hist_write + 1) % EMBSH_HISTORY_SIZE;
-  if (s.hist_count < EMBSH_HISTORY_SIZE)
-    ++s.hist_count;
+  const uint32_t cur = s.line_pos - s.cursor_back;
+  if (cur > same) {
+    CursorLeft(s, cur - same);
+  } else {
+    CursorRight(s, same - cur);
+  }
+  std::memmove(s.line_buf + same, text + same, len - same);
+  SessionWriteN(s, s.line_buf + same, len - same);
+  if (s.line_pos > len) {
+    SessionWrite(s, "\x1b[K");
+  }
+  s.line_pos = len;
+  s.line_buf[len] = '\0';
+  s.cursor_back = 0;
+  CursorLeft(s, back);
+}
+
+/// @brief Delete @p n characters starting at column @p from, leaving the cursor there.
+inline void DeleteRange(Session& s, uint32_t from, uint32_t n) noexcept {
+  const uint32_t cur = s.line_pos - s.cursor_back;
+  if (cur > from) {
+    CursorLeft(s, cur - from);
+  }
+  std::memmove(s.line_buf + from, s.line_buf + from + n, s.line_pos - from - n);
+  s.line_pos -= n;
+  s.line_buf[s.line_pos] = '\0';
+  const uint32_t tail = s.line_pos - from;
+  SessionWriteN(s, s.line_buf + from, tail);
+  uint32_t cols = tail;
+  if (n < 4) {
+    SessionWriteN(s, "   ", n);
+    cols += n;
+  } else {
+    SessionWrite(s, "\x1b[K");
+  }
+  s.cursor_back = 0;
+  CursorMove(s, cols, 'D');
+  s.cursor_back = tail;
+}
+
+/// @brief Insert @p n bytes at the cursor, redrawing the text right of it.
+/// @return Bytes inserted (input past the line buffer is dropped).
+inline size_t InsertAtCursor(Session& s, const char* data, size_t n) noexcept {
+  const size_t room = EMBSH_LINE_BUF_SIZE - 1 - s.line_pos;
+  if (n > room)
+    n = room;
+  if (n == 0)
+    return 0;
+  const uint32_t cur = s.line_pos - s.cursor_back;
+  std::memmove(s.line_buf + cur + n, s.line_buf + cur, s.cursor_back);
+  std::memcpy(s.line_buf + cur, data, n);
+  s.line_pos += static_cast<uint32_t>(n);
+  SessionWriteN(s, s.line_buf + cur, n + s.cursor_back);
+  const uint32_t back = s.cursor_back;
+  s.cursor_back = 0;
+  CursorMove(s, back, 'D');
+  s.cursor_back = back;
+  return n;
+}
+
+/// @brief Replace the current line with new text (cursor at the end).
+inline void ReplaceLine(Session& s, const char* new_line) noexcept {
+  RedrawLine(s, new_line, static_cast<uint32_t>(std::strlen(new_line)), 0);
 }
 
-/// @brief Clear the current line on the terminal and replace with new text.
-inline void ReplaceLine(Session& s, const char* new_line) noexcept {
-  // Erase current line.
-  for (uint32_t i = 0; i < s.line_pos; ++i) {
-    SessionWrite(s, "\b \b");
-  }
-  uint32_t len = static_cast<uint32_t>(std::strlen(new_line));
-  if (len >= EMBSH_LINE_BUF_SIZE)
-    len = EMBSH_LINE_BUF_SIZE - 1;
-  std::memcpy(s.line_buf, new_line, len);
-  s.line_buf[len] = '\0';
-  s.line_pos = len;
-  SessionWriteN(s, s.line_buf, s.line_pos);
+/// @brief Replace the current line with history entry @p seq.
+inline void LoadHistory(Session& s, uint32_t seq) noexcept {
+  char entry[EMBSH_LINE_BUF_SIZE];
+  int32_t len = SessionHistory(s).Load(seq, entry, sizeof(entry));
+  RedrawLine(s, entry, (len > 0) ? static_cast<uint32_t>(len) : 0, 0);
 }
 
 /// @brief Navigate history up (older).
 inline void HistoryUp(Session& s) noexcept {
-  if (s.hist_count == 0)
+  const HistoryRing& hist = SessionHistory(s);
+  const uint32_t end = hist.End();
+  const uint32_t begin = hist.Begin();
+  if (begin == end)
     return;
-  if (!s.hist_browsing) {
-    s.hist_nav = s.hist_write;
+  if (!s.hist_browsing || s.hist_nav > end) {
+    s.hist_nav = end;
     s.hist_browsing = true;
   }
-  uint32_t prev = (s.hist_nav + EMBSH_HISTORY_SIZE - 1) % EMBSH_HISTORY_SIZE;
-  // Check if we've gone past the oldest entry.
-  uint32_t oldest = (s.hist_count < EMBSH_HISTORY_SIZE) ? 0 : s.hist_write;
-  if (prev == s.hist_nav)
-    return;  // Single entry case.
-  // Don't go past oldest.
-  uint32_t dist_from_write = (s.hist_write + EMBSH_HISTORY_SIZE - prev) % EMBSH_HISTORY_SIZE;
-  if (dist_from_write > s.hist_count)
-    return;
-
-  s.hist_nav = prev;
-  ReplaceLine(s, s.history[s.hist_nav]);
+  // Stop at the oldest retained entry.
+  if (s.hist_nav <= begin) {
+    if (s.hist_nav == begin)
+      return;
+    s.hist_nav = begin + 1;
+  }
+  --s.hist_nav;
+  LoadHistory(s, s.hist_nav);
 }
 
 /// @brief Navigate history down (newer).
 inline void HistoryDown(Session& s) noexcept {
   if (!s.hist_browsing)
     return;
-  uint32_t next = (s.hist_nav + 1) % EMBSH_HISTORY_SIZE;
-  if (next == s.hist_write) {
+  const uint32_t next = s.hist_nav + 1;
+  if (next >= SessionHistory(s).End()) {
     // Back to current (empty) line.
     s.hist_browsing = false;
-    for (uint32_t i = 0; i < s.line_pos; ++i) {
-      SessionWrite(s, "\b \b");
-    }
-    s.line_pos = 0;
-    s.line_buf[0] = '\0';
+    RedrawLine(s, "", 0, 0);
     return;
   }
   s.hist_nav = next;
-  ReplaceLine(s, s.history[s.hist_nav]);
+  LoadHistory(s, s.hist_nav);
 }
 
-/// @brief Handle tab completion.
+/// @brief Handle tab completion (only with the cursor at the end of the line).
 inline void TabComplete(Session& s, const char* prompt) noexcept {
+  if (s.cursor_back != 0)
+    return;
   s.line_buf[s.line_pos] = '\0';
+  const auto& reg = CommandRegistry::Instance();
+  const CommandRegistry::Match m = reg.MatchPrefix(s.line_buf, s.line_pos);
   char completion[64] = {};
-  uint32_t matches = CommandRegistry::Instance().AutoComplete(s.line_buf, completion, sizeof(completion));
+  uint32_t matches = m.count;
+  if (matches > 0) {
+    uint32_t n = (m.common < sizeof(completion) - 1) ? m.common : static_cast<uint32_t>(sizeof(completion) - 1);
+    std::memcpy(completion, m.first->name, n);
+  }
 
   if (matches == 1) {
     // Single match: replace line with completion + space.
-    for (uint32_t i = 0; i < s.line_pos; ++i) {
-      SessionWrite(s, "\b \b");
-    }
     uint32_t comp_len = static_cast<uint32_t>(std::strlen(completion));
-    if (comp_len >= EMBSH_LINE_BUF_SIZE - 2) {
-      comp_len = EMBSH_LINE_BUF_SIZE - 3;
-    }
-    std::memcpy(s.line_buf, completion, comp_len);
-    s.line_buf[comp_len] = ' ';
-    s.line_pos = comp_len + 1;
-    s.line_buf[s.line_pos] = '\0';
-    SessionWriteN(s, s.line_buf, s.line_pos);
+    completion[comp_len++] = ' ';
+    RedrawLine(s, completion, comp_len, 0);
   } else if (matches > 1) {
     // Show all matches.
     SessionWrite(s, "\r\n");
-    CommandRegistry::Instance().ForEach([&s](const CmdEntry& cmd) {
-      if (std::strncmp(cmd.name, s.line_buf, s.line_pos) == 0) {
-        SessionWrite(s, cmd.name);
-        SessionWrite(s, "  ");
-      }
+    reg.ForEachMatch(s.line_buf, s.line_pos, [&s](const CmdEntry& e) {
+      SessionWrite(s, e.name);
+      SessionWrite(s, "  ");
     });
     SessionWrite(s, "\r\n");
     SessionWrite(s, prompt);
@@ -258,6 +1170,107 @@ inline void TabComplete(Session& s, const char* prompt) noexcept {
   }
 }
 
+/// @brief Shown after the line while searching; the pattern follows it.
+constexpr const char kSearchTag[] = "  (i-search) ";
+
+/// @brief Start Ctrl+R search: the cursor goes to the end of the line, the tag after it.
+inline void StartSearch(Session& s) noexcept {
+  CursorRight(s, s.cursor_back);
+  s.searching = true;
+  s.search_len = 0;
+  s.search_seq = SessionHistory(s).End();
+  SessionWrite(s, kSearchTag);
+}
+
+/// @brief Erase the search tag and pattern and keep the matched line for editing.
+inline void EndSearch(Session& s) noexcept {
+  CursorMove(s, static_cast<uint32_t>(sizeof(kSearchTag) - 1) + s.search_len, 'D');
+  SessionWrite(s, "\x1b[K");
+  s.searching = false;
+  if (s.search_seq < SessionHistory(s).End()) {
+    // Up/Down continue from the match.
+    s.hist_browsing = true;
+    s.hist_nav = s.search_seq;
+  }
+}
+
+/**
+ * @brief Search entries older than @p before for the pattern and show the match.
+ *
+ * Only the part of the line that differs from the previous match is
+ * redrawn (RedrawLine()); the tag and full pattern are then re-sent after it.
+ *
+ * @param shown Pattern characters currently on screen.
+ * @return -1 if nothing matched (screen unchanged), 0 if the line text is
+ *         unchanged (the caller updates the pattern), 1 if redrawn.
+ */
+inline int SearchHistory(Session& s, uint32_t before, uint32_t shown) noexcept {
+  uint32_t seq = 0;
+  if (!SessionHistory(s).Find(s.search_buf, s.search_len, before, seq))
+    return -1;
+  s.search_seq = seq;
+  char entry[EMBSH_LINE_BUF_SIZE];
+  int32_t len = SessionHistory(s).Load(seq, entry, sizeof(entry));
+  if (len < 0 || (static_cast<uint32_t>(len) == s.line_pos && std::memcmp(entry, s.line_buf, s.line_pos) == 0))
+    return 0;  // Same text (or evicted meanwhile by another session).
+  CursorMove(s, static_cast<uint32_t>(sizeof(kSearchTag) - 1) + shown, 'D');
+  RedrawLine(s, entry, static_cast<uint32_t>(len), 0);
+  SessionWrite(s, kSearchTag);
+  SessionWriteN(s, s.search_buf, s.search_len);
+  return 1;
+}
+
+/**
+ * @brief Handle one byte while searching.
+ *
+ * Printable bytes extend the pattern, Ctrl+R finds the next older match,
+ * Backspace shortens the pattern and Ctrl+G leaves the search. Any other
+ * byte ends the search and is then processed normally, so Enter runs the
+ * match and arrows start editing it. A failed search rings the bell.
+ *
+ * @return true if the byte was consumed.
+ */
+inline bool SearchByte(Session& s, uint8_t byte) noexcept {
+  const uint32_t end = SessionHistory(s).End();
+  if (byte >= 0x20 && byte < 0x7F) {
+    if (s.search_len >= EMBSH_SEARCH_MAX) {
+      SessionWrite(s, "\a");
+      return true;
+    }
+    s.search_buf[s.search_len++] = static_cast<char>(byte);
+    // The current match stays if it still contains the longer pattern.
+    const int r = SearchHistory(s, (s.search_seq < end) ? s.search_seq + 1 : end, s.search_len - 1);
+    if (r < 0) {
+      --s.search_len;
+      SessionWrite(s, "\a");
+    } else if (r == 0) {
+      SessionWriteN(s, &s.search_buf[s.search_len - 1], 1);
+    }
+    return true;
+  }
+  switch (byte) {
+    case 0x12:  // Ctrl+R: next older match.
+      if (s.search_len == 0 || SearchHistory(s, s.search_seq, s.search_len) < 0)
+        SessionWrite(s, "\a");
+      return true;
+    case 0x7F:
+    case 0x08:
+      if (s.search_len > 0) {
+        --s.search_len;
+        SessionWrite(s, "\b \b");
+        if (s.search_len == 0)
+          s.search_seq = end;  // A new pattern searches from the newest entry again.
+      }
+      return true;
+    case 0x07:  // Ctrl+G
+      EndSearch(s);
+      return true;
+    default:
+      EndSearch(s);
+      return false;
+  }
+}
+
 /// @brief Filter IAC telnet protocol bytes.
 /// @return The printable character, or '\0' if the byte was consumed.
 inline char FilterIac(Session& s, uint8_t byte) noexcept {
@@ -272,6 +1285,7 @@ inline char FilterIac(Session& s, uint8_t byte) noexcept {
     case Session::IacState::kIac:
       if (byte >= 0xFB && byte <= 0xFE) {  // WILL/WONT/DO/DONT
         s.iac_state = Session::IacState::kNego;
+        s.iac_verb = byte;
         return '\0';
       }
       if (byte == 0xFA) {  // SB
@@ -283,7 +1297,15 @@ inline char FilterIac(Session& s, uint8_t byte) noexcept {
       return (byte == 0xFF) ? static_cast<char>(0xFF) : '\0';
 
     case Session::IacState::kNego:
-      // Option byte after WILL/WONT/DO/DONT: ignore and return to normal.
+      // Option byte after WILL/WONT/DO/DONT. Only the reply to our BINARY
+      // offer is tracked; everything else is ignored.
+      if (byte == 0x00) {  // BINARY
+        if (s.iac_verb == 0xFD) {
+          s.telnet_binary = true;
+        } else if (s.iac_verb == 0xFE) {
+          s.telnet_binary = false;
+        }
+      }
       s.iac_state = Session::IacState::kNormal;
       return '\0';
 
@@ -298,6 +1320,113 @@ inline char FilterIac(Session& s, uint8_t byte) noexcept {
   return '\0';
 }
 
+/**
+ * @brief Act on the final byte of an escape sequence.
+ * @param param Numeric CSI parameter (0 if none); for '~' it selects the key.
+ */
+inline void EscapeKey(Session& s, char final, uint16_t param) noexcept {
+  switch (final) {
+    case 'A':  // Up arrow
+      HistoryUp(s);
+      return;
+    case 'B':  // Down arrow
+      HistoryDown(s);
+      return;
+    case 'C':  // Right arrow
+      if (s.cursor_back > 0)
+        CursorRight(s, 1);
+      return;
+    case 'D':  // Left arrow
+      if (s.cursor_back < s.line_pos)
+        CursorLeft(s, 1);
+      return;
+    case 'H':  // Home
+      CursorLeft(s, s.line_pos - s.cursor_back);
+      return;
+    case 'F':  // End
+      CursorRight(s, s.cursor_back);
+      return;
+    case '~':
+      switch (param) {
+        case 1:
+        case 7:
+          EscapeKey(s, 'H', 0);
+          return;
+        case 4:
+        case 8:
+          EscapeKey(s, 'F', 0);
+          return;
+        case 3:  // Delete
+          if (s.cursor_back > 0)
+            DeleteRange(s, s.line_pos - s.cursor_back, 1);
+          return;
+        case 200:  // Bracketed paste start / end.
+          s.pasting = true;
+          return;
+        case 201:
+          s.pasting = false;
+          return;
+        default:
+          return;
+      }
+    default:
+      return;
+  }
+}
+
+/**
+ * @brief Emacs-style editing keys: Ctrl+A/E (home/end), Ctrl+B/F (left/right),
+ *        Ctrl+K (kill to end), Ctrl+U (kill to start), Ctrl+W (kill word),
+ *        Ctrl+R (reverse history search).
+ * @return true if @p byte was one of them.
+ */
+inline bool EditKey(Session& s, uint8_t byte) noexcept {
+  const uint32_t cur = s.line_pos - s.cursor_back;
+  switch (byte) {
+    case 0x01:
+      EscapeKey(s, 'H', 0);
+      return true;
+    case 0x05:
+      EscapeKey(s, 'F', 0);
+      return true;
+    case 0x02:
+      EscapeKey(s, 'D', 0);
+      return true;
+    case 0x06:
+      EscapeKey(s, 'C', 0);
+      return true;
+    case 0x0B:
+      if (s.cursor_back > 0) {
+        SessionWrite(s, "\x1b[K");
+        s.line_pos = cur;
+        s.line_buf[cur] = '\0';
+        s.cursor_back = 0;
+      }
+      return true;
+    case 0x12:
+      StartSearch(s);
+      return true;
+    case 0x15:
+      if (cur > 0)
+        DeleteRange(s, 0, cur);
+      return true;
+    case 0x17: {
+      uint32_t from = cur;
+      while (from > 0 && s.line_buf[from - 1] == ' ') {
+        --from;
+      }
+      while (from > 0 && s.line_buf[from - 1] != ' ') {
+        --from;
+      }
+      if (from < cur)
+        DeleteRange(s, from, cur - from);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
 /// @brief Process one input byte in a session.
 /// @return true if a complete line is ready for execution.
 inline bool ProcessByte(Session& s, uint8_t byte, const char* prompt) noexcept {
@@ -311,6 +1440,13 @@ inline bool ProcessByte(Session& s, uint8_t byte, const char* prompt) noexcept {
 
   char ch = static_cast<char>(byte);
 
+  // CR/LF FSM: "\r\n" and telnet "\r\0" end a line once.
+  if (s.skip_lf) {
+    s.skip_lf = false;
+    if (ch == '\n' || ch == '\0')
+      return false;
+  }
+
   // ESC sequence FSM.
   switch (s.esc_state) {
     case Session::EscState::kEsc:
@@ -318,64 +1454,95 @@ inline bool ProcessByte(Session& s, uint8_t byte, const char* prompt) noexcept {
         s.esc_state = Session::EscState::kBracket;
         return false;
       }
+      if (ch == 'O') {  // SS3: keypad / application cursor keys.
+        s.esc_state = Session::EscState::kSs3;
+        return false;
+      }
       s.esc_state = Session::EscState::kNone;
       return false;  // Unknown ESC sequence, ignore.
 
-    case Session::EscState::kBracket:
+    case Session::EscState::kSs3:
       s.esc_state = Session::EscState::kNone;
-      switch (ch) {
-        case 'A':
-          HistoryUp(s);
-          return false;  // Up arrow
-        case 'B':
-          HistoryDown(s);
-          return false;  // Down arrow
-        case 'C':
-          return false;  // Right arrow (TODO: cursor move)
-        case 'D':
-          return false;  // Left arrow (TODO: cursor move)
-        default:
-          return false;
+      EscapeKey(s, ch, 0);
+      return false;
+
+    case Session::EscState::kBracket:
+      // CSI parameters: digits, ';' starts the next one (only the last is kept).
+      if (ch >= '0' && ch <= '9') {
+        if (s.esc_param < 1000)
+          s.esc_param = static_cast<uint16_t>(s.esc_param * 10 + (ch - '0'));
+        return false;
+      }
+      if (ch == ';') {
+        s.esc_param = 0;
+        return false;
       }
+      s.esc_state = Session::EscState::kNone;
+      EscapeKey(s, ch, s.esc_param);
+      s.esc_param = 0;
+      return false;
 
     case Session::EscState::kNone:
       break;
   }
 
+  if (s.searching && SearchByte(s, byte))
+    return false;
+
   // ESC starts escape sequence.
   if (byte == 0x1B) {
     s.esc_state = Session::EscState::kEsc;
+    s.esc_param = 0;
     return false;
   }
 
+  // Pasted text is data: Tab is a space, other control bytes (Ctrl+D, ^H)
+  // are dropped. Ctrl+C still cancels, and ends a paste whose end marker was lost.
+  if (s.pasting) {
+    if (byte == '\t') {
+      byte = ' ';
+      ch = ' ';
+    } else if (byte == 0x03) {
+      s.pasting = false;
+    } else if (byte < 0x20 && ch != '\r' && ch != '\n') {
+      return false;
+    }
+  }
+
   // Ctrl+C: cancel current line.
   if (byte == 0x03) {
     SessionWrite(s, "^C\r\n");
     s.line_pos = 0;
+    s.cursor_back = 0;
     s.line_buf[0] = '\0';
     s.hist_browsing = false;
     SessionWrite(s, prompt);
     return false;
   }
 
-  // Ctrl+D: EOF.
+  // Ctrl+D: EOF on an empty line, else delete the character under the cursor.
   if (byte == 0x04) {
     if (s.line_pos == 0) {
       SessionWrite(s, "\r\nBye.\r\n");
       s.active.store(false, std::memory_order_release);
+    } else {
+      EscapeKey(s, '~', 3);
     }
     return false;
   }
 
   // Backspace.
   if (byte == 0x7F || byte == 0x08) {
-    if (s.line_pos > 0) {
-      --s.line_pos;
-      SessionWrite(s, "\b \b");
+    const uint32_t cur = s.line_pos - s.cursor_back;
+    if (cur > 0) {
+      DeleteRange(s, cur - 1, 1);
     }
     return false;
   }
 
+  if (EditKey(s, byte))
+    return false;
+
   // Tab: auto-complete.
   if (byte == '\t') {
     TabComplete(s, prompt);
@@ -385,15 +1552,8 @@ inline bool ProcessByte(Session& s, uint8_t byte, const char* prompt) noexcept {
   // Enter: execute line.
   if (ch == '\r' || ch == '\n') {
     SessionWrite(s, "\r\n");
-
-    // Telnet \r\n: peek-and-consume trailing byte.
-    if (s.telnet_mode && ch == '\r') {
-      char next;
-      ssize_t peek = ::recv(s.read_fd, &next, 1, MSG_PEEK);
-      if (peek == 1 && (next == '\n' || next == '\0')) {
-        (void)::recv(s.read_fd, &next, 1, 0);
-      }
-    }
+    s.cursor_back = 0;
+    s.skip_lf = (ch == '\r');
 
     s.line_buf[s.line_pos] = '\0';
     s.hist_browsing = false;
@@ -408,57 +1568,557 @@ inline bool ProcessByte(Session& s, uint8_t byte, const char* prompt) noexcept {
   }
 
   // Regular printable character.
-  if (s.line_pos < EMBSH_LINE_BUF_SIZE - 1 && byte >= 0x20 && byte < 0x7F) {
-    s.line_buf[s.line_pos++] = ch;
-    SessionWriteN(s, &ch, 1);
+  if (byte >= 0x20 && byte < 0x7F) {
+    if (s.cursor_back != 0) {
+      (void)InsertAtCursor(s, &ch, 1);
+    } else if (s.line_pos < EMBSH_LINE_BUF_SIZE - 1) {
+      s.line_buf[s.line_pos++] = ch;
+      SessionWriteN(s, &ch, 1);
+    }
   }
 
   return false;
 }
 
-/// @brief Execute the current line buffer of a session.
-inline void ExecuteLine(Session& s) noexcept {
-  char cmd_copy[EMBSH_LINE_BUF_SIZE];
-  std::memcpy(cmd_copy, s.line_buf, s.line_pos + 1);
+/// @brief SessionOutput::write adapter routing ShellPrintf into a session.
+inline void WriteToSession(const char* data, size_t len, void* ctx) noexcept {
+  SessionWriteN(*static_cast<Session*>(ctx), data, len);
+}
+
+/// @brief Route ShellPrintf / ShellWrite on this thread into @p s's tx_buf.
+inline void BindOutput(Session& s, const std::atomic<bool>* cancel) noexcept {
+  auto& out = detail::CurrentOutput();
+  out.write = WriteToSession;
+  out.ctx = &s;
+  out.buf = detail::CanWrite(s) ? s.tx_buf : nullptr;
+  out.len = &s.tx_len;
+  out.cap = sizeof(s.tx_buf);
+  out.bulk = [](const void* data, size_t len, void* ctx) noexcept {
+    return SessionWriteBinary(*static_cast<Session*>(ctx), data, len);
+  };
+  out.send_fd = [](int fd, off_t* offset, size_t count, void* ctx) noexcept {
+    return SessionSendFd(*static_cast<Session*>(ctx), fd, offset, count);
+  };
+  out.cancel = cancel;
+}
+
+/// @brief Call @p cmd through CommandRegistry::Invoke() (timed when EMBSH_ENABLE_STATS is set).
+inline int InvokeCommand(const CmdEntry* cmd, int argc, char* argv[]) noexcept {
+  return CommandRegistry::Instance().Invoke(cmd, argc, argv);
+}
+
+/**
+ * @brief WorkerPool job: run the session's pending async command.
+ *
+ * Owns the session's line and output state until it clears busy; then
+ * re-prints the prompt and signals the backend so parked input resumes.
+ */
+inline void RunAsyncCommand(void* arg) noexcept {
+  auto& s = *static_cast<Session*>(arg);
+  BindOutput(s, &s.cancel);
+  (void)InvokeCommand(s.job_cmd, s.job_argc, s.job_argv);
+  detail::CurrentOutput() = detail::SessionOutput{};
+  if (s.budget != nullptr) {
+    s.budget->ReleaseSlot();  // Reserved by ProcessBytes() for this line.
+  }
+  if (s.cancel.load(std::memory_order_acquire)) {
+    SessionWrite(s, "^C\r\n");
+  }
+  s.line_pos = 0;
+  s.cursor_back = 0;
+  s.line_buf[0] = '\0';
+  if (s.job_prompt != nullptr && s.active.load(std::memory_order_acquire)) {
+    SessionWrite(s, s.job_prompt);
+  }
+  SessionFlush(s);
+
+  // Clear busy before signalling so the woken loop sees parked input as
+  // resumable; job_live keeps teardown (WaitIdle) off notify until here.
+  WakeEvent* notify = s.notify;
+  s.busy.store(false, std::memory_order_release);
+  if (notify != nullptr) {
+    notify->Signal();
+  }
+  s.job_live.store(false, std::memory_order_release);
+}
+
+/**
+ * @brief Hand a kCmdAsync command to the WorkerPool.
+ * @return true if queued; the session is busy until the job finishes.
+ */
+inline bool DispatchAsync(Session& s, const CmdEntry* cmd, int argc, char* argv[], const char* prompt) noexcept {
+  s.job_cmd = cmd;
+  s.job_argc = argc;
+  std::memcpy(s.job_argv, argv, sizeof(s.job_argv));
+  s.job_prompt = prompt;
+  s.cancel.store(false, std::memory_order_relaxed);
+  SessionFlush(s);  // Echo goes out before the job starts writing.
+  s.job_live.store(true, std::memory_order_relaxed);
+  s.busy.store(true, std::memory_order_release);
+  if (!WorkerPool::Instance().Submit(RunAsyncCommand, &s)) {
+    s.busy.store(false, std::memory_order_relaxed);
+    s.job_live.store(false, std::memory_order_relaxed);
+    SessionWrite(s, "busy: worker queue full\r\n");
+    return false;
+  }
+  return true;
+}
 
+/**
+ * @brief Execute the current line buffer of a session.
+ *
+ * kCmdAsync commands are queued on the WorkerPool; @p prompt is then
+ * printed by the worker when the command finishes. A pipeline (see
+ * RunPipeline()) goes to the pool as a whole if any of its commands is
+ * kCmdAsync.
+ *
+ * @return true if the command was dispatched asynchronously. The session
+ *         is busy and the caller must not touch its line or output state.
+ */
+inline bool ExecuteLine(Session& s, const char* prompt = nullptr) noexcept {
+  // History already holds its own copy, so tokenize line_buf in place; the
+  // caller resets it afterwards.
   char* argv[EMBSH_MAX_ARGS] = {};
-  int argc = ShellSplit(cmd_copy, s.line_pos, argv);
+  int argc = ShellSplit(s.line_buf, s.line_pos, argv);
 
-  if (argc <= 0)
-    return;
+  if (argc < 0) {
+    SessionWrite(s, "too many arguments\r\n");
+    return false;
+  }
+  if (argc == 0)
+    return false;
+#if EMBSH_ENABLE_STATS
+  detail::StatsAdd(s.stats.lines);
+#endif
 
   // Built-in: exit / quit.
   if (std::strcmp(argv[0], "exit") == 0 || std::strcmp(argv[0], "quit") == 0) {
     SessionWrite(s, "Bye.\r\n");
     s.active.store(false, std::memory_order_release);
-    return;
+    return false;
+  }
+
+  if (detail::HasShellOperator(argc, argv)) {
+    if (detail::PipelineIsAsync(argc, argv)) {
+      return DispatchAsync(s, detail::PipelineEntry(), argc, argv, prompt);
+    }
+    BindOutput(s, nullptr);
+    (void)RunPipeline(argc, argv);
+    detail::CurrentOutput() = detail::SessionOutput{};
+    return false;
   }
 
   const CmdEntry* cmd = CommandRegistry::Instance().Find(argv[0]);
-  if (cmd != nullptr) {
-    // Set up session output for ShellPrintf routing.
-    auto write_adapter = [](const char* str, void* ctx) {
-      auto* sess = static_cast<Session*>(ctx);
-      SessionWrite(*sess, str);
-    };
-    detail::CurrentOutput().write = write_adapter;
-    detail::CurrentOutput().ctx = &s;
-
-    cmd->fn(argc, argv, cmd->ctx);
-
-    detail::CurrentOutput().write = nullptr;
-    detail::CurrentOutput().ctx = nullptr;
-  } else {
+  if (cmd == nullptr) {
     char msg[160];
     int n = std::snprintf(msg, sizeof(msg), "unknown command: %s\r\n", argv[0]);
     if (n > 0) {
       SessionWriteN(s, msg, static_cast<size_t>(n));
     }
+    return false;
+  }
+  if ((cmd->flags & kCmdAsync) != 0) {
+    return DispatchAsync(s, cmd, argc, argv, prompt);
+  }
+
+  BindOutput(s, nullptr);
+  (void)InvokeCommand(cmd, argc, argv);
+  detail::CurrentOutput() = detail::SessionOutput{};
+  return false;
+}
+
+/// @brief Editor input classes; only kInputPrintable bytes may skip ProcessByte().
+enum InputClass : uint8_t {
+  kInputPrintable = 0,  ///< 0x20..0x7E
+  kInputControl = 1,    ///< 0x00..0x1F, 0x7F (ESC, CR, Ctrl keys, backspace)
+  kInputHigh = 2,       ///< 0x80..0xFE
+  kInputIac = 3,        ///< 0xFF (telnet IAC)
+};
+
+struct InputClassTable {
+  uint8_t cls[256];
+};
+
+inline constexpr InputClassTable MakeInputClassTable() noexcept {
+  InputClassTable t = {};
+  for (int b = 0; b < 0x80; ++b) {
+    t.cls[b] = (b >= 0x20 && b < 0x7F) ? kInputPrintable : kInputControl;
+  }
+  for (int b = 0x80; b < 0xFF; ++b) {
+    t.cls[b] = kInputHigh;
+  }
+  t.cls[0xFF] = kInputIac;
+  return t;
+}
+
+inline constexpr InputClassTable kInputClass = MakeInputClassTable();
+
+/**
+ * @brief Length of the printable (0x20..0x7E) run at @p data.
+ *
+ * 16 bytes per step with SSE2 or AArch64 NEON, then one table lookup per
+ * byte for the tail (or everything, on other targets).
+ */
+inline size_t PrintableRun(const uint8_t* data, size_t len) noexcept {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i below = _mm_set1_epi8(0x1F);
+  const __m128i del = _mm_set1_epi8(0x7F);
+  for (; i + 16 <= len; i += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    // Signed compare: 0x80..0xFF are negative, so only 0x20..0x7F pass; then drop DEL.
+    const __m128i ok = _mm_andnot_si128(_mm_cmpeq_epi8(v, del), _mm_cmpgt_epi8(v, below));
+    const unsigned stop = static_cast<unsigned>(_mm_movemask_epi8(ok)) ^ 0xFFFFU;
+    if (stop != 0)
+      return i + static_cast<size_t>(__builtin_ctz(stop));
+  }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+  for (; i + 16 <= len; i += 16) {
+    // Unsigned v - 0x20 >= 0x5F exactly for bytes outside 0x20..0x7E.
+    const uint8x16_t v = vld1q_u8(data + i);
+    if (vmaxvq_u8(vcgeq_u8(vsubq_u8(v, vdupq_n_u8(0x20)), vdupq_n_u8(0x5F))) != 0)
+      break;  // The scalar loop finds it within these 16 bytes.
+  }
+#endif
+  while (i < len && kInputClass.cls[data[i]] == kInputPrintable) {
+    ++i;
+  }
+  return i;
+}
+
+/**
+ * @brief Insert a run of printable bytes at the cursor with one echo.
+ *
+ * Same line contents as ProcessByte() on each byte of the run while no
+ * escape or IAC sequence is pending; bytes past the line buffer are dropped
+ * the same way. Mid-line, the text right of the cursor is redrawn once per
+ * run instead of once per byte.
+ *
+ * @return Length of the printable run at @p data (all of it is consumed).
+ */
+inline size_t AppendPrintable(Session& s, const uint8_t* data, size_t len) noexcept {
+  const size_t run = PrintableRun(data, len);
+  s.skip_lf = false;
+  (void)InsertAtCursor(s, reinterpret_cast<const char*>(data), run);
+  return run;
+}
+
+/**
+ * @brief Run the editor FSM over a block of input.
+ *
+ * Complete lines are executed as they are found and the prompt is
+ * re-printed after each one. Stops early if a command or Ctrl+D ends
+ * the session, or after dispatching an async command (the rest of the
+ * block stays in the caller's buffer until ResumeInput()). Output is flushed after every prompt and once at the end
+ * of the block, so echo for a whole read costs a single write.
+ *
+ * With a SessionBudget, processing stops where the byte or command
+ * tokens (or the execution slots) run out; the rest is left to the caller
+ * like parked input, and SessionBudget::resume_ns says when to retry.
+ *
+ * Printable runs bypass the per-byte FSM (AppendPrintable()): the next
+ * control, high or IAC byte is found 16 bytes at a time (PrintableRun()),
+ * so a pasted block costs one scan, one copy and one echo append per line.
+ *
+ * @return Number of bytes consumed from @p data.
+ */
+inline size_t ProcessBytes(Session& s, const uint8_t* data, size_t len, const char* prompt) noexcept {
+  if (s.busy.load(std::memory_order_acquire))
+    return 0;  // Parked until the async command finishes.
+  SessionBudget* const b = s.budget;
+  uint64_t now = 0;
+  size_t end = len;
+  if (b != nullptr) {
+    now = detail::MonotonicNs();
+    b->resume_ns = 0;
+    end = b->AllowBytes(len, now);
+  }
+  bool hold_line = false;
+  bool dispatched = false;
+  size_t i = 0;
+  while (i < end && s.active.load(std::memory_order_acquire)) {
+    if (kInputClass.cls[data[i]] == kInputPrintable && s.esc_state == Session::EscState::kNone &&
+        s.iac_state == Session::IacState::kNormal && !s.searching) {
+      i += AppendPrintable(s, data + i, end - i);
+      continue;
+    }
+    // A line may end here: it needs a command token and an execution slot first.
+    const bool eol = (b != nullptr) && (data[i] == '\r' || (data[i] == '\n' && !s.skip_lf));
+    if (eol && !b->AcquireLine(now)) {
+      hold_line = true;
+      break;
+    }
+    if (ProcessByte(s, data[i++], prompt)) {
+      if (b != nullptr)
+        b->TakeLine(now);
+      if (ExecuteLine(s, prompt)) {
+        dispatched = true;  // The worker now owns line/tx state, the slot, and prints the prompt.
+        break;
+      }
+      s.line_pos = 0;
+      s.cursor_back = 0;
+      s.line_buf[0] = '\0';
+      if (s.active.load(std::memory_order_acquire)) {
+        SessionWrite(s, prompt);
+      }
+      SessionFlush(s);
+      if (b != nullptr)
+        now = detail::MonotonicNs();
+    }
+    if (eol)
+      b->ReleaseSlot();
+  }
+  if (b != nullptr) {
+    b->TakeBytes(i, now);
+    if (!dispatched && i < len && s.active.load(std::memory_order_acquire)) {
+      b->Hold(hold_line, now);
+    }
+  }
+  if (!dispatched)
+    SessionFlush(s);
+  return i;
+}
+
+/**
+ * @brief Block until @p fd has input or @p wake_fd / @p notify_fd is signalled.
+ *
+ * Waits without a timeout; callers re-check their running flags when woken.
+ * Negative fds are ignored by poll().
+ *
+ * @return 1 if @p fd is readable (or hung up), 0 if woken, -1 on error
+ *         (errno set, including EINTR).
+ */
+inline int WaitInput(int fd, int wake_fd, int notify_fd = -1) noexcept {
+  struct pollfd pfd[3] = {{fd, POLLIN, 0}, {wake_fd, POLLIN, 0}, {notify_fd, POLLIN, 0}};
+  int pr = ::poll(pfd, 3, -1);
+  if (pr < 0)
+    return -1;
+  if (pfd[0].revents != 0)
+    return 1;
+  return 0;
+}
+
+/**
+ * @brief Milliseconds until input held back by the session's budget may be retried.
+ * @return -1 if nothing is held (or an async command owns the session), else >= 0.
+ */
+inline int HeldInputMs(const Session& s) noexcept {
+  if (s.budget == nullptr || s.budget->resume_ns == 0 || s.busy.load(std::memory_order_acquire))
+    return -1;
+  const uint64_t now = detail::MonotonicNs();
+  if (s.budget->resume_ns <= now)
+    return 0;
+  return static_cast<int>((s.budget->resume_ns - now + 999999U) / 1000000U);
+}
+
+/**
+ * @brief WaitInput() on a session's read_fd that also drains its output queue.
+ *
+ * While output is queued and no async command owns it, the wait includes
+ * POLLOUT on write_fd and a writable transport is drained here. While the
+ * budget holds input back, read_fd is left out and the wait times out when
+ * it may be retried (returning 0, as when woken).
+ *
+ * @return As WaitInput(); -1 with errno EPIPE if draining failed.
+ */
+inline int WaitSession(Session& s, int wake_fd, int notify_fd = -1) noexcept {
+  const bool want_out = !s.busy.load(std::memory_order_acquire) && s.txq_len > 0;
+  const int held_ms = HeldInputMs(s);
+  struct pollfd pfd[4] = {{held_ms < 0 ? s.read_fd : -1, POLLIN, 0},
+                          {wake_fd, POLLIN, 0},
+                          {notify_fd, POLLIN, 0},
+                          {want_out ? s.write_fd : -1, POLLOUT, 0}};
+  int pr = ::poll(pfd, 4, held_ms);
+  if (pr < 0)
+    return -1;
+  if (pfd[3].revents != 0 && !detail::DrainTxQueue(s)) {
+    errno = EPIPE;
+    return -1;
+  }
+  return (pfd[0].revents != 0) ? 1 : 0;
+}
+
+/**
+ * @brief Read input that arrives while an async command is running.
+ *
+ * Bytes are kept in rx_buf for ResumeInput(); once it is full, further
+ * bytes are dropped. Ctrl+C is consumed and requests cancellation.
+ *
+ * @return Same as FillInput().
+ */
+inline ssize_t ParkInput(Session& s) noexcept {
+  if (s.rx_pos > 0) {
+    std::memmove(s.rx_buf, s.rx_buf + s.rx_pos, s.rx_len - s.rx_pos);
+    s.rx_len -= s.rx_pos;
+    s.rx_pos = 0;
+  }
+  uint8_t scratch[32];
+  uint8_t* dst = s.rx_buf + s.rx_len;
+  size_t room = sizeof(s.rx_buf) - s.rx_len;
+  if (room == 0) {
+    dst = scratch;
+    room = sizeof(scratch);
+  }
+  ssize_t n = detail::TransportRead(s, dst, room);
+  detail::CountRead(s, n);
+  if (n <= 0)
+    return n;
+  size_t kept = 0;
+  for (ssize_t i = 0; i < n; ++i) {
+    if (dst[i] == 0x03) {
+      s.cancel.store(true, std::memory_order_release);
+    } else {
+      dst[kept++] = dst[i];
+    }
+  }
+  if (dst != scratch) {
+    s.rx_len += static_cast<uint32_t>(kept);
+  }
+  return n;
+}
+
+/**
+ * @brief Make input available in the session read buffer.
+ *
+ * Returns immediately if unconsumed bytes remain; otherwise performs one
+ * transport read for up to EMBSH_RX_BUF_SIZE bytes. While the session is
+ * busy, input is parked instead (see ParkInput()).
+ *
+ * @return Bytes available (> 0), 0 on EOF, or -1 on error (errno set).
+ */
+inline ssize_t FillInput(Session& s) noexcept {
+  if (s.busy.load(std::memory_order_acquire))
+    return ParkInput(s);
+  if (s.rx_pos < s.rx_len)
+    return static_cast<ssize_t>(s.rx_len - s.rx_pos);
+  s.rx_pos = 0;
+  s.rx_len = 0;
+  ssize_t n = detail::TransportRead(s, s.rx_buf, sizeof(s.rx_buf));
+  detail::CountRead(s, n);
+  if (n > 0)
+    s.rx_len = static_cast<uint32_t>(n);
+  return n;
+}
+
+/**
+ * @brief Read whatever input is available and feed it to the editor.
+ *
+ * A transport with borrow() is edited in place, without the copy into
+ * rx_buf; bytes left when an async command starts stay in the transport
+ * and are parked by the next read.
+ *
+ * @return Same as FillInput().
+ */
+inline ssize_t ReadInput(Session& s, const char* prompt) noexcept {
+  const Transport* t = s.transport;
+  if (t != nullptr && t->borrow != nullptr && s.rx_pos >= s.rx_len && !s.busy.load(std::memory_order_acquire)) {
+    const uint8_t* data = nullptr;
+    ssize_t n = t->borrow(s.transport_ctx, &data);
+    detail::CountRead(s, n);
+    if (n > 0) {
+      t->release(s.transport_ctx, ProcessBytes(s, data, static_cast<size_t>(n), prompt));
+    }
+    return n;
+  }
+  ssize_t n = FillInput(s);
+  if (n > 0) {
+    s.rx_pos += static_cast<uint32_t>(ProcessBytes(s, s.rx_buf + s.rx_pos, s.rx_len - s.rx_pos, prompt));
+  }
+  return n;
+}
+
+/**
+ * @brief Feed input parked while an async command was running.
+ *
+ * Call after the session's notify event fires; a no-op while still busy.
+ */
+inline void ResumeInput(Session& s, const char* prompt) noexcept {
+  if (s.busy.load(std::memory_order_acquire) || s.rx_pos >= s.rx_len)
+    return;
+  s.rx_pos += static_cast<uint32_t>(ProcessBytes(s, s.rx_buf + s.rx_pos, s.rx_len - s.rx_pos, prompt));
+}
+
+/**
+ * @brief Cancel and wait out a running async command before teardown.
+ *
+ * The command sees ShellCancelled(); it must return for this to finish.
+ */
+inline void WaitIdle(Session& s) noexcept {
+  if (!s.job_live.load(std::memory_order_acquire))
+    return;
+  s.cancel.store(true, std::memory_order_release);
+  while (s.job_live.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
   }
 }
 
 }  // namespace editor
 
+#if EMBSH_ENABLE_STATS
+
+// ============================================================================
+// Built-in stats command
+// ============================================================================
+
+namespace detail {
+
+inline unsigned long long StatsLoad(const std::atomic<uint64_t>& counter) noexcept {
+  return static_cast<unsigned long long>(counter.load(std::memory_order_relaxed));
+}
+
+/// @brief Print per-command latency, current session I/O and telnet counters.
+inline int StatsCommand(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  auto& reg = CommandRegistry::Instance();
+  ShellPrintf("%-16s %10s %12s %10s %10s\r\n", "command", "calls", "total_us", "avg_us", "max_us");
+  reg.ForEach([&reg](const CmdEntry& cmd) {
+    const CmdStats* st = reg.StatsFor(&cmd);
+    const unsigned long long calls = (st != nullptr) ? StatsLoad(st->calls) : 0;
+    if (calls == 0)
+      return;
+    const unsigned long long total_us = StatsLoad(st->total_ns) / 1000U;
+    ShellPrintf("%-16s %10llu %12llu %10llu %10llu\r\n", cmd.name, calls, total_us, total_us / calls,
+                StatsLoad(st->max_ns) / 1000U);
+    ShellWrite(std::string_view("  hist"));
+    for (uint32_t b = 0; b < kStatsBuckets; ++b) {
+      const uint32_t n = st->hist[b].load(std::memory_order_relaxed);
+      if (n == 0)
+        continue;
+      const uint64_t limit = CmdStats::BucketLimitUs(b);
+      ShellWrite(std::string_view(limit != 0 ? " <" : " >="));
+      ShellWriteUint(limit != 0 ? limit : CmdStats::BucketLimitUs(b - 1));
+      ShellWrite(std::string_view("us:"));
+      ShellWriteUint(n);
+    }
+    ShellWrite(std::string_view("\r\n"));
+  });
+
+  auto& out = CurrentOutput();
+  if (out.write == editor::WriteToSession) {
+    const auto& st = static_cast<const Session*>(out.ctx)->stats;
+    ShellPrintf("session: in=%llu out=%llu reads=%llu writes=%llu lines=%llu dropped=%llu\r\n", StatsLoad(st.bytes_in),
+                StatsLoad(st.bytes_out), StatsLoad(st.read_calls), StatsLoad(st.write_calls), StatsLoad(st.lines),
+                StatsLoad(st.tx_dropped));
+  }
+  const auto& ts = TelnetStats();
+  ShellPrintf("telnet: accepts=%llu rejects=%llu auth_failures=%llu\r\n", StatsLoad(ts.accepts),
+              StatsLoad(ts.rejects), StatsLoad(ts.auth_failures));
+  return 0;
+}
+
+inline bool RegisterStatsOnce() noexcept {
+  static const bool done = []() {
+    CommandRegistry::Instance().Register("stats", StatsCommand, "Show command latency and I/O counters");
+    return true;
+  }();
+  return done;
+}
+
+static const bool kStatsRegistered EMBSH_UNUSED = RegisterStatsOnce();
+
+}  // namespace detail
+
+#endif  // EMBSH_ENABLE_STATS
+
 }  // namespace embsh
 
 #endif  // EMBSH_LINE_EDITOR_HPP_
@@ -0,0 +1,382 @@
+/**
+ * @file multiplexer.hpp
+ * @brief One epoll thread driving any number of fd-backed sessions.
+ */
+
+#ifndef EMBSH_MULTIPLEXER_HPP_
+#define EMBSH_MULTIPLEXER_HPP_
+
+#include "embsh/line_editor.hpp"
+#include "embsh/thread.hpp"
+
+#include <atomic>
+#include <mutex>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#ifndef EMBSH_MUX_MAX_SESSIONS
+#define EMBSH_MUX_MAX_SESSIONS 16  ///< Sessions one ShellMultiplexer can host.
+#endif
+
+#ifndef EMBSH_REACTOR_MAX_EVENTS
+#define EMBSH_REACTOR_MAX_EVENTS 32
+#endif
+
+namespace embsh {
+
+/**
+ * @brief Shared I/O thread for UART, console, pty or socket sessions.
+ *
+ * A backend configures its Session (fds, transport functions, history),
+ * sends its first prompt and hands it to Attach(); from then on this
+ * object's epoll thread reads, edits and executes for it, so N serial
+ * shells cost one thread instead of N. Prompts and other per-backend
+ * settings stay with the session's owner.
+ *
+ * Reads are level-triggered, one per wakeup, so sessions take turns. Writes
+ * go through the session's transport as in the threaded backends: a
+ * blocking fd (UART, console) stalls the loop while the device drains, and
+ * a session that provides txq_buf with a non-blocking fd has its queue
+ * drained on EPOLLOUT instead.
+ */
+class ShellMultiplexer final {
+ public:
+  ShellMultiplexer() = default;
+  ~ShellMultiplexer() { Stop(); }
+
+  ShellMultiplexer(const ShellMultiplexer&) = delete;
+  ShellMultiplexer& operator=(const ShellMultiplexer&) = delete;
+
+  /**
+   * @brief Create the epoll set and start the I/O thread.
+   * @param opts Scheduling, affinity and stack of the I/O thread.
+   * @return kAlreadyRunning, kOutOfMemory or kThreadStartFailed on error.
+   */
+  inline expected<void, ShellError> Start(const ThreadOptions& opts = ThreadOptions{}) noexcept;
+
+  /// @brief Stop the thread and end every attached session (fds are left open).
+  inline void Stop() noexcept;
+
+  /**
+   * @brief Serve @p s from the I/O thread until it ends or is detached.
+   *
+   * @param s        Active session; must outlive the attachment.
+   * @param prompt   Prompt re-sent after each line.
+   * @param epilogue Text written when the session ends (nullptr = none).
+   * @return Handle for Detach(); kNotRunning, kRegistryFull (no free slot)
+   *         or kInvalidArgument (fd not pollable, e.g. a regular file).
+   */
+  inline expected<uint32_t, ShellError> Attach(Session& s, const char* prompt,
+                                               const char* epilogue = nullptr) noexcept;
+
+  /**
+   * @brief Stop serving a session: waits for its async command and the
+   *        event being dispatched, writes the epilogue and flushes.
+   *
+   * The wait for an async command happens outside the entry table lock, so
+   * the I/O thread keeps serving the other sessions meanwhile. A no-op if
+   * the session already ended (EOF, exit) or the handle is stale. Must not
+   * be called from a synchronous command of a session on this multiplexer.
+   */
+  inline void Detach(uint32_t handle) noexcept;
+
+  /// @brief Sessions currently attached.
+  inline uint32_t SessionCount() const noexcept;
+
+  bool IsRunning() const noexcept { return running_.load(std::memory_order_relaxed); }
+
+ private:
+  static_assert(EMBSH_MUX_MAX_SESSIONS > 0 && EMBSH_MUX_MAX_SESSIONS <= 256, "slot index is 8 bits");
+
+  static constexpr uint64_t kWakeTag = ~uint64_t{0};
+  static constexpr uint64_t kDoneTag = ~uint64_t{0} - 1;
+
+  struct Entry {
+    Session* session = nullptr;  ///< nullptr = free slot.
+    const char* prompt = nullptr;
+    const char* epilogue = nullptr;
+    uint32_t handle = 0;  ///< (generation << 8) | index; 0 never names a live entry.
+    bool want_out = false;
+    bool closing = false;  ///< Ended while busy; finished when the job signals done_ (see End()).
+  };
+
+  Entry entries_[EMBSH_MUX_MAX_SESSIONS];
+  mutable std::mutex mtx_;  ///< Entry table; held by the loop while it dispatches a batch.
+  uint32_t generation_ = 0;
+  Thread thread_;
+  std::atomic<bool> running_{false};
+  int epoll_fd_ = -1;
+  WakeEvent wake_;  ///< Signalled by Stop().
+  WakeEvent done_;  ///< notify of every session: an async command finished.
+
+  inline void Loop() noexcept;
+  inline bool Dispatch(Entry& e, uint32_t events) noexcept;
+  inline void Resume() noexcept;
+  inline void WatchOutput(Entry& e) noexcept;
+  inline void End(Entry& e) noexcept;
+
+  static uint32_t SlotOf(uint32_t handle) noexcept { return handle & 0xFFU; }
+};
+
+// ============================================================================
+// ShellMultiplexer implementation
+// ============================================================================
+
+inline expected<void, ShellError> ShellMultiplexer::Start(const ThreadOptions& opts) noexcept {
+  if (running_.load(std::memory_order_relaxed)) {
+    return expected<void, ShellError>::error(ShellError::kAlreadyRunning);
+  }
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  struct epoll_event wev = {};
+  wev.events = EPOLLIN;
+  wev.data.u64 = kWakeTag;
+  struct epoll_event dev = {};
+  dev.events = EPOLLIN;
+  dev.data.u64 = kDoneTag;
+  if (epoll_fd_ < 0 || !wake_.Open() || !done_.Open() || ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_.fd(), &wev) < 0 ||
+      ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, done_.fd(), &dev) < 0) {
+    if (epoll_fd_ >= 0) {
+      ::close(epoll_fd_);
+      epoll_fd_ = -1;
+    }
+    wake_.Close();
+    done_.Close();
+    return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+  }
+
+  running_.store(true, std::memory_order_release);
+  if (!thread_.Start(opts, [this]() { Loop(); })) {
+    running_.store(false, std::memory_order_release);
+    ::close(epoll_fd_);
+    epoll_fd_ = -1;
+    wake_.Close();
+    done_.Close();
+    return expected<void, ShellError>::error(ShellError::kThreadStartFailed);
+  }
+  return expected<void, ShellError>::success();
+}
+
+inline void ShellMultiplexer::Stop() noexcept {
+  if (!running_.load(std::memory_order_relaxed))
+    return;
+  running_.store(false, std::memory_order_release);
+  wake_.Signal();
+  if (thread_.Joinable()) {
+    thread_.Join();
+  }
+
+  // The loop is gone, so nothing else finishes closing entries: cancel them
+  // under the lock, wait outside it (as Detach() does), then finish.
+  Session* busy[EMBSH_MUX_MAX_SESSIONS] = {};
+  uint32_t handles[EMBSH_MUX_MAX_SESSIONS] = {};
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (uint32_t i = 0; i < EMBSH_MUX_MAX_SESSIONS; ++i) {
+      auto& e = entries_[i];
+      if (e.session == nullptr)
+        continue;
+      End(e);
+      busy[i] = e.session;
+      handles[i] = e.handle;
+    }
+  }
+  for (auto* s : busy) {
+    if (s != nullptr) {
+      editor::WaitIdle(*s);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (uint32_t i = 0; i < EMBSH_MUX_MAX_SESSIONS; ++i) {
+      auto& e = entries_[i];
+      if (busy[i] != nullptr && e.session != nullptr && e.handle == handles[i]) {
+        End(e);
+      }
+    }
+  }
+  ::close(epoll_fd_);
+  epoll_fd_ = -1;
+  wake_.Close();
+  done_.Close();
+}
+
+inline expected<uint32_t, ShellError> ShellMultiplexer::Attach(Session& s, const char* prompt,
+                                                               const char* epilogue) noexcept {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (!running_.load(std::memory_order_relaxed)) {
+    return expected<uint32_t, ShellError>::error(ShellError::kNotRunning);
+  }
+  uint32_t idx = 0;
+  while (idx < EMBSH_MUX_MAX_SESSIONS && entries_[idx].session != nullptr) {
+    ++idx;
+  }
+  if (idx == EMBSH_MUX_MAX_SESSIONS) {
+    return expected<uint32_t, ShellError>::error(ShellError::kRegistryFull);
+  }
+  generation_ = (generation_ % 0xFFFFFFU) + 1;  // 24 bits, never 0.
+
+  auto& e = entries_[idx];
+  e.handle = (generation_ << 8) | idx;
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = e.handle;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, s.read_fd, &ev) < 0) {
+    return expected<uint32_t, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  e.session = &s;
+  e.prompt = prompt;
+  e.epilogue = epilogue;
+  e.want_out = false;
+  e.closing = false;
+  s.notify = &done_;
+  WatchOutput(e);
+  return expected<uint32_t, ShellError>::success(e.handle);
+}
+
+inline void ShellMultiplexer::Detach(uint32_t handle) noexcept {
+  if (SlotOf(handle) >= EMBSH_MUX_MAX_SESSIONS)
+    return;
+  auto& e = entries_[SlotOf(handle)];
+  Session* busy = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (e.session == nullptr || e.handle != handle)
+      return;
+    End(e);  // Cancels and defers if an async command still runs.
+    if (e.session != nullptr) {
+      busy = e.session;
+    }
+  }
+  if (busy == nullptr)
+    return;
+  editor::WaitIdle(*busy);
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (e.session != nullptr && e.handle == handle) {
+    End(e);  // The loop has not handled done_ yet.
+  }
+}
+
+inline uint32_t ShellMultiplexer::SessionCount() const noexcept {
+  std::lock_guard<std::mutex> lock(mtx_);
+  uint32_t n = 0;
+  for (const auto& e : entries_) {
+    n += (e.session != nullptr) ? 1U : 0U;
+  }
+  return n;
+}
+
+inline void ShellMultiplexer::Loop() noexcept {
+  struct epoll_event events[EMBSH_REACTOR_MAX_EVENTS];
+  detail::SharedLoopThread() = true;  // Output on this thread must never wait for one peer.
+
+  while (running_.load(std::memory_order_relaxed)) {
+    int n = ::epoll_wait(epoll_fd_, events, EMBSH_REACTOR_MAX_EVENTS, -1);
+    if (n < 0 && errno != EINTR)
+      break;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (int i = 0; i < n; ++i) {
+      const uint64_t tag = events[i].data.u64;
+      if (tag == kWakeTag)
+        continue;  // Loop condition re-checks running_.
+      if (tag == kDoneTag) {
+        Resume();
+        continue;
+      }
+      // A stale event for a slot detached and reused within this batch fails the handle check.
+      auto& e = entries_[SlotOf(static_cast<uint32_t>(tag))];
+      if (e.session == nullptr || e.handle != static_cast<uint32_t>(tag) || e.closing)
+        continue;
+      if (Dispatch(e, events[i].events)) {
+        WatchOutput(e);
+      } else {
+        End(e);
+      }
+    }
+  }
+}
+
+inline bool ShellMultiplexer::Dispatch(Entry& e, uint32_t events) noexcept {
+  auto& s = *e.session;
+  if ((events & EPOLLOUT) != 0 && !s.busy.load(std::memory_order_acquire) && !detail::DrainTxQueue(s)) {
+    return false;
+  }
+  if ((events & ~static_cast<uint32_t>(EPOLLOUT)) != 0) {
+    ssize_t n = editor::ReadInput(s, e.prompt);
+    if (n == 0)
+      return false;  // EOF: the device went away.
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+      return false;
+  }
+  return s.active.load(std::memory_order_acquire);
+}
+
+/// @brief Feed input parked by sessions whose async command has finished; finish deferred ends.
+inline void ShellMultiplexer::Resume() noexcept {
+  done_.Drain();
+  for (auto& e : entries_) {
+    if (e.session == nullptr || e.session->busy.load(std::memory_order_acquire))
+      continue;
+    if (e.closing) {
+      End(e);
+      continue;
+    }
+    editor::ResumeInput(*e.session, e.prompt);
+    if (e.session->active.load(std::memory_order_acquire)) {
+      WatchOutput(e);
+    } else {
+      End(e);
+    }
+  }
+}
+
+/// @brief Keep EPOLLOUT registered exactly while the loop owns queued output.
+inline void ShellMultiplexer::WatchOutput(Entry& e) noexcept {
+  const auto& s = *e.session;
+  if (e.closing)
+    return;
+  const bool want = !s.busy.load(std::memory_order_acquire) && s.txq_len > 0;
+  if (want == e.want_out)
+    return;
+  struct epoll_event ev = {};
+  ev.events = EPOLLIN | (want ? static_cast<uint32_t>(EPOLLOUT) : 0U);
+  ev.data.u64 = e.handle;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, s.read_fd, &ev) == 0) {
+    e.want_out = want;
+  }
+}
+
+/**
+ * @brief End a session without waiting on its async command.
+ *
+ * A busy session is cancelled and taken out of the epoll set; the entry
+ * stays closing until the job signals done_, when Resume() (or Detach())
+ * calls this again to write the epilogue and free the entry.
+ */
+inline void ShellMultiplexer::End(Entry& e) noexcept {
+  auto& s = *e.session;
+  if (s.busy.load(std::memory_order_acquire)) {
+    s.cancel.store(true, std::memory_order_release);
+    if (!e.closing) {
+      (void)::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s.read_fd, nullptr);
+    }
+    e.closing = true;
+    return;
+  }
+  editor::WaitIdle(s);  // busy is clear: at most the job's last two stores remain.
+  if (e.epilogue != nullptr) {
+    SessionWrite(s, e.epilogue);
+  }
+  SessionFlush(s);
+  (void)::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s.read_fd, nullptr);
+  s.notify = nullptr;
+  s.active.store(false, std::memory_order_release);
+  e.session = nullptr;
+  e.handle = 0;
+  e.closing = false;
+}
+
+}  // namespace embsh
+
+#endif  // EMBSH_MULTIPLEXER_HPP_
@@ -34,6 +34,13 @@
 #define EMBSH_UNUSED
 #endif
 
+/// Linker-section command tables need named sections and __start_/__stop_ symbols (GNU ld, lld on ELF).
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__ELF__)
+#define EMBSH_HAS_CMD_SECTION 1
+#else
+#define EMBSH_HAS_CMD_SECTION 0
+#endif
+
 // ============================================================================
 // Token pasting
 // ============================================================================
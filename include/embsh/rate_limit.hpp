@@ -0,0 +1,192 @@
+/**
+ * @file rate_limit.hpp
+ * @brief Token buckets and the per-session budget the editor enforces.
+ *
+ * A session with a SessionBudget (TelnetServer sets one from ServerConfig)
+ * processes input only while it has byte tokens, and starts a command line
+ * only with a command token and a free execution slot. Input that has to
+ * wait stays in the session's read buffer and is not read further, so a
+ * flooding client is pushed back by TCP flow control instead of costing
+ * CPU; the session loop retries it at SessionBudget::resume_ns.
+ */
+
+#ifndef EMBSH_RATE_LIMIT_HPP_
+#define EMBSH_RATE_LIMIT_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+#ifndef EMBSH_BUDGET_RETRY_MS
+#define EMBSH_BUDGET_RETRY_MS 5  ///< Retry interval for a line waiting for an execution slot.
+#endif
+
+namespace embsh {
+
+/// @brief Sustained rate and burst of a TokenBucket; per_sec = 0 means unlimited.
+struct RateLimit {
+  uint32_t per_sec = 0;
+  uint32_t burst = 0;  ///< Tokens available at once; 0 = per_sec (one second's worth).
+};
+
+namespace detail {
+
+inline uint64_t MonotonicNs() noexcept {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+}  // namespace detail
+
+/**
+ * @brief Lock-free token bucket.
+ *
+ * Stored as the time at which the bucket would be full again (the GCRA
+ * form): taking n tokens moves it n * 1e9 / per_sec ns ahead, and tokens
+ * are available while it is less than burst intervals past now. That is a
+ * single atomic word, so a server-wide bucket is shared by session threads
+ * without a lock. Concurrent takers may overdraw slightly; the debt delays
+ * later tokens, so the long-run rate holds.
+ */
+class TokenBucket final {
+ public:
+  /// @brief Set the rate and refill the bucket (not thread-safe).
+  inline void Configure(const RateLimit& limit) noexcept {
+    uint64_t interval = 0;
+    if (limit.per_sec != 0) {
+      interval = 1000000000ULL / limit.per_sec;
+      interval = (interval != 0) ? interval : 1;
+    }
+    interval_ns_ = interval;
+    depth_ns_ = interval * ((limit.burst != 0) ? limit.burst : limit.per_sec);
+    full_at_.store(0, std::memory_order_relaxed);
+  }
+
+  bool Limited() const noexcept { return interval_ns_ != 0; }
+
+  /// @brief Tokens available at @p now_ns; UINT64_MAX when unlimited.
+  inline uint64_t Available(uint64_t now_ns) const noexcept {
+    if (!Limited())
+      return UINT64_MAX;
+    const uint64_t lead = Lead(now_ns);
+    return (lead >= depth_ns_) ? 0 : (depth_ns_ - lead) / interval_ns_;
+  }
+
+  /// @brief Consume @p n tokens, available or not.
+  inline void Take(uint64_t n, uint64_t now_ns) noexcept {
+    if (!Limited() || n == 0)
+      return;
+    uint64_t cur = full_at_.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+      next = ((cur > now_ns) ? cur : now_ns) + n * interval_ns_;
+    } while (!full_at_.compare_exchange_weak(cur, next, std::memory_order_relaxed));
+  }
+
+  /// @brief Nanoseconds after @p now_ns until one token is available (0 = now).
+  inline uint64_t WaitNs(uint64_t now_ns) const noexcept {
+    if (!Limited())
+      return 0;
+    const uint64_t need = Lead(now_ns) + interval_ns_;
+    return (need > depth_ns_) ? need - depth_ns_ : 0;
+  }
+
+ private:
+  uint64_t interval_ns_ = 0;  ///< Refill time of one token; 0 = unlimited.
+  uint64_t depth_ns_ = 0;     ///< burst * interval_ns_.
+  std::atomic<uint64_t> full_at_{0};
+
+  uint64_t Lead(uint64_t now_ns) const noexcept {
+    const uint64_t full = full_at_.load(std::memory_order_relaxed);
+    return (full > now_ns) ? full - now_ns : 0;
+  }
+};
+
+/**
+ * @brief Budget of one session: its own buckets plus the shared server-wide ones.
+ *
+ * Owned by the backend and driven by editor::ProcessBytes() on the session
+ * thread; only the shared buckets and the running counter are touched from
+ * several threads.
+ */
+struct SessionBudget {
+  TokenBucket cmds;   ///< Command lines of this session.
+  TokenBucket bytes;  ///< Input bytes of this session.
+  TokenBucket* total_cmds = nullptr;   ///< Shared by all sessions of a server (nullptr = none).
+  TokenBucket* total_bytes = nullptr;  ///< Shared by all sessions of a server (nullptr = none).
+  std::atomic<uint32_t>* running = nullptr;  ///< Commands executing server-wide.
+  uint32_t max_running = 0;  ///< Limit on *running; 0 = unlimited.
+  bool holds_slot = false;   ///< A running slot is reserved for the current line (or its async job).
+  uint64_t resume_ns = 0;    ///< Input held back until this MonotonicNs() time; 0 = none held.
+
+  /// @brief Bytes of @p len that may be processed now.
+  inline size_t AllowBytes(size_t len, uint64_t now_ns) const noexcept {
+    uint64_t n = bytes.Available(now_ns);
+    if (total_bytes != nullptr) {
+      const uint64_t t = total_bytes->Available(now_ns);
+      n = (t < n) ? t : n;
+    }
+    return (n < len) ? static_cast<size_t>(n) : len;
+  }
+
+  inline void TakeBytes(size_t n, uint64_t now_ns) noexcept {
+    bytes.Take(n, now_ns);
+    if (total_bytes != nullptr)
+      total_bytes->Take(n, now_ns);
+  }
+
+  /**
+   * @brief Reserve what a line ending here needs: a command token and an
+   *        execution slot. @return false if the line has to wait.
+   */
+  inline bool AcquireLine(uint64_t now_ns) noexcept {
+    if (cmds.Available(now_ns) == 0 || (total_cmds != nullptr && total_cmds->Available(now_ns) == 0))
+      return false;
+    if (holds_slot || running == nullptr || max_running == 0)
+      return true;
+    uint32_t cur = running->load(std::memory_order_relaxed);
+    do {
+      if (cur >= max_running)
+        return false;
+    } while (!running->compare_exchange_weak(cur, cur + 1, std::memory_order_acq_rel));
+    holds_slot = true;
+    return true;
+  }
+
+  /// @brief Charge the command token of a line that runs.
+  inline void TakeLine(uint64_t now_ns) noexcept {
+    cmds.Take(1, now_ns);
+    if (total_cmds != nullptr)
+      total_cmds->Take(1, now_ns);
+  }
+
+  inline void ReleaseSlot() noexcept {
+    if (holds_slot) {
+      running->fetch_sub(1, std::memory_order_acq_rel);
+      holds_slot = false;
+    }
+  }
+
+  /// @brief Record that input waits: for a line (command token or slot) or for byte tokens.
+  inline void Hold(bool line, uint64_t now_ns) noexcept {
+    uint64_t wait;
+    if (line) {
+      wait = cmds.WaitNs(now_ns);
+      const uint64_t t = (total_cmds != nullptr) ? total_cmds->WaitNs(now_ns) : 0;
+      wait = (t > wait) ? t : wait;
+    } else {
+      wait = bytes.WaitNs(now_ns);
+      const uint64_t t = (total_bytes != nullptr) ? total_bytes->WaitNs(now_ns) : 0;
+      wait = (t > wait) ? t : wait;
+    }
+    if (wait == 0)
+      wait = EMBSH_BUDGET_RETRY_MS * 1000000ULL;  // Waiting for another session's command to end.
+    resume_ns = now_ns + wait;
+  }
+};
+
+}  // namespace embsh
+
+#endif  // EMBSH_RATE_LIMIT_HPP_
@@ -0,0 +1,560 @@
+/**
+ * @file script.hpp
+ * @brief Pre-tokenized command scripts: the `source` command and a batch API.
+ *
+ * A script is tokenized once into a compact table of lines with their
+ * CmdEntry already resolved, then executed without echo, line editing,
+ * ShellSplit or a registry lookup per line. ScriptCache shares compiled
+ * scripts between sessions and recompiles a file when its mtime, size or
+ * inode changes. Including this header registers `source <file>`.
+ */
+
+#ifndef EMBSH_SCRIPT_HPP_
+#define EMBSH_SCRIPT_HPP_
+
+#include "embsh/line_editor.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef EMBSH_SCRIPT_MAX_LINES
+#define EMBSH_SCRIPT_MAX_LINES 256  ///< Command lines per script.
+#endif
+
+#ifndef EMBSH_SCRIPT_MAX_ARGV
+#define EMBSH_SCRIPT_MAX_ARGV 1024  ///< Arguments per script, all lines together.
+#endif
+
+#ifndef EMBSH_SCRIPT_CACHE
+#define EMBSH_SCRIPT_CACHE 4  ///< Compiled scripts kept by ScriptCache.
+#endif
+
+#ifndef EMBSH_SCRIPT_PATH_MAX
+#define EMBSH_SCRIPT_PATH_MAX 128
+#endif
+
+#ifndef EMBSH_SCRIPT_MAX_DEPTH
+#define EMBSH_SCRIPT_MAX_DEPTH 4  ///< Nested `source` calls per thread.
+#endif
+
+namespace embsh {
+
+// ============================================================================
+// Script - one compiled command script
+// ============================================================================
+
+/**
+ * @brief A command script tokenized once, run many times.
+ *
+ * The text lives in a private mapping (the file itself, copy-on-write, or
+ * an anonymous copy for LoadText()) and is split in place; each line keeps
+ * a span of that text and 16-bit offsets of its arguments. Run() copies a
+ * line's span into a stack buffer before calling its command, so commands
+ * may modify argv as usual and one Script can run on several threads at
+ * once. Lines longer than EMBSH_LINE_BUF_SIZE are rejected, as they would
+ * be interactively.
+ *
+ * Blank lines and lines whose first word starts with '#' are skipped.
+ * Commands unknown at load time are looked up again when reached, so a
+ * script may use commands registered after it was compiled. kCmdAsync
+ * commands run synchronously on the calling thread. A line with `|`, `>`
+ * or `>>` runs as a pipeline (RunPipeline()).
+ */
+class Script final {
+ public:
+  Script() = default;
+  ~Script() { Clear(); }
+
+  Script(const Script&) = delete;
+  Script& operator=(const Script&) = delete;
+
+  /// @brief Map and compile @p path, replacing any previous contents.
+  inline expected<void, ShellError> LoadFile(const char* path) noexcept;
+
+  /// @brief Compile a copy of @p len bytes of script @p text.
+  inline expected<void, ShellError> LoadText(const char* text, size_t len) noexcept;
+
+  /// @brief True if this script was loaded from a file that changed since.
+  inline bool Changed() const noexcept;
+
+  /// @brief Reload from the same file if Changed().
+  inline expected<void, ShellError> Refresh() noexcept;
+
+  /**
+   * @brief Execute every line in order through the current output (ShellPrintf).
+   *
+   * Stops at the first command returning non-zero, at an unknown command
+   * (-1) or when ShellCancelled() turns true (-1).
+   *
+   * @param failed_line If non-null, receives the 1-based line that stopped the run.
+   * @return 0 if every line succeeded, otherwise the status that stopped it.
+   */
+  inline int Run(uint32_t* failed_line = nullptr) const noexcept;
+
+  /// @brief Release the mapping and forget all lines.
+  inline void Clear() noexcept;
+
+  uint32_t LineCount() const noexcept { return line_count_; }
+  const char* Path() const noexcept { return path_; }
+
+  /// @brief 1-based line of the last Load*() error, 0 if not line-specific.
+  uint32_t ErrorLine() const noexcept { return error_line_; }
+
+ private:
+  struct Line {
+    const CmdEntry* cmd;  ///< Resolved at load time, nullptr if unknown then.
+    uint32_t text_off;    ///< Tokenized span in text_.
+    uint32_t line_no;
+    uint16_t text_len;   ///< Span length including the final NUL.
+    uint16_t arg_first;  ///< First entry in arg_off_.
+    uint8_t argc;
+    uint8_t piped;  ///< Has `|` / `>` / `>>` tokens; run by RunPipeline().
+  };
+
+  /// Offsets in arg_off_ standing for the static operator tokens (kShellPipe, ...).
+  static constexpr uint16_t kArgPipe = 0xFFFD;
+  static constexpr uint16_t kArgRedirect = 0xFFFE;
+  static constexpr uint16_t kArgAppend = 0xFFFF;
+
+  struct Identity {
+    int64_t mtime_ns = 0;
+    int64_t size = 0;
+    uint64_t ino = 0;
+  };
+
+  static inline Identity IdentityOf(const struct stat& st) noexcept {
+    Identity id;
+    id.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    id.size = static_cast<int64_t>(st.st_size);
+    id.ino = static_cast<uint64_t>(st.st_ino);
+    return id;
+  }
+
+  inline expected<void, ShellError> Compile(char* text, size_t len) noexcept;
+
+  char* text_ = nullptr;
+  size_t map_len_ = 0;
+  Line lines_[EMBSH_SCRIPT_MAX_LINES];
+  uint16_t arg_off_[EMBSH_SCRIPT_MAX_ARGV];
+  uint32_t line_count_ = 0;
+  uint32_t error_line_ = 0;
+  Identity id_;
+  char path_[EMBSH_SCRIPT_PATH_MAX] = {};
+};
+
+// ============================================================================
+// Script implementation
+// ============================================================================
+
+inline expected<void, ShellError> Script::LoadFile(const char* path) noexcept {
+  if (path == nullptr || std::strlen(path) >= sizeof(path_)) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  char path_copy[EMBSH_SCRIPT_PATH_MAX];
+  std::strcpy(path_copy, path);  // path may alias path_ (Refresh).
+  Clear();
+
+  int fd = ::open(path_copy, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
+  const size_t size = static_cast<size_t>(st.st_size);
+  const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+
+  // The tokenizer needs one writable byte past the text. A private file
+  // mapping has it (zero-filled) unless the file ends on a page boundary;
+  // then, and for empty files, read into an anonymous mapping instead.
+  void* p = MAP_FAILED;
+  size_t map_len = size;
+  if (size % page != 0) {
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  } else {
+    map_len = size + 1;
+    p = ::mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    size_t got = 0;
+    while (p != MAP_FAILED && got < size) {
+      ssize_t n = ::pread(fd, static_cast<char*>(p) + got, size - got, static_cast<off_t>(got));
+      if (n <= 0) {
+        ::munmap(p, map_len);
+        p = MAP_FAILED;
+        break;
+      }
+      got += static_cast<size_t>(n);
+    }
+  }
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
+
+  text_ = static_cast<char*>(p);
+  map_len_ = map_len;
+  auto r = Compile(text_, size);
+  if (!r) {
+    const uint32_t error_line = error_line_;
+    Clear();
+    error_line_ = error_line;
+    return r;
+  }
+  std::strcpy(path_, path_copy);
+  id_ = IdentityOf(st);
+  return r;
+}
+
+inline expected<void, ShellError> Script::LoadText(const char* text, size_t len) noexcept {
+  Clear();
+  if (text == nullptr && len != 0) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  void* p = ::mmap(nullptr, len + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+  }
+  if (len != 0) {
+    std::memcpy(p, text, len);
+  }
+  text_ = static_cast<char*>(p);
+  map_len_ = len + 1;
+  auto r = Compile(text_, len);
+  if (!r) {
+    const uint32_t error_line = error_line_;
+    Clear();
+    error_line_ = error_line;
+  }
+  return r;
+}
+
+inline expected<void, ShellError> Script::Compile(char* text, size_t len) noexcept {
+  auto& reg = CommandRegistry::Instance();
+  uint32_t arg_count = 0;
+  uint32_t line_no = 0;
+  size_t pos = 0;
+
+  while (pos < len) {
+    ++line_no;
+    const char* nl = static_cast<const char*>(std::memchr(text + pos, '\n', len - pos));
+    size_t end = (nl != nullptr) ? static_cast<size_t>(nl - text) : len;
+    const size_t next = end + 1;
+    text[end] = '\0';
+    if (end > pos && text[end - 1] == '\r') {
+      text[--end] = '\0';
+    }
+    while (pos < end && (text[pos] == ' ' || text[pos] == '\t')) {
+      ++pos;
+    }
+    if (pos == end || text[pos] == '#') {
+      pos = next;
+      continue;
+    }
+
+    if (end - pos + 1 > EMBSH_LINE_BUF_SIZE) {
+      error_line_ = line_no;
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    char* argv[EMBSH_MAX_ARGS] = {};
+    const int argc = ShellSplit(text + pos, static_cast<uint32_t>(end - pos), argv);
+    if (argc < 0) {
+      error_line_ = line_no;
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    if (line_count_ >= EMBSH_SCRIPT_MAX_LINES || arg_count + static_cast<uint32_t>(argc) > EMBSH_SCRIPT_MAX_ARGV) {
+      error_line_ = line_no;
+      return expected<void, ShellError>::error(ShellError::kScriptTooLarge);
+    }
+
+    Line& ln = lines_[line_count_++];
+    ln.cmd = reg.Find(argv[0]);
+    ln.text_off = static_cast<uint32_t>(pos);
+    ln.line_no = line_no;
+    ln.text_len = static_cast<uint16_t>(end - pos + 1);
+    ln.arg_first = static_cast<uint16_t>(arg_count);
+    ln.argc = static_cast<uint8_t>(argc);
+    ln.piped = 0;
+    for (int i = 0; i < argc; ++i) {
+      uint16_t off;
+      if (argv[i] == kShellPipe) {
+        off = kArgPipe;
+      } else if (argv[i] == kShellRedirect) {
+        off = kArgRedirect;
+      } else if (argv[i] == kShellAppend) {
+        off = kArgAppend;
+      } else {
+        off = static_cast<uint16_t>(argv[i] - (text + pos));
+      }
+      ln.piped |= (off >= kArgPipe) ? 1U : 0U;
+      arg_off_[arg_count++] = off;
+    }
+    pos = next;
+  }
+  return expected<void, ShellError>::success();
+}
+
+inline bool Script::Changed() const noexcept {
+  if (path_[0] == '\0')
+    return false;
+  struct stat st;
+  if (::stat(path_, &st) != 0)
+    return true;
+  const Identity now = IdentityOf(st);
+  return now.mtime_ns != id_.mtime_ns || now.size != id_.size || now.ino != id_.ino;
+}
+
+inline expected<void, ShellError> Script::Refresh() noexcept {
+  if (!Changed())
+    return expected<void, ShellError>::success();
+  return LoadFile(path_);
+}
+
+inline int Script::Run(uint32_t* failed_line) const noexcept {
+  auto& reg = CommandRegistry::Instance();
+  for (uint32_t i = 0; i < line_count_; ++i) {
+    const Line& ln = lines_[i];
+    int rc = -1;
+    if (!ShellCancelled()) {
+      char buf[EMBSH_LINE_BUF_SIZE];
+      char* argv[EMBSH_MAX_ARGS + 1];
+      std::memcpy(buf, text_ + ln.text_off, ln.text_len);
+      static char* const kOperators[] = {const_cast<char*>(kShellPipe), const_cast<char*>(kShellRedirect),
+                                         const_cast<char*>(kShellAppend)};
+      for (uint32_t a = 0; a < ln.argc; ++a) {
+        const uint16_t off = arg_off_[ln.arg_first + a];
+        argv[a] = (off >= kArgPipe) ? kOperators[off - kArgPipe] : buf + off;
+      }
+      argv[ln.argc] = nullptr;
+
+      const CmdEntry* cmd = (ln.cmd != nullptr) ? ln.cmd : reg.Find(argv[0]);
+      if (ln.piped != 0) {
+        auto r = RunPipeline(ln.argc, argv);
+        rc = r.has_value() ? r.value() : -1;
+      } else if (cmd != nullptr) {
+        rc = editor::InvokeCommand(cmd, ln.argc, argv);
+      } else {
+        ShellPrintf("unknown command: %s\r\n", argv[0]);
+      }
+    }
+    if (rc != 0) {
+      if (failed_line != nullptr)
+        *failed_line = ln.line_no;
+      return rc;
+    }
+  }
+  return 0;
+}
+
+inline void Script::Clear() noexcept {
+  if (text_ != nullptr) {
+    ::munmap(text_, map_len_);
+  }
+  text_ = nullptr;
+  map_len_ = 0;
+  line_count_ = 0;
+  error_line_ = 0;
+  id_ = Identity{};
+  path_[0] = '\0';
+}
+
+// ============================================================================
+// ScriptCache - compiled scripts shared by every session
+// ============================================================================
+
+/**
+ * @brief Process-wide cache of EMBSH_SCRIPT_CACHE compiled script files.
+ *
+ * Run() stats the file on every call and recompiles it when it changed.
+ * A script being run elsewhere is never recompiled under its runner: the
+ * old copy is retired and freed by its last user, and the new one is
+ * compiled into another slot. When every slot is busy Run() fails with
+ * kOutOfMemory. Compilation happens under the cache mutex, execution
+ * outside it.
+ */
+class ScriptCache final {
+ public:
+  static ScriptCache& Instance() noexcept {
+    static ScriptCache cache;
+    return cache;
+  }
+
+  /**
+   * @brief Compile @p path if needed and run it.
+   * @param failed_line If non-null, receives the line that stopped the run
+   *                    or failed to compile.
+   * @return The Script::Run() status, or the load error.
+   */
+  inline expected<int, ShellError> Run(const char* path, uint32_t* failed_line = nullptr) noexcept {
+    Entry* e = nullptr;
+    auto r = Acquire(path, &e, failed_line);
+    if (!r) {
+      return expected<int, ShellError>::error(r.error_value());
+    }
+    const int rc = e->script.Run(failed_line);
+    Release(e);
+    return expected<int, ShellError>::success(rc);
+  }
+
+  /// @brief Drop every idle cached script.
+  inline void Clear() noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& e : entries_) {
+      if (e.users == 0) {
+        e.script.Clear();
+        e.retired = false;
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    Script script;
+    uint32_t users = 0;
+    uint64_t last_use = 0;
+    bool retired = false;  ///< Superseded by a newer compile; freed by its last user.
+  };
+
+  ScriptCache() = default;
+  ScriptCache(const ScriptCache&) = delete;
+  ScriptCache& operator=(const ScriptCache&) = delete;
+
+  inline expected<void, ShellError> Acquire(const char* path, Entry** out, uint32_t* error_line) noexcept {
+    if (path == nullptr || path[0] == '\0') {
+      return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+    }
+    std::lock_guard<std::mutex> lock(mtx_);
+    Entry* slot = nullptr;
+    for (auto& e : entries_) {
+      if (e.retired || std::strcmp(e.script.Path(), path) != 0)
+        continue;
+      if (!e.script.Changed()) {
+        Grab(e, out);
+        return expected<void, ShellError>::success();
+      }
+      if (e.users == 0) {
+        slot = &e;  // Recompile in place.
+      } else {
+        e.retired = true;
+      }
+      break;
+    }
+    if (slot == nullptr) {
+      slot = FreeSlot();
+      if (slot == nullptr) {
+        return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+      }
+    }
+    auto r = slot->script.LoadFile(path);
+    if (!r) {
+      if (error_line != nullptr)
+        *error_line = slot->script.ErrorLine();
+      return r;
+    }
+    Grab(*slot, out);
+    return r;
+  }
+
+  inline void Release(Entry* e) noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (--e->users == 0 && e->retired) {
+      e->script.Clear();
+      e->retired = false;
+    }
+  }
+
+  inline void Grab(Entry& e, Entry** out) noexcept {
+    ++e.users;
+    e.last_use = ++tick_;
+    *out = &e;
+  }
+
+  /// Empty slot first, else the least recently used idle one.
+  inline Entry* FreeSlot() noexcept {
+    Entry* lru = nullptr;
+    for (auto& e : entries_) {
+      if (e.users != 0)
+        continue;
+      if (e.script.Path()[0] == '\0')
+        return &e;
+      if (lru == nullptr || e.last_use < lru->last_use)
+        lru = &e;
+    }
+    return lru;
+  }
+
+  Entry entries_[EMBSH_SCRIPT_CACHE];
+  uint64_t tick_ = 0;
+  std::mutex mtx_;
+};
+
+// ============================================================================
+// Built-in source command
+// ============================================================================
+
+namespace detail {
+
+inline const char* ScriptErrorText(ShellError e) noexcept {
+  switch (e) {
+    case ShellError::kFileOpenFailed:
+      return "cannot open";
+    case ShellError::kScriptTooLarge:
+      return "too many lines or arguments";
+    case ShellError::kOutOfMemory:
+      return "script cache busy";
+    default:
+      return "invalid line";
+  }
+}
+
+/// @brief `source <file>`: run a script through ScriptCache.
+inline int SourceCommand(int argc, char* argv[], void* /*ctx*/) {
+  static thread_local uint32_t depth = 0;
+  if (argc != 2) {
+    ShellPrintf("usage: source <file>\r\n");
+    return -1;
+  }
+  if (depth >= EMBSH_SCRIPT_MAX_DEPTH) {
+    ShellPrintf("source: nesting too deep\r\n");
+    return -1;
+  }
+  ++depth;
+  uint32_t line = 0;
+  auto r = ScriptCache::Instance().Run(argv[1], &line);
+  --depth;
+  if (!r) {
+    if (line != 0) {
+      ShellPrintf("source: %s:%u: %s\r\n", argv[1], line, ScriptErrorText(r.error_value()));
+    } else {
+      ShellPrintf("source: %s: %s\r\n", argv[1], ScriptErrorText(r.error_value()));
+    }
+    return -1;
+  }
+  if (r.value() != 0) {
+    ShellPrintf("source: %s:%u: exit status %d\r\n", argv[1], line, r.value());
+  }
+  return r.value();
+}
+
+inline bool RegisterSourceOnce() noexcept {
+  static const bool done = []() {
+    CommandRegistry::Instance().Register("source", SourceCommand, nullptr, "Run commands from a script file",
+                                         kCmdAsync);
+    return true;
+  }();
+  return done;
+}
+
+static const bool kSourceRegistered EMBSH_UNUSED = RegisterSourceOnce();
+
+}  // namespace detail
+
+}  // namespace embsh
+
+#endif  // EMBSH_SCRIPT_HPP_
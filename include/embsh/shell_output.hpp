@@ -0,0 +1,574 @@
+/**
+ * @file shell_output.hpp
+ * @brief Command output routing: ShellPrintf, ShellWrite and appenders.
+ *
+ * Output goes to the session bound to the calling thread (see
+ * detail::SessionOutput). When the backend exposes its output buffer,
+ * text is formatted straight into it; anything that does not fit is
+ * streamed through the session's write callback in chunks, so there is
+ * no limit on the total length of one call. Code that runs commands
+ * without a session binds an OutputSink instead.
+ */
+
+#ifndef EMBSH_SHELL_OUTPUT_HPP_
+#define EMBSH_SHELL_OUTPUT_HPP_
+
+#include "embsh/platform.hpp"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cwchar>
+#include <string_view>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace embsh {
+
+namespace detail {
+
+/// @brief Session write callback: append @p len bytes to the session output.
+using SessionWriteFn = void (*)(const char* data, size_t len, void* session_ctx);
+
+/// @brief Raw bulk write callback (see ShellWriteBinary()).
+using SessionBulkFn = bool (*)(const void* data, size_t len, void* session_ctx);
+
+/// @brief fd-backed bulk callback (see ShellSendFd()).
+using SessionSendFdFn = ssize_t (*)(int fd, off_t* offset, size_t count, void* session_ctx);
+
+/**
+ * @brief Thread-local session write context for Printf routing.
+ *
+ * @c buf / @c len / @c cap optionally expose the session's output buffer;
+ * short writes are copied there directly and only overflow goes through
+ * @c write, which is expected to flush.
+ */
+struct SessionOutput {
+  SessionWriteFn write = nullptr;
+  void* ctx = nullptr;
+  char* buf = nullptr;       ///< Session output buffer, or nullptr.
+  uint32_t* len = nullptr;   ///< Bytes used in buf.
+  uint32_t cap = 0;          ///< Capacity of buf.
+  SessionBulkFn bulk = nullptr;
+  SessionSendFdFn send_fd = nullptr;
+  const std::atomic<bool>* cancel = nullptr;  ///< Set while an async command runs.
+};
+
+inline SessionOutput& CurrentOutput() noexcept {
+  static thread_local SessionOutput out;
+  return out;
+}
+
+/// @brief Append @p len raw bytes to @p out (buffer first, then the write callback).
+inline void OutputWrite(const SessionOutput& out, const char* data, size_t len) noexcept {
+  if (out.write == nullptr || len == 0)
+    return;
+  if (out.buf != nullptr && len <= out.cap - *out.len) {
+    std::memcpy(out.buf + *out.len, data, len);
+    *out.len += static_cast<uint32_t>(len);
+    return;
+  }
+  out.write(data, len, out.ctx);
+}
+
+}  // namespace detail
+
+// ============================================================================
+// Unformatted appenders
+// ============================================================================
+
+/// @brief Append @p len raw bytes to the current session's output.
+inline void ShellWrite(const char* data, size_t len) noexcept {
+  detail::OutputWrite(detail::CurrentOutput(), data, len);
+}
+
+inline void ShellWrite(std::string_view str) noexcept {
+  ShellWrite(str.data(), str.size());
+}
+
+/// @brief Append @p value in decimal.
+inline void ShellWriteUint(uint64_t value) noexcept {
+  char tmp[20];
+  size_t pos = sizeof(tmp);
+  do {
+    tmp[--pos] = static_cast<char>('0' + value % 10U);
+    value /= 10U;
+  } while (value != 0);
+  ShellWrite(tmp + pos, sizeof(tmp) - pos);
+}
+
+/// @brief Append @p value in decimal, with a leading '-' when negative.
+inline void ShellWriteInt(int64_t value) noexcept {
+  if (value < 0) {
+    ShellWrite("-", 1);
+    ShellWriteUint(0U - static_cast<uint64_t>(value));
+    return;
+  }
+  ShellWriteUint(static_cast<uint64_t>(value));
+}
+
+/// @brief Append @p value in lowercase hex, zero-padded to @p min_digits (no "0x").
+inline void ShellWriteHex(uint64_t value, uint32_t min_digits = 0) noexcept {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  char tmp[16];
+  size_t pos = sizeof(tmp);
+  if (min_digits > sizeof(tmp))
+    min_digits = sizeof(tmp);
+  do {
+    tmp[--pos] = kDigits[value & 0xFU];
+    value >>= 4;
+  } while (value != 0);
+  while (sizeof(tmp) - pos < min_digits) {
+    tmp[--pos] = '0';
+  }
+  ShellWrite(tmp + pos, sizeof(tmp) - pos);
+}
+
+/**
+ * @brief Send raw bytes (trace buffers, binary dumps) to the current session.
+ *
+ * No text processing: bytes leave unchanged except for the telnet escaping
+ * (IAC doubling, and CR NUL until the peer accepts BINARY). Pending text
+ * output goes out first.
+ *
+ * @return false if no session is bound or the transport failed.
+ */
+inline bool ShellWriteBinary(const void* data, size_t len) noexcept {
+  auto& out = detail::CurrentOutput();
+  return out.bulk != nullptr && out.bulk(data, len, out.ctx);
+}
+
+/**
+ * @brief Stream up to @p count bytes of @p fd to the current session.
+ *
+ * Starts at @p *offset (advanced) or the fd's file position if @p offset is
+ * nullptr. Uses sendfile() where the transport allows it.
+ *
+ * @return Bytes sent, or -1 if no session is bound or on error.
+ */
+inline ssize_t ShellSendFd(int fd, off_t* offset, size_t count) noexcept {
+  auto& out = detail::CurrentOutput();
+  return (out.send_fd != nullptr) ? out.send_fd(fd, offset, count, out.ctx) : -1;
+}
+
+// ============================================================================
+// Streaming printf
+// ============================================================================
+
+namespace detail {
+
+/// @brief Append @p count copies of the space character.
+inline void WritePadding(int count) noexcept {
+  static constexpr char kSpaces[] = "                ";
+  while (count > 0) {
+    int n = (count < static_cast<int>(sizeof(kSpaces) - 1)) ? count : static_cast<int>(sizeof(kSpaces) - 1);
+    ShellWrite(kSpaces, static_cast<size_t>(n));
+    count -= n;
+  }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#endif
+
+/**
+ * @brief printf() that writes each literal run and conversion as it goes.
+ *
+ * %s is streamed without a length limit; every other conversion is
+ * rendered by snprintf() into a small stack buffer, so a single numeric
+ * field is limited to 127 characters. That includes %ls and %lc, which
+ * snprintf() converts to multibyte per the C locale. %n is not supported.
+ *
+ * @return Number of characters produced.
+ */
+inline int StreamFormat(const char* fmt, va_list ap) noexcept {
+  int total = 0;
+  const char* p = fmt;
+  while (*p != '\0') {
+    const char* lit = p;
+    while (*p != '\0' && *p != '%')
+      ++p;
+    if (p > lit) {
+      ShellWrite(lit, static_cast<size_t>(p - lit));
+      total += static_cast<int>(p - lit);
+    }
+    if (*p == '\0')
+      break;
+
+    // Rebuild the conversion spec with '*' arguments resolved.
+    const char* start = p++;
+    char spec[48];  // '%' + flags + width + precision + length + conv.
+    size_t sl = 0;
+    spec[sl++] = '%';
+    bool left = false;
+    while (*p != '\0' && std::strchr("-+ #0", *p) != nullptr) {
+      left |= (*p == '-');
+      if (sl < 8)
+        spec[sl++] = *p;
+      ++p;
+    }
+    int width = 0;
+    if (*p == '*') {
+      width = va_arg(ap, int);
+      if (width < 0) {
+        left = true;
+        width = -width;
+        spec[sl++] = '-';
+      }
+      ++p;
+    } else {
+      while (*p >= '0' && *p <= '9')
+        width = width * 10 + (*p++ - '0');
+    }
+    int prec = -1;
+    if (*p == '.') {
+      ++p;
+      if (*p == '*') {
+        prec = va_arg(ap, int);
+        ++p;
+      } else {
+        prec = 0;
+        while (*p >= '0' && *p <= '9')
+          prec = prec * 10 + (*p++ - '0');
+      }
+    }
+    if (width > 0) {
+      sl += static_cast<size_t>(std::snprintf(spec + sl, sizeof(spec) - sl, "%d", width));
+    }
+    if (prec >= 0) {
+      sl += static_cast<size_t>(std::snprintf(spec + sl, sizeof(spec) - sl, ".%d", prec));
+    }
+    char length[3] = {};
+    size_t ll = 0;
+    while (ll < 2 && *p != '\0' && std::strchr("hljztL", *p) != nullptr) {
+      length[ll++] = *p;
+      spec[sl++] = *p++;
+    }
+    const char conv = *p;
+    if (conv == '\0') {
+      // Truncated spec: emit it verbatim.
+      ShellWrite(start, static_cast<size_t>(p - start));
+      total += static_cast<int>(p - start);
+      break;
+    }
+    ++p;
+    spec[sl++] = conv;
+    spec[sl] = '\0';
+
+    char tmp[128];
+    int n = 0;
+    switch (conv) {
+      case '%':
+        tmp[0] = '%';
+        n = 1;
+        break;
+      case 's': {
+        if (length[0] == 'l') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, const wchar_t*));
+          break;
+        }
+        const char* str = va_arg(ap, const char*);
+        if (str == nullptr)
+          str = "(null)";
+        size_t len = (prec >= 0) ? strnlen(str, static_cast<size_t>(prec)) : std::strlen(str);
+        int pad = (width > static_cast<int>(len)) ? width - static_cast<int>(len) : 0;
+        if (!left)
+          WritePadding(pad);
+        ShellWrite(str, len);
+        if (left)
+          WritePadding(pad);
+        total += static_cast<int>(len) + pad;
+        continue;
+      }
+      case 'c':
+        if (length[0] == 'l') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, wint_t));
+        } else {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, int));
+        }
+        break;
+      case 'd':
+      case 'i':
+        if (length[0] == 'l' && length[1] == 'l') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long long));
+        } else if (length[0] == 'l') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long));
+        } else if (length[0] == 'j') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, intmax_t));
+        } else if (length[0] == 'z' || length[0] == 't') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, ptrdiff_t));
+        } else {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, int));
+        }
+        break;
+      case 'u':
+      case 'o':
+      case 'x':
+      case 'X':
+        if (length[0] == 'l' && length[1] == 'l') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, unsigned long long));
+        } else if (length[0] == 'l') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, unsigned long));
+        } else if (length[0] == 'j') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, uintmax_t));
+        } else if (length[0] == 'z' || length[0] == 't') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, size_t));
+        } else {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, unsigned int));
+        }
+        break;
+      case 'p':
+        n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, void*));
+        break;
+      case 'f':
+      case 'F':
+      case 'e':
+      case 'E':
+      case 'g':
+      case 'G':
+      case 'a':
+      case 'A':
+        if (length[0] == 'L') {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, long double));
+        } else {
+          n = std::snprintf(tmp, sizeof(tmp), spec, va_arg(ap, double));
+        }
+        break;
+      default:
+        // Unknown conversion (including %n): emit it verbatim, consume nothing.
+        ShellWrite(start, static_cast<size_t>(p - start));
+        total += static_cast<int>(p - start);
+        continue;
+    }
+    if (n > 0) {
+      size_t len = (static_cast<size_t>(n) < sizeof(tmp)) ? static_cast<size_t>(n) : sizeof(tmp) - 1;
+      ShellWrite(tmp, len);
+      total += static_cast<int>(len);
+    }
+  }
+  return total;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+}  // namespace detail
+
+/**
+ * @brief Printf into the current session's output.
+ *
+ * Formats directly into the session output buffer when the result fits;
+ * otherwise streams it in chunks, flushing as the buffer fills. Output is
+ * never truncated as a whole.
+ *
+ * @return Characters written, or -1 if no session is bound.
+ */
+inline int ShellPrintf(const char* fmt, ...)
+#if defined(__GNUC__) || defined(__clang__)
+    __attribute__((format(printf, 1, 2)))
+#endif
+    ;
+
+inline int ShellPrintf(const char* fmt, ...) {
+  auto& out = detail::CurrentOutput();
+  if (out.write == nullptr)
+    return -1;
+
+  va_list args;
+  va_start(args, fmt);
+  if (out.buf != nullptr) {
+    const size_t room = out.cap - *out.len;
+    va_list probe;
+    va_copy(probe, args);
+    int n = std::vsnprintf(out.buf + *out.len, room, fmt, probe);
+    va_end(probe);
+    if (n >= 0 && static_cast<size_t>(n) < room) {
+      *out.len += static_cast<uint32_t>(n);
+      va_end(args);
+      return n;
+    }
+    // Did not fit: the partial text is past *out.len and is overwritten below.
+  }
+  int n = detail::StreamFormat(fmt, args);
+  va_end(args);
+  return n;
+}
+
+/**
+ * @brief True once the user pressed Ctrl+C during the current async command.
+ *
+ * Long-running (kCmdAsync) commands should poll this and return early.
+ * Always false for synchronous commands.
+ */
+inline bool ShellCancelled() noexcept {
+  const auto* cancel = detail::CurrentOutput().cancel;
+  return cancel != nullptr && cancel->load(std::memory_order_acquire);
+}
+
+// ============================================================================
+// OutputSink - capture command output without a session
+// ============================================================================
+
+/**
+ * @brief Caller-owned buffer that receives command output (see CommandRegistry::Execute()).
+ *
+ * ShellPrintf formats straight into the buffer. Once it is full, output
+ * either goes to the optional flush callback (stream into an HTTP reply,
+ * an arena, a log) and the buffer is reused, or is dropped and counted.
+ * With cap 0 (buf may be nullptr) every write goes straight to the callback.
+ * No heap and no locks: a sink belongs to one thread at a time.
+ */
+class OutputSink {
+ public:
+  /// @brief Hand one chunk of output on; false stops further delivery (the rest is dropped).
+  using FlushFn = bool (*)(const char* data, size_t len, void* ctx);
+
+  OutputSink(char* buf, size_t cap) noexcept : OutputSink(buf, cap, nullptr, nullptr) {}
+
+  OutputSink(char* buf, size_t cap, FlushFn flush, void* ctx) noexcept
+      : buf_(buf), cap_(static_cast<uint32_t>((cap < UINT32_MAX) ? cap : UINT32_MAX)), flush_(flush), ctx_(ctx) {}
+
+  OutputSink(const OutputSink&) = delete;
+  OutputSink& operator=(const OutputSink&) = delete;
+
+  /// @brief Bytes held in the buffer (not yet flushed).
+  const char* data() const noexcept { return buf_; }
+  size_t size() const noexcept { return len_; }
+  std::string_view view() const noexcept { return std::string_view(buf_, len_); }
+
+  /// @brief Bytes produced since the last Clear(), including flushed and dropped ones.
+  uint64_t Total() const noexcept { return total_ + len_; }
+
+  /// @brief Bytes lost to a full buffer without a flush callback (or after it failed).
+  uint64_t Dropped() const noexcept { return dropped_; }
+
+  /// @brief Forget buffered output and reset the counters.
+  void Clear() noexcept {
+    len_ = 0;
+    total_ = 0;
+    dropped_ = 0;
+    failed_ = false;
+  }
+
+  /// @brief Append raw bytes; flushes or drops what does not fit.
+  inline void Write(const void* data, size_t len) noexcept;
+
+  /// @brief Pass buffered bytes to the flush callback. @return false if it failed or there is none.
+  inline bool Flush() noexcept;
+
+ private:
+  char* buf_;
+  uint32_t cap_;
+  uint32_t len_ = 0;
+  FlushFn flush_;
+  void* ctx_;
+  uint64_t total_ = 0;  ///< Bytes flushed or dropped.
+  uint64_t dropped_ = 0;
+  bool failed_ = false;
+
+  friend class ScopedSinkOutput;
+};
+
+inline void OutputSink::Write(const void* data, size_t len) noexcept {
+  const auto* src = static_cast<const char*>(data);
+  if (cap_ == 0 && len > 0) {
+    // Pure streaming sink: every write goes straight to the callback.
+    if (flush_ == nullptr || failed_ || !flush_(src, len, ctx_)) {
+      failed_ = failed_ || flush_ != nullptr;
+      dropped_ += len;
+    }
+    total_ += len;
+    return;
+  }
+  while (len > 0) {
+    size_t room = cap_ - len_;
+    if (room == 0) {
+      if (!Flush()) {
+        dropped_ += len;
+        total_ += len;
+        return;
+      }
+      room = cap_;
+    }
+    const size_t n = (len < room) ? len : room;
+    std::memcpy(buf_ + len_, src, n);
+    len_ += static_cast<uint32_t>(n);
+    src += n;
+    len -= n;
+  }
+}
+
+inline bool OutputSink::Flush() noexcept {
+  if (flush_ == nullptr || failed_)
+    return false;
+  if (len_ > 0) {
+    failed_ = !flush_(buf_, len_, ctx_);
+    if (failed_) {
+      dropped_ += len_;
+    }
+    total_ += len_;
+    len_ = 0;
+  }
+  return !failed_;
+}
+
+/**
+ * @brief Route ShellPrintf / ShellWrite on this thread into a sink for the current scope.
+ *
+ * The previous binding (a session, or an outer sink) is restored on exit,
+ * so a command may capture the output of the commands it runs.
+ */
+class ScopedSinkOutput final {
+ public:
+  explicit ScopedSinkOutput(OutputSink& sink) noexcept : saved_(detail::CurrentOutput()) {
+    auto& out = detail::CurrentOutput();
+    out = detail::SessionOutput{};
+    out.write = [](const char* data, size_t len, void* ctx) noexcept {
+      static_cast<OutputSink*>(ctx)->Write(data, len);
+    };
+    out.ctx = &sink;
+    out.buf = (sink.cap_ > 0) ? sink.buf_ : nullptr;
+    out.len = &sink.len_;
+    out.cap = sink.cap_;
+    out.bulk = [](const void* data, size_t len, void* ctx) noexcept {
+      static_cast<OutputSink*>(ctx)->Write(data, len);
+      return true;
+    };
+    out.send_fd = [](int fd, off_t* offset, size_t count, void* ctx) noexcept -> ssize_t {
+      char chunk[512];
+      size_t sent = 0;
+      while (sent < count) {
+        const size_t want = (count - sent < sizeof(chunk)) ? count - sent : sizeof(chunk);
+        ssize_t n = (offset != nullptr) ? ::pread(fd, chunk, want, *offset) : ::read(fd, chunk, want);
+        if (n < 0)
+          return (sent > 0) ? static_cast<ssize_t>(sent) : -1;
+        if (n == 0)
+          break;
+        static_cast<OutputSink*>(ctx)->Write(chunk, static_cast<size_t>(n));
+        if (offset != nullptr)
+          *offset += n;
+        sent += static_cast<size_t>(n);
+      }
+      return static_cast<ssize_t>(sent);
+    };
+    out.cancel = saved_.cancel;  // Ctrl+C on an enclosing async command still reaches nested ones.
+  }
+
+  ~ScopedSinkOutput() { detail::CurrentOutput() = saved_; }
+
+  ScopedSinkOutput(const ScopedSinkOutput&) = delete;
+  ScopedSinkOutput& operator=(const ScopedSinkOutput&) = delete;
+
+ private:
+  detail::SessionOutput saved_;
+};
+
+}  // namespace embsh
+
+#endif  // EMBSH_SHELL_OUTPUT_HPP_
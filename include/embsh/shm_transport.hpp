@@ -0,0 +1,749 @@
+/**
+ * @file shm_transport.hpp
+ * @brief Shared-memory shell backend and client: a pair of lock-free SPSC
+ *        rings in a memfd, eventfd wakeups, fds handed over a unix socket.
+ *
+ * A local supervisor talks to the shell without loopback TCP, IAC
+ * filtering or a socket write per line: bytes are copied into a ring and
+ * the peer is woken only when the ring goes from empty to non-empty (or a
+ * full producer is waiting for space). The unix socket carries the memfd
+ * and the two eventfds once per connection and then only signals hangup.
+ */
+
+#ifndef EMBSH_SHM_TRANSPORT_HPP_
+#define EMBSH_SHM_TRANSPORT_HPP_
+
+#include "embsh/history_file.hpp"
+#include "embsh/line_editor.hpp"
+#include "embsh/thread.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef EMBSH_SHM_RING_SIZE
+#define EMBSH_SHM_RING_SIZE 16384  ///< Bytes per direction; rounded up to a power of two.
+#endif
+
+namespace embsh {
+
+namespace detail {
+
+constexpr uint32_t kShmMagic = 0x484D5345U;  ///< "ESMH"
+constexpr uint32_t kShmVersion = 1;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring indices must be address-free atomics");
+
+/// @brief Indices of one single-producer / single-consumer ring; free-running, masked on use.
+struct ShmRing {
+  alignas(64) std::atomic<uint32_t> head{0};  ///< Written by the producer only.
+  alignas(64) std::atomic<uint32_t> tail{0};  ///< Written by the consumer only.
+  alignas(64) std::atomic<uint32_t> producer_waiting{0};  ///< Producer found the ring full and sleeps.
+};
+
+/// @brief Start of the shared mapping; the two data areas follow it.
+struct ShmLayout {
+  uint32_t magic = kShmMagic;
+  uint32_t version = kShmVersion;
+  uint32_t ring_bytes = 0;
+  std::atomic<uint32_t> client_closed{0};
+  std::atomic<uint32_t> shell_closed{0};
+  ShmRing in;   ///< Client to shell.
+  ShmRing out;  ///< Shell to client.
+};
+
+inline size_t ShmMapSize(uint32_t ring_bytes) noexcept {
+  return sizeof(ShmLayout) + 2U * ring_bytes;
+}
+
+inline void ShmSignal(int fd) noexcept {
+  const uint64_t one = 1;
+  (void)::write(fd, &one, sizeof(one));
+}
+
+inline void ShmDrain(int fd) noexcept {
+  uint64_t value = 0;
+  (void)::read(fd, &value, sizeof(value));
+}
+
+/// @brief One side's view of a channel.
+struct ShmEndpoint {
+  ShmLayout* layout = nullptr;
+  ShmRing* rx = nullptr;
+  ShmRing* tx = nullptr;
+  uint8_t* rx_data = nullptr;
+  uint8_t* tx_data = nullptr;
+  uint32_t cap = 0;
+  int own_fd = -1;   ///< eventfd this side sleeps on (data to read, or space to write).
+  int peer_fd = -1;  ///< eventfd the other side sleeps on.
+  std::atomic<uint32_t>* peer_closed = nullptr;
+  int timeout_ms = 2000;  ///< Longest a write waits for the peer to make room.
+
+  /// @brief Point the endpoint into a mapped layout; @p shell selects the direction.
+  inline void Bind(ShmLayout* l, bool shell, int own, int peer) noexcept {
+    layout = l;
+    cap = l->ring_bytes;
+    uint8_t* base = reinterpret_cast<uint8_t*>(l) + sizeof(ShmLayout);
+    rx = shell ? &l->in : &l->out;
+    tx = shell ? &l->out : &l->in;
+    rx_data = shell ? base : base + cap;
+    tx_data = shell ? base + cap : base;
+    peer_closed = shell ? &l->client_closed : &l->shell_closed;
+    own_fd = own;
+    peer_fd = peer;
+  }
+};
+
+/**
+ * @brief Contiguous readable bytes at the ring tail, without consuming them.
+ *
+ * own_fd is level-triggered in effect: it is drained only once the ring is
+ * seen empty, then the ring is re-checked (a seq_cst fence pairs with the
+ * producer's), so a wakeup can be spurious but never lost.
+ *
+ * @return Bytes at @p *data, 0 once the peer closed (or the indices are
+ *         corrupt), -1 with errno EAGAIN when empty.
+ */
+inline ssize_t ShmPeek(ShmEndpoint& ep, const uint8_t** data) noexcept {
+  const uint32_t t = ep.rx->tail.load(std::memory_order_relaxed);
+  uint32_t n = ep.rx->head.load(std::memory_order_acquire) - t;
+  if (n == 0) {
+    ShmDrain(ep.own_fd);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    n = ep.rx->head.load(std::memory_order_acquire) - t;
+    if (n == 0) {
+      if (ep.peer_closed->load(std::memory_order_acquire) != 0)
+        return 0;
+      errno = EAGAIN;
+      return -1;
+    }
+    ShmSignal(ep.own_fd);  // The drained wakeup may also cover bytes this read leaves behind.
+  }
+  if (n > ep.cap)
+    return 0;  // The peer broke the ring; treat it as gone.
+  const uint32_t off = t & (ep.cap - 1);
+  *data = ep.rx_data + off;
+  return static_cast<ssize_t>((n < ep.cap - off) ? n : ep.cap - off);
+}
+
+/// @brief Release @p n peeked bytes and wake a producer waiting for room.
+inline void ShmConsume(ShmEndpoint& ep, size_t n) noexcept {
+  ep.rx->tail.store(ep.rx->tail.load(std::memory_order_relaxed) + static_cast<uint32_t>(n),
+                    std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ep.rx->producer_waiting.load(std::memory_order_relaxed) != 0 &&
+      ep.rx->producer_waiting.exchange(0, std::memory_order_relaxed) != 0) {
+    ShmSignal(ep.peer_fd);
+  }
+}
+
+/// @brief Copy out up to @p len bytes (both sides of the wrap). @return As ShmPeek().
+inline ssize_t ShmRead(ShmEndpoint& ep, void* buf, size_t len) noexcept {
+  auto* dst = static_cast<uint8_t*>(buf);
+  size_t total = 0;
+  while (total < len) {
+    const uint8_t* src = nullptr;
+    ssize_t n = ShmPeek(ep, &src);
+    if (n <= 0)
+      return (total > 0) ? static_cast<ssize_t>(total) : n;
+    size_t take = (static_cast<size_t>(n) < len - total) ? static_cast<size_t>(n) : len - total;
+    std::memcpy(dst + total, src, take);
+    ShmConsume(ep, take);
+    total += take;
+  }
+  return static_cast<ssize_t>(total);
+}
+
+/**
+ * @brief Free bytes in the tx ring at producer index @p h.
+ * @return false if the consumer's tail is not within cap bytes behind @p h
+ *         (a corrupt or hostile peer); nothing may then be copied.
+ */
+inline bool ShmRoom(const ShmEndpoint& ep, uint32_t h, uint32_t& room) noexcept {
+  const uint32_t used = h - ep.tx->tail.load(std::memory_order_acquire);
+  if (used > ep.cap)
+    return false;
+  room = ep.cap - used;
+  return true;
+}
+
+/**
+ * @brief Copy an iovec array into the ring, sleeping on own_fd while it is full.
+ *
+ * The consumer is signalled only when it may have seen the ring empty.
+ *
+ * @return Bytes written; -1 with errno EPIPE (peer closed or corrupt ring
+ *         indices) or ETIMEDOUT (no room for timeout_ms) if nothing was written.
+ */
+inline ssize_t ShmWrite(ShmEndpoint& ep, const struct iovec* iov, int iovcnt) noexcept {
+  size_t total = 0;
+  bool drained = false;
+  int i = 0;
+  size_t done_in_iov = 0;
+  ssize_t result = 0;
+  while (i < iovcnt) {
+    if (ep.peer_closed->load(std::memory_order_acquire) != 0) {
+      errno = EPIPE;
+      result = -1;
+      break;
+    }
+    const uint32_t h = ep.tx->head.load(std::memory_order_relaxed);
+    uint32_t room = 0;
+    if (!ShmRoom(ep, h, room)) {
+      errno = EPIPE;  // The peer broke the ring; treat it as gone.
+      result = -1;
+      break;
+    }
+    if (room == 0) {
+      ep.tx->producer_waiting.store(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!ShmRoom(ep, h, room)) {
+        errno = EPIPE;
+        result = -1;
+        break;
+      }
+      if (room == 0) {
+        struct pollfd pfd = {ep.own_fd, POLLIN, 0};
+        int pr = ::poll(&pfd, 1, ep.timeout_ms);
+        if (pr < 0 && errno == EINTR)
+          continue;
+        if (pr <= 0) {
+          errno = ETIMEDOUT;
+          result = -1;
+          break;
+        }
+        ShmDrain(ep.own_fd);
+        drained = true;
+        continue;
+      }
+    }
+
+    uint32_t put = 0;
+    while (i < iovcnt && put < room) {
+      const size_t left = iov[i].iov_len - done_in_iov;
+      const uint32_t chunk = (left < room - put) ? static_cast<uint32_t>(left) : room - put;
+      const uint8_t* src = static_cast<const uint8_t*>(iov[i].iov_base) + done_in_iov;
+      const uint32_t off = (h + put) & (ep.cap - 1);
+      const uint32_t first = (chunk < ep.cap - off) ? chunk : ep.cap - off;
+      std::memcpy(ep.tx_data + off, src, first);
+      std::memcpy(ep.tx_data, src + first, chunk - first);
+      put += chunk;
+      done_in_iov += chunk;
+      if (done_in_iov == iov[i].iov_len) {
+        ++i;
+        done_in_iov = 0;
+      }
+    }
+    ep.tx->head.store(h + put, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ep.tx->tail.load(std::memory_order_relaxed) == h) {
+      ShmSignal(ep.peer_fd);  // The consumer may be asleep on an empty ring.
+    }
+    total += put;
+  }
+  if (drained) {
+    ShmSignal(ep.own_fd);  // Waiting for room may have swallowed a data wakeup.
+  }
+  return (total > 0 || result == 0) ? static_cast<ssize_t>(total) : result;
+}
+
+/// @brief Transport ops of the shell side; the context is a ShmEndpoint.
+inline const Transport& ShmShellTransport() noexcept {
+  static const Transport ops = {
+      [](void* ctx, const struct iovec* iov, int iovcnt) noexcept -> ssize_t {
+        ssize_t n = ShmRead(*static_cast<ShmEndpoint*>(ctx), iov[0].iov_base, iov[0].iov_len);
+        (void)iovcnt;  // One buffer per read today (rx_buf).
+        return n;
+      },
+      [](void* ctx, const struct iovec* iov, int iovcnt) noexcept -> ssize_t {
+        return ShmWrite(*static_cast<ShmEndpoint*>(ctx), iov, iovcnt);
+      },
+      [](void* ctx, const uint8_t** data) noexcept -> ssize_t {
+        return ShmPeek(*static_cast<ShmEndpoint*>(ctx), data);
+      },
+      [](void* ctx, size_t len) noexcept { ShmConsume(*static_cast<ShmEndpoint*>(ctx), len); },
+  };
+  return ops;
+}
+
+/// @brief Fill a sockaddr_un; false if @p path does not fit.
+inline bool ShmSocketAddr(const char* path, struct sockaddr_un& addr) noexcept {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  const size_t len = std::strlen(path);
+  if (len == 0 || len >= sizeof(addr.sun_path))
+    return false;
+  std::memcpy(addr.sun_path, path, len);
+  return true;
+}
+
+}  // namespace detail
+
+// ============================================================================
+// ShmShell - shell side
+// ============================================================================
+
+/**
+ * @brief Shell backend serving one local client at a time over shared memory.
+ *
+ * Listens on a unix socket. Each connection gets a fresh memfd with both
+ * rings plus two eventfds (SCM_RIGHTS); the session then reads its input
+ * in place from the ring (Transport::borrow) and writes output straight
+ * into the other ring. A second client is refused until the first one
+ * disconnects or runs `exit`.
+ */
+class ShmShell final {
+ public:
+  struct Config {
+    const char* path;          ///< Unix socket path for the fd handoff.
+    const char* prompt;
+    uint32_t ring_bytes;       ///< Per direction; rounded up to a power of two.
+    mode_t mode;               ///< Permissions of the socket file.
+    int tx_timeout_ms;         ///< Longest an output write waits for a stalled client.
+    const char* history_file;  ///< Persistent history log (nullptr = in memory only).
+    ThreadOptions thread;      ///< Scheduling, affinity and stack of the shell thread.
+
+    Config() noexcept
+        : path("/tmp/embsh.sock"),
+          prompt("embsh> "),
+          ring_bytes(EMBSH_SHM_RING_SIZE),
+          mode(0600),
+          tx_timeout_ms(2000),
+          history_file(nullptr),
+          thread() {}
+  };
+
+  explicit ShmShell(const Config& cfg = Config{}) : cfg_(cfg) { detail::RegisterHelpOnce(); }
+
+  ~ShmShell() { Stop(); }
+
+  ShmShell(const ShmShell&) = delete;
+  ShmShell& operator=(const ShmShell&) = delete;
+
+  /// @brief Bind the socket and start serving. kPortInUse if another server owns the path.
+  inline expected<void, ShellError> Start() noexcept;
+
+  /// @brief Stop serving, end the client session and remove the socket file.
+  inline void Stop() noexcept;
+
+  bool IsRunning() const noexcept { return running_.load(std::memory_order_relaxed); }
+
+  /// @brief True while a client is connected.
+  bool HasClient() const noexcept { return client_.load(std::memory_order_relaxed); }
+
+ private:
+  Config cfg_;
+  Session session_ = {};
+  detail::ShmEndpoint ep_;
+  Thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<bool> client_{false};
+  WakeEvent wake_;  ///< Signalled by Stop().
+  WakeEvent done_;  ///< Async command finished.
+  int listen_fd_ = -1;
+  int conn_fd_ = -1;  ///< Handoff socket of the current client; reports its hangup.
+  uint32_t ring_bytes_ = 0;
+  HistoryFile* history_file_ = nullptr;
+  HistoryStore history_;  ///< Full-size in-memory history when no history_file is set.
+
+  inline void RunLoop() noexcept;
+  inline void OpenClient(int conn) noexcept;
+  inline void EndClient() noexcept;
+};
+
+// ============================================================================
+// ShmShell implementation
+// ============================================================================
+
+inline expected<void, ShellError> ShmShell::Start() noexcept {
+  if (running_.load(std::memory_order_relaxed)) {
+    return expected<void, ShellError>::error(ShellError::kAlreadyRunning);
+  }
+  struct sockaddr_un addr;
+  if (cfg_.path == nullptr || !detail::ShmSocketAddr(cfg_.path, addr)) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  history_file_ = (cfg_.history_file != nullptr) ? HistoryFile::Shared(cfg_.history_file) : nullptr;
+  if (cfg_.history_file != nullptr && history_file_ == nullptr) {
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
+  session_.history = (history_file_ != nullptr) ? &history_file_->Store() : &history_;
+
+  ring_bytes_ = 64;
+  while (ring_bytes_ < cfg_.ring_bytes && ring_bytes_ < (1U << 30)) {
+    ring_bytes_ <<= 1;
+  }
+
+  // A socket file nobody answers on is left over from a crash; a live one is another server.
+  struct stat st;
+  if (::lstat(cfg_.path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool live = probe >= 0 && ::connect(probe, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0;
+    if (probe >= 0)
+      ::close(probe);
+    if (live) {
+      return expected<void, ShellError>::error(ShellError::kPortInUse);
+    }
+    (void)::unlink(cfg_.path);
+  }
+
+  listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0 || ::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+    const bool in_use = (errno == EADDRINUSE);
+    if (listen_fd_ >= 0)
+      ::close(listen_fd_);
+    listen_fd_ = -1;
+    return expected<void, ShellError>::error(in_use ? ShellError::kPortInUse : ShellError::kDeviceOpenFailed);
+  }
+  (void)::chmod(cfg_.path, cfg_.mode);
+  if (::listen(listen_fd_, 4) < 0 || !wake_.Open() || !done_.Open()) {
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    (void)::unlink(cfg_.path);
+    return expected<void, ShellError>::error(ShellError::kDeviceOpenFailed);
+  }
+
+  running_.store(true, std::memory_order_release);
+  if (!thread_.Start(cfg_.thread, [this]() { RunLoop(); })) {
+    running_.store(false, std::memory_order_release);
+    wake_.Close();
+    done_.Close();
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    (void)::unlink(cfg_.path);
+    return expected<void, ShellError>::error(ShellError::kThreadStartFailed);
+  }
+  return expected<void, ShellError>::success();
+}
+
+inline void ShmShell::Stop() noexcept {
+  if (!running_.load(std::memory_order_relaxed))
+    return;
+  running_.store(false, std::memory_order_release);
+  wake_.Signal();
+  if (thread_.Joinable()) {
+    thread_.Join();
+  }
+  wake_.Close();
+  done_.Close();
+  ::close(listen_fd_);
+  listen_fd_ = -1;
+  (void)::unlink(cfg_.path);
+  if (history_file_ != nullptr) {
+    history_file_->Flush();
+  }
+}
+
+inline void ShmShell::RunLoop() noexcept {
+  auto& s = session_;
+  while (running_.load(std::memory_order_relaxed)) {
+    const bool client = client_.load(std::memory_order_relaxed);
+    struct pollfd pfd[5] = {{wake_.fd(), POLLIN, 0},
+                            {listen_fd_, POLLIN, 0},
+                            {client ? conn_fd_ : -1, POLLIN, 0},
+                            {client ? s.read_fd : -1, POLLIN, 0},
+                            {client ? done_.fd() : -1, POLLIN, 0}};
+    int pr = ::poll(pfd, 5, -1);
+    if (pr < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (pfd[0].revents != 0)
+      continue;  // Loop condition re-checks running_.
+
+    if (client) {
+      bool end = false;
+      if (pfd[2].revents != 0) {
+        char byte;
+        ssize_t r = ::recv(conn_fd_, &byte, 1, MSG_DONTWAIT);
+        end = r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR);  // Hangup.
+      }
+      if (!end && pfd[4].revents != 0) {
+        done_.Drain();
+        editor::ResumeInput(s, cfg_.prompt);
+      }
+      if (!end && pfd[3].revents != 0) {
+        ssize_t n = editor::ReadInput(s, cfg_.prompt);
+        end = n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR);
+      }
+      if (end || !s.active.load(std::memory_order_acquire)) {
+        EndClient();
+      }
+    }
+
+    if (pfd[1].revents != 0) {
+      int conn = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (conn >= 0) {
+        if (client_.load(std::memory_order_relaxed)) {
+          ::close(conn);  // One client at a time.
+        } else {
+          OpenClient(conn);
+        }
+      }
+    }
+  }
+  if (client_.load(std::memory_order_relaxed)) {
+    EndClient();
+  }
+}
+
+inline void ShmShell::OpenClient(int conn) noexcept {
+  const size_t map_len = detail::ShmMapSize(ring_bytes_);
+  int mem_fd = ::memfd_create("embsh-shm", MFD_CLOEXEC);
+  int shell_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  int client_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  void* map = MAP_FAILED;
+  if (mem_fd >= 0 && ::ftruncate(mem_fd, static_cast<off_t>(map_len)) == 0) {
+    map = ::mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+  }
+
+  bool sent = false;
+  if (map != MAP_FAILED && shell_fd >= 0 && client_fd >= 0) {
+    auto* layout = new (map) detail::ShmLayout();
+    layout->ring_bytes = ring_bytes_;
+
+    int fds[3] = {mem_fd, shell_fd, client_fd};
+    char cbuf[CMSG_SPACE(sizeof(fds))] = {};
+    uint32_t version = detail::kShmVersion;
+    struct iovec iov = {&version, sizeof(version)};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    sent = ::sendmsg(conn, &msg, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(version));
+    if (sent) {
+      ep_.Bind(layout, true, shell_fd, client_fd);
+      ep_.timeout_ms = cfg_.tx_timeout_ms;
+    }
+  }
+  if (mem_fd >= 0)
+    ::close(mem_fd);  // The mapping keeps the memory.
+  if (!sent) {
+    if (map != MAP_FAILED)
+      ::munmap(map, map_len);
+    if (shell_fd >= 0)
+      ::close(shell_fd);
+    if (client_fd >= 0)
+      ::close(client_fd);
+    ::close(conn);
+    return;
+  }
+
+  conn_fd_ = conn;
+  auto& s = session_;
+  s.transport = &detail::ShmShellTransport();
+  s.transport_ctx = &ep_;
+  s.read_fd = shell_fd;  // Readiness descriptor.
+  s.write_fd = -1;
+  s.tx_len = 0;
+  s.telnet_mode = false;
+  s.line_pos = 0;
+  s.cursor_back = 0;
+  s.skip_lf = false;
+  s.rx_pos = 0;
+  s.rx_len = 0;
+  s.hist_browsing = false;
+  s.esc_state = Session::EscState::kNone;
+  s.pasting = false;
+  s.searching = false;
+  s.notify = &done_;
+  s.active.store(true, std::memory_order_release);
+  client_.store(true, std::memory_order_release);
+  SessionWrite(s, cfg_.prompt);
+  SessionFlush(s);
+}
+
+inline void ShmShell::EndClient() noexcept {
+  auto& s = session_;
+  editor::WaitIdle(s);
+  SessionFlush(s);
+  s.active.store(false, std::memory_order_release);
+  s.notify = nullptr;
+  s.transport = nullptr;
+  s.read_fd = -1;
+
+  ep_.layout->shell_closed.store(1, std::memory_order_release);
+  detail::ShmSignal(ep_.peer_fd);
+  ::munmap(ep_.layout, detail::ShmMapSize(ep_.cap));
+  ::close(ep_.own_fd);
+  ::close(ep_.peer_fd);
+  ep_ = detail::ShmEndpoint();
+  ::close(conn_fd_);
+  conn_fd_ = -1;
+  done_.Drain();
+  client_.store(false, std::memory_order_release);
+}
+
+// ============================================================================
+// ShmClient - tool side
+// ============================================================================
+
+/**
+ * @brief Client library for ShmShell: send command lines, read the output.
+ *
+ * The shell echoes input and prints its prompt as on any terminal, so a
+ * tool typically writes "cmd\r" and reads until the prompt. Not thread-safe;
+ * use one client per thread (the shell serves one at a time anyway).
+ */
+class ShmClient final {
+ public:
+  ShmClient() = default;
+  ~ShmClient() { Close(); }
+
+  ShmClient(const ShmClient&) = delete;
+  ShmClient& operator=(const ShmClient&) = delete;
+
+  /// @brief Connect to the ShmShell listening on @p path and map its rings.
+  inline expected<void, ShellError> Connect(const char* path, int timeout_ms = 1000) noexcept;
+
+  /// @brief Tell the shell to end the session and unmap.
+  inline void Close() noexcept;
+
+  bool IsOpen() const noexcept { return ep_.layout != nullptr; }
+
+  /**
+   * @brief Send @p len bytes; waits while the ring is full.
+   * @return Bytes sent, or -1 (errno EPIPE: shell gone, ETIMEDOUT: stalled).
+   */
+  ssize_t Write(const void* data, size_t len) noexcept {
+    if (!IsOpen())
+      return -1;
+    struct iovec iov = {const_cast<void*>(data), len};
+    return detail::ShmWrite(ep_, &iov, 1);
+  }
+
+  /**
+   * @brief Read available output, waiting up to @p timeout_ms (-1 = forever) for some.
+   * @return Bytes read, 0 once the shell ended the session, or -1 with
+   *         errno EAGAIN on timeout.
+   */
+  inline ssize_t Read(void* buf, size_t len, int timeout_ms) noexcept;
+
+  /// @brief Readable while output may be pending, for the caller's own poll loop.
+  int fd() const noexcept { return ep_.own_fd; }
+
+ private:
+  detail::ShmEndpoint ep_;
+  int sock_fd_ = -1;
+};
+
+inline expected<void, ShellError> ShmClient::Connect(const char* path, int timeout_ms) noexcept {
+  if (IsOpen()) {
+    return expected<void, ShellError>::error(ShellError::kAlreadyRunning);
+  }
+  struct sockaddr_un addr;
+  if (path == nullptr || !detail::ShmSocketAddr(path, addr)) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock < 0 || ::connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+    if (sock >= 0)
+      ::close(sock);
+    return expected<void, ShellError>::error(ShellError::kDeviceOpenFailed);
+  }
+
+  int fds[3] = {-1, -1, -1};
+  uint32_t version = 0;
+  struct pollfd pfd = {sock, POLLIN, 0};
+  if (::poll(&pfd, 1, timeout_ms) == 1) {
+    char cbuf[CMSG_SPACE(sizeof(fds))] = {};
+    struct iovec iov = {&version, sizeof(version)};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    struct cmsghdr* cm = nullptr;
+    if (::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) == static_cast<ssize_t>(sizeof(version)) &&
+        (cm = CMSG_FIRSTHDR(&msg)) != nullptr && cm->cmsg_type == SCM_RIGHTS &&
+        cm->cmsg_len == CMSG_LEN(sizeof(fds))) {
+      std::memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    }
+  }
+
+  // Validate before trusting the layout: magic, version and a size that matches the memfd.
+  void* map = MAP_FAILED;
+  size_t map_len = 0;
+  struct stat st;
+  if (fds[0] >= 0 && version == detail::kShmVersion && ::fstat(fds[0], &st) == 0 &&
+      static_cast<size_t>(st.st_size) > sizeof(detail::ShmLayout)) {
+    map_len = static_cast<size_t>(st.st_size);
+    map = ::mmap(nullptr, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+  }
+  auto* layout = static_cast<detail::ShmLayout*>(map);
+  const bool ok = map != MAP_FAILED && layout->magic == detail::kShmMagic &&
+                  layout->version == detail::kShmVersion && layout->ring_bytes >= 64 &&
+                  (layout->ring_bytes & (layout->ring_bytes - 1)) == 0 &&
+                  detail::ShmMapSize(layout->ring_bytes) == map_len;
+  if (fds[0] >= 0)
+    ::close(fds[0]);
+  if (!ok) {
+    if (map != MAP_FAILED)
+      ::munmap(map, map_len);
+    for (int i = 1; i < 3; ++i) {
+      if (fds[i] >= 0)
+        ::close(fds[i]);
+    }
+    ::close(sock);
+    return expected<void, ShellError>::error(ShellError::kDeviceOpenFailed);
+  }
+
+  ep_.Bind(layout, false, fds[2], fds[1]);
+  sock_fd_ = sock;
+  return expected<void, ShellError>::success();
+}
+
+inline void ShmClient::Close() noexcept {
+  if (!IsOpen())
+    return;
+  ep_.layout->client_closed.store(1, std::memory_order_release);
+  detail::ShmSignal(ep_.peer_fd);
+  ::munmap(ep_.layout, detail::ShmMapSize(ep_.cap));
+  ::close(ep_.own_fd);
+  ::close(ep_.peer_fd);
+  ep_ = detail::ShmEndpoint();
+  ::close(sock_fd_);
+  sock_fd_ = -1;
+}
+
+inline ssize_t ShmClient::Read(void* buf, size_t len, int timeout_ms) noexcept {
+  if (!IsOpen())
+    return 0;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  for (;;) {
+    ssize_t n = detail::ShmRead(ep_, buf, len);
+    if (n >= 0 || errno != EAGAIN)
+      return n;
+    int wait = -1;
+    if (timeout_ms >= 0) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      if (left.count() <= 0) {
+        errno = EAGAIN;
+        return -1;
+      }
+      wait = static_cast<int>(left.count());
+    }
+    struct pollfd pfd = {ep_.own_fd, POLLIN, 0};
+    (void)::poll(&pfd, 1, wait);
+  }
+}
+
+}  // namespace embsh
+
+#endif  // EMBSH_SHM_TRANSPORT_HPP_
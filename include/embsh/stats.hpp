@@ -0,0 +1,111 @@
+/**
+ * @file stats.hpp
+ * @brief Optional runtime counters: per-command latency, per-session I/O,
+ *        and telnet server events.
+ *
+ * Enabled with EMBSH_ENABLE_STATS=1 (must match in every translation unit).
+ * When disabled no counter is stored or updated. All counters are relaxed
+ * atomics: writers never block, and readers (the built-in `stats` command
+ * or an exporter) see each value torn-free but not as one snapshot.
+ */
+
+#ifndef EMBSH_STATS_HPP_
+#define EMBSH_STATS_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+
+#ifndef EMBSH_ENABLE_STATS
+#define EMBSH_ENABLE_STATS 0
+#endif
+
+namespace embsh {
+
+/// @brief Latency histogram size; bucket i covers [4^(i-1), 4^i) us, bucket 0 is < 1 us.
+constexpr uint32_t kStatsBuckets = 12;
+
+/// @brief Execution statistics of one command.
+struct CmdStats {
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> total_ns{0};
+  std::atomic<uint64_t> max_ns{0};
+  std::atomic<uint32_t> hist[kStatsBuckets] = {};
+
+  /// @brief Histogram bucket of a duration.
+  static constexpr uint32_t Bucket(uint64_t ns) noexcept {
+    uint64_t us = ns / 1000U;
+    uint32_t b = 0;
+    while (us != 0 && b < kStatsBuckets - 1) {
+      us >>= 2;
+      ++b;
+    }
+    return b;
+  }
+
+  /// @brief Upper bound of bucket @p b in microseconds (0 for the last, open bucket).
+  static constexpr uint64_t BucketLimitUs(uint32_t b) noexcept {
+    return (b + 1 >= kStatsBuckets) ? 0 : (uint64_t{1} << (2 * b));
+  }
+
+  inline void Record(uint64_t ns) noexcept {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+    hist[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t prev = max_ns.load(std::memory_order_relaxed);
+    while (ns > prev && !max_ns.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+  }
+};
+
+/// @brief I/O counters of one session.
+struct SessionStats {
+  std::atomic<uint64_t> bytes_in{0};
+  std::atomic<uint64_t> bytes_out{0};
+  std::atomic<uint64_t> read_calls{0};   ///< Transport reads (read_fn() / Transport readv / borrow).
+  std::atomic<uint64_t> write_calls{0};  ///< Transport writes and sendfile() calls.
+  std::atomic<uint64_t> lines{0};        ///< Non-empty lines executed.
+  std::atomic<uint64_t> tx_dropped{0};   ///< Output bytes discarded by TxPolicy::kDrop.
+
+  inline void Reset() noexcept {
+    bytes_in.store(0, std::memory_order_relaxed);
+    bytes_out.store(0, std::memory_order_relaxed);
+    read_calls.store(0, std::memory_order_relaxed);
+    write_calls.store(0, std::memory_order_relaxed);
+    lines.store(0, std::memory_order_relaxed);
+    tx_dropped.store(0, std::memory_order_relaxed);
+  }
+};
+
+/// @brief Telnet server event counters.
+struct ServerStats {
+  std::atomic<uint64_t> accepts{0};
+  std::atomic<uint64_t> rejects{0};        ///< No free session slot.
+  std::atomic<uint64_t> auth_failures{0};  ///< Wrong username/password attempts.
+};
+
+/// @brief Counters summed over every TelnetServer in the process.
+inline ServerStats& TelnetStats() noexcept {
+  static ServerStats stats;
+  return stats;
+}
+
+namespace detail {
+
+/// @brief Monotonic clock for command timing.
+inline uint64_t StatsNowNs() noexcept {
+  struct timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/// @brief Relaxed increment shorthand.
+inline void StatsAdd(std::atomic<uint64_t>& counter, uint64_t n = 1) noexcept {
+  counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+}  // namespace detail
+
+}  // namespace embsh
+
+#endif  // EMBSH_STATS_HPP_
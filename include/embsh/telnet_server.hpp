@@ -7,15 +7,22 @@
 #ifndef EMBSH_TELNET_SERVER_HPP_
 #define EMBSH_TELNET_SERVER_HPP_
 
+#include "embsh/history_file.hpp"
 #include "embsh/line_editor.hpp"
+#include "embsh/rate_limit.hpp"
+#include "embsh/thread.hpp"
 
 #include <atomic>
 #include <cstring>
-#include <thread>
+#include <memory>
+#include <new>
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -27,6 +34,14 @@
 #define EMBSH_DEFAULT_PORT 2323
 #endif
 
+#ifndef EMBSH_REACTOR_MAX_EVENTS
+#define EMBSH_REACTOR_MAX_EVENTS 32
+#endif
+
+#ifndef EMBSH_TX_QUEUE_SIZE
+#define EMBSH_TX_QUEUE_SIZE 4096  ///< Per-session output queue for slow clients.
+#endif
+
 namespace embsh {
 
 // ============================================================================
@@ -36,11 +51,29 @@ namespace embsh {
 /// @brief TCP telnet server configuration.
 struct ServerConfig {
   uint16_t port = EMBSH_DEFAULT_PORT;
-  uint32_t max_sessions = EMBSH_MAX_SESSIONS;
+  uint32_t max_sessions = EMBSH_MAX_SESSIONS;  ///< Capped at EMBSH_MAX_SESSIONS unless reactor_mode.
   const char* prompt = "embsh> ";
   const char* banner = "\r\n=== embsh v0.1.0 ===\r\n\r\n";
   const char* username = nullptr;  ///< nullptr = no authentication.
   const char* password = nullptr;
+  bool reactor_mode = false;  ///< Drive listen fd and all sessions from one epoll thread.
+  bool shared_history = false;  ///< One history store for all sessions instead of one each.
+  const char* history_file = nullptr;  ///< Persistent history log shared by all sessions (implies shared_history).
+  bool binary = false;  ///< Offer TELNET BINARY so bulk output (ShellWriteBinary) skips CR NUL stuffing.
+  TxPolicy tx_policy = TxPolicy::kBlock;  ///< When a client's EMBSH_TX_QUEUE_SIZE output queue is full.
+  int tx_timeout_ms = 2000;               ///< kBlock: longest stall before disconnecting (thread mode only).
+  bool prespawn = false;  ///< Thread mode: start all session threads in Start() and hand connections to them.
+  int backlog = 16;       ///< listen() backlog (the kernel caps it at somaxconn).
+  bool reuse_port = false;  ///< SO_REUSEPORT: let several servers share the port.
+  bool tcp_nodelay = true;  ///< TCP_NODELAY on client sockets: echo and prompts are not held back by Nagle.
+  int defer_accept_s = 0;   ///< TCP_DEFER_ACCEPT seconds; only for clients that speak first (0 = off).
+  bool bracketed_paste = false;  ///< Enable xterm bracketed paste on the client terminal while connected.
+  RateLimit session_cmds;   ///< Command lines per second of each session.
+  RateLimit session_bytes;  ///< Input bytes per second of each session (after login).
+  RateLimit total_cmds;     ///< Command lines per second of all sessions together.
+  RateLimit total_bytes;    ///< Input bytes per second of all sessions together.
+  uint32_t max_running = 0;  ///< Commands executing at once across sessions (sync and async); 0 = unlimited.
+  ThreadOptions threads;     ///< Accept/reactor and session threads.
 };
 
 // ============================================================================
@@ -51,7 +84,28 @@ struct ServerConfig {
  * @brief Lightweight telnet debug server.
  *
  * Listens on a configurable TCP port and accepts up to max_sessions
- * concurrent telnet sessions. Each session runs in its own thread.
+ * concurrent telnet sessions. By default each session runs in its own
+ * thread. With ServerConfig::reactor_mode a single thread multiplexes the
+ * listen socket and every session socket through epoll, so a session costs
+ * one slot and one fd instead of a thread; max_sessions is then not bounded
+ * by EMBSH_MAX_SESSIONS.
+ *
+ * Client sockets are non-blocking in both modes. Output a client does not
+ * accept immediately waits in a per-session queue drained on POLLOUT /
+ * EPOLLOUT, so a stalled client never blocks another session; once the
+ * queue is full ServerConfig::tx_policy applies. On the reactor thread
+ * TxPolicy::kBlock acts as kDisconnect, since waiting for one client there
+ * would stall all of them; async commands on the worker pool still wait.
+ *
+ * With ServerConfig::prespawn (thread mode) every session thread starts in
+ * Start() and waits on its slot's handoff event; the accept thread fills a
+ * free slot and signals it, so a connection costs neither a thread spawn
+ * nor a join.
+ *
+ * The rate limits and max_running bound what clients can make the shell
+ * do; input over budget is not read until it fits (see rate_limit.hpp).
+ * ServerConfig::threads places every server thread, e.g. on a housekeeping
+ * core at SCHED_IDLE, away from the real-time workload.
  */
 class TelnetServer final {
  public:
@@ -74,26 +128,66 @@ class TelnetServer final {
  private:
   struct SessionSlot {
     Session session;
-    std::thread thread;
+    Thread thread;
+    SessionBudget budget;
+    WakeEvent done;     ///< Async command finished (thread mode).
+    WakeEvent handoff;  ///< A connection was assigned to this slot (prespawn).
     std::atomic<bool> in_use{false};
+    bool want_in = true;    ///< EPOLLIN registered; dropped while the budget holds input (reactor mode).
+    bool want_out = false;  ///< EPOLLOUT registered (reactor mode).
+    bool closing = false;   ///< Reactor mode: teardown waits for the async command (see ReactorClose()).
+    char tx_queue[EMBSH_TX_QUEUE_SIZE];
   };
 
+  /// @brief Outcome of feeding one byte to the login FSM.
+  enum class AuthResult : uint8_t { kPending = 0, kGranted, kDenied };
+
+  static constexpr uint32_t kListenTag = 0xFFFFFFFFU;
+  static constexpr uint32_t kWakeTag = 0xFFFFFFFEU;
+  static constexpr uint32_t kDoneTag = 0xFFFFFFFDU;
+  static constexpr uint8_t kMaxAuthAttempts = 3;
+
   ServerConfig cfg_;
   int listen_fd_ = -1;
-  std::thread accept_thread_;
-  SessionSlot slots_[EMBSH_MAX_SESSIONS] = {};
+  int epoll_fd_ = -1;
+  WakeEvent wake_;  ///< Signalled by Stop(); in every poll / epoll set.
+  WakeEvent done_;  ///< Async command finished (reactor mode).
+  Thread accept_thread_;
+  std::unique_ptr<SessionSlot[]> slots_;
+  uint32_t slot_count_ = 0;
+  std::unique_ptr<HistoryStore> shared_history_;
+  HistoryFile* history_file_ = nullptr;  ///< HistoryFile::Shared() instance when cfg_.history_file is set.
+  TokenBucket total_cmds_;
+  TokenBucket total_bytes_;
+  std::atomic<uint32_t> running_cmds_{0};  ///< Commands executing (max_running).
   std::atomic<bool> running_{false};
+  bool prespawned_ = false;
+  bool budgeted_ = false;  ///< Any rate limit or max_running configured.
 
   inline void AcceptLoop() noexcept;
+  inline void ReactorLoop() noexcept;
   inline void SessionLoop(SessionSlot& slot) noexcept;
-  inline void RunAuth(Session& s) noexcept;
+  inline void PoolWorker(SessionSlot& slot) noexcept;
+  inline bool ListenSocket() noexcept;
+  inline void TuneClient(int client_fd) const noexcept;
+  inline AuthResult AuthByte(Session& s, uint8_t byte) noexcept;
+  inline bool ConsumeInput(Session& s) noexcept;
+  inline void InitSession(SessionSlot& slot, int client_fd) noexcept;
+  inline void OpenSession(Session& s) noexcept;
+  inline void ReactorAccept() noexcept;
+  inline bool ReactorRead(SessionSlot& slot) noexcept;
+  inline void ReactorResume() noexcept;
+  inline void ReactorRetryHeld() noexcept;
+  inline int ReactorTimeoutMs() const noexcept;
+  inline void ReactorWatch(SessionSlot& slot) noexcept;
+  inline void ReactorClose(SessionSlot& slot) noexcept;
 
   inline int FindFreeSlot() noexcept {
-    for (uint32_t i = 0; i < cfg_.max_sessions && i < EMBSH_MAX_SESSIONS; ++i) {
+    for (uint32_t i = 0; i < slot_count_; ++i) {
       if (!slots_[i].in_use.load(std::memory_order_acquire)) {
-        // Join stale thread if needed.
-        if (slots_[i].thread.joinable()) {
-          slots_[i].thread.join();
+        // Join stale thread if needed; pre-spawned threads stay alive.
+        if (slots_[i].thread.Joinable() && (!prespawned_ || slots_[i].handoff.fd() < 0)) {
+          slots_[i].thread.Join();
         }
         return static_cast<int>(i);
       }
@@ -110,9 +204,21 @@ class TelnetServer final {
     }
   }
 
-  static inline void SendIac(int fd, uint8_t cmd, uint8_t opt) noexcept {
-    uint8_t buf[3] = {0xFF, cmd, opt};
-    (void)::send(fd, buf, 3, MSG_NOSIGNAL);
+  static inline void CountAccept() noexcept {
+#if EMBSH_ENABLE_STATS
+    detail::StatsAdd(TelnetStats().accepts);
+#endif
+  }
+
+  static inline void CountReject() noexcept {
+#if EMBSH_ENABLE_STATS
+    detail::StatsAdd(TelnetStats().rejects);
+#endif
+  }
+
+  static inline void SendIac(Session& s, uint8_t cmd, uint8_t opt) noexcept {
+    const char buf[3] = {static_cast<char>(0xFF), static_cast<char>(cmd), static_cast<char>(opt)};
+    SessionWriteN(s, buf, sizeof(buf));
   }
 };
 
@@ -125,33 +231,90 @@ inline expected<void, ShellError> TelnetServer::Start() noexcept {
     return expected<void, ShellError>::error(ShellError::kAlreadyRunning);
   }
 
-  listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
-  if (listen_fd_ < 0) {
-    return expected<void, ShellError>::error(ShellError::kPortInUse);
+  if (cfg_.max_sessions == 0) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  slot_count_ = cfg_.reactor_mode ? cfg_.max_sessions
+                                  : (cfg_.max_sessions < EMBSH_MAX_SESSIONS ? cfg_.max_sessions : EMBSH_MAX_SESSIONS);
+  slots_.reset(new (std::nothrow) SessionSlot[slot_count_]);
+  if (!slots_) {
+    slot_count_ = 0;
+    return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+  }
+  if (cfg_.history_file != nullptr) {
+    history_file_ = HistoryFile::Shared(cfg_.history_file);
+    if (history_file_ == nullptr) {
+      return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+    }
+  } else if (cfg_.shared_history && !shared_history_) {
+    shared_history_.reset(new (std::nothrow) HistoryStore());
+    if (!shared_history_) {
+      return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+    }
   }
 
-  int opt = 1;
-  (void)::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-  struct sockaddr_in addr = {};
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = INADDR_ANY;
-  addr.sin_port = htons(cfg_.port);
+  if (!wake_.Open()) {
+    return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+  }
 
-  if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-    ::close(listen_fd_);
-    listen_fd_ = -1;
+  if (!ListenSocket()) {
+    wake_.Close();
     return expected<void, ShellError>::error(ShellError::kPortInUse);
   }
 
-  if (::listen(listen_fd_, 4) < 0) {
-    ::close(listen_fd_);
-    listen_fd_ = -1;
-    return expected<void, ShellError>::error(ShellError::kPortInUse);
+  if (cfg_.reactor_mode) {
+    (void)::fcntl(listen_fd_, F_SETFL, ::fcntl(listen_fd_, F_GETFL, 0) | O_NONBLOCK);
+    epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u32 = kListenTag;
+    struct epoll_event wev = {};
+    wev.events = EPOLLIN;
+    wev.data.u32 = kWakeTag;
+    struct epoll_event dev = {};
+    dev.events = EPOLLIN;
+    dev.data.u32 = kDoneTag;
+    if (epoll_fd_ < 0 || !done_.Open() || ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0 ||
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_.fd(), &wev) < 0 ||
+        ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, done_.fd(), &dev) < 0) {
+      if (epoll_fd_ >= 0) {
+        ::close(epoll_fd_);
+        epoll_fd_ = -1;
+      }
+      ::close(listen_fd_);
+      listen_fd_ = -1;
+      done_.Close();
+      wake_.Close();
+      return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+    }
   }
 
+  total_cmds_.Configure(cfg_.total_cmds);
+  total_bytes_.Configure(cfg_.total_bytes);
+  running_cmds_.store(0, std::memory_order_relaxed);
+  budgeted_ = cfg_.session_cmds.per_sec != 0 || cfg_.session_bytes.per_sec != 0 || total_cmds_.Limited() ||
+              total_bytes_.Limited() || cfg_.max_running != 0;
+
   running_.store(true, std::memory_order_release);
-  accept_thread_ = std::thread([this]() { AcceptLoop(); });
+  prespawned_ = cfg_.prespawn && !cfg_.reactor_mode;
+  bool started = true;
+  if (prespawned_) {
+    for (uint32_t i = 0; i < slot_count_ && started; ++i) {
+      auto& slot = slots_[i];
+      if (slot.handoff.Open()) {
+        started = slot.thread.Start(cfg_.threads, [this, &slot]() { PoolWorker(slot); });
+      }
+    }
+  }
+  if (started && cfg_.reactor_mode) {
+    started = accept_thread_.Start(cfg_.threads, [this]() { ReactorLoop(); });
+  } else if (started) {
+    started = accept_thread_.Start(cfg_.threads, [this]() { AcceptLoop(); });
+  }
+  if (!started) {
+    Stop();
+    return expected<void, ShellError>::error(ShellError::kThreadStartFailed);
+  }
 
   return expected<void, ShellError>::success();
 }
@@ -161,49 +324,173 @@ inline void TelnetServer::Stop() noexcept {
     return;
   running_.store(false, std::memory_order_release);
 
-  // Close the listen socket to unblock accept().
+  // Wake the accept/reactor thread and every session thread; the event stays
+  // signalled until Close() below.
+  wake_.Signal();
+
+  accept_thread_.Join();
+
   if (listen_fd_ >= 0) {
-    ::shutdown(listen_fd_, SHUT_RDWR);
     ::close(listen_fd_);
     listen_fd_ = -1;
   }
-
-  if (accept_thread_.joinable()) {
-    accept_thread_.join();
+  if (epoll_fd_ >= 0) {
+    ::close(epoll_fd_);
+    epoll_fd_ = -1;
   }
 
-  // Stop all active sessions.
-  for (uint32_t i = 0; i < EMBSH_MAX_SESSIONS; ++i) {
+  // Stop all active sessions (the reactor has already closed its own).
+  for (uint32_t i = 0; i < slot_count_; ++i) {
     if (slots_[i].in_use.load(std::memory_order_acquire)) {
       slots_[i].session.active.store(false, std::memory_order_release);
       if (slots_[i].session.read_fd >= 0) {
         ::shutdown(slots_[i].session.read_fd, SHUT_RDWR);
       }
     }
-    if (slots_[i].thread.joinable()) {
-      slots_[i].thread.join();
-    }
+    slots_[i].thread.Join();
     slots_[i].in_use.store(false, std::memory_order_release);
+    slots_[i].done.Close();
+    slots_[i].handoff.Close();
+  }
+  prespawned_ = false;
+  if (history_file_ != nullptr) {
+    history_file_->Flush();
   }
+  done_.Close();
+  wake_.Close();
+}
+
+inline bool TelnetServer::ListenSocket() noexcept {
+  listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0)
+    return false;
+
+  int opt = 1;
+  (void)::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  if (cfg_.reuse_port) {
+    (void)::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+  }
+  if (cfg_.defer_accept_s > 0) {
+    (void)::setsockopt(listen_fd_, IPPROTO_TCP, TCP_DEFER_ACCEPT, &cfg_.defer_accept_s, sizeof(cfg_.defer_accept_s));
+  }
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = INADDR_ANY;
+  addr.sin_port = htons(cfg_.port);
+
+  if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+      ::listen(listen_fd_, cfg_.backlog > 0 ? cfg_.backlog : SOMAXCONN) < 0) {
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+inline void TelnetServer::TuneClient(int client_fd) const noexcept {
+  if (cfg_.tcp_nodelay) {
+    int opt = 1;
+    (void)::setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  }
+}
+
+inline void TelnetServer::InitSession(SessionSlot& slot, int client_fd) noexcept {
+  auto& s = slot.session;
+  s.read_fd = client_fd;
+  s.write_fd = client_fd;
+  s.write_fn = io::TcpWrite;
+  s.read_fn = io::TcpRead;
+  s.writev_fn = io::TcpWriteV;
+  s.tx_len = 0;
+  s.txq_buf = slot.tx_queue;
+  s.txq_cap = sizeof(slot.tx_queue);
+  s.txq_head = 0;
+  s.txq_len = 0;
+  s.tx_policy = cfg_.tx_policy;
+  s.tx_timeout_ms = cfg_.tx_timeout_ms;
+  s.telnet_mode = true;
+  s.line_pos = 0;
+  s.cursor_back = 0;
+  s.skip_lf = false;
+  s.rx_pos = 0;
+  s.rx_len = 0;
+  s.hist_browsing = false;
+  s.hist_nav = 0;
+  s.history = (history_file_ != nullptr) ? &history_file_->Store() : shared_history_.get();
+  s.local_history.Clear();  // A reused slot must not leak the previous user's commands.
+  s.esc_state = Session::EscState::kNone;
+  s.esc_param = 0;
+  s.pasting = false;
+  s.searching = false;
+  s.iac_state = Session::IacState::kNormal;
+  s.iac_verb = 0;
+  s.telnet_binary = false;
+#if EMBSH_ENABLE_STATS
+  s.stats.Reset();
+#endif
+  s.busy.store(false, std::memory_order_relaxed);
+  s.cancel.store(false, std::memory_order_relaxed);
+  s.budget = nullptr;
+  if (budgeted_) {
+    auto& b = slot.budget;
+    b.cmds.Configure(cfg_.session_cmds);
+    b.bytes.Configure(cfg_.session_bytes);
+    b.total_cmds = total_cmds_.Limited() ? &total_cmds_ : nullptr;
+    b.total_bytes = total_bytes_.Limited() ? &total_bytes_ : nullptr;
+    b.running = &running_cmds_;
+    b.max_running = cfg_.max_running;
+    b.holds_slot = false;
+    b.resume_ns = 0;
+    s.budget = &b;
+  }
+  s.active.store(true, std::memory_order_release);
+
+  // Authentication state.
+  s.auth_required = (cfg_.username != nullptr && cfg_.password != nullptr);
+  s.authenticated = !s.auth_required;
+  s.auth_attempts = 0;
+  s.auth_phase = Session::AuthPhase::kUser;
+  s.auth_user_pos = 0;
+  s.auth_pass_pos = 0;
+}
+
+inline void TelnetServer::OpenSession(Session& s) noexcept {
+  // Telnet negotiations: suppress go-ahead + echo.
+  SendIac(s, 0xFB, 0x03);  // WILL SGA
+  SendIac(s, 0xFB, 0x01);  // WILL ECHO
+  if (cfg_.binary) {
+    SendIac(s, 0xFB, 0x00);  // WILL BINARY (output only); the reply sets telnet_binary.
+  }
+
+  // Banner.
+  if (cfg_.banner != nullptr) {
+    SessionWrite(s, cfg_.banner);
+  }
+  if (cfg_.bracketed_paste) {
+    SessionWrite(s, editor::kBracketedPasteOn);
+  }
+
+  SessionWrite(s, s.auth_required ? "Username: " : cfg_.prompt);
+  SessionFlush(s);
 }
 
 inline void TelnetServer::AcceptLoop() noexcept {
   while (running_.load(std::memory_order_relaxed)) {
-    struct pollfd pfd;
-    pfd.fd = listen_fd_;
-    pfd.events = POLLIN;
-    int pr = ::poll(&pfd, 1, 500);
-    if (pr <= 0)
+    if (editor::WaitInput(listen_fd_, wake_.fd()) <= 0)
       continue;
 
     struct sockaddr_in client_addr = {};
     socklen_t addr_len = sizeof(client_addr);
-    int client_fd = ::accept(listen_fd_, reinterpret_cast<struct sockaddr*>(&client_addr), &addr_len);
+    int client_fd = ::accept4(listen_fd_, reinterpret_cast<struct sockaddr*>(&client_addr), &addr_len,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (client_fd < 0)
       continue;
+    CountAccept();
 
     int idx = FindFreeSlot();
     if (idx < 0) {
+      CountReject();
       SendStr(client_fd, "Too many connections.\r\n");
       ::close(client_fd);
       continue;
@@ -211,86 +498,74 @@ inline void TelnetServer::AcceptLoop() noexcept {
 
     auto& slot = slots_[idx];
     slot.in_use.store(true, std::memory_order_release);
+    TuneClient(client_fd);
+    InitSession(slot, client_fd);
+    // Without the event, parked input waits for the next keystroke instead.
+    slot.session.notify = slot.done.Open() ? &slot.done : nullptr;
+
+    if (prespawned_ && slot.thread.Joinable()) {
+      slot.handoff.Signal();
+    } else if (!slot.thread.Start(cfg_.threads, [this, &slot]() { SessionLoop(slot); })) {
+      CountReject();
+      SendStr(client_fd, "Cannot start session.\r\n");
+      ::close(client_fd);
+      slot.session.read_fd = -1;
+      slot.session.active.store(false, std::memory_order_release);
+      slot.done.Close();
+      slot.in_use.store(false, std::memory_order_release);
+    }
+  }
+}
 
-    // Initialize session.
-    auto& s = slot.session;
-    s.read_fd = client_fd;
-    s.write_fd = client_fd;
-    s.write_fn = io::TcpWrite;
-    s.read_fn = io::TcpRead;
-    s.telnet_mode = true;
-    s.line_pos = 0;
-    s.hist_browsing = false;
-    s.esc_state = Session::EscState::kNone;
-    s.iac_state = Session::IacState::kNormal;
-    s.active.store(true, std::memory_order_release);
-
-    // Authentication state.
-    s.auth_required = (cfg_.username != nullptr && cfg_.password != nullptr);
-    s.authenticated = !s.auth_required;
-    s.auth_attempts = 0;
-    s.auth_user_pos = 0;
-
-    slot.thread = std::thread([this, &slot]() { SessionLoop(slot); });
+/// @brief Pre-spawned session thread: serve each connection handed to this slot.
+inline void TelnetServer::PoolWorker(SessionSlot& slot) noexcept {
+  while (running_.load(std::memory_order_relaxed)) {
+    if (editor::WaitInput(slot.handoff.fd(), wake_.fd()) <= 0)
+      continue;  // Stop() or EINTR: re-check running_.
+    slot.handoff.Drain();
+    if (slot.in_use.load(std::memory_order_acquire)) {
+      SessionLoop(slot);
+    }
   }
 }
 
 inline void TelnetServer::SessionLoop(SessionSlot& slot) noexcept {
   auto& s = slot.session;
 
-  // Telnet negotiations: suppress go-ahead + echo.
-  SendIac(s.write_fd, 0xFB, 0x03);  // WILL SGA
-  SendIac(s.write_fd, 0xFB, 0x01);  // WILL ECHO
-
-  // Banner.
-  if (cfg_.banner != nullptr) {
-    SessionWrite(s, cfg_.banner);
-  }
-
-  // Authentication.
-  if (s.auth_required) {
-    RunAuth(s);
-    if (!s.authenticated) {
-      SessionWrite(s, "Authentication failed.\r\n");
-      ::close(s.read_fd);
-      s.read_fd = -1;
-      s.active.store(false, std::memory_order_release);
-      slot.in_use.store(false, std::memory_order_release);
-      return;
-    }
-  }
-
-  // Main interactive loop.
-  SessionWrite(s, cfg_.prompt);
+  OpenSession(s);
 
+  // Main interactive loop (login first when authentication is required).
   while (running_.load(std::memory_order_relaxed) && s.active.load(std::memory_order_acquire)) {
-    struct pollfd pfd;
-    pfd.fd = s.read_fd;
-    pfd.events = POLLIN;
-    int pr = ::poll(&pfd, 1, 200);
-    if (pr == 0)
+    int wr = editor::WaitSession(s, wake_.fd(), slot.done.fd());
+    if (wr == 0) {
+      // Stop() or an async command finishing; resume any parked input.
+      slot.done.Drain();
+      if (!s.busy.load(std::memory_order_acquire) && s.rx_pos < s.rx_len && !ConsumeInput(s))
+        break;
       continue;
-    if (pr < 0) {
+    }
+    if (wr < 0) {
       if (errno == EINTR)
         continue;
       break;
     }
 
-    uint8_t byte;
-    ssize_t n = s.read_fn(s.read_fd, &byte, 1);
-    if (n <= 0)
+    ssize_t n = editor::FillInput(s);
+    if (n <= 0) {
+      if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        continue;
       break;
-
-    if (editor::ProcessByte(s, byte, cfg_.prompt)) {
-      editor::ExecuteLine(s);
-      s.line_pos = 0;
-      s.line_buf[0] = '\0';
-      if (s.active.load(std::memory_order_acquire)) {
-        SessionWrite(s, cfg_.prompt);
-      }
     }
+    if (!ConsumeInput(s))
+      break;
   }
 
+  editor::WaitIdle(s);
+  if (cfg_.bracketed_paste) {
+    SessionWrite(s, editor::kBracketedPasteOff);
+  }
+  SessionFlush(s);
+  (void)detail::WaitTxQueue(s, s.tx_timeout_ms);  // Let "Bye." and the like reach the client.
   if (s.read_fd >= 0) {
     ::close(s.read_fd);
     s.read_fd = -1;
@@ -299,106 +574,332 @@ inline void TelnetServer::SessionLoop(SessionSlot& slot) noexcept {
   slot.in_use.store(false, std::memory_order_release);
 }
 
-inline void TelnetServer::RunAuth(Session& s) noexcept {
-  static constexpr uint8_t kMaxAttempts = 3;
-  enum class AuthPhase : uint8_t { kUser, kPass };
-  AuthPhase phase = AuthPhase::kUser;
-  char user_buf[64] = {};
-  char pass_buf[64] = {};
-  uint32_t buf_pos = 0;
-
-  SessionWrite(s, "Username: ");
-
-  while (s.active.load(std::memory_order_acquire) && s.auth_attempts < kMaxAttempts) {
-    struct pollfd pfd;
-    pfd.fd = s.read_fd;
-    pfd.events = POLLIN;
-    int pr = ::poll(&pfd, 1, 200);
-    if (pr <= 0) {
-      if (pr == 0)
-        continue;
-      break;
+/// @brief Drain the session read buffer through the login FSM, then the editor.
+/// @return false when the session should be closed.
+inline bool TelnetServer::ConsumeInput(Session& s) noexcept {
+  if (!s.authenticated) {
+    while (!s.authenticated && s.rx_pos < s.rx_len) {
+      AuthResult ar = AuthByte(s, s.rx_buf[s.rx_pos++]);
+      if (ar == AuthResult::kDenied) {
+        SessionWrite(s, "Authentication failed.\r\n");
+        SessionFlush(s);
+        return false;
+      }
+      if (ar == AuthResult::kGranted) {
+        SessionWrite(s, cfg_.prompt);
+      }
+    }
+    SessionFlush(s);
+  }
+  // While an async command runs the worker owns tx_buf; ProcessBytes() then
+  // leaves the parked bytes alone.
+  if (s.authenticated && s.rx_pos < s.rx_len) {
+    s.rx_pos += static_cast<uint32_t>(editor::ProcessBytes(s, s.rx_buf + s.rx_pos, s.rx_len - s.rx_pos, cfg_.prompt));
+  }
+  return s.active.load(std::memory_order_acquire);
+}
+
+inline TelnetServer::AuthResult TelnetServer::AuthByte(Session& s, uint8_t byte) noexcept {
+  // IAC filtering.
+  if (s.telnet_mode) {
+    char ch = editor::FilterIac(s, byte);
+    if (ch == '\0')
+      return AuthResult::kPending;
+    byte = static_cast<uint8_t>(ch);
+  }
+
+  char ch = static_cast<char>(byte);
+
+  // Swallow the '\n' / '\0' after a '\r' terminator.
+  if (s.skip_lf) {
+    s.skip_lf = false;
+    if (ch == '\n' || ch == '\0')
+      return AuthResult::kPending;
+  }
+
+  const bool user_phase = (s.auth_phase == Session::AuthPhase::kUser);
+  uint32_t& buf_pos = user_phase ? s.auth_user_pos : s.auth_pass_pos;
+
+  // Backspace.
+  if (byte == 0x7F || byte == 0x08) {
+    if (buf_pos > 0) {
+      --buf_pos;
+      SessionWrite(s, "\b \b");
+    }
+    return AuthResult::kPending;
+  }
+
+  // Enter.
+  if (ch == '\r' || ch == '\n') {
+    s.skip_lf = (ch == '\r');
+    SessionWrite(s, "\r\n");
+
+    if (user_phase) {
+      s.auth_user_buf[s.auth_user_pos] = '\0';
+      s.auth_phase = Session::AuthPhase::kPass;
+      s.auth_pass_pos = 0;
+      SessionWrite(s, "Password: ");
+      return AuthResult::kPending;
     }
 
-    uint8_t byte;
-    ssize_t n = s.read_fn(s.read_fd, &byte, 1);
-    if (n <= 0)
+    // Password entered.
+    s.auth_pass_buf[s.auth_pass_pos] = '\0';
+    const bool ok =
+        std::strcmp(s.auth_user_buf, cfg_.username) == 0 && std::strcmp(s.auth_pass_buf, cfg_.password) == 0;
+    std::memset(s.auth_pass_buf, 0, sizeof(s.auth_pass_buf));
+    s.auth_pass_pos = 0;
+    if (ok) {
+      s.authenticated = true;
+      SessionWrite(s, "Login successful.\r\n");
+      return AuthResult::kGranted;
+    }
+
+    ++s.auth_attempts;
+#if EMBSH_ENABLE_STATS
+    detail::StatsAdd(TelnetStats().auth_failures);
+#endif
+    if (s.auth_attempts >= kMaxAuthAttempts)
+      return AuthResult::kDenied;
+
+    SessionWrite(s, "Invalid credentials. Try again.\r\n");
+    s.auth_phase = Session::AuthPhase::kUser;
+    s.auth_user_pos = 0;
+    SessionWrite(s, "Username: ");
+    return AuthResult::kPending;
+  }
+
+  // Printable character.
+  if (byte >= 0x20 && byte < 0x7F) {
+    if (user_phase && s.auth_user_pos < sizeof(s.auth_user_buf) - 1) {
+      s.auth_user_buf[s.auth_user_pos++] = ch;
+      SessionWriteN(s, &ch, 1);
+    } else if (!user_phase && s.auth_pass_pos < sizeof(s.auth_pass_buf) - 1) {
+      s.auth_pass_buf[s.auth_pass_pos++] = ch;
+      SessionWrite(s, "*");  // Mask password.
+    }
+  }
+  return AuthResult::kPending;
+}
+
+// ============================================================================
+// Reactor mode
+// ============================================================================
+
+inline void TelnetServer::ReactorLoop() noexcept {
+  struct epoll_event events[EMBSH_REACTOR_MAX_EVENTS];
+  detail::SharedLoopThread() = true;  // Output on this thread must never wait for one peer.
+
+  while (running_.load(std::memory_order_relaxed)) {
+    int n = ::epoll_wait(epoll_fd_, events, EMBSH_REACTOR_MAX_EVENTS, ReactorTimeoutMs());
+    if (n < 0 && errno != EINTR)
       break;
+    if (budgeted_) {
+      ReactorRetryHeld();
+    }
 
-    // IAC filtering.
-    if (s.telnet_mode) {
-      char ch = editor::FilterIac(s, byte);
-      if (ch == '\0')
+    for (int i = 0; i < n; ++i) {
+      const uint32_t tag = events[i].data.u32;
+      if (tag == kListenTag) {
+        ReactorAccept();
         continue;
-      byte = static_cast<uint8_t>(ch);
+      }
+      if (tag == kWakeTag)
+        continue;  // Loop condition re-checks running_.
+      if (tag == kDoneTag) {
+        ReactorResume();
+        continue;
+      }
+      if (tag >= slot_count_)
+        continue;
+      auto& slot = slots_[tag];
+      if (!slot.in_use.load(std::memory_order_relaxed) || slot.closing)
+        continue;
+      bool ok = true;
+      if ((events[i].events & EPOLLOUT) != 0 && !slot.session.busy.load(std::memory_order_acquire)) {
+        ok = detail::DrainTxQueue(slot.session);
+      }
+      if (ok && (events[i].events & ~static_cast<uint32_t>(EPOLLOUT)) != 0) {
+        // Held input is not read further; a hangup still ends the session.
+        ok = slot.want_in ? ReactorRead(slot) : (events[i].events & (EPOLLHUP | EPOLLERR)) == 0;
+      }
+      if (ok) {
+        ReactorWatch(slot);
+      } else {
+        ReactorClose(slot);
+      }
     }
+  }
 
-    char ch = static_cast<char>(byte);
+  // Stopping: the worker pool may not keep a session past Stop(), so only
+  // here does the reactor wait out async commands.
+  for (uint32_t i = 0; i < slot_count_; ++i) {
+    if (slots_[i].in_use.load(std::memory_order_relaxed)) {
+      editor::WaitIdle(slots_[i].session);
+      ReactorClose(slots_[i]);
+    }
+  }
+}
 
-    // Backspace.
-    if (byte == 0x7F || byte == 0x08) {
-      if (buf_pos > 0) {
-        --buf_pos;
-        if (phase == AuthPhase::kUser) {
-          SessionWrite(s, "\b \b");
-        } else {
-          SessionWrite(s, "\b \b");
-        }
-      }
+inline void TelnetServer::ReactorAccept() noexcept {
+  // Level-triggered listen fd: drain the backlog while it is non-empty.
+  for (;;) {
+    struct sockaddr_in client_addr = {};
+    socklen_t addr_len = sizeof(client_addr);
+    int client_fd = ::accept4(listen_fd_, reinterpret_cast<struct sockaddr*>(&client_addr), &addr_len,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd < 0)
+      return;
+    CountAccept();
+
+    int idx = FindFreeSlot();
+    if (idx < 0) {
+      CountReject();
+      SendStr(client_fd, "Too many connections.\r\n");
+      ::close(client_fd);
       continue;
     }
+    TuneClient(client_fd);
 
-    // Enter.
-    if (ch == '\r' || ch == '\n') {
-      // Consume trailing \n.
-      if (s.telnet_mode && ch == '\r') {
-        char next;
-        ssize_t peek = ::recv(s.read_fd, &next, 1, MSG_PEEK);
-        if (peek == 1 && (next == '\n' || next == '\0')) {
-          (void)::recv(s.read_fd, &next, 1, 0);
-        }
-      }
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u32 = static_cast<uint32_t>(idx);
+    if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+      ::close(client_fd);
+      continue;
+    }
 
-      SessionWrite(s, "\r\n");
+    auto& slot = slots_[idx];
+    slot.in_use.store(true, std::memory_order_release);
+    slot.want_in = true;
+    slot.want_out = false;
+    slot.closing = false;
+    InitSession(slot, client_fd);
+    slot.session.notify = &done_;
+    OpenSession(slot.session);
+    if (slot.session.active.load(std::memory_order_acquire)) {
+      ReactorWatch(slot);
+    } else {
+      ReactorClose(slot);
+    }
+  }
+}
 
-      if (phase == AuthPhase::kUser) {
-        user_buf[buf_pos] = '\0';
-        phase = AuthPhase::kPass;
-        buf_pos = 0;
-        SessionWrite(s, "Password: ");
-        // Turn off echo for password.
-        continue;
-      }
+inline bool TelnetServer::ReactorRead(SessionSlot& slot) noexcept {
+  // One read per wakeup keeps sessions fair; epoll is level-triggered, so
+  // anything left in the socket is reported again on the next pass.
+  auto& s = slot.session;
+  ssize_t n = editor::FillInput(s);
+  if (n == 0)
+    return false;
+  if (n < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  return ConsumeInput(s);
+}
 
-      // Password entered.
-      pass_buf[buf_pos] = '\0';
-      if (std::strcmp(user_buf, cfg_.username) == 0 && std::strcmp(pass_buf, cfg_.password) == 0) {
-        s.authenticated = true;
-        SessionWrite(s, "Login successful.\r\n");
-        return;
-      }
+/// @brief Feed input parked by sessions whose async command has finished; finish deferred closes.
+inline void TelnetServer::ReactorResume() noexcept {
+  done_.Drain();
+  for (uint32_t i = 0; i < slot_count_; ++i) {
+    auto& slot = slots_[i];
+    auto& s = slot.session;
+    if (!slot.in_use.load(std::memory_order_relaxed) || s.busy.load(std::memory_order_acquire))
+      continue;
+    if (slot.closing) {
+      ReactorClose(slot);
+      continue;
+    }
+    // The job may also have queued output, or disconnected on a full queue.
+    if ((s.rx_pos < s.rx_len && !ConsumeInput(s)) || !s.active.load(std::memory_order_acquire)) {
+      ReactorClose(slot);
+      continue;
+    }
+    ReactorWatch(slot);
+  }
+}
 
-      ++s.auth_attempts;
-      if (s.auth_attempts < kMaxAttempts) {
-        SessionWrite(s, "Invalid credentials. Try again.\r\n");
-        phase = AuthPhase::kUser;
-        buf_pos = 0;
-        SessionWrite(s, "Username: ");
-      }
+/// @brief Feed input held back by the budget of sessions whose retry time has come.
+inline void TelnetServer::ReactorRetryHeld() noexcept {
+  for (uint32_t i = 0; i < slot_count_; ++i) {
+    auto& slot = slots_[i];
+    if (!slot.in_use.load(std::memory_order_relaxed) || slot.closing || editor::HeldInputMs(slot.session) != 0)
+      continue;
+    if (!ConsumeInput(slot.session)) {
+      ReactorClose(slot);
       continue;
     }
+    ReactorWatch(slot);
+  }
+}
 
-    // Printable character.
-    if (byte >= 0x20 && byte < 0x7F) {
-      if (phase == AuthPhase::kUser && buf_pos < sizeof(user_buf) - 1) {
-        user_buf[buf_pos++] = ch;
-        SessionWriteN(s, &ch, 1);
-      } else if (phase == AuthPhase::kPass && buf_pos < sizeof(pass_buf) - 1) {
-        pass_buf[buf_pos++] = ch;
-        SessionWrite(s, "*");  // Mask password.
-      }
+/// @brief epoll_wait() timeout: until the earliest held input may be retried, -1 if none.
+inline int TelnetServer::ReactorTimeoutMs() const noexcept {
+  int timeout = -1;
+  if (!budgeted_)
+    return timeout;
+  for (uint32_t i = 0; i < slot_count_; ++i) {
+    if (!slots_[i].in_use.load(std::memory_order_relaxed) || slots_[i].closing)
+      continue;
+    const int ms = editor::HeldInputMs(slots_[i].session);
+    if (ms >= 0 && (timeout < 0 || ms < timeout)) {
+      timeout = ms;
     }
   }
+  return timeout;
+}
+
+/**
+ * @brief Keep EPOLLOUT registered exactly while the reactor owns queued
+ *        output, and EPOLLIN unless the budget holds the session's input.
+ */
+inline void TelnetServer::ReactorWatch(SessionSlot& slot) noexcept {
+  const auto& s = slot.session;
+  if (slot.closing)
+    return;
+  const bool want_out = !s.busy.load(std::memory_order_acquire) && s.txq_len > 0;
+  const bool want_in = editor::HeldInputMs(s) < 0;
+  if (want_out == slot.want_out && want_in == slot.want_in)
+    return;
+  struct epoll_event ev = {};
+  ev.events = (want_in ? static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP) : 0U) |
+              (want_out ? static_cast<uint32_t>(EPOLLOUT) : 0U);
+  ev.data.u32 = static_cast<uint32_t>(&slot - slots_.get());
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, s.read_fd, &ev) == 0) {
+    slot.want_out = want_out;
+    slot.want_in = want_in;
+  }
+}
+
+/**
+ * @brief End a reactor session without waiting on an async command.
+ *
+ * While a worker still owns the session it is cancelled and the socket is
+ * taken out of the epoll set (a hangup would otherwise be reported on every
+ * pass); the slot stays closing until the job signals done_, and
+ * ReactorResume() calls this again to finish.
+ */
+inline void TelnetServer::ReactorClose(SessionSlot& slot) noexcept {
+  auto& s = slot.session;
+  if (s.busy.load(std::memory_order_acquire)) {
+    s.cancel.store(true, std::memory_order_release);
+    if (!slot.closing && s.read_fd >= 0) {
+      (void)::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s.read_fd, nullptr);
+    }
+    slot.closing = true;
+    return;
+  }
+  editor::WaitIdle(s);  // busy is clear: at most the job's last two stores remain.
+  if (cfg_.bracketed_paste) {
+    SessionWrite(s, editor::kBracketedPasteOff);
+  }
+  SessionFlush(s);
+  if (s.read_fd >= 0) {
+    (void)::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, s.read_fd, nullptr);
+    ::close(s.read_fd);
+    s.read_fd = -1;
+  }
+  s.active.store(false, std::memory_order_release);
+  slot.closing = false;
+  slot.in_use.store(false, std::memory_order_release);
 }
 
 }  // namespace embsh
@@ -0,0 +1,147 @@
+/**
+ * @file thread.hpp
+ * @brief Threads with a configurable scheduling class, CPU affinity and stack size.
+ *
+ * Every thread embsh creates (backend loops, telnet sessions, the
+ * WorkerPool) is an embsh::Thread started with a ThreadOptions, so a
+ * process with a real-time workload can keep the shell off its cores and
+ * below its priorities.
+ */
+
+#ifndef EMBSH_THREAD_HPP_
+#define EMBSH_THREAD_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace embsh {
+
+/**
+ * @brief How a thread is created; the defaults inherit everything from the
+ *        creating thread, like std::thread.
+ *
+ * policy, priority, cpu_mask and stack_size are set on the pthread
+ * attributes, so a request the process may not make (SCHED_FIFO without
+ * CAP_SYS_NICE, a CPU outside its cpuset) fails the thread's start and
+ * the Start() that wanted it. nice is applied by the new thread itself and
+ * is best effort: lowering it below the current value needs CAP_SYS_NICE.
+ */
+struct ThreadOptions {
+  int policy = -1;        ///< SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO or SCHED_RR; -1 = inherit.
+  int priority = 0;       ///< sched_priority for SCHED_FIFO / SCHED_RR (1..99); 0 for the others.
+  int nice = 0;           ///< Nice value of the thread (-20..19); 0 = unchanged.
+  uint64_t cpu_mask = 0;  ///< Allowed CPUs, bit i = CPU i (0..63); 0 = inherit.
+  /// Bytes, raised to PTHREAD_STACK_MIN; 0 = libc default. Commands run on shell threads: leave room for
+  /// their stack use, plus kPipelineStackSize (about 4.7 KB) when EMBSH_ENABLE_PIPES is on.
+  size_t stack_size = 0;
+};
+
+/**
+ * @brief Minimal joinable thread created with ThreadOptions.
+ *
+ * Replaces std::thread, which cannot take a stack size or scheduling
+ * attributes. The callable is stored in the object (at most two pointers
+ * of trivially copyable captures, e.g. `[this, &slot]`), so starting a
+ * thread allocates nothing beyond its stack. Not movable: the running
+ * thread refers to this object.
+ */
+class Thread final {
+ public:
+  Thread() = default;
+  ~Thread() { Join(); }
+
+  Thread(const Thread&) = delete;
+  Thread& operator=(const Thread&) = delete;
+
+  /**
+   * @brief Start @p fn on a new thread.
+   * @return false if pthread_create() refused (see ThreadOptions) or a
+   *         thread is already attached to this object.
+   */
+  template <typename Fn>
+  inline bool Start(const ThreadOptions& opts, Fn fn) noexcept;
+
+  /// @brief Wait for the thread to finish; a no-op if none was started.
+  inline void Join() noexcept {
+    if (started_) {
+      (void)::pthread_join(tid_, nullptr);
+      started_ = false;
+    }
+  }
+
+  bool Joinable() const noexcept { return started_; }
+
+ private:
+  static constexpr size_t kFnSize = 2 * sizeof(void*);
+
+  alignas(void*) unsigned char fn_[kFnSize] = {};
+  void (*invoke_)(void* fn) = nullptr;
+  pthread_t tid_ = {};
+  int nice_ = 0;
+  bool started_ = false;
+
+  static void* Entry(void* arg) noexcept {
+    auto* self = static_cast<Thread*>(arg);
+    if (self->nice_ != 0) {
+      (void)::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), self->nice_);
+    }
+    self->invoke_(self->fn_);
+    return nullptr;
+  }
+};
+
+template <typename Fn>
+inline bool Thread::Start(const ThreadOptions& opts, Fn fn) noexcept {
+  static_assert(sizeof(Fn) <= kFnSize && alignof(Fn) <= alignof(void*), "capture at most two pointers");
+  static_assert(std::is_trivially_copyable<Fn>::value && std::is_trivially_destructible<Fn>::value,
+                "capture pointers or references only");
+  if (started_)
+    return false;
+  new (fn_) Fn(fn);
+  invoke_ = [](void* f) noexcept { (*static_cast<Fn*>(f))(); };
+  nice_ = opts.nice;
+
+  pthread_attr_t attr;
+  if (::pthread_attr_init(&attr) != 0)
+    return false;
+  int rc = 0;
+  if (opts.stack_size > 0) {
+    const size_t min = static_cast<size_t>(PTHREAD_STACK_MIN);
+    rc = ::pthread_attr_setstacksize(&attr, opts.stack_size < min ? min : opts.stack_size);
+  }
+  if (rc == 0 && opts.policy >= 0) {
+    struct sched_param sp = {};
+    sp.sched_priority = opts.priority;
+    rc = ::pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    if (rc == 0)
+      rc = ::pthread_attr_setschedpolicy(&attr, opts.policy);
+    if (rc == 0)
+      rc = ::pthread_attr_setschedparam(&attr, &sp);
+  }
+  if (rc == 0 && opts.cpu_mask != 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; ++cpu) {
+      if ((opts.cpu_mask >> cpu) & 1U)
+        CPU_SET(cpu, &set);
+    }
+    rc = ::pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+  }
+  if (rc == 0)
+    rc = ::pthread_create(&tid_, &attr, Entry, this);
+  (void)::pthread_attr_destroy(&attr);
+  started_ = (rc == 0);
+  return started_;
+}
+
+}  // namespace embsh
+
+#endif  // EMBSH_THREAD_HPP_
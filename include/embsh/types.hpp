@@ -27,6 +27,12 @@ enum class ShellError : uint8_t {
   kNotRunning,
   kDeviceOpenFailed,
   kInvalidArgument,
+  kOutOfMemory,
+  kRegistryFrozen,
+  kFileOpenFailed,
+  kScriptTooLarge,
+  kCommandNotFound,
+  kThreadStartFailed,
 };
 
 // ============================================================================
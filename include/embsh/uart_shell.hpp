@@ -6,18 +6,51 @@
 #ifndef EMBSH_UART_SHELL_HPP_
 #define EMBSH_UART_SHELL_HPP_
 
+#include "embsh/history_file.hpp"
 #include "embsh/line_editor.hpp"
+#include "embsh/multiplexer.hpp"
+#include "embsh/thread.hpp"
 
 #include <atomic>
-#include <thread>
 
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
 
+/// Custom baud rates through termios2 / BOTHER (Linux with the asm-generic termios layout).
+#ifndef EMBSH_UART_TERMIOS2
+#if EMBSH_PLATFORM_LINUX && defined(TCGETS2) && !defined(__mips__) && !defined(__sparc__) && !defined(__alpha__)
+#define EMBSH_UART_TERMIOS2 1
+#else
+#define EMBSH_UART_TERMIOS2 0
+#endif
+#endif
+
 namespace embsh {
 
+namespace detail {
+
+#if EMBSH_UART_TERMIOS2
+/// @brief Kernel `struct termios2` (asm/termbits.h cannot be included next to <termios.h>).
+struct UartTermios2 {
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+
+constexpr tcflag_t kUartBother = 0010000;  ///< c_cflag: speed in c_ispeed / c_ospeed.
+constexpr tcflag_t kUartIbShift = 16;      ///< c_cflag: shift of the input speed field.
+#endif
+
+}  // namespace detail
+
 /**
  * @brief UART serial port shell backend.
  *
@@ -30,9 +63,25 @@ class UartShell final {
     const char* device;
     uint32_t baudrate;
     const char* prompt;
-    int override_fd;
-
-    Config() noexcept : device("/dev/ttyS0"), baudrate(115200), prompt("embsh> "), override_fd(-1) {}
+    int override_fd;           ///< Already configured fd (e.g. PTY master); termios is left as is.
+    const char* history_file;  ///< Persistent history log (nullptr = in memory only).
+    bool rts_cts;              ///< Hardware flow control (CRTSCTS).
+    uint8_t vmin;              ///< Bytes a read waits for (VMIN); above 1 requires vtime.
+    uint8_t vtime;             ///< Inter-byte read timeout in 0.1 s (VTIME); 0 = none.
+    ShellMultiplexer* mux;     ///< Started multiplexer to serve this shell (nullptr = own thread).
+    ThreadOptions thread;      ///< Scheduling, affinity and stack of the shell thread.
+
+    Config() noexcept
+        : device("/dev/ttyS0"),
+          baudrate(115200),
+          prompt("embsh> "),
+          override_fd(-1),
+          history_file(nullptr),
+          rts_cts(false),
+          vmin(1),
+          vtime(0),
+          mux(nullptr),
+          thread() {}
   };
 
   explicit UartShell(const Config& cfg = Config{}) : cfg_(cfg) { detail::RegisterHelpOnce(); }
@@ -53,15 +102,27 @@ class UartShell final {
  private:
   Config cfg_;
   Session session_ = {};
-  std::thread thread_;
+  Thread thread_;
   std::atomic<bool> running_{false};
+  WakeEvent wake_;  ///< Signalled by Stop() to end the blocking poll.
+  WakeEvent done_;  ///< Async command finished; owned by RunLoop().
   int uart_fd_ = -1;
   bool owns_fd_ = false;
+  HistoryFile* history_file_ = nullptr;
+  HistoryStore history_;  ///< Full-size in-memory history when no history_file is set.
+  uint32_t mux_handle_ = 0;  ///< Attachment on cfg_.mux; 0 = own thread.
 
   inline void RunLoop() noexcept;
 
+  /// @brief Standard termios speed of @p baud, or B0 when it has no constant.
   static inline speed_t BaudToSpeed(uint32_t baud) noexcept {
     switch (baud) {
+      case 1200:
+        return B1200;
+      case 2400:
+        return B2400;
+      case 4800:
+        return B4800;
       case 9600:
         return B9600;
       case 19200:
@@ -76,12 +137,38 @@ class UartShell final {
         return B230400;
       case 460800:
         return B460800;
+      case 500000:
+        return B500000;
+      case 576000:
+        return B576000;
       case 921600:
         return B921600;
+      case 1000000:
+        return B1000000;
+      case 1152000:
+        return B1152000;
+      case 1500000:
+        return B1500000;
+      case 2000000:
+        return B2000000;
+      case 2500000:
+        return B2500000;
+      case 3000000:
+        return B3000000;
+      case 3500000:
+        return B3500000;
+      case 4000000:
+        return B4000000;
       default:
-        return B115200;
+        return B0;
     }
   }
+
+  /// @brief Set a rate with no termios constant through termios2 / BOTHER.
+  static inline bool SetCustomBaud(int fd, uint32_t baud) noexcept;
+
+  /// @brief Apply 8N1 raw mode, flow control, VMIN/VTIME and the baud rate to @p fd.
+  inline expected<void, ShellError> ConfigureTty(int fd) noexcept;
 };
 
 // ============================================================================
@@ -92,6 +179,17 @@ inline expected<void, ShellError> UartShell::Start() noexcept {
   if (running_.load(std::memory_order_relaxed)) {
     return expected<void, ShellError>::error(ShellError::kAlreadyRunning);
   }
+  const bool custom = (BaudToSpeed(cfg_.baudrate) == B0);
+  if (cfg_.override_fd < 0 && (cfg_.baudrate == 0 || (custom && !EMBSH_UART_TERMIOS2) ||
+                               (cfg_.vmin > 1 && cfg_.vtime == 0))) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+
+  history_file_ = (cfg_.history_file != nullptr) ? HistoryFile::Shared(cfg_.history_file) : nullptr;
+  if (cfg_.history_file != nullptr && history_file_ == nullptr) {
+    return expected<void, ShellError>::error(ShellError::kFileOpenFailed);
+  }
+  session_.history = (history_file_ != nullptr) ? &history_file_->Store() : &history_;
 
   if (cfg_.override_fd >= 0) {
     uart_fd_ = cfg_.override_fd;
@@ -103,35 +201,11 @@ inline expected<void, ShellError> UartShell::Start() noexcept {
     }
     owns_fd_ = true;
 
-    // Configure termios.
-    struct termios tty = {};
-    if (::tcgetattr(uart_fd_, &tty) != 0) {
+    auto r = ConfigureTty(uart_fd_);
+    if (!r.has_value()) {
       ::close(uart_fd_);
       uart_fd_ = -1;
-      return expected<void, ShellError>::error(ShellError::kDeviceOpenFailed);
-    }
-
-    speed_t spd = BaudToSpeed(cfg_.baudrate);
-    (void)::cfsetispeed(&tty, spd);
-    (void)::cfsetospeed(&tty, spd);
-
-    // 8N1, no flow control.
-    tty.c_cflag = (tty.c_cflag & ~static_cast<tcflag_t>(CSIZE)) | CS8;
-    tty.c_cflag |= static_cast<tcflag_t>(CLOCAL | CREAD);
-    tty.c_cflag &= ~static_cast<tcflag_t>(PARENB | CSTOPB | CRTSCTS);
-
-    // Raw mode.
-    tty.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO | ECHOE | ISIG);
-    tty.c_iflag &= ~static_cast<tcflag_t>(IXON | IXOFF | IXANY | ICRNL | INLCR | IGNCR);
-    tty.c_oflag &= ~static_cast<tcflag_t>(OPOST);
-
-    tty.c_cc[VMIN] = 1;
-    tty.c_cc[VTIME] = 0;
-
-    if (::tcsetattr(uart_fd_, TCSANOW, &tty) != 0) {
-      ::close(uart_fd_);
-      uart_fd_ = -1;
-      return expected<void, ShellError>::error(ShellError::kDeviceOpenFailed);
+      return r;
     }
   }
 
@@ -139,68 +213,177 @@ inline expected<void, ShellError> UartShell::Start() noexcept {
   session_.write_fd = uart_fd_;
   session_.write_fn = io::PosixWrite;
   session_.read_fn = io::PosixRead;
+  session_.writev_fn = io::PosixWriteV;
+  session_.tx_len = 0;
   session_.telnet_mode = false;
   session_.line_pos = 0;
+  session_.cursor_back = 0;
+  session_.skip_lf = false;
+  session_.rx_pos = 0;
+  session_.rx_len = 0;
   session_.hist_browsing = false;
   session_.esc_state = Session::EscState::kNone;
+  session_.pasting = false;
+  session_.searching = false;
   session_.active.store(true, std::memory_order_release);
 
+  if (cfg_.mux != nullptr) {
+    SessionWrite(session_, cfg_.prompt);
+    SessionFlush(session_);
+    auto h = cfg_.mux->Attach(session_, cfg_.prompt);
+    if (!h.has_value()) {
+      if (owns_fd_) {
+        ::close(uart_fd_);
+      }
+      uart_fd_ = -1;
+      return expected<void, ShellError>::error(h.error_value());
+    }
+    mux_handle_ = h.value();
+    running_.store(true, std::memory_order_release);
+    return expected<void, ShellError>::success();
+  }
+
+  if (!wake_.Open()) {
+    if (owns_fd_) {
+      ::close(uart_fd_);
+    }
+    uart_fd_ = -1;
+    return expected<void, ShellError>::error(ShellError::kOutOfMemory);
+  }
+
   running_.store(true, std::memory_order_release);
-  thread_ = std::thread([this]() { RunLoop(); });
+  if (!thread_.Start(cfg_.thread, [this]() { RunLoop(); })) {
+    running_.store(false, std::memory_order_release);
+    session_.active.store(false, std::memory_order_relaxed);
+    wake_.Close();
+    if (owns_fd_) {
+      ::close(uart_fd_);
+    }
+    uart_fd_ = -1;
+    return expected<void, ShellError>::error(ShellError::kThreadStartFailed);
+  }
 
   return expected<void, ShellError>::success();
 }
 
+inline bool UartShell::SetCustomBaud(int fd, uint32_t baud) noexcept {
+#if EMBSH_UART_TERMIOS2
+  detail::UartTermios2 tio = {};
+  if (::ioctl(fd, _IOR('T', 0x2A, detail::UartTermios2), &tio) != 0) {
+    return false;
+  }
+  tio.c_cflag = (tio.c_cflag & ~static_cast<tcflag_t>(CBAUD | (CBAUD << detail::kUartIbShift))) | detail::kUartBother;
+  tio.c_ispeed = baud;
+  tio.c_ospeed = baud;
+  if (::ioctl(fd, _IOW('T', 0x2B, detail::UartTermios2), &tio) != 0 ||
+      ::ioctl(fd, _IOR('T', 0x2A, detail::UartTermios2), &tio) != 0) {
+    return false;
+  }
+  // The driver picks the nearest divisor; beyond 2% the link would see framing errors.
+  uint32_t got = tio.c_ospeed;
+  uint32_t diff = (got > baud) ? got - baud : baud - got;
+  return diff <= baud / 50U;
+#else
+  (void)fd;
+  (void)baud;
+  return false;
+#endif
+}
+
+inline expected<void, ShellError> UartShell::ConfigureTty(int fd) noexcept {
+  struct termios tty = {};
+  if (::tcgetattr(fd, &tty) != 0) {
+    return expected<void, ShellError>::error(ShellError::kDeviceOpenFailed);
+  }
+
+  speed_t spd = BaudToSpeed(cfg_.baudrate);
+  // A custom rate starts from B38400 and is replaced through termios2 below.
+  (void)::cfsetispeed(&tty, (spd != B0) ? spd : B38400);
+  (void)::cfsetospeed(&tty, (spd != B0) ? spd : B38400);
+
+  // 8N1, optional RTS/CTS.
+  tty.c_cflag = (tty.c_cflag & ~static_cast<tcflag_t>(CSIZE)) | CS8;
+  tty.c_cflag |= static_cast<tcflag_t>(CLOCAL | CREAD);
+  tty.c_cflag &= ~static_cast<tcflag_t>(PARENB | CSTOPB | CRTSCTS);
+  if (cfg_.rts_cts) {
+    tty.c_cflag |= static_cast<tcflag_t>(CRTSCTS);
+  }
+
+  // Raw mode.
+  tty.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO | ECHOE | ISIG);
+  tty.c_iflag &= ~static_cast<tcflag_t>(IXON | IXOFF | IXANY | ICRNL | INLCR | IGNCR);
+  tty.c_oflag &= ~static_cast<tcflag_t>(OPOST);
+
+  // With VTIME set, poll() reports the first byte and read() then collects up to VMIN bytes
+  // or stops after an inter-byte gap of VTIME, so a paste arrives in fewer reads.
+  tty.c_cc[VMIN] = (cfg_.vmin != 0) ? cfg_.vmin : 1;
+  tty.c_cc[VTIME] = cfg_.vtime;
+
+  if (::tcsetattr(fd, TCSANOW, &tty) != 0) {
+    return expected<void, ShellError>::error(ShellError::kDeviceOpenFailed);
+  }
+  if (spd == B0 && !SetCustomBaud(fd, cfg_.baudrate)) {
+    return expected<void, ShellError>::error(ShellError::kInvalidArgument);
+  }
+  return expected<void, ShellError>::success();
+}
+
 inline void UartShell::Stop() noexcept {
   if (!running_.load(std::memory_order_relaxed))
     return;
   running_.store(false, std::memory_order_release);
+  if (mux_handle_ != 0) {
+    cfg_.mux->Detach(mux_handle_);
+    mux_handle_ = 0;
+  }
   session_.active.store(false, std::memory_order_release);
+  wake_.Signal();
 
-  if (thread_.joinable()) {
-    thread_.join();
+  if (thread_.Joinable()) {
+    thread_.Join();
   }
+  wake_.Close();
 
   if (owns_fd_ && uart_fd_ >= 0) {
     ::close(uart_fd_);
     uart_fd_ = -1;
   }
+  if (history_file_ != nullptr) {
+    history_file_->Flush();
+  }
 }
 
 inline void UartShell::RunLoop() noexcept {
   auto& s = session_;
+  // Without the event, parked input waits for the next keystroke instead.
+  s.notify = done_.Open() ? &done_ : nullptr;
   SessionWrite(s, cfg_.prompt);
+  SessionFlush(s);
 
   while (running_.load(std::memory_order_relaxed) && s.active.load(std::memory_order_acquire)) {
-    struct pollfd pfd;
-    pfd.fd = s.read_fd;
-    pfd.events = POLLIN;
-    int pr = ::poll(&pfd, 1, 200);
-    if (pr == 0)
+    int wr = editor::WaitInput(s.read_fd, wake_.fd(), done_.fd());
+    if (wr == 0) {
+      done_.Drain();
+      editor::ResumeInput(s, cfg_.prompt);
       continue;
-    if (pr < 0) {
+    }
+    if (wr < 0) {
       if (errno == EINTR)
         continue;
       break;
     }
 
-    uint8_t byte;
-    ssize_t n = s.read_fn(s.read_fd, &byte, 1);
+    ssize_t n = editor::ReadInput(s, cfg_.prompt);
     if (n <= 0) {
       if (n < 0 && errno == EINTR)
         continue;
       break;
     }
-
-    if (editor::ProcessByte(s, byte, cfg_.prompt)) {
-      editor::ExecuteLine(s);
-      s.line_pos = 0;
-      s.line_buf[0] = '\0';
-      if (s.active.load(std::memory_order_acquire)) {
-        SessionWrite(s, cfg_.prompt);
-      }
-    }
   }
+
+  editor::WaitIdle(s);
+  s.notify = nullptr;
+  done_.Close();
 }
 
 }  // namespace embsh
@@ -0,0 +1,138 @@
+/**
+ * @file worker_pool.hpp
+ * @brief Small bounded thread pool for long-running shell commands.
+ */
+
+#ifndef EMBSH_WORKER_POOL_HPP_
+#define EMBSH_WORKER_POOL_HPP_
+
+#include "embsh/platform.hpp"
+#include "embsh/thread.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#ifndef EMBSH_WORKER_THREADS
+#define EMBSH_WORKER_THREADS 2
+#endif
+
+#ifndef EMBSH_WORKER_QUEUE
+#define EMBSH_WORKER_QUEUE 8
+#endif
+
+namespace embsh {
+
+// ============================================================================
+// WorkerPool - Meyer's singleton job runner
+// ============================================================================
+
+/**
+ * @brief Fixed-size pool that runs jobs off the session threads.
+ *
+ * EMBSH_WORKER_THREADS threads are started on the first Submit(), so
+ * programs without asynchronous commands never create them. Pending jobs
+ * wait in a fixed ring of EMBSH_WORKER_QUEUE entries; Submit() fails rather
+ * than allocating when it is full. SetThreadOptions() before the first
+ * async command chooses their scheduling, affinity and stack.
+ */
+class WorkerPool final {
+ public:
+  using JobFn = void (*)(void* arg);
+
+  static WorkerPool& Instance() noexcept {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  /**
+   * @brief Options for the worker threads.
+   * @return false if they are already running (the options are then unchanged).
+   */
+  inline bool SetThreadOptions(const ThreadOptions& opts) noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (started_)
+      return false;
+    opts_ = opts;
+    return true;
+  }
+
+  /**
+   * @brief Queue @p fn(@p arg) for a worker thread.
+   * @return false if the queue is full or the pool cannot start.
+   */
+  inline bool Submit(JobFn fn, void* arg) noexcept {
+    std::unique_lock<std::mutex> lock(mtx_);
+    if (stopping_ || count_ >= EMBSH_WORKER_QUEUE)
+      return false;
+    if (!started_) {
+      for (auto& t : threads_) {
+        started_ |= t.Start(opts_, [this]() { Run(); });
+      }
+      if (!started_)
+        return false;
+    }
+    Job& job = queue_[(head_ + count_) % EMBSH_WORKER_QUEUE];
+    job.fn = fn;
+    job.arg = arg;
+    ++count_;
+    lock.unlock();
+    cv_.notify_one();
+    return true;
+  }
+
+  /// @brief Jobs queued but not yet picked up by a worker.
+  uint32_t Pending() const noexcept {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return count_;
+  }
+
+ private:
+  struct Job {
+    JobFn fn = nullptr;
+    void* arg = nullptr;
+  };
+
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) {
+      t.Join();
+    }
+  }
+
+  inline void Run() noexcept {
+    for (;;) {
+      std::unique_lock<std::mutex> lock(mtx_);
+      cv_.wait(lock, [this]() { return stopping_ || count_ > 0; });
+      if (count_ == 0)
+        return;  // Stopping and drained.
+      Job job = queue_[head_];
+      head_ = (head_ + 1) % EMBSH_WORKER_QUEUE;
+      --count_;
+      lock.unlock();
+      job.fn(job.arg);
+    }
+  }
+
+  Job queue_[EMBSH_WORKER_QUEUE] = {};
+  uint32_t head_ = 0;
+  uint32_t count_ = 0;
+  bool started_ = false;
+  bool stopping_ = false;
+  ThreadOptions opts_;
+  Thread threads_[EMBSH_WORKER_THREADS];
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+};
+
+}  // namespace embsh
+
+#endif  // EMBSH_WORKER_POOL_HPP_
@@ -5,9 +5,22 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+#include "test_support.hpp"
+
 #include "embsh/command_registry.hpp"
 
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
 
 // ============================================================================
 // ShellSplit tests
@@ -75,6 +88,83 @@ TEST_CASE("ShellSplit: tab separator", "[command_registry]") {
   CHECK(std::strcmp(argv[1], "arg1") == 0);
 }
 
+TEST_CASE("ShellSplit: backslash escapes inside quotes", "[command_registry]") {
+  char buf[64] = "set '{\\\"k\\\":1}' \"a\\\\b\"";
+  char* argv[EMBSH_MAX_ARGS] = {};
+  int argc = embsh::ShellSplit(buf, static_cast<uint32_t>(std::strlen(buf)), argv);
+  REQUIRE(argc == 3);
+  CHECK(std::strcmp(argv[0], "set") == 0);
+  CHECK(std::strcmp(argv[1], "{\"k\":1}") == 0);
+  CHECK(std::strcmp(argv[2], "a\\b") == 0);
+}
+
+TEST_CASE("ShellSplit: escaped closing quote does not end the argument", "[command_registry]") {
+  char buf[64] = "echo \"say \\\"hi\\\"\" tail";
+  char* argv[EMBSH_MAX_ARGS] = {};
+  int argc = embsh::ShellSplit(buf, static_cast<uint32_t>(std::strlen(buf)), argv);
+  REQUIRE(argc == 3);
+  CHECK(std::strcmp(argv[1], "say \"hi\"") == 0);
+  CHECK(std::strcmp(argv[2], "tail") == 0);
+}
+
+TEST_CASE("ShellSplit: empty quoted argument", "[command_registry]") {
+  char buf[64] = "cmd \"\" x";
+  char* argv[EMBSH_MAX_ARGS] = {};
+  int argc = embsh::ShellSplit(buf, static_cast<uint32_t>(std::strlen(buf)), argv);
+  REQUIRE(argc == 3);
+  CHECK(argv[1][0] == '\0');
+  CHECK(std::strcmp(argv[2], "x") == 0);
+}
+
+TEST_CASE("ShellSplit: unquoted pipe and redirect operators are separate tokens", "[command_registry]") {
+  char buf[64] = "a|b >> f 'x|y' c>d";
+  char* argv[EMBSH_MAX_ARGS] = {};
+  int argc = embsh::ShellSplit(buf, static_cast<uint32_t>(std::strlen(buf)), argv);
+  REQUIRE(argc == 9);
+  const char* expect[] = {"a", "|", "b", ">>", "f", "x|y", "c", ">", "d"};
+  for (int i = 0; i < argc; ++i) {
+    CHECK(std::strcmp(argv[i], expect[i]) == 0);
+  }
+  CHECK(argv[1] == embsh::kShellPipe);
+  CHECK(argv[3] == embsh::kShellAppend);
+  CHECK(argv[7] == embsh::kShellRedirect);
+  CHECK_FALSE(embsh::IsShellOperator(argv[5]));  // Quoted: a plain argument.
+}
+
+TEST_CASE("ShellSplit: more than EMBSH_MAX_ARGS returns -1", "[command_registry]") {
+  char buf[256] = {};
+  uint32_t len = 0;
+  for (int i = 0; i < EMBSH_MAX_ARGS; ++i) {
+    buf[len++] = 'a';
+    buf[len++] = ' ';
+  }
+  char full[256];
+  std::memcpy(full, buf, sizeof(buf));
+  char* argv[EMBSH_MAX_ARGS] = {};
+  CHECK(embsh::ShellSplit(full, len, argv) == EMBSH_MAX_ARGS);
+
+  buf[len++] = 'z';
+  CHECK(embsh::ShellSplit(buf, len, argv) == -1);
+}
+
+TEST_CASE("ShellSplit: long escape-heavy argument", "[command_registry]") {
+  char buf[256] = {};
+  uint32_t len = 0;
+  buf[len++] = '"';
+  while (len + 3 < sizeof(buf)) {
+    buf[len++] = '\\';
+    buf[len++] = 'x';
+  }
+  buf[len++] = '"';
+  const uint32_t escapes = (len - 2) / 2;
+  char* argv[EMBSH_MAX_ARGS] = {};
+  REQUIRE(embsh::ShellSplit(buf, len, argv) == 1);
+  REQUIRE(std::strlen(argv[0]) == escapes);
+  for (uint32_t i = 0; i < escapes; ++i) {
+    CHECK(argv[0][i] == 'x');
+  }
+}
+
 // ============================================================================
 // CommandRegistry tests
 // ============================================================================
@@ -93,6 +183,17 @@ static int test_cmd_ctx(int /*argc*/, char* /*argv*/[], void* ctx) {
   return 0;
 }
 
+static int st_alpha(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  return 7;
+}
+
+static int st_beta(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  return 8;
+}
+
+EMBSH_CMD_STATIC(st_alpha, "Static command alpha");
+EMBSH_CMD_STATIC(st_beta, "Static command beta");
+
 // NOTE: CommandRegistry is a singleton, so tests share state.
 // Tests are ordered to account for this.
 
@@ -114,7 +215,7 @@ TEST_CASE("CommandRegistry: register and find", "[command_registry]") {
 TEST_CASE("CommandRegistry: duplicate name rejected", "[command_registry]") {
   auto& reg = embsh::CommandRegistry::Instance();
   // Ensure "test_a" is registered (may already be from prior test).
-  (void)reg.Register("test_a", test_cmd_a, "Test command A");
+  RequireRegister("test_a", test_cmd_a, "Test command A");
 
   auto r = reg.Register("test_a", test_cmd_b, "Duplicate");
   CHECK_FALSE(r.has_value());
@@ -140,7 +241,7 @@ TEST_CASE("CommandRegistry: context pointer passed to command", "[command_regist
 
 TEST_CASE("CommandRegistry: AutoComplete single match", "[command_registry]") {
   auto& reg = embsh::CommandRegistry::Instance();
-  reg.Register("autocomplete_foo", test_cmd_a, "auto foo");
+  RequireRegister("autocomplete_foo", test_cmd_a, "auto foo");
 
   char buf[64] = {};
   uint32_t matches = reg.AutoComplete("autocomplete_", buf, sizeof(buf));
@@ -150,8 +251,8 @@ TEST_CASE("CommandRegistry: AutoComplete single match", "[command_registry]") {
 
 TEST_CASE("CommandRegistry: AutoComplete multiple matches", "[command_registry]") {
   auto& reg = embsh::CommandRegistry::Instance();
-  reg.Register("multi_alpha", test_cmd_a, "alpha");
-  reg.Register("multi_beta", test_cmd_b, "beta");
+  RequireRegister("multi_alpha", test_cmd_a, "alpha");
+  RequireRegister("multi_beta", test_cmd_b, "beta");
 
   char buf[64] = {};
   uint32_t matches = reg.AutoComplete("multi_", buf, sizeof(buf));
@@ -173,3 +274,516 @@ TEST_CASE("CommandRegistry: ForEach visits all commands", "[command_registry]")
   reg.ForEach([&visited](const embsh::CmdEntry& /*cmd*/) { ++visited; });
   CHECK(visited == reg.Count());
 }
+
+TEST_CASE("CommandRegistry: hashed lookup finds every registered name", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  static char names[24][16];
+  for (int i = 0; i < 24; ++i) {
+    std::snprintf(names[i], sizeof(names[i]), "hash_cmd_%02d", i);
+    REQUIRE(reg.Register(names[i], test_cmd_a, "hash test").has_value());
+  }
+  for (int i = 0; i < 24; ++i) {
+    const auto* found = reg.Find(names[i]);
+    REQUIRE(found != nullptr);
+    CHECK(found->name == names[i]);
+  }
+  CHECK(reg.Find("hash_cmd_") == nullptr);
+  CHECK(reg.Find("hash_cmd_000") == nullptr);
+  CHECK_FALSE(reg.Register(names[7], test_cmd_b, "dup").has_value());
+}
+
+TEST_CASE("CommandRegistry: empty or null name rejected", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  auto r = reg.Register("", test_cmd_a, "empty");
+  CHECK_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kInvalidArgument);
+  CHECK(reg.Find(nullptr) == nullptr);
+}
+
+TEST_CASE("CommandRegistry: MatchPrefix returns range, count and LCP", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  RequireRegister("pfx_net_up", test_cmd_a, "pfx");
+  RequireRegister("pfx_net_down", test_cmd_a, "pfx");
+  RequireRegister("pfx_disk", test_cmd_a, "pfx");
+
+  auto m = reg.MatchPrefix("pfx_", 4);
+  CHECK(m.count == 3);
+  CHECK(m.common == 4);
+  REQUIRE(m.first != nullptr);
+  CHECK(std::strcmp(m.first->name, "pfx_disk") == 0);
+
+  m = reg.MatchPrefix("pfx_n", 5);
+  REQUIRE(m.count == 2);
+  CHECK(m.common == 8);  // "pfx_net_"
+  CHECK(std::strcmp(m.first->name, "pfx_net_down") == 0);
+
+  m = reg.MatchPrefix("pfx_x", 5);
+  CHECK(m.count == 0);
+  CHECK(m.first == nullptr);
+}
+
+TEST_CASE("CommandRegistry: sorted index is in name order", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  RequireRegister("order_m", test_cmd_a, "order");
+  RequireRegister("order_a", test_cmd_a, "order");
+  RequireRegister("order_z", test_cmd_a, "order");
+  REQUIRE(reg.Count() > 3);
+  const char* prev = nullptr;
+  uint32_t visited = reg.ForEachMatch("", 0, [&prev](const embsh::CmdEntry& e) {
+    if (prev != nullptr) {
+      CHECK(std::strcmp(prev, e.name) < 0);
+    }
+    prev = e.name;
+  });
+  // Empty prefix matches everything.
+  CHECK(visited == reg.Count());
+  CHECK(reg.MatchPrefix("", 0).count == reg.Count());
+
+  const char* names[3] = {};
+  uint32_t k = 0;
+  CHECK(reg.ForEachMatch("order_", 6, [&](const embsh::CmdEntry& e) { names[k++] = e.name; }) == 3);
+  CHECK(std::strcmp(names[0], "order_a") == 0);
+  CHECK(std::strcmp(names[2], "order_z") == 0);
+
+  // Registrations after a query show up in the next one.
+  RequireRegister("order_q", test_cmd_a, "order");
+  RequireRegister("order_b", test_cmd_a, "order");
+  CHECK(reg.Find("order_q") != nullptr);
+  const char* merged[5] = {};
+  k = 0;
+  CHECK(reg.ForEachMatch("order_", 6, [&](const embsh::CmdEntry& e) { merged[k++] = e.name; }) == 5);
+  CHECK(std::strcmp(merged[1], "order_b") == 0);
+  CHECK(std::strcmp(merged[3], "order_q") == 0);
+  CHECK(reg.MatchPrefix("order_q", 7).count == 1);
+}
+
+TEST_CASE("CommandRegistry: queries nested in a visitor never wait on a writer", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  RequireRegister("nest_0", test_cmd_a, "nest");
+  uint32_t inner = 0;
+  std::atomic<bool> second{false};
+  std::thread writer;
+  CHECK(reg.ForEachMatch("nest_", 5, [&](const embsh::CmdEntry&) {
+    // Two registrations need both index copies; the second waits for this
+    // visitor's pin, and queries made from inside it must still return.
+    writer = std::thread([&reg, &second]() {
+      (void)reg.Register("nest_a", test_cmd_a, "nest");
+      while (!second.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      (void)reg.Register("nest_b", test_cmd_a, "nest");
+    });
+    for (int i = 0; i < 2000 && reg.Find("nest_a") == nullptr; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    inner = reg.MatchPrefix("nest_", 5).count;
+    second.store(true, std::memory_order_release);
+    for (int i = 0; i < 100 && reg.Find("nest_b") == nullptr; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    (void)reg.ForEachMatch("nest_", 5, [](const embsh::CmdEntry&) {});
+    (void)reg.MatchPrefix("nest_", 5);
+  }) == 1);
+  writer.join();
+  CHECK(inner >= 2);
+  CHECK(reg.Find("nest_b") != nullptr);
+  CHECK(reg.MatchPrefix("nest_", 5).count == 3);
+}
+
+TEST_CASE("CommandRegistry: lookups run concurrently with registration", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  static char names[24][16];
+  std::atomic<bool> done{false};
+  std::atomic<uint32_t> bad{0};
+
+  std::thread reader([&]() {
+    while (!done.load(std::memory_order_acquire)) {
+      auto m = reg.MatchPrefix("conc_", 5);
+      if (m.count > 0 && std::strncmp(m.first->name, "conc_", 5) != 0) {
+        bad.fetch_add(1);
+      }
+      const char* prev = nullptr;
+      reg.ForEachMatch("conc_", 5, [&](const embsh::CmdEntry& e) {
+        if (prev != nullptr && std::strcmp(prev, e.name) >= 0) {
+          bad.fetch_add(1);
+        }
+        prev = e.name;
+      });
+      const auto* e = reg.Find("conc_00");
+      if (e != nullptr && e->fn == nullptr) {
+        bad.fetch_add(1);
+      }
+    }
+  });
+
+  uint32_t failed = 0;
+  for (int i = 23; i >= 0; --i) {
+    std::snprintf(names[i], sizeof(names[i]), "conc_%02d", i);
+    failed += reg.Register(names[i], test_cmd_a, "conc").has_value() ? 0U : 1U;
+  }
+  done.store(true, std::memory_order_release);
+  reader.join();
+
+  REQUIRE(failed == 0);  // Checked after join(): a REQUIRE with the reader running would terminate.
+  CHECK(bad.load() == 0);
+  CHECK(reg.MatchPrefix("conc_", 5).count == 24);
+  for (auto& n : names) {
+    CHECK(reg.Find(n) != nullptr);
+  }
+}
+
+TEST_CASE("CommandRegistry: Freeze rejects further registration", "[command_registry]") {
+  // Freezing the singleton is irreversible; do it in a child process.
+  pid_t pid = fork();
+  REQUIRE(pid >= 0);
+  if (pid == 0) {
+    auto& reg = embsh::CommandRegistry::Instance();
+    (void)reg.Register("frz_before", test_cmd_a, "frz");
+    reg.Freeze();
+    bool ok = reg.IsFrozen();
+    auto r = reg.Register("frz_after", test_cmd_a, "frz");
+    ok = ok && !r.has_value() && r.error_value() == embsh::ShellError::kRegistryFrozen;
+    ok = ok && reg.Find("frz_before") != nullptr && reg.Find("frz_after") == nullptr;
+    ok = ok && reg.MatchPrefix("frz_", 4).count == 1;
+    _exit(ok ? 0 : 1);
+  }
+  int status = 0;
+  REQUIRE(waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+  CHECK(WEXITSTATUS(status) == 0);
+  CHECK_FALSE(embsh::CommandRegistry::Instance().IsFrozen());
+}
+
+TEST_CASE("CommandRegistry: EMBSH_CMD_STATIC entries come from the link-time table", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+#if EMBSH_HAS_CMD_SECTION
+  CHECK(reg.StaticCount() >= 2);
+#endif
+  const auto* a = reg.Find("st_alpha");
+  REQUIRE(a != nullptr);
+  CHECK(a->fn == st_alpha);
+  CHECK(std::strcmp(a->desc, "Static command alpha") == 0);
+  REQUIRE(reg.Find("st_beta") != nullptr);
+  CHECK(reg.Find("st_beta")->fn(0, nullptr, nullptr) == 8);
+
+  // Static names take part in duplicate checks and prefix queries.
+  auto r = reg.Register("st_alpha", test_cmd_b, "dup");
+  CHECK_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kDuplicateName);
+  RequireRegister("st_gamma", test_cmd_b, "dynamic");
+  CHECK(reg.MatchPrefix("st_", 3).count == 3);
+
+  uint32_t seen = 0;
+  reg.ForEach([&seen](const embsh::CmdEntry& e) {
+    if (std::strncmp(e.name, "st_", 3) == 0)
+      ++seen;
+  });
+  CHECK(seen == 3);
+}
+
+// ============================================================================
+// Execute / OutputSink tests
+// ============================================================================
+
+static int exec_echo(int argc, char* argv[], void* /*ctx*/) {
+  for (int i = 1; i < argc; ++i) {
+    embsh::ShellPrintf("%s%s", (i > 1) ? " " : "", argv[i]);
+  }
+  embsh::ShellWrite("\r\n", 2);
+  return argc - 1;
+}
+
+static int exec_fill(int argc, char* argv[], void* /*ctx*/) {
+  const int n = (argc > 1) ? std::atoi(argv[1]) : 0;
+  for (int i = 0; i < n; ++i) {
+    embsh::ShellPrintf("%04d\n", i);
+  }
+  return 0;
+}
+
+/// Captures the output of a nested Execute and prints its length.
+static int exec_outer(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  embsh::ShellPrintf("before;");
+  char buf[32];
+  embsh::OutputSink inner(buf, sizeof(buf));
+  auto r = embsh::CommandRegistry::Instance().Execute("exec_echo nested call", inner);
+  embsh::ShellPrintf("inner=%zu rc=%d;after", inner.size(), r.has_value() ? r.value() : -1);
+  return 0;
+}
+
+/// Reports the piped input it received.
+static int exec_stdin(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  std::string_view in;
+  if (!embsh::ShellPipeInput(in)) {
+    embsh::ShellPrintf("not piped\r\n");
+    return 0;
+  }
+  embsh::ShellPrintf("piped %zu, first %.4s\r\n", in.size(), in.data());
+  return 3;
+}
+
+static void RegisterExecCommands() {
+  RequireRegister("exec_echo", exec_echo, "echo args");
+  RequireRegister("exec_fill", exec_fill, "print N numbered lines");
+  RequireRegister("exec_outer", exec_outer, "nested Execute");
+  RequireRegister("exec_stdin", exec_stdin, "report piped input");
+}
+
+/// Execute @p line and return its output; @p rc gets the status or -1.
+static std::string Run(const char* line, int* rc = nullptr) {
+  static char buf[8192];
+  embsh::OutputSink sink(buf, sizeof(buf));
+  auto r = embsh::CommandRegistry::Instance().Execute(line, sink);
+  if (rc != nullptr)
+    *rc = r.has_value() ? r.value() : -1;
+  return std::string(sink.view());
+}
+
+TEST_CASE("CommandRegistry: Execute captures output into a caller buffer", "[command_registry]") {
+  RegisterExecCommands();
+  auto& reg = embsh::CommandRegistry::Instance();
+  char buf[64];
+  embsh::OutputSink sink(buf, sizeof(buf));
+  auto r = reg.Execute("exec_echo 'hello world' 42", sink);
+  REQUIRE(r.has_value());
+  CHECK(r.value() == 2);
+  CHECK(sink.view() == "hello world 42\r\n");
+  CHECK(sink.Dropped() == 0);
+
+  // Nothing is bound once Execute returns.
+  CHECK(embsh::ShellPrintf("stray") == -1);
+  CHECK(sink.size() == 16);
+}
+
+TEST_CASE("CommandRegistry: Execute errors", "[command_registry]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  char buf[16];
+  embsh::OutputSink sink(buf, sizeof(buf));
+  CHECK(reg.Execute("no_such_command", sink).error_value() == embsh::ShellError::kCommandNotFound);
+  CHECK(reg.Execute("   ", sink).error_value() == embsh::ShellError::kInvalidArgument);
+  CHECK(reg.Execute(nullptr, sink).error_value() == embsh::ShellError::kInvalidArgument);
+  const std::string long_line(EMBSH_EXEC_LINE_SIZE, 'x');
+  CHECK(reg.Execute(long_line.c_str(), sink).error_value() == embsh::ShellError::kInvalidArgument);
+  CHECK(sink.size() == 0);
+}
+
+TEST_CASE("CommandRegistry: a full sink drops or flushes the overflow", "[command_registry]") {
+  RegisterExecCommands();
+  auto& reg = embsh::CommandRegistry::Instance();
+  char small[12];
+  embsh::OutputSink truncating(small, sizeof(small));
+  REQUIRE(reg.Execute("exec_fill 5", truncating).has_value());
+  CHECK(truncating.view() == "0000\n0001\n00");
+  CHECK(truncating.Total() == 25);
+  CHECK(truncating.Dropped() == 13);
+
+  std::string collected;
+  char chunk[16];
+  embsh::OutputSink streaming(
+      chunk, sizeof(chunk),
+      [](const char* data, size_t len, void* ctx) {
+        static_cast<std::string*>(ctx)->append(data, len);
+        return true;
+      },
+      &collected);
+  REQUIRE(reg.Execute("exec_fill 100", streaming).has_value());
+  CHECK(streaming.size() == 0);  // Flushed before Execute returned.
+  CHECK(collected.size() == 500);
+  CHECK(collected.compare(0, 10, "0000\n0001\n") == 0);
+  CHECK(collected.compare(495, 5, "0099\n") == 0);
+  CHECK(streaming.Dropped() == 0);
+}
+
+TEST_CASE("CommandRegistry: a zero-capacity sink streams every write", "[command_registry]") {
+  RegisterExecCommands();
+  auto& reg = embsh::CommandRegistry::Instance();
+  std::string collected;
+  auto collect = [](const char* data, size_t len, void* ctx) {
+    static_cast<std::string*>(ctx)->append(data, len);
+    return true;
+  };
+  embsh::OutputSink streaming(nullptr, 0, collect, &collected);
+  REQUIRE(reg.Execute("exec_fill 100", streaming).has_value());
+  CHECK(collected.size() == 500);
+  CHECK(collected.compare(495, 5, "0099\n") == 0);
+  CHECK(streaming.Total() == 500);
+  CHECK(streaming.Dropped() == 0);
+
+  // A failing callback stops delivery instead of spinning.
+  static int calls = 0;
+  calls = 0;
+  embsh::OutputSink refusing(
+      nullptr, 0,
+      [](const char* /*data*/, size_t /*len*/, void* /*ctx*/) {
+        ++calls;
+        return false;
+      },
+      nullptr);
+  REQUIRE(reg.Execute("exec_fill 10", refusing).has_value());
+  CHECK(calls == 1);
+  CHECK(refusing.Dropped() == 50);
+
+  embsh::OutputSink discarding(nullptr, 0);
+  REQUIRE(reg.Execute("exec_fill 3", discarding).has_value());
+  CHECK(discarding.Dropped() == 15);
+}
+
+TEST_CASE("CommandRegistry: nested Execute restores the outer sink", "[command_registry]") {
+  RegisterExecCommands();
+  char buf[128];
+  embsh::OutputSink sink(buf, sizeof(buf));
+  REQUIRE(embsh::CommandRegistry::Instance().Execute("exec_outer", sink).has_value());
+  CHECK(sink.view() == "before;inner=13 rc=2;after");
+}
+
+TEST_CASE("CommandRegistry: Execute runs concurrently on many threads", "[command_registry]") {
+  RegisterExecCommands();
+  std::atomic<int> bad{0};
+  std::thread threads[4];
+  for (int t = 0; t < 4; ++t) {
+    threads[t] = std::thread([t, &bad]() {
+      char line[32];
+      char expect[32];
+      std::snprintf(line, sizeof(line), "exec_echo thread%d", t);
+      std::snprintf(expect, sizeof(expect), "thread%d\r\n", t);
+      for (int i = 0; i < 2000; ++i) {
+        char buf[32];
+        embsh::OutputSink sink(buf, sizeof(buf));
+        auto r = embsh::CommandRegistry::Instance().Execute(line, sink);
+        if (!r.has_value() || sink.view() != expect)
+          bad.fetch_add(1);
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  CHECK(bad.load() == 0);
+}
+
+// ============================================================================
+// Pipeline tests
+// ============================================================================
+
+TEST_CASE("Pipeline: built-in filters stream the first command's output", "[command_registry]") {
+  RegisterExecCommands();
+  int rc = -1;
+  CHECK(Run("exec_fill 300 | grep -c 29", &rc) == "13\r\n");
+  CHECK(rc == 0);
+  CHECK(Run("exec_fill 300 | grep 0129") == "0129\n");
+  CHECK(Run("exec_fill 300 | grep nothing", &rc).empty());
+  CHECK(rc == 1);
+  CHECK(Run("exec_fill 300 | head -n 3") == "0000\n0001\n0002\n");
+  CHECK(Run("exec_fill 300 | head") == Run("exec_fill 10"));
+  CHECK(Run("exec_fill 300 | tail -2") == "0298\n0299\n");
+  CHECK(Run("exec_fill 300 | wc -l") == "300\r\n");
+  CHECK(Run("exec_fill 300 | wc") == "300 300 1500\r\n");
+  CHECK(Run("exec_fill 300 | grep -v 9 | tail -n 1 | wc -c") == "5\r\n");  // "0288\n"
+  CHECK(Run("exec_echo A b | grep -i a") == "A b\r\n");
+  CHECK(Run("exec_echo '|' x") == "| x\r\n");
+}
+
+TEST_CASE("Pipeline: a plain command after a pipe gets the input buffered", "[command_registry]") {
+  RegisterExecCommands();
+  int rc = -1;
+  CHECK(Run("exec_stdin") == "not piped\r\n");
+  CHECK(Run("exec_fill 3 | exec_stdin", &rc) == "piped 15, first 0000\r\n");
+  CHECK(rc == 3);
+  CHECK(Run("exec_fill 300 | exec_stdin") ==
+        "piped " + std::to_string(EMBSH_PIPE_BUF_SIZE) + ", first 0000\r\nexec_stdin: input cut to " +
+            std::to_string(EMBSH_PIPE_BUF_SIZE) + " bytes\r\n");
+  CHECK(Run("exec_fill 3 | exec_stdin | grep -c piped") == "1\r\n");
+  CHECK(Run("grep x | head -n 1").find("reads piped input") != std::string::npos);  // A filter without input.
+  CHECK(Run("grep x", &rc).empty());  // The filters are not registry commands.
+  CHECK(rc == -1);
+}
+
+TEST_CASE("Pipeline: a registered command shadows the built-in filter", "[command_registry]") {
+  RegisterExecCommands();
+  auto& reg = embsh::CommandRegistry::Instance();
+  CHECK(reg.Find("wc") == nullptr);  // No registry slots for the filters.
+  CHECK(Run("help").find("wc               - Count piped lines") != std::string::npos);
+
+  auto my_wc = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    embsh::ShellPrintf("my wc\r\n");
+    return 0;
+  };
+  REQUIRE(reg.Register("wc", my_wc, "user wc").has_value());
+  CHECK(Run("exec_fill 3 | wc") == "my wc\r\n");
+  CHECK(Run("wc") == "my wc\r\n");
+  const std::string help = Run("help");
+  CHECK(help.find("user wc") != std::string::npos);
+  CHECK(help.find("Count piped lines") == std::string::npos);
+  CHECK(Run("exec_fill 3 | grep -c 0") == "3\r\n");  // Other filters are unaffected.
+}
+
+TEST_CASE("Pipeline: output redirected to a file", "[command_registry]") {
+  RegisterExecCommands();
+  char path[] = "/tmp/embsh_pipe_XXXXXX";  // Targets are names inside EMBSH_PIPE_FILE_DIR.
+  int fd = ::mkstemp(path);
+  REQUIRE(fd >= 0);
+  ::close(fd);
+  const char* name = path + 5;
+  const std::string trunc = std::string("exec_echo one>") + name;
+  const std::string append = std::string("exec_fill 20 | tail -n 1 >> ") + name;
+  CHECK(Run(trunc.c_str()).empty());
+  CHECK(Run(append.c_str()).empty());
+  CHECK(Run(append.c_str()).empty());
+  char buf[64] = {};
+  fd = ::open(path, O_RDONLY);
+  REQUIRE(fd >= 0);
+  CHECK(std::string(buf, static_cast<size_t>(::read(fd, buf, sizeof(buf)))) == "one\r\n0019\n0019\n");
+  ::close(fd);
+  CHECK(Run(trunc.c_str()).empty());  // '>' truncates.
+  CHECK(Run((std::string("exec_fill 1 | exec_stdin > ") + name).c_str()).empty());
+  fd = ::open(path, O_RDONLY);
+  CHECK(std::string(buf, static_cast<size_t>(::read(fd, buf, sizeof(buf)))) == "piped 5, first 0000\r\n");
+  ::close(fd);
+
+  char sbuf[64];
+  embsh::OutputSink sink(sbuf, sizeof(sbuf));
+  auto& reg = embsh::CommandRegistry::Instance();
+  for (const char* bad : {"exec_echo x > /tmp/f", "exec_echo x > ../f", "exec_echo x >> dir/f", "exec_echo x > .."}) {
+    sink.Clear();
+    INFO(bad);
+    CHECK(reg.Execute(bad, sink).error_value() == embsh::ShellError::kInvalidArgument);
+    CHECK(sink.view().find("redirect target must be a file name") == 0);
+  }
+
+  // The final name may not be a symlink, even one pointing back inside the directory.
+  char link[] = "/tmp/embsh_link_XXXXXX";
+  fd = ::mkstemp(link);
+  REQUIRE(fd >= 0);
+  ::close(fd);
+  ::unlink(link);
+  REQUIRE(::symlink(path, link) == 0);
+  sink.Clear();
+  CHECK(reg.Execute((std::string("exec_echo x > ") + (link + 5)).c_str(), sink).error_value() ==
+        embsh::ShellError::kFileOpenFailed);
+  CHECK(sink.view() == std::string("cannot open ") + (link + 5) + "\r\n");
+  ::unlink(link);
+  ::unlink(path);
+}
+
+TEST_CASE("Pipeline: syntax errors and unknown stages", "[command_registry]") {
+  RegisterExecCommands();
+  auto& reg = embsh::CommandRegistry::Instance();
+  char buf[128];
+  embsh::OutputSink sink(buf, sizeof(buf));
+  for (const char* bad : {"exec_echo |", "| exec_echo", "exec_echo || grep x", "exec_echo >", "exec_echo > a b",
+                          "exec_echo > a | grep x", "exec_fill 1 | grep", "exec_fill 1 | head -n x"}) {
+    sink.Clear();
+    INFO(bad);
+    CHECK(reg.Execute(bad, sink).error_value() == embsh::ShellError::kInvalidArgument);
+    CHECK(sink.size() > 0);
+  }
+  std::string five = "exec_fill 1";
+  for (int i = 0; i < EMBSH_PIPE_MAX_STAGES; ++i) {
+    five += " | head";
+  }
+  sink.Clear();
+  CHECK(reg.Execute(five.c_str(), sink).error_value() == embsh::ShellError::kInvalidArgument);
+  sink.Clear();
+  CHECK(reg.Execute("exec_fill 1 | no_such_filter", sink).error_value() == embsh::ShellError::kCommandNotFound);
+  CHECK(sink.view() == "unknown command: no_such_filter\r\n");
+}
@@ -5,6 +5,8 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+#include "test_support.hpp"
+
 #include "embsh/console_shell.hpp"
 
 #include <chrono>
@@ -87,6 +89,25 @@ TEST_CASE("ConsoleShell: start and stop with pipes", "[console_shell]") {
   CHECK_FALSE(shell.IsRunning());
 }
 
+TEST_CASE("ConsoleShell: Stop interrupts an idle shell immediately", "[console_shell]") {
+  ConsolePipes pipes;
+
+  embsh::ConsoleShell::Config cfg;
+  cfg.read_fd = pipes.input_pipe[0];
+  cfg.write_fd = pipes.output_pipe[1];
+  cfg.raw_mode = false;
+
+  embsh::ConsoleShell shell(cfg);
+  REQUIRE(shell.Start().has_value());
+  (void)pipes.ReadOutput(100);  // Shell is now blocked waiting for input.
+
+  auto t0 = std::chrono::steady_clock::now();
+  shell.Stop();
+  auto elapsed = std::chrono::steady_clock::now() - t0;
+  CHECK_FALSE(shell.IsRunning());
+  CHECK(elapsed < std::chrono::milliseconds(50));
+}
+
 TEST_CASE("ConsoleShell: command execution via pipe", "[console_shell]") {
   static bool console_cmd_ran = false;
   console_cmd_ran = false;
@@ -94,7 +115,7 @@ TEST_CASE("ConsoleShell: command execution via pipe", "[console_shell]") {
     console_cmd_ran = true;
     return 0;
   };
-  embsh::CommandRegistry::Instance().Register("console_test", cmd_fn, "console test");
+  RequireRegister("console_test", cmd_fn, "console test");
 
   ConsolePipes pipes;
 
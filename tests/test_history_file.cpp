@@ -0,0 +1,216 @@
+/**
+ * @file test_history_file.cpp
+ * @brief Unit tests for the persistent HistoryFile log.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "embsh/console_shell.hpp"
+#include "embsh/history_file.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+/// Temporary log path, removed (with its compaction file) on destruction.
+struct TempLog {
+  char path[64] = "/tmp/embsh_history_XXXXXX";
+
+  TempLog() {
+    int fd = ::mkstemp(path);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  ~TempLog() {
+    ::unlink(path);
+    std::string tmp = std::string(path) + ".tmp";
+    ::unlink(tmp.c_str());
+  }
+
+  size_t Size() const {
+    struct stat st;
+    return (::stat(path, &st) == 0) ? static_cast<size_t>(st.st_size) : 0;
+  }
+
+  void Append(const void* data, size_t len) const {
+    int fd = ::open(path, O_WRONLY | O_APPEND);
+    if (fd >= 0) {
+      (void)::write(fd, data, len);
+      ::close(fd);
+    }
+  }
+};
+
+static std::string Entry(embsh::HistoryStore& store, uint32_t seq) {
+  char buf[EMBSH_LINE_BUF_SIZE];
+  int32_t n = store.Load(seq, buf, sizeof(buf));
+  return (n < 0) ? std::string("<none>") : std::string(buf, static_cast<size_t>(n));
+}
+
+static void Push(embsh::HistoryStore& store, const std::string& line) {
+  store.Push(line.data(), static_cast<uint32_t>(line.size()));
+}
+
+// ============================================================================
+// HistoryFile
+// ============================================================================
+
+TEST_CASE("HistoryFile: entries survive a reopen", "[history_file]") {
+  TempLog log;
+  {
+    embsh::HistoryFile hf;
+    REQUIRE(hf.Open(log.path).has_value());
+    CHECK(hf.Store().Count() == 0);
+    Push(hf.Store(), "net show");
+    Push(hf.Store(), "net show");  // Repeat of the newest is not stored or logged.
+    Push(hf.Store(), "log level 3");
+    Push(hf.Store(), "reboot");
+  }
+  CHECK(log.Size() == 8 + (4 + 8) + (4 + 11) + (4 + 6));
+
+  embsh::HistoryFile hf;
+  REQUIRE(hf.Open(log.path).has_value());
+  auto& store = hf.Store();
+  REQUIRE(store.Count() == 3);
+  CHECK(Entry(store, store.Begin()) == "net show");
+  CHECK(Entry(store, store.Begin() + 2) == "reboot");
+}
+
+TEST_CASE("HistoryFile: appends reach the file without Flush", "[history_file]") {
+  TempLog log;
+  embsh::HistoryFile hf;
+  REQUIRE(hf.Open(log.path).has_value());
+  const size_t empty = log.Size();
+  Push(hf.Store(), "written by the worker");
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+  while (log.Size() == empty && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  CHECK(log.Size() == empty + 4 + 21);
+  CHECK(hf.Dropped() == 0);
+}
+
+TEST_CASE("HistoryFile: a torn last record is dropped on open", "[history_file]") {
+  TempLog log;
+  {
+    embsh::HistoryFile hf;
+    REQUIRE(hf.Open(log.path).has_value());
+    Push(hf.Store(), "first");
+    Push(hf.Store(), "second");
+  }
+  const size_t good = log.Size();
+  const char torn[] = {9, 0, 't', 'h', 'i'};  // Power cut in the middle of "third...".
+  log.Append(torn, sizeof(torn));
+
+  embsh::HistoryFile hf;
+  REQUIRE(hf.Open(log.path).has_value());
+  REQUIRE(hf.Store().Count() == 2);
+  CHECK(Entry(hf.Store(), hf.Store().End() - 1) == "second");
+  CHECK(log.Size() == good);
+
+  Push(hf.Store(), "third");
+  hf.Close();
+  REQUIRE(hf.Open(log.path).has_value());
+  CHECK(hf.Store().Count() == 3);
+}
+
+TEST_CASE("HistoryFile: open loads only the newest entries the store holds", "[history_file]") {
+  TempLog log;
+  const int total = EMBSH_HISTORY_SIZE + 10;
+  {
+    embsh::HistoryFile hf;
+    REQUIRE(hf.Open(log.path, 1U << 30).has_value());  // No compaction.
+    for (int i = 0; i < total; ++i) {
+      Push(hf.Store(), "cmd " + std::to_string(i));
+      if (i % 16 == 0)
+        hf.Flush();
+    }
+  }
+
+  embsh::HistoryFile hf;
+  REQUIRE(hf.Open(log.path).has_value());
+  auto& store = hf.Store();
+  CHECK(store.Count() == EMBSH_HISTORY_SIZE);
+  CHECK(Entry(store, store.End() - 1) == "cmd " + std::to_string(total - 1));
+  CHECK(Entry(store, store.Begin()) == "cmd " + std::to_string(total - EMBSH_HISTORY_SIZE));
+}
+
+TEST_CASE("HistoryFile: the log is compacted past its size limit", "[history_file]") {
+  TempLog log;
+  const uint32_t limit = 2 * EMBSH_HISTORY_BYTES;
+  embsh::HistoryFile hf;
+  REQUIRE(hf.Open(log.path, limit).has_value());
+  const std::string pad(200, 'x');
+  int i = 0;
+  while (i < 200) {
+    Push(hf.Store(), std::to_string(i++) + pad);
+    hf.Flush();
+  }
+  CHECK(log.Size() <= limit);
+  hf.Close();
+
+  REQUIRE(hf.Open(log.path, limit).has_value());
+  auto& store = hf.Store();
+  REQUIRE(store.Count() > 0);
+  CHECK(Entry(store, store.End() - 1) == std::to_string(i - 1) + pad);
+}
+
+TEST_CASE("HistoryFile: a file that is not a history log is left alone", "[history_file]") {
+  TempLog log;
+  const char text[] = "not a history log\n";
+  log.Append(text, sizeof(text) - 1);
+
+  embsh::HistoryFile hf;
+  auto r = hf.Open(log.path);
+  REQUIRE_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kFileOpenFailed);
+  CHECK(log.Size() == sizeof(text) - 1);
+  CHECK(hf.Open("/nonexistent/dir/history").error_value() == embsh::ShellError::kFileOpenFailed);
+}
+
+TEST_CASE("HistoryFile: ConsoleShell records commands in its history file", "[history_file]") {
+  TempLog log;
+  int in[2];
+  int out[2];
+  REQUIRE(::pipe(in) == 0);
+  REQUIRE(::pipe(out) == 0);
+
+  embsh::ConsoleShell::Config cfg;
+  cfg.read_fd = in[0];
+  cfg.write_fd = out[1];
+  cfg.raw_mode = false;
+  cfg.history_file = log.path;
+  {
+    embsh::ConsoleShell shell(cfg);
+    REQUIRE(shell.Start().has_value());
+    const char cmds[] = "help\rnot_a_command\r";
+    REQUIRE(::write(in[1], cmds, sizeof(cmds) - 1) == static_cast<ssize_t>(sizeof(cmds) - 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    shell.Stop();
+  }
+
+  embsh::HistoryFile* shared = embsh::HistoryFile::Shared(log.path);
+  REQUIRE(shared != nullptr);
+  CHECK(shared->Store().Count() == 2);
+  CHECK(log.Size() == 8 + (4 + 4) + (4 + 13));
+
+  embsh::HistoryFile reopened;
+  REQUIRE(reopened.Open(log.path).has_value());
+  CHECK(Entry(reopened.Store(), reopened.Store().End() - 1) == "not_a_command");
+
+  for (int fd : {in[0], in[1], out[0], out[1]}) {
+    ::close(fd);
+  }
+}
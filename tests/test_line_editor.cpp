@@ -5,9 +5,23 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+#include "test_support.hpp"
+
 #include "embsh/line_editor.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
 
 // ============================================================================
 // Helper: create a session with a pipe backend for testing.
@@ -33,6 +47,19 @@ struct PipePair {
   }
 };
 
+static std::string ReadAll(int fd) {
+  std::string result;
+  char buf[256];
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (::poll(&pfd, 1, 0) == 1) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    result.append(buf, static_cast<size_t>(n));
+  }
+  return result;
+}
+
 static void InitTestSession(embsh::Session& s, PipePair& output) {
   s.read_fd = -1;  // Not used directly in ProcessByte tests.
   s.write_fd = output.write_fd;
@@ -40,8 +67,6 @@ static void InitTestSession(embsh::Session& s, PipePair& output) {
   s.read_fn = embsh::io::PosixRead;
   s.telnet_mode = false;
   s.line_pos = 0;
-  s.hist_count = 0;
-  s.hist_write = 0;
   s.hist_browsing = false;
   s.esc_state = embsh::Session::EscState::kNone;
   s.iac_state = embsh::Session::IacState::kNormal;
@@ -163,12 +188,12 @@ TEST_CASE("LineEditor: PushHistory stores entries", "[line_editor]") {
   std::strcpy(s.line_buf, "cmd1");
   s.line_pos = 4;
   embsh::editor::PushHistory(s);
-  CHECK(s.hist_count == 1);
+  CHECK(embsh::SessionHistory(s).Count() == 1);
 
   std::strcpy(s.line_buf, "cmd2");
   s.line_pos = 4;
   embsh::editor::PushHistory(s);
-  CHECK(s.hist_count == 2);
+  CHECK(embsh::SessionHistory(s).Count() == 2);
 }
 
 TEST_CASE("LineEditor: PushHistory skips duplicates", "[line_editor]") {
@@ -179,12 +204,12 @@ TEST_CASE("LineEditor: PushHistory skips duplicates", "[line_editor]") {
   std::strcpy(s.line_buf, "repeat");
   s.line_pos = 6;
   embsh::editor::PushHistory(s);
-  CHECK(s.hist_count == 1);
+  CHECK(embsh::SessionHistory(s).Count() == 1);
 
   std::strcpy(s.line_buf, "repeat");
   s.line_pos = 6;
   embsh::editor::PushHistory(s);
-  CHECK(s.hist_count == 1);  // Not incremented.
+  CHECK(embsh::SessionHistory(s).Count() == 1);  // Not incremented.
 }
 
 TEST_CASE("LineEditor: PushHistory ignores empty input", "[line_editor]") {
@@ -194,7 +219,7 @@ TEST_CASE("LineEditor: PushHistory ignores empty input", "[line_editor]") {
 
   s.line_pos = 0;
   embsh::editor::PushHistory(s);
-  CHECK(s.hist_count == 0);
+  CHECK(embsh::SessionHistory(s).Count() == 0);
 }
 
 TEST_CASE("LineEditor: arrow up navigates history", "[line_editor]") {
@@ -244,6 +269,136 @@ TEST_CASE("LineEditor: arrow down returns to empty line", "[line_editor]") {
   CHECK(s.line_pos == 0);
 }
 
+TEST_CASE("LineEditor: arrow up stops at the oldest entry", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+
+  std::strcpy(s.line_buf, "only");
+  s.line_pos = 4;
+  embsh::editor::PushHistory(s);
+  s.line_pos = 0;
+  s.line_buf[0] = '\0';
+
+  embsh::editor::HistoryUp(s);
+  embsh::editor::HistoryUp(s);
+  CHECK(std::strcmp(s.line_buf, "only") == 0);
+}
+
+// ============================================================================
+// HistoryStore tests
+// ============================================================================
+
+TEST_CASE("HistoryStore: entry count is bounded by EMBSH_HISTORY_SIZE", "[line_editor]") {
+  embsh::HistoryStore hist;
+  char line[16];
+  for (int i = 0; i < EMBSH_HISTORY_SIZE + 5; ++i) {
+    int n = std::snprintf(line, sizeof(line), "c%d", i);
+    hist.Push(line, static_cast<uint32_t>(n));
+  }
+  CHECK(hist.Count() == EMBSH_HISTORY_SIZE);
+  CHECK(hist.End() - hist.Begin() == EMBSH_HISTORY_SIZE);
+
+  char got[16];
+  REQUIRE(hist.Load(hist.End() - 1, got, sizeof(got)) > 0);
+  std::snprintf(line, sizeof(line), "c%d", EMBSH_HISTORY_SIZE + 4);
+  CHECK(std::strcmp(got, line) == 0);
+  CHECK(hist.Load(hist.Begin() - 1, got, sizeof(got)) == -1);
+  CHECK(hist.Load(hist.End(), got, sizeof(got)) == -1);
+}
+
+TEST_CASE("HistoryStore: a session's local history keeps the small local size", "[line_editor]") {
+  embsh::Session s;
+  CHECK(s.local_history.Capacity() == EMBSH_LOCAL_HISTORY_SIZE);
+  CHECK(s.local_history.Bytes() == EMBSH_LOCAL_HISTORY_BYTES);
+  CHECK(sizeof(embsh::Session) < sizeof(embsh::HistoryStore));
+
+  char line[16];
+  for (int i = 0; i < EMBSH_LOCAL_HISTORY_SIZE + 3; ++i) {
+    int n = std::snprintf(line, sizeof(line), "c%d", i);
+    embsh::SessionHistory(s).Push(line, static_cast<uint32_t>(n));
+  }
+  CHECK(s.local_history.Count() == EMBSH_LOCAL_HISTORY_SIZE);
+  char got[16];
+  REQUIRE(s.local_history.Load(s.local_history.Begin(), got, sizeof(got)) > 0);
+  CHECK(std::strcmp(got, "c3") == 0);
+}
+
+TEST_CASE("HistoryStore: long lines evict by bytes and never split", "[line_editor]") {
+  embsh::HistoryStore hist;
+  char line[EMBSH_LINE_BUF_SIZE];
+  const uint32_t len = EMBSH_LINE_BUF_SIZE - 1;
+  for (int i = 0; i < EMBSH_HISTORY_BYTES / EMBSH_LINE_BUF_SIZE + 4; ++i) {
+    std::memset(line, 'a' + i, len);
+    hist.Push(line, len);
+
+    // Every retained entry reads back whole.
+    char got[EMBSH_LINE_BUF_SIZE];
+    for (uint32_t seq = hist.Begin(); seq < hist.End(); ++seq) {
+      REQUIRE(hist.Load(seq, got, sizeof(got)) == static_cast<int32_t>(len));
+      CHECK(got[0] == static_cast<char>('a' + seq));
+      CHECK(got[len - 1] == static_cast<char>('a' + seq));
+    }
+  }
+  CHECK(hist.Count() == EMBSH_HISTORY_BYTES / EMBSH_LINE_BUF_SIZE);
+}
+
+TEST_CASE("HistoryStore: short entries pack back-to-back", "[line_editor]") {
+  embsh::HistoryStore hist;
+  hist.Push("ls", 2);
+  hist.Push("ls", 2);  // Repeat of newest is ignored.
+  hist.Push("help", 4);
+  CHECK(hist.Count() == 2);
+
+  char got[8];
+  CHECK(hist.Load(hist.Begin(), got, sizeof(got)) == 2);
+  CHECK(std::strcmp(got, "ls") == 0);
+  // Truncates to the caller's buffer.
+  CHECK(hist.Load(hist.Begin() + 1, got, 3) == 2);
+  CHECK(std::strcmp(got, "he") == 0);
+
+  hist.Clear();
+  CHECK(hist.Count() == 0);
+}
+
+TEST_CASE("HistoryStore: Find matches substrings newest first", "[line_editor]") {
+  embsh::HistoryStore hist;
+  hist.Push("net show", 8);
+  hist.Push("log level 3", 11);
+  hist.Push("net set ip 10.0.0.1", 19);
+  hist.Push("reboot", 6);
+
+  uint32_t seq = 0;
+  REQUIRE(hist.Find("net", 3, hist.End(), seq));
+  CHECK(seq == hist.Begin() + 2);
+  REQUIRE(hist.Find("net", 3, seq, seq));
+  CHECK(seq == hist.Begin());
+  CHECK_FALSE(hist.Find("net", 3, seq, seq));
+  CHECK_FALSE(hist.Find("xyz", 3, hist.End(), seq));
+  REQUIRE(hist.Find("el 3", 4, hist.End() + 10, seq));  // before is clamped to End().
+  CHECK(seq == hist.Begin() + 1);
+}
+
+TEST_CASE("HistoryStore: sessions can share one store", "[line_editor]") {
+  PipePair out;
+  embsh::HistoryStore shared;
+  embsh::Session a;
+  embsh::Session b;
+  InitTestSession(a, out);
+  InitTestSession(b, out);
+  a.history = &shared;
+  b.history = &shared;
+
+  std::strcpy(a.line_buf, "from_a");
+  a.line_pos = 6;
+  embsh::editor::PushHistory(a);
+  CHECK(a.local_history.Count() == 0);
+
+  b.line_pos = 0;
+  embsh::editor::HistoryUp(b);
+  CHECK(std::strcmp(b.line_buf, "from_a") == 0);
+}
+
 // ============================================================================
 // ESC sequence tests
 // ============================================================================
@@ -277,12 +432,161 @@ TEST_CASE("LineEditor: unknown ESC sequence is ignored", "[line_editor]") {
 
   embsh::editor::ProcessByte(s, 'x', prompt);
   embsh::editor::ProcessByte(s, 0x1B, prompt);  // ESC
-  embsh::editor::ProcessByte(s, 'O', prompt);   // Not '[', reset
+  embsh::editor::ProcessByte(s, 'q', prompt);   // Not '[' or 'O', reset
 
   CHECK(s.line_pos == 1);
   CHECK(s.line_buf[0] == 'x');
 }
 
+// ============================================================================
+// Cursor editing tests
+// ============================================================================
+
+static void FeedText(embsh::Session& s, const char* text) {
+  for (const char* p = text; *p != '\0'; ++p) {
+    (void)embsh::editor::ProcessByte(s, static_cast<uint8_t>(*p), "> ");
+  }
+}
+
+TEST_CASE("LineEditor: arrow keys move the cursor for mid-line insert", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+
+  FeedText(s, "helo\x1b[D");
+  CHECK(s.cursor_back == 1);
+  FeedText(s, "l");
+  CHECK(std::string(s.line_buf, s.line_pos) == "hello");
+  CHECK(s.cursor_back == 1);
+  embsh::SessionFlush(s);
+  // Left is a backspace; the insert redraws "lo" and steps back over "o".
+  CHECK(ReadAll(out.read_fd) == "helo\blo\b");
+
+  FeedText(s, "\x1b[C\x1b[C");  // Right stops at the end.
+  CHECK(s.cursor_back == 0);
+  FeedText(s, "\x1bOH>\x1b[4~!");  // SS3 Home, CSI 4~ End.
+  CHECK(std::string(s.line_buf, s.line_pos) == ">hello!");
+  embsh::SessionFlush(s);
+  CHECK(ReadAll(out.read_fd) == "o\x1b[5D>hello\x1b[5D\x1b[5C!");
+}
+
+TEST_CASE("LineEditor: Ctrl+A/E/K/U/W and Delete edit around the cursor", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+
+  FeedText(s, "one two  three");
+  FeedText(s, "\x17");  // Ctrl+W
+  CHECK(std::string(s.line_buf, s.line_pos) == "one two  ");
+  FeedText(s, "\x17");
+  CHECK(std::string(s.line_buf, s.line_pos) == "one ");
+  FeedText(s, "\x01\x04");  // Ctrl+A, Ctrl+D deletes under the cursor.
+  CHECK(std::string(s.line_buf, s.line_pos) == "ne ");
+  CHECK(s.active.load());
+  FeedText(s, "\x06\x1b[3~");  // Ctrl+F, Delete.
+  CHECK(std::string(s.line_buf, s.line_pos) == "n ");
+  CHECK(s.cursor_back == 1);
+  FeedText(s, "\x0b");  // Ctrl+K
+  CHECK(std::string(s.line_buf, s.line_pos) == "n");
+  CHECK(s.cursor_back == 0);
+  FeedText(s, "ext\x02\x02\x15");  // Ctrl+B twice, Ctrl+U.
+  CHECK(std::string(s.line_buf, s.line_pos) == "xt");
+  CHECK(s.cursor_back == 2);
+  FeedText(s, "\x05\x7F");  // Ctrl+E, Backspace.
+  CHECK(std::string(s.line_buf, s.line_pos) == "x");
+}
+
+TEST_CASE("LineEditor: history recall sends only the changed part", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  auto& hist = embsh::SessionHistory(s);
+  hist.Push("config set net.ip 10.0.0.1", 26);
+  hist.Push("config set net.ip 10.0.0.2", 26);
+  hist.Push("config show", 11);
+
+  FeedText(s, "\x1b[A\x1b[A");
+  CHECK(std::strcmp(s.line_buf, "config set net.ip 10.0.0.2") == 0);
+  (void)ReadAll(out.read_fd);
+  embsh::SessionFlush(s);
+  (void)ReadAll(out.read_fd);
+
+  FeedText(s, "\x1b[A");
+  embsh::SessionFlush(s);
+  CHECK(ReadAll(out.read_fd) == "\b1");
+
+  FeedText(s, "\x1b[B\x1b[B");  // "config show": keep "config s", rewrite "how", clear the rest.
+  CHECK(std::strcmp(s.line_buf, "config show") == 0);
+  FeedText(s, "\x1b[B");
+  CHECK(s.line_pos == 0);
+  embsh::SessionFlush(s);
+  CHECK(ReadAll(out.read_fd) == "\b2\x1b[18Dhow\x1b[K\x1b[11D\x1b[K");
+}
+
+TEST_CASE("LineEditor: Ctrl+R searches history incrementally", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  auto& hist = embsh::SessionHistory(s);
+  hist.Push("net show", 8);
+  hist.Push("log level 3", 11);
+  hist.Push("net set ip 10.0.0.1", 19);
+  hist.Push("reboot", 6);
+
+  FeedText(s, "\x12net");
+  CHECK(s.searching);
+  CHECK(std::strcmp(s.line_buf, "net set ip 10.0.0.1") == 0);
+  FeedText(s, "\x12");  // Older match.
+  CHECK(std::strcmp(s.line_buf, "net show") == 0);
+  FeedText(s, "\x12");  // No more: bell, line kept.
+  CHECK(std::strcmp(s.line_buf, "net show") == 0);
+  FeedText(s, "z");  // Pattern "netz" fails and is not extended.
+  CHECK(s.search_len == 3);
+  FeedText(s, "\x7F\x7F\x7F" "lev");
+  CHECK(std::strcmp(s.line_buf, "log level 3") == 0);
+
+  // An arrow ends the search and edits the match.
+  FeedText(s, "\x1b[D");
+  CHECK_FALSE(s.searching);
+  CHECK(s.cursor_back == 1);
+  FeedText(s, "1\r");
+  CHECK(std::strcmp(s.line_buf, "log level 13") == 0);
+  CHECK(s.line_pos == 12);
+  embsh::SessionFlush(s);
+  const std::string text = ReadAll(out.read_fd);
+  CHECK(text.find("(i-search) ") != std::string::npos);
+  CHECK(text.find('\a') != std::string::npos);
+}
+
+TEST_CASE("LineEditor: Ctrl+R redraws only the changed part of the match", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  auto& hist = embsh::SessionHistory(s);
+  hist.Push("config set net.ip 10.0.0.1", 26);
+  hist.Push("config set net.ip 10.0.0.2", 26);
+
+  FeedText(s, "\x12" "10");
+  CHECK(std::strcmp(s.line_buf, "config set net.ip 10.0.0.2") == 0);
+  embsh::SessionFlush(s);
+  (void)ReadAll(out.read_fd);
+
+  FeedText(s, ".");  // Same match: only the pattern character is sent.
+  embsh::SessionFlush(s);
+  CHECK(ReadAll(out.read_fd) == ".");
+
+  FeedText(s, "\x12");  // "...1": back over tag and pattern, rewrite one digit, re-send the tail.
+  embsh::SessionFlush(s);
+  CHECK(std::strcmp(s.line_buf, "config set net.ip 10.0.0.1") == 0);
+  CHECK(ReadAll(out.read_fd) == "\x1b[16D\b1  (i-search) 10.");
+
+  FeedText(s, "\x07");  // Ctrl+G leaves the search and keeps the line.
+  CHECK_FALSE(s.searching);
+  CHECK(s.line_pos == 26);
+  embsh::SessionFlush(s);
+  CHECK(ReadAll(out.read_fd) == "\x1b[16D\x1b[K");
+}
+
 // ============================================================================
 // IAC filter tests
 // ============================================================================
@@ -327,3 +631,910 @@ TEST_CASE("LineEditor: IAC IAC passes literal 0xFF", "[line_editor]") {
   CHECK(embsh::editor::FilterIac(s, 0xFF) == '\0');                     // IAC
   CHECK(embsh::editor::FilterIac(s, 0xFF) == static_cast<char>(0xFF));  // Literal 0xFF
 }
+
+// ============================================================================
+// Batched input tests
+// ============================================================================
+
+static int g_batch_calls = 0;
+
+static int BatchCountCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  ++g_batch_calls;
+  return 0;
+}
+
+TEST_CASE("LineEditor: ProcessBytes executes every line in a block", "[line_editor]") {
+  RequireRegister("batch_count", BatchCountCmd, "batch test");
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  g_batch_calls = 0;
+
+  const char input[] = "batch_count\r\nbatch_count\rbatch_count\npart";
+  size_t len = sizeof(input) - 1;
+  size_t used = embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(input), len, "> ");
+
+  CHECK(used == len);
+  CHECK(g_batch_calls == 3);
+  REQUIRE(s.line_pos == 4);
+  CHECK(std::strncmp(s.line_buf, "part", 4) == 0);
+}
+
+static char g_last_arg[64];
+
+static int LastArgCmd(int argc, char* argv[], void* /*ctx*/) {
+  std::snprintf(g_last_arg, sizeof(g_last_arg), "%d:%s", argc, argv[argc - 1]);
+  return 0;
+}
+
+TEST_CASE("LineEditor: ExecuteLine tokenizes the line buffer in place", "[line_editor]") {
+  RequireRegister("last_arg", LastArgCmd, "argv test");
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  g_last_arg[0] = '\0';
+
+  const char input[] = "last_arg one \"two \\\" three\"\r";
+  embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(input), sizeof(input) - 1, "> ");
+  CHECK(std::strcmp(g_last_arg, "3:two \" three") == 0);
+  // History keeps the untokenized line.
+  REQUIRE(embsh::SessionHistory(s).Count() == 1);
+  char line[EMBSH_LINE_BUF_SIZE];
+  REQUIRE(embsh::SessionHistory(s).Load(0, line, sizeof(line)) > 0);
+  CHECK(std::strcmp(line, "last_arg one \"two \\\" three\"") == 0);
+}
+
+TEST_CASE("LineEditor: too many arguments are reported", "[line_editor]") {
+  RequireRegister("batch_count", BatchCountCmd, "batch test");
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  g_batch_calls = 0;
+
+  char input[EMBSH_LINE_BUF_SIZE] = "batch_count";
+  for (int i = 0; i < EMBSH_MAX_ARGS; ++i)
+    std::strcat(input, " a");
+  std::strcat(input, "\r");
+  embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(input), std::strlen(input), "> ");
+  CHECK(g_batch_calls == 0);
+
+  char got[1024] = {};
+  ssize_t n = ::read(out.read_fd, got, sizeof(got) - 1);
+  REQUIRE(n > 0);
+  CHECK(std::strstr(got, "too many arguments") != nullptr);
+}
+
+TEST_CASE("LineEditor: CR LF and telnet CR NUL end a line once", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.telnet_mode = true;
+
+  const uint8_t input[] = {'a', '\r', '\0', 'b', '\r', '\n', 'c'};
+  CHECK(embsh::editor::ProcessByte(s, input[0], "> ") == false);
+  CHECK(embsh::editor::ProcessByte(s, input[1], "> ") == true);
+  s.line_pos = 0;
+  CHECK(embsh::editor::ProcessByte(s, input[2], "> ") == false);  // Swallowed NUL.
+  CHECK(embsh::editor::ProcessByte(s, input[3], "> ") == false);
+  CHECK(embsh::editor::ProcessByte(s, input[4], "> ") == true);
+  s.line_pos = 0;
+  CHECK(embsh::editor::ProcessByte(s, input[5], "> ") == false);  // Swallowed LF.
+  CHECK(embsh::editor::ProcessByte(s, input[6], "> ") == false);
+  CHECK(s.line_pos == 1);
+  CHECK(s.line_buf[0] == 'c');
+}
+
+TEST_CASE("LineEditor: ProcessBytes stops when the session ends", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+
+  const char input[] = "exit\rtrailing";
+  size_t used = embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(input), sizeof(input) - 1, "> ");
+  CHECK(used == 5);
+  CHECK(s.active.load() == false);
+}
+
+TEST_CASE("LineEditor: printable runs match per-byte processing", "[line_editor]") {
+  std::string input = "ab\x7F" "cd\x1b[1;5Axy\x1b[5~z";
+  input += std::string(EMBSH_LINE_BUF_SIZE, 'q');  // Overflows the line buffer.
+  const auto* data = reinterpret_cast<const uint8_t*>(input.data());
+
+  PipePair out1;
+  embsh::Session bulk;
+  InitTestSession(bulk, out1);
+  CHECK(embsh::editor::ProcessBytes(bulk, data, input.size(), "> ") == input.size());
+
+  PipePair out2;
+  embsh::Session single;
+  InitTestSession(single, out2);
+  for (size_t i = 0; i < input.size(); ++i) {
+    CHECK_FALSE(embsh::editor::ProcessByte(single, data[i], "> "));
+  }
+  embsh::SessionFlush(single);
+
+  REQUIRE(bulk.line_pos == EMBSH_LINE_BUF_SIZE - 1);
+  CHECK(single.line_pos == bulk.line_pos);
+  CHECK(std::strncmp(bulk.line_buf, "acdxyzqq", 8) == 0);
+  CHECK(std::memcmp(bulk.line_buf, single.line_buf, bulk.line_pos) == 0);
+  CHECK(ReadAll(out1.read_fd) == ReadAll(out2.read_fd));
+}
+
+TEST_CASE("LineEditor: PrintableRun stops at every non-printable byte", "[line_editor]") {
+  CHECK(embsh::editor::kInputClass.cls[' '] == embsh::editor::kInputPrintable);
+  CHECK(embsh::editor::kInputClass.cls[0x7F] == embsh::editor::kInputControl);
+  CHECK(embsh::editor::kInputClass.cls[0x80] == embsh::editor::kInputHigh);
+  CHECK(embsh::editor::kInputClass.cls[0xFF] == embsh::editor::kInputIac);
+
+  // Each stop byte at each offset of a 40-byte run, across the 16-byte SIMD steps.
+  uint8_t buf[40];
+  int bad = 0;
+  for (int stop = 0; stop < 256; ++stop) {
+    if (stop >= 0x20 && stop < 0x7F)
+      continue;
+    for (size_t at = 0; at < sizeof(buf); ++at) {
+      std::memset(buf, 'a' + static_cast<int>(at % 26), sizeof(buf));
+      buf[at] = static_cast<uint8_t>(stop);
+      bad += (embsh::editor::PrintableRun(buf, sizeof(buf)) != at) ? 1 : 0;
+      bad += (embsh::editor::PrintableRun(buf, at) != at) ? 1 : 0;
+    }
+  }
+  CHECK(bad == 0);
+  std::memset(buf, '~', sizeof(buf));
+  CHECK(embsh::editor::PrintableRun(buf, sizeof(buf)) == sizeof(buf));
+}
+
+TEST_CASE("LineEditor: pasting mid-line redraws the tail once per run", "[line_editor]") {
+  const char input[] = "ab\x1b[Dxyz";
+  const auto* data = reinterpret_cast<const uint8_t*>(input);
+
+  PipePair out1;
+  embsh::Session bulk;
+  InitTestSession(bulk, out1);
+  (void)embsh::editor::ProcessBytes(bulk, data, sizeof(input) - 1, "> ");
+
+  PipePair out2;
+  embsh::Session single;
+  InitTestSession(single, out2);
+  for (size_t i = 0; i + 1 < sizeof(input); ++i) {
+    (void)embsh::editor::ProcessByte(single, data[i], "> ");
+  }
+  embsh::SessionFlush(single);
+
+  CHECK(std::string(bulk.line_buf, bulk.line_pos) == "axyzb");
+  CHECK(std::string(single.line_buf, single.line_pos) == "axyzb");
+  CHECK(ReadAll(out1.read_fd) == "ab\bxyzb\b");
+  CHECK(ReadAll(out2.read_fd) == "ab\bxb\byb\bzb\b");
+}
+
+TEST_CASE("LineEditor: bracketed paste inserts text literally", "[line_editor]") {
+  RequireRegister("batch_count", BatchCountCmd, "batch test");
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  g_batch_calls = 0;
+
+  // Tab becomes a space and Ctrl+D is dropped inside the paste; each line runs.
+  const char input[] = "\x1b[200~batch_count\tx\r\n\x04" "batch_count\r\n\x1b[201~";
+  embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(input), sizeof(input) - 1, "> ");
+  CHECK(g_batch_calls == 2);
+  CHECK(s.active.load());
+  CHECK_FALSE(s.pasting);
+  char line[EMBSH_LINE_BUF_SIZE];
+  REQUIRE(embsh::SessionHistory(s).Count() == 2);
+  REQUIRE(embsh::SessionHistory(s).Load(0, line, sizeof(line)) > 0);
+  CHECK(std::strcmp(line, "batch_count x") == 0);
+
+  // A lost end marker: Ctrl+C leaves paste mode.
+  const char open_paste[] = "\x1b[200~ab\x03";
+  embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(open_paste), sizeof(open_paste) - 1, "> ");
+  CHECK_FALSE(s.pasting);
+  CHECK(s.line_pos == 0);
+}
+
+TEST_CASE("LineEditor: ReadInput consumes a whole read in one call", "[line_editor]") {
+  PipePair in;
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.read_fd = in.read_fd;
+
+  const char input[] = "hello world";
+  REQUIRE(::write(in.write_fd, input, sizeof(input) - 1) == static_cast<ssize_t>(sizeof(input) - 1));
+
+  ssize_t n = embsh::editor::ReadInput(s, "> ");
+  CHECK(n == static_cast<ssize_t>(sizeof(input) - 1));
+  CHECK(s.rx_pos == s.rx_len);
+  REQUIRE(s.line_pos == sizeof(input) - 1);
+  CHECK(std::strncmp(s.line_buf, input, s.line_pos) == 0);
+}
+
+// ============================================================================
+// Asynchronous command tests
+// ============================================================================
+
+static std::atomic<bool> g_async_release{false};
+static std::atomic<int> g_after_calls{0};
+
+static int AsyncWaitCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  while (!g_async_release.load() && !embsh::ShellCancelled()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  embsh::ShellPrintf("async done\r\n");
+  return 0;
+}
+
+static int AfterCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  ++g_after_calls;
+  return 0;
+}
+
+static bool WaitNotify(embsh::WakeEvent& ev, int timeout_ms = 1000) {
+  struct pollfd pfd = {ev.fd(), POLLIN, 0};
+  if (::poll(&pfd, 1, timeout_ms) != 1)
+    return false;
+  ev.Drain();
+  return true;
+}
+
+TEST_CASE("LineEditor: async command parks input until it finishes", "[line_editor]") {
+  RequireRegister("async_wait", AsyncWaitCmd, nullptr, "async test", embsh::kCmdAsync);
+  RequireRegister("after_cmd", AfterCmd, "runs after async");
+  PipePair in;
+  PipePair out;
+  embsh::WakeEvent done;
+  REQUIRE(done.Open());
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.read_fd = in.read_fd;
+  s.notify = &done;
+  g_async_release = false;
+  g_after_calls = 0;
+
+  const char first[] = "async_wait\rafter_cmd\r";
+  REQUIRE(::write(in.write_fd, first, sizeof(first) - 1) == static_cast<ssize_t>(sizeof(first) - 1));
+  REQUIRE(embsh::editor::ReadInput(s, "> ") > 0);
+  CHECK(s.busy.load());
+  CHECK(s.rx_pos == sizeof("async_wait\r") - 1);  // The rest stays parked.
+
+  // Input arriving while busy is parked behind it, not executed.
+  const char second[] = "after_cmd\r";
+  REQUIRE(::write(in.write_fd, second, sizeof(second) - 1) == static_cast<ssize_t>(sizeof(second) - 1));
+  REQUIRE(embsh::editor::ReadInput(s, "> ") > 0);
+  CHECK(g_after_calls == 0);
+
+  g_async_release = true;
+  REQUIRE(WaitNotify(done));
+  embsh::editor::WaitIdle(s);
+  CHECK_FALSE(s.busy.load());
+  embsh::editor::ResumeInput(s, "> ");
+  CHECK(g_after_calls == 2);
+  CHECK(s.rx_pos == s.rx_len);
+  CHECK(ReadAll(out.read_fd).find("async done\r\n> ") != std::string::npos);
+}
+
+TEST_CASE("LineEditor: Ctrl+C cancels a running async command", "[line_editor]") {
+  RequireRegister("async_wait", AsyncWaitCmd, nullptr, "async test", embsh::kCmdAsync);
+  PipePair in;
+  PipePair out;
+  embsh::WakeEvent done;
+  REQUIRE(done.Open());
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.read_fd = in.read_fd;
+  s.notify = &done;
+  g_async_release = false;
+
+  const char cmd[] = "async_wait\r";
+  REQUIRE(::write(in.write_fd, cmd, sizeof(cmd) - 1) == static_cast<ssize_t>(sizeof(cmd) - 1));
+  REQUIRE(embsh::editor::ReadInput(s, "> ") > 0);
+  REQUIRE(s.busy.load());
+
+  const char ctrl_c = 0x03;
+  REQUIRE(::write(in.write_fd, &ctrl_c, 1) == 1);
+  REQUIRE(embsh::editor::ReadInput(s, "> ") == 1);
+  CHECK(s.rx_pos == s.rx_len);  // Ctrl+C is consumed, not parked.
+
+  REQUIRE(WaitNotify(done));
+  embsh::editor::WaitIdle(s);
+  CHECK(ReadAll(out.read_fd).find("^C\r\n> ") != std::string::npos);
+}
+
+// ============================================================================
+// Buffered output tests
+// ============================================================================
+
+static int g_write_calls = 0;
+static size_t g_write_bytes = 0;
+
+static ssize_t CountingWrite(int /*fd*/, const void* /*buf*/, size_t len) {
+  ++g_write_calls;
+  g_write_bytes += len;
+  return static_cast<ssize_t>(len);
+}
+
+static ssize_t CountingWriteV(int /*fd*/, const struct iovec* iov, int iovcnt) {
+  ++g_write_calls;
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; ++i)
+    total += iov[i].iov_len;
+  g_write_bytes += total;
+  return static_cast<ssize_t>(total);
+}
+
+TEST_CASE("LineEditor: SessionWrite is buffered until SessionFlush", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.write_fn = CountingWrite;
+  g_write_calls = 0;
+  g_write_bytes = 0;
+
+  embsh::SessionWrite(s, "hello ");
+  embsh::SessionWrite(s, "world");
+  CHECK(g_write_calls == 0);
+  CHECK(s.tx_len == 11);
+
+  embsh::SessionFlush(s);
+  CHECK(g_write_calls == 1);
+  CHECK(g_write_bytes == 11);
+  CHECK(s.tx_len == 0);
+
+  embsh::SessionFlush(s);  // Nothing pending: no syscall.
+  CHECK(g_write_calls == 1);
+}
+
+TEST_CASE("LineEditor: echo for a whole input block is one write", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.write_fn = CountingWrite;
+  g_write_calls = 0;
+
+  const char input[] = "abc\x7F\x7F" "def";
+  (void)embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(input), sizeof(input) - 1, "> ");
+  CHECK(g_write_calls == 1);
+  CHECK(s.line_pos == 4);
+}
+
+TEST_CASE("LineEditor: oversized fragment is coalesced with writev", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.write_fn = CountingWrite;
+  s.writev_fn = CountingWriteV;
+  g_write_calls = 0;
+  g_write_bytes = 0;
+
+  char big[EMBSH_TX_BUF_SIZE + 16];
+  std::memset(big, 'x', sizeof(big));
+  embsh::SessionWrite(s, "head");
+  embsh::SessionWriteN(s, big, sizeof(big));
+  CHECK(g_write_calls == 1);
+  CHECK(g_write_bytes == 4 + sizeof(big));
+  CHECK(s.tx_len == 0);
+}
+
+TEST_CASE("LineEditor: buffered output reaches the fd intact", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+
+  char big[EMBSH_TX_BUF_SIZE * 2 + 7];
+  for (size_t i = 0; i < sizeof(big); ++i)
+    big[i] = static_cast<char>('a' + (i % 26));
+  embsh::SessionWrite(s, "<");
+  embsh::SessionWriteN(s, big, sizeof(big));
+  embsh::SessionWrite(s, ">");
+  embsh::SessionFlush(s);
+
+  char got[sizeof(big) + 2];
+  size_t total = 0;
+  while (total < sizeof(got)) {
+    ssize_t n = ::read(out.read_fd, got + total, sizeof(got) - total);
+    REQUIRE(n > 0);
+    total += static_cast<size_t>(n);
+  }
+  CHECK(got[0] == '<');
+  CHECK(std::memcmp(got + 1, big, sizeof(big)) == 0);
+  CHECK(got[sizeof(got) - 1] == '>');
+}
+
+// ============================================================================
+// Command output tests
+// ============================================================================
+
+static std::string FormatWithStream(const char* fmt, ...) {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  embsh::editor::BindOutput(s, nullptr);
+  va_list args;
+  va_start(args, fmt);
+  (void)embsh::detail::StreamFormat(fmt, args);
+  va_end(args);
+  embsh::detail::CurrentOutput() = embsh::detail::SessionOutput{};
+  embsh::SessionFlush(s);
+  return ReadAll(out.read_fd);
+}
+
+TEST_CASE("LineEditor: streaming formatter matches snprintf", "[line_editor]") {
+  char want[256];
+  std::snprintf(want, sizeof(want), "[%5d|%-6s|%08.3f|%llx|%*d|%.*s|%%|%c|%zu|%+i|%#o|%-3c]", 42, "ab", 3.14159,
+                0x1234abcdULL, 4, -7, 2, "xyz", 'Q', static_cast<size_t>(99), 5, 8, 'z');
+  CHECK(FormatWithStream("[%5d|%-6s|%08.3f|%llx|%*d|%.*s|%%|%c|%zu|%+i|%#o|%-3c]", 42, "ab", 3.14159, 0x1234abcdULL, 4,
+                         -7, 2, "xyz", 'Q', static_cast<size_t>(99), 5, 8, 'z') == want);
+  CHECK(FormatWithStream("%-*s|%s", 5, "a", static_cast<const char*>(nullptr)) == "a    |(null)");
+
+  // Wide strings and characters are converted, not read as char data.
+  std::snprintf(want, sizeof(want), "%ls|%-6ls|%.2ls|%3lc|%d", L"wide", L"ab", L"xyz", static_cast<wint_t>(L'w'), 7);
+  CHECK(FormatWithStream("%ls|%-6ls|%.2ls|%3lc|%d", L"wide", L"ab", L"xyz", static_cast<wint_t>(L'w'), 7) == want);
+  CHECK(std::string(want) == "wide|ab    |xy|  w|7");
+}
+
+TEST_CASE("LineEditor: ShellPrintf output longer than tx_buf is not truncated", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  embsh::editor::BindOutput(s, nullptr);
+
+  std::string big(EMBSH_TX_BUF_SIZE * 3, 'x');
+  int n = embsh::ShellPrintf("<%s|%d>", big.c_str(), 12345);
+  embsh::detail::CurrentOutput() = embsh::detail::SessionOutput{};
+  embsh::SessionFlush(s);
+  CHECK(n == static_cast<int>(big.size() + 8));
+  CHECK(ReadAll(out.read_fd) == "<" + big + "|12345>");
+}
+
+TEST_CASE("LineEditor: ShellPrintf formats into tx_buf and batches writes", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.write_fn = CountingWrite;
+  g_write_calls = 0;
+  g_write_bytes = 0;
+  embsh::editor::BindOutput(s, nullptr);
+
+  constexpr int kLines = 200;
+  for (int i = 0; i < kLines; ++i) {
+    embsh::ShellPrintf("%04d 0123456789abcdef0123456789abcdef\r\n", i);
+  }
+  embsh::detail::CurrentOutput() = embsh::detail::SessionOutput{};
+  embsh::SessionFlush(s);
+  constexpr size_t kBytes = kLines * 39;
+  CHECK(g_write_bytes == kBytes);
+  CHECK(g_write_calls <= static_cast<int>(kBytes / EMBSH_TX_BUF_SIZE + 2));
+}
+
+TEST_CASE("LineEditor: ShellWrite integer and hex appenders", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  embsh::editor::BindOutput(s, nullptr);
+
+  embsh::ShellWrite(std::string_view("v="));
+  embsh::ShellWriteInt(INT64_MIN);
+  embsh::ShellWrite(" ", 1);
+  embsh::ShellWriteInt(0);
+  embsh::ShellWrite(" ", 1);
+  embsh::ShellWriteUint(UINT64_MAX);
+  embsh::ShellWrite(" ", 1);
+  embsh::ShellWriteHex(0xbeef, 8);
+  embsh::ShellWrite(" ", 1);
+  embsh::ShellWriteHex(0);
+  embsh::detail::CurrentOutput() = embsh::detail::SessionOutput{};
+  embsh::SessionFlush(s);
+  CHECK(ReadAll(out.read_fd) == "v=-9223372036854775808 0 18446744073709551615 0000beef 0");
+}
+
+// ============================================================================
+// Bulk output tests
+// ============================================================================
+
+TEST_CASE("LineEditor: SessionWriteBinary escapes IAC and bare CR on telnet", "[line_editor]") {
+  const char data[] = "a\xFF" "b\r\nc\rd\xFF\xFF";
+  const size_t len = sizeof(data) - 1;
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+
+  embsh::SessionWrite(s, "pre:");
+  REQUIRE(embsh::SessionWriteBinary(s, data, len));
+  CHECK(ReadAll(out.read_fd) == "pre:" + std::string(data, len));  // Raw backend: unchanged, in order.
+
+  s.telnet_mode = true;
+  REQUIRE(embsh::SessionWriteBinary(s, data, len));
+  CHECK(ReadAll(out.read_fd) == std::string("a\xFF\xFF" "b\r\nc\r\0d\xFF\xFF\xFF\xFF", 14));
+
+  s.telnet_binary = true;
+  REQUIRE(embsh::SessionWriteBinary(s, data, len));
+  CHECK(ReadAll(out.read_fd) == std::string("a\xFF\xFF" "b\r\nc\rd\xFF\xFF\xFF\xFF", 13));
+}
+
+TEST_CASE("LineEditor: DO and DONT BINARY track the peer's answer", "[line_editor]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.telnet_mode = true;
+
+  const uint8_t do_binary[] = {0xFF, 0xFD, 0x00, 'x'};
+  for (uint8_t b : do_binary)
+    (void)embsh::editor::ProcessByte(s, b, "> ");
+  CHECK(s.telnet_binary);
+  CHECK(s.line_pos == 1);  // Negotiation bytes are not line input.
+
+  const uint8_t other[] = {0xFF, 0xFE, 0x01};  // DONT ECHO: unrelated option.
+  for (uint8_t b : other)
+    (void)embsh::editor::ProcessByte(s, b, "> ");
+  CHECK(s.telnet_binary);
+
+  const uint8_t dont_binary[] = {0xFF, 0xFE, 0x00};
+  for (uint8_t b : dont_binary)
+    (void)embsh::editor::ProcessByte(s, b, "> ");
+  CHECK_FALSE(s.telnet_binary);
+}
+
+TEST_CASE("LineEditor: SessionSendFd streams a file and advances the offset", "[line_editor]") {
+  char path[] = "/tmp/embsh_sendfd_XXXXXX";
+  int fd = ::mkstemp(path);
+  REQUIRE(fd >= 0);
+  ::unlink(path);
+  std::string content;
+  for (int i = 0; i < 10000; ++i)
+    content.push_back(static_cast<char>(i & 0xFF));
+  REQUIRE(::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+
+  off_t off = 100;
+  CHECK(embsh::SessionSendFd(s, fd, &off, 5000) == 5000);
+  CHECK(off == 5100);
+  CHECK(ReadAll(out.read_fd) == content.substr(100, 5000));
+
+  // Past the end: short count.
+  off = 9990;
+  CHECK(embsh::SessionSendFd(s, fd, &off, 100) == 10);
+  CHECK(ReadAll(out.read_fd) == content.substr(9990));
+
+  // Telnet sessions are escaped (0xFF doubled) and a pipe source also works.
+  PipePair src;
+  const char raw[] = "\xFF\x01\xFF";
+  REQUIRE(::write(src.write_fd, raw, 3) == 3);
+  ::close(src.write_fd);
+  src.write_fd = -1;
+  s.telnet_mode = true;
+  s.telnet_binary = true;
+  CHECK(embsh::SessionSendFd(s, src.read_fd, nullptr, 64) == 3);
+  CHECK(ReadAll(out.read_fd) == "\xFF\xFF\x01\xFF\xFF");
+  ::close(fd);
+}
+
+TEST_CASE("LineEditor: SessionSendFd keeps CR LF together across chunks", "[line_editor]") {
+  char path[] = "/tmp/embsh_sendfd_XXXXXX";
+  int fd = ::mkstemp(path);
+  REQUIRE(fd >= 0);
+  ::unlink(path);
+  // The CR is the last byte of the first 2048-byte chunk, its LF the first of the next.
+  const std::string content = std::string(2047, 'a') + "\r\n" + std::string(2046, 'b') + "\r";
+  REQUIRE(::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  s.telnet_mode = true;
+  off_t off = 0;
+  CHECK(embsh::SessionSendFd(s, fd, &off, 1U << 20) == static_cast<ssize_t>(content.size()));
+  CHECK(off == static_cast<off_t>(content.size()));
+  // Only the CR at end of file is bare.
+  CHECK(ReadAll(out.read_fd) == content + std::string(1, '\0'));
+
+  // A count that stops right after a CR sends it escaped.
+  off = 0;
+  CHECK(embsh::SessionSendFd(s, fd, &off, 2048) == 2048);
+  CHECK(ReadAll(out.read_fd) == content.substr(0, 2048) + std::string(1, '\0'));
+  ::close(fd);
+}
+
+// ============================================================================
+// Output queue tests (non-blocking transport)
+// ============================================================================
+
+/// Non-blocking socketpair whose write side is already full.
+struct FullSocket {
+  int fds[2] = {-1, -1};
+  size_t filler = 0;  ///< Bytes written to fill it.
+
+  FullSocket() {
+    if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0)
+      return;
+    char junk[1024];
+    std::memset(junk, '.', sizeof(junk));
+    ssize_t n;
+    while ((n = ::write(fds[0], junk, sizeof(junk))) > 0)
+      filler += static_cast<size_t>(n);
+  }
+
+  ~FullSocket() {
+    for (int fd : fds) {
+      if (fd >= 0)
+        ::close(fd);
+    }
+  }
+
+  /// Read everything the peer has received so far (waits up to @p ms for more).
+  std::string Drain(int ms = 0) {
+    std::string result;
+    char buf[4096];
+    struct pollfd pfd = {fds[1], POLLIN, 0};
+    while (::poll(&pfd, 1, ms) == 1) {
+      ssize_t n = ::read(fds[1], buf, sizeof(buf));
+      if (n <= 0)
+        break;
+      result.append(buf, static_cast<size_t>(n));
+    }
+    return result;
+  }
+};
+
+static void InitQueuedSession(embsh::Session& s, FullSocket& sock, char* queue, uint32_t cap) {
+  s.write_fd = sock.fds[0];
+  s.write_fn = embsh::io::PosixWrite;
+  s.writev_fn = embsh::io::PosixWriteV;
+  s.txq_buf = queue;
+  s.txq_cap = cap;
+  s.active.store(true, std::memory_order_relaxed);
+}
+
+TEST_CASE("LineEditor: output the transport refuses is queued in order", "[line_editor]") {
+  FullSocket sock;
+  REQUIRE(sock.filler > 0);
+  char queue[256];
+  embsh::Session s;
+  InitQueuedSession(s, sock, queue, sizeof(queue));
+
+  embsh::SessionWrite(s, "first ");
+  embsh::SessionFlush(s);
+  CHECK(s.txq_len == 6);
+  embsh::SessionWrite(s, "second");
+  embsh::SessionFlush(s);
+  CHECK(s.txq_len == 12);  // Appended behind, not written around the queue.
+
+  std::string got = sock.Drain();
+  while (s.txq_len > 0) {
+    REQUIRE(embsh::detail::DrainTxQueue(s));
+    got += sock.Drain();
+  }
+  CHECK(got.size() == sock.filler + 12);
+  CHECK(got.substr(sock.filler) == "first second");
+  CHECK(s.active.load());
+}
+
+TEST_CASE("LineEditor: full output queue applies the drop policy", "[line_editor]") {
+  FullSocket sock;
+  char queue[64];
+  embsh::Session s;
+  InitQueuedSession(s, sock, queue, sizeof(queue));
+  s.tx_policy = embsh::TxPolicy::kDrop;
+
+  embsh::SessionWrite(s, "kept");
+  embsh::SessionFlush(s);
+  const std::string big(100, 'x');
+  embsh::SessionWriteN(s, big.data(), big.size());
+  embsh::SessionFlush(s);
+  CHECK(s.txq_len == 4);
+  CHECK(s.active.load());
+}
+
+TEST_CASE("LineEditor: full output queue applies the disconnect policy", "[line_editor]") {
+  FullSocket sock;
+  char queue[64];
+  embsh::Session s;
+  InitQueuedSession(s, sock, queue, sizeof(queue));
+  s.tx_policy = embsh::TxPolicy::kDisconnect;
+
+  const std::string big(100, 'x');
+  embsh::SessionWriteN(s, big.data(), big.size());
+  embsh::SessionFlush(s);
+  CHECK_FALSE(s.active.load());
+  CHECK(s.txq_len == 0);
+}
+
+TEST_CASE("LineEditor: block policy waits for the peer, then times out", "[line_editor]") {
+  FullSocket sock;
+  char queue[64];
+  embsh::Session s;
+  InitQueuedSession(s, sock, queue, sizeof(queue));
+  s.tx_policy = embsh::TxPolicy::kBlock;
+  s.tx_timeout_ms = 1000;
+
+  // A reader catching up lets the write complete.
+  std::string got;
+  std::thread reader([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    got = sock.Drain(200);
+  });
+  const std::string big(1000, 'y');
+  embsh::SessionWriteN(s, big.data(), big.size());
+  embsh::SessionFlush(s);
+  reader.join();
+  CHECK(s.active.load());
+  got += sock.Drain();
+  CHECK(got.size() == sock.filler + big.size());
+
+  // Nobody reads: the session is dropped after tx_timeout_ms.
+  FullSocket stalled;
+  embsh::Session t;
+  InitQueuedSession(t, stalled, queue, sizeof(queue));
+  t.tx_timeout_ms = 30;
+  auto t0 = std::chrono::steady_clock::now();
+  embsh::SessionWriteN(t, big.data(), big.size());
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+  CHECK_FALSE(t.active.load());
+  CHECK(ms >= 25);
+  CHECK(ms < 1000);
+}
+
+TEST_CASE("LineEditor: bulk output on a shared loop thread queues instead of waiting", "[line_editor]") {
+  char path[] = "/tmp/embsh_loopfd_XXXXXX";
+  int fd = ::mkstemp(path);
+  REQUIRE(fd >= 0);
+  ::unlink(path);
+  const std::string content(1000, 'z');
+  REQUIRE(::write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size()));
+
+  FullSocket sock;
+  char queue[64];
+  embsh::Session s;
+  InitQueuedSession(s, sock, queue, sizeof(queue));
+  s.tx_policy = embsh::TxPolicy::kDisconnect;
+
+  bool queued = false;
+  ssize_t sent = 0;
+  long long ms = 0;
+  std::thread loop([&]() {
+    embsh::detail::SharedLoopThread() = true;
+    auto t0 = std::chrono::steady_clock::now();
+    queued = embsh::SessionWriteBinary(s, "head", 4);
+    off_t off = 0;
+    sent = embsh::SessionSendFd(s, fd, &off, content.size());
+    ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+  });
+  loop.join();
+  CHECK(queued);
+  CHECK(sent == -1);  // The file does not fit the queue: tx_policy, not a 5 s stall.
+  CHECK_FALSE(s.active.load());
+  CHECK(ms < 1000);
+  ::close(fd);
+}
+
+// ============================================================================
+// Transport tests (no fd)
+// ============================================================================
+
+/// In-memory transport standing in for an RTT or shared-memory channel.
+struct MemTransport {
+  std::string in;  ///< Pending input.
+  size_t in_pos = 0;
+  std::string out;
+  int readv_calls = 0;
+  int writev_calls = 0;
+  size_t released = 0;
+
+  static ssize_t ReadV(void* ctx, const struct iovec* iov, int iovcnt) {
+    auto* t = static_cast<MemTransport*>(ctx);
+    ++t->readv_calls;
+    if (t->in_pos == t->in.size()) {
+      errno = EAGAIN;
+      return -1;
+    }
+    size_t total = 0;
+    for (int i = 0; i < iovcnt && t->in_pos < t->in.size(); ++i) {
+      size_t n = std::min(iov[i].iov_len, t->in.size() - t->in_pos);
+      std::memcpy(iov[i].iov_base, t->in.data() + t->in_pos, n);
+      t->in_pos += n;
+      total += n;
+    }
+    return static_cast<ssize_t>(total);
+  }
+
+  static ssize_t WriteV(void* ctx, const struct iovec* iov, int iovcnt) {
+    auto* t = static_cast<MemTransport*>(ctx);
+    ++t->writev_calls;
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+      t->out.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+      total += iov[i].iov_len;
+    }
+    return static_cast<ssize_t>(total);
+  }
+
+  static ssize_t Borrow(void* ctx, const uint8_t** data) {
+    auto* t = static_cast<MemTransport*>(ctx);
+    if (t->in_pos == t->in.size()) {
+      errno = EAGAIN;
+      return -1;
+    }
+    *data = reinterpret_cast<const uint8_t*>(t->in.data() + t->in_pos);
+    return static_cast<ssize_t>(t->in.size() - t->in_pos);
+  }
+
+  static void Release(void* ctx, size_t len) {
+    auto* t = static_cast<MemTransport*>(ctx);
+    t->in_pos += len;
+    t->released += len;
+  }
+};
+
+static const embsh::Transport kMemOps = {MemTransport::ReadV, MemTransport::WriteV, nullptr, nullptr};
+static const embsh::Transport kMemBorrowOps = {MemTransport::ReadV, MemTransport::WriteV, MemTransport::Borrow,
+                                               MemTransport::Release};
+
+static void InitTransportSession(embsh::Session& s, MemTransport& mem, const embsh::Transport* ops) {
+  s.transport = ops;
+  s.transport_ctx = &mem;
+  s.telnet_mode = false;
+  s.active.store(true, std::memory_order_relaxed);
+}
+
+TEST_CASE("Transport: a session without an fd reads and writes through the ops", "[line_editor]") {
+  RequireRegister("batch_count", BatchCountCmd, "batch test");
+  MemTransport mem;
+  mem.in = "batch_count\rab";
+  embsh::Session s;
+  InitTransportSession(s, mem, &kMemOps);
+  g_batch_calls = 0;
+
+  CHECK(embsh::editor::ReadInput(s, "> ") == static_cast<ssize_t>(mem.in.size()));
+  embsh::SessionFlush(s);
+  CHECK(g_batch_calls == 1);
+  REQUIRE(s.line_pos == 2);
+  CHECK(mem.out == "batch_count\r\n> ab");
+  CHECK(mem.writev_calls == 2);  // Line output up to the prompt, then the echo.
+
+  CHECK(embsh::editor::ReadInput(s, "> ") == -1);
+  CHECK(errno == EAGAIN);
+
+  // Bulk output is one gather write, escapes included.
+  embsh::Session t;
+  MemTransport raw;
+  InitTransportSession(t, raw, &kMemOps);
+  t.telnet_mode = true;
+  const uint8_t data[] = {'a', 0xFF, 'b', '\r', 'c'};
+  REQUIRE(embsh::SessionWriteBinary(t, data, sizeof(data)));
+  CHECK(raw.writev_calls == 1);
+  CHECK(raw.out == std::string("a\xFF\xFF" "b\r", 5) + std::string(1, '\0') + "c");
+}
+
+TEST_CASE("Transport: borrowed input is edited in place", "[line_editor]") {
+  RequireRegister("async_wait", AsyncWaitCmd, nullptr, "async test", embsh::kCmdAsync);
+  RequireRegister("after_cmd", AfterCmd, "runs after async");
+  MemTransport mem;
+  mem.in = "async_wait\rafter_cmd\r";
+  embsh::WakeEvent done;
+  REQUIRE(done.Open());
+  embsh::Session s;
+  InitTransportSession(s, mem, &kMemBorrowOps);
+  s.notify = &done;
+  g_async_release = false;
+  g_after_calls = 0;
+
+  REQUIRE(embsh::editor::ReadInput(s, "> ") > 0);
+  CHECK(s.busy.load());
+  CHECK(mem.readv_calls == 0);
+  CHECK(mem.released == sizeof("async_wait\r") - 1);  // The rest stays in the transport.
+  CHECK(s.rx_len == 0);
+
+  // While busy the remainder is parked through readv, as from an fd.
+  REQUIRE(embsh::editor::ReadInput(s, "> ") == static_cast<ssize_t>(sizeof("after_cmd\r") - 1));
+  CHECK(mem.readv_calls == 1);
+  CHECK(g_after_calls == 0);
+
+  g_async_release = true;
+  REQUIRE(WaitNotify(done));
+  embsh::editor::WaitIdle(s);
+  embsh::editor::ResumeInput(s, "> ");
+  CHECK(g_after_calls == 1);
+  CHECK(mem.out.find("async done\r\n> after_cmd\r\n> ") != std::string::npos);
+}
@@ -0,0 +1,421 @@
+/**
+ * @file test_multiplexer.cpp
+ * @brief Unit tests for ShellMultiplexer with PTY-backed UART shells and piped consoles.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "test_support.hpp"
+
+#include "embsh/console_shell.hpp"
+#include "embsh/multiplexer.hpp"
+#include "embsh/uart_shell.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <unistd.h>
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+struct MuxPty {
+  int master = -1;
+  int slave = -1;
+
+  MuxPty() {
+    if (::openpty(&master, &slave, nullptr, nullptr, nullptr) != 0) {
+      master = -1;
+      slave = -1;
+    }
+  }
+
+  ~MuxPty() {
+    CloseMaster();
+    CloseSlave();
+  }
+
+  void CloseMaster() {
+    if (master >= 0)
+      ::close(master);
+    master = -1;
+  }
+
+  void CloseSlave() {
+    if (slave >= 0)
+      ::close(slave);
+    slave = -1;
+  }
+
+  void Send(const char* str) const { (void)::write(master, str, std::strlen(str)); }
+
+  /// Read until @p want appears or the timeout passes.
+  std::string ReadUntil(const char* want, int timeout_ms = 1000) const {
+    std::string result;
+    char buf[256];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (result.find(want) == std::string::npos && std::chrono::steady_clock::now() < deadline) {
+      struct pollfd pfd = {master, POLLIN, 0};
+      if (::poll(&pfd, 1, 20) == 1) {
+        ssize_t n = ::read(master, buf, sizeof(buf));
+        if (n <= 0)
+          break;
+        result.append(buf, static_cast<size_t>(n));
+      }
+    }
+    return result;
+  }
+};
+
+static std::mutex g_mux_mtx;
+static std::set<std::thread::id> g_mux_threads;
+static std::string g_mux_trace;
+
+static int MuxTraceCmd(int argc, char* argv[], void* /*ctx*/) {
+  std::lock_guard<std::mutex> lock(g_mux_mtx);
+  g_mux_threads.insert(std::this_thread::get_id());
+  for (int i = 1; i < argc; ++i) {
+    g_mux_trace += argv[i];
+    g_mux_trace += ";";
+  }
+  return 0;
+}
+
+static int MuxAsyncCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  embsh::ShellPrintf("async done\r\n");
+  return 0;
+}
+
+static std::atomic<bool> g_mux_release{false};
+
+/// Ignores cancellation until released (at most 2 s), like a command stuck in a syscall.
+static int MuxStubbornCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  for (int i = 0; i < 2000 && !g_mux_release.load(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return 0;
+}
+
+static void RegisterMuxCommands() {
+  RequireRegister("mux_trace", MuxTraceCmd, "record args and thread");
+  RequireRegister("mux_async", MuxAsyncCmd, nullptr, "async on a mux session", embsh::kCmdAsync);
+  RequireRegister("mux_stubborn", MuxStubbornCmd, nullptr, "ignores ^C", embsh::kCmdAsync);
+}
+
+static bool WaitFor(const std::function<bool()>& cond, int timeout_ms = 1000) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (!cond() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return cond();
+}
+
+// ============================================================================
+// ShellMultiplexer
+// ============================================================================
+
+TEST_CASE("ShellMultiplexer: one thread serves several UART shells", "[multiplexer]") {
+  RegisterMuxCommands();
+  embsh::ShellMultiplexer mux;
+  REQUIRE(mux.Start().has_value());
+
+  MuxPty a;
+  MuxPty b;
+  REQUIRE(a.slave >= 0);
+  REQUIRE(b.slave >= 0);
+  embsh::UartShell::Config ca;
+  ca.override_fd = a.slave;
+  ca.prompt = "uart0> ";
+  ca.mux = &mux;
+  embsh::UartShell::Config cb = ca;
+  cb.override_fd = b.slave;
+  cb.prompt = "uart1> ";
+
+  embsh::UartShell sa(ca);
+  embsh::UartShell sb(cb);
+  REQUIRE(sa.Start().has_value());
+  REQUIRE(sb.Start().has_value());
+  CHECK(sa.IsRunning());
+  CHECK(mux.SessionCount() == 2);
+  CHECK(a.ReadUntil("uart0> ").find("uart0> ") != std::string::npos);
+  CHECK(b.ReadUntil("uart1> ").find("uart1> ") != std::string::npos);
+
+  g_mux_threads.clear();
+  g_mux_trace.clear();
+  a.Send("mux_trace from_a\r");
+  CHECK(a.ReadUntil("uart0> ").find("uart0> ") != std::string::npos);
+  b.Send("mux_trace from_b\r");
+  CHECK(b.ReadUntil("uart1> ").find("uart1> ") != std::string::npos);
+  {
+    std::lock_guard<std::mutex> lock(g_mux_mtx);
+    CHECK(g_mux_trace == "from_a;from_b;");
+    CHECK(g_mux_threads.size() == 1);
+  }
+
+  sa.Stop();
+  CHECK_FALSE(sa.IsRunning());
+  CHECK(mux.SessionCount() == 1);
+  b.Send("mux_trace still_b\r");
+  CHECK(b.ReadUntil("uart1> ").find("uart1> ") != std::string::npos);
+  sb.Stop();
+  CHECK(mux.SessionCount() == 0);
+  mux.Stop();
+}
+
+TEST_CASE("ShellMultiplexer: async commands resume parked input", "[multiplexer]") {
+  RegisterMuxCommands();
+  embsh::ShellMultiplexer mux;
+  REQUIRE(mux.Start().has_value());
+  MuxPty pty;
+  embsh::UartShell::Config cfg;
+  cfg.override_fd = pty.slave;
+  cfg.prompt = "m> ";
+  cfg.mux = &mux;
+  embsh::UartShell shell(cfg);
+  REQUIRE(shell.Start().has_value());
+  (void)pty.ReadUntil("m> ");
+
+  g_mux_trace.clear();
+  pty.Send("mux_async\rmux_trace after\r");
+  CHECK(pty.ReadUntil("async done", 2000).find("async done") != std::string::npos);
+  CHECK(WaitFor([] {
+    std::lock_guard<std::mutex> lock(g_mux_mtx);
+    return g_mux_trace == "after;";
+  }));
+  shell.Stop();
+}
+
+TEST_CASE("ShellMultiplexer: detaching a busy session does not stall the others", "[multiplexer]") {
+  RegisterMuxCommands();
+  embsh::ShellMultiplexer mux;
+  REQUIRE(mux.Start().has_value());
+  MuxPty pa;
+  MuxPty pb;
+  embsh::UartShell::Config cfg;
+  cfg.prompt = "m> ";
+  cfg.mux = &mux;
+  cfg.override_fd = pa.slave;
+  embsh::UartShell a(cfg);
+  cfg.override_fd = pb.slave;
+  embsh::UartShell b(cfg);
+  REQUIRE(a.Start().has_value());
+  REQUIRE(b.Start().has_value());
+  (void)pa.ReadUntil("m> ");
+  (void)pb.ReadUntil("m> ");
+
+  g_mux_release = false;
+  pa.Send("mux_stubborn\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::atomic<bool> detached{false};
+  std::thread stopper([&] {
+    a.Stop();  // Detach() waits for the command, but not under the loop's lock.
+    detached = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  g_mux_trace.clear();
+  auto t0 = std::chrono::steady_clock::now();
+  pb.Send("mux_trace live\r");
+  CHECK(WaitFor([] {
+    std::lock_guard<std::mutex> lock(g_mux_mtx);
+    return g_mux_trace == "live;";
+  }, 300));
+  CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(400));
+  CHECK_FALSE(detached.load());
+
+  g_mux_release = true;
+  stopper.join();
+  CHECK(mux.SessionCount() == 1);
+  b.Stop();
+}
+
+TEST_CASE("ShellMultiplexer: stop waits for a busy session outside the lock", "[multiplexer]") {
+  RegisterMuxCommands();
+  embsh::ShellMultiplexer mux;
+  REQUIRE(mux.Start().has_value());
+  MuxPty pty;
+  embsh::UartShell::Config cfg;
+  cfg.prompt = "m> ";
+  cfg.mux = &mux;
+  cfg.override_fd = pty.slave;
+  embsh::UartShell shell(cfg);
+  REQUIRE(shell.Start().has_value());
+  (void)pty.ReadUntil("m> ");
+
+  g_mux_release = false;
+  pty.Send("mux_stubborn\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::atomic<bool> stopped{false};
+  std::thread stopper([&] {
+    mux.Stop();
+    stopped = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto t0 = std::chrono::steady_clock::now();
+  (void)mux.SessionCount();  // Takes the lock Stop() must not hold while waiting.
+  CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(200));
+  CHECK_FALSE(stopped.load());
+
+  g_mux_release = true;
+  stopper.join();
+  CHECK(mux.SessionCount() == 0);
+  shell.Stop();
+}
+
+TEST_CASE("ShellMultiplexer: a session that hangs up is removed", "[multiplexer]") {
+  embsh::ShellMultiplexer mux;
+  REQUIRE(mux.Start().has_value());
+  int in[2];
+  int out[2];
+  REQUIRE(::pipe(in) == 0);
+  REQUIRE(::pipe(out) == 0);
+
+  embsh::ConsoleShell::Config cfg;
+  cfg.read_fd = in[0];
+  cfg.write_fd = out[1];
+  cfg.raw_mode = false;
+  cfg.bracketed_paste = true;
+  cfg.mux = &mux;
+  embsh::ConsoleShell shell(cfg);
+  REQUIRE(shell.Start().has_value());
+  CHECK(mux.SessionCount() == 1);
+
+  ::close(in[1]);  // EOF on the console input.
+  CHECK(WaitFor([&] { return mux.SessionCount() == 0; }));
+  shell.Stop();  // Stale attachment: no-op.
+
+  char buf[256];
+  ssize_t n = ::read(out[0], buf, sizeof(buf));
+  REQUIRE(n > 0);
+  const std::string text(buf, static_cast<size_t>(n));
+  CHECK(text.find(embsh::editor::kBracketedPasteOn) == 0);
+  CHECK(text.find(embsh::editor::kBracketedPasteOff) != std::string::npos);
+  for (int fd : {in[0], out[0], out[1]}) {
+    ::close(fd);
+  }
+}
+
+TEST_CASE("ShellMultiplexer: attach errors and stop with sessions attached", "[multiplexer]") {
+  embsh::ShellMultiplexer mux;
+  MuxPty pty;
+  embsh::UartShell::Config cfg;
+  cfg.override_fd = pty.slave;
+  cfg.mux = &mux;
+  {
+    embsh::UartShell shell(cfg);
+    CHECK(shell.Start().error_value() == embsh::ShellError::kNotRunning);
+  }
+
+  REQUIRE(mux.Start().has_value());
+  CHECK(mux.Start().error_value() == embsh::ShellError::kAlreadyRunning);
+
+  char path[] = "/tmp/embsh_mux_XXXXXX";
+  int file_fd = ::mkstemp(path);
+  REQUIRE(file_fd >= 0);
+  embsh::ConsoleShell::Config ccfg;
+  ccfg.read_fd = file_fd;  // Regular files cannot be polled by epoll.
+  ccfg.write_fd = file_fd;
+  ccfg.raw_mode = false;
+  ccfg.mux = &mux;
+  {
+    embsh::ConsoleShell console(ccfg);
+    CHECK(console.Start().error_value() == embsh::ShellError::kInvalidArgument);
+  }
+  ::close(file_fd);
+  ::unlink(path);
+
+  embsh::UartShell shell(cfg);
+  REQUIRE(shell.Start().has_value());
+  auto t0 = std::chrono::steady_clock::now();
+  mux.Stop();
+  CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50));
+  CHECK(mux.SessionCount() == 0);
+  shell.Stop();
+}
+
+/// Mailbox transport with an eventfd that stays readable while input is pending.
+struct MailboxTransport {
+  std::mutex mtx;
+  std::string in;
+  std::string out;
+  embsh::WakeEvent ready;
+
+  void Push(const char* text) {
+    std::lock_guard<std::mutex> lock(mtx);
+    in += text;
+    ready.Signal();
+  }
+
+  std::string Output() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return out;
+  }
+
+  static ssize_t ReadV(void* ctx, const struct iovec* iov, int /*iovcnt*/) {
+    auto* t = static_cast<MailboxTransport*>(ctx);
+    std::lock_guard<std::mutex> lock(t->mtx);
+    if (t->in.empty()) {
+      errno = EAGAIN;
+      return -1;
+    }
+    size_t n = std::min(iov[0].iov_len, t->in.size());
+    std::memcpy(iov[0].iov_base, t->in.data(), n);
+    t->in.erase(0, n);
+    if (t->in.empty())
+      t->ready.Drain();
+    return static_cast<ssize_t>(n);
+  }
+
+  static ssize_t WriteV(void* ctx, const struct iovec* iov, int iovcnt) {
+    auto* t = static_cast<MailboxTransport*>(ctx);
+    std::lock_guard<std::mutex> lock(t->mtx);
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; ++i) {
+      t->out.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+      total += iov[i].iov_len;
+    }
+    return static_cast<ssize_t>(total);
+  }
+};
+
+TEST_CASE("ShellMultiplexer: serves a transport without a device fd", "[multiplexer]") {
+  RegisterMuxCommands();
+  static const embsh::Transport kOps = {MailboxTransport::ReadV, MailboxTransport::WriteV, nullptr, nullptr};
+  MailboxTransport box;
+  REQUIRE(box.ready.Open());
+  embsh::Session s;
+  s.transport = &kOps;
+  s.transport_ctx = &box;
+  s.read_fd = box.ready.fd();  // Readiness descriptor polled in place of a device.
+  s.active.store(true, std::memory_order_relaxed);
+
+  embsh::ShellMultiplexer mux;
+  REQUIRE(mux.Start().has_value());
+  auto h = mux.Attach(s, "rtt> ");
+  REQUIRE(h.has_value());
+
+  g_mux_trace.clear();
+  box.Push("mux_trace over_rtt\r");
+  CHECK(WaitFor([&] { return box.Output().find("rtt> ") != std::string::npos; }));
+  {
+    std::lock_guard<std::mutex> lock(g_mux_mtx);
+    CHECK(g_mux_trace == "over_rtt;");
+  }
+  mux.Detach(h.value());
+  CHECK_FALSE(s.active.load());
+  mux.Stop();
+}
@@ -0,0 +1,293 @@
+/**
+ * @file test_script.cpp
+ * @brief Unit tests for Script, ScriptCache and the source command.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "test_support.hpp"
+
+#include "embsh/script.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <poll.h>
+#include <unistd.h>
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static std::string g_trace;
+
+static int TraceCmd(int argc, char* argv[], void* /*ctx*/) {
+  for (int i = 0; i < argc; ++i) {
+    g_trace += argv[i];
+    g_trace += (i + 1 < argc) ? " " : ";";
+  }
+  return 0;
+}
+
+static int FailCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  return 7;
+}
+
+static int ClobberCmd(int argc, char* argv[], void* /*ctx*/) {
+  for (int i = 0; i < argc; ++i) {
+    argv[i][0] = 'X';
+  }
+  argv[0] = nullptr;
+  return 0;
+}
+
+static void RegisterTestCommands() {
+  RequireRegister("trace", TraceCmd, "record argv");
+  RequireRegister("fail7", FailCmd, "return 7");
+  RequireRegister("clobber", ClobberCmd, "modify argv");
+}
+
+/// Temporary script file, removed on destruction.
+struct TempScript {
+  char path[64] = "/tmp/embsh_script_XXXXXX";
+
+  TempScript() {
+    int fd = ::mkstemp(path);
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  ~TempScript() { ::unlink(path); }
+
+  void Write(const char* text) const {
+    FILE* f = std::fopen(path, "w");
+    if (f != nullptr) {
+      std::fputs(text, f);
+      std::fclose(f);
+    }
+  }
+};
+
+struct PipePair {
+  int read_fd = -1;
+  int write_fd = -1;
+
+  PipePair() {
+    int fds[2];
+    if (::pipe(fds) == 0) {
+      read_fd = fds[0];
+      write_fd = fds[1];
+    }
+  }
+
+  ~PipePair() {
+    if (read_fd >= 0)
+      ::close(read_fd);
+    if (write_fd >= 0)
+      ::close(write_fd);
+  }
+};
+
+static std::string ReadAll(int fd) {
+  std::string result;
+  char buf[256];
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (::poll(&pfd, 1, 0) == 1) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    result.append(buf, static_cast<size_t>(n));
+  }
+  return result;
+}
+
+// ============================================================================
+// Script
+// ============================================================================
+
+TEST_CASE("Script: runs lines in order, skipping blanks and comments", "[script]") {
+  RegisterTestCommands();
+  const char text[] = "# provisioning\r\ntrace a b\r\n\n   \t\n  trace 'c d' \"e\\\"f\"\n# trace skipped\ntrace last";
+  embsh::Script script;
+  REQUIRE(script.LoadText(text, sizeof(text) - 1).has_value());
+  CHECK(script.LineCount() == 3);
+
+  g_trace.clear();
+  CHECK(script.Run() == 0);
+  CHECK(g_trace == "trace a b;trace c d e\"f;trace last;");
+}
+
+TEST_CASE("Script: stops at the first failing command", "[script]") {
+  RegisterTestCommands();
+  const char text[] = "trace 1\nfail7\ntrace 2\n";
+  embsh::Script script;
+  REQUIRE(script.LoadText(text, sizeof(text) - 1).has_value());
+
+  g_trace.clear();
+  uint32_t line = 0;
+  CHECK(script.Run(&line) == 7);
+  CHECK(line == 2);
+  CHECK(g_trace == "trace 1;");
+}
+
+TEST_CASE("Script: unknown command fails, later registration resolves it", "[script]") {
+  RegisterTestCommands();
+  const char text[] = "late_cmd x\n";
+  embsh::Script script;
+  REQUIRE(script.LoadText(text, sizeof(text) - 1).has_value());
+
+  uint32_t line = 0;
+  CHECK(script.Run(&line) == -1);
+  CHECK(line == 1);
+
+  REQUIRE(embsh::CommandRegistry::Instance().Register("late_cmd", TraceCmd, "late").has_value());
+  g_trace.clear();
+  CHECK(script.Run() == 0);
+  CHECK(g_trace == "late_cmd x;");
+}
+
+TEST_CASE("Script: commands may modify argv without changing the script", "[script]") {
+  RegisterTestCommands();
+  const char text[] = "clobber abc def\ntrace abc\n";
+  embsh::Script script;
+  REQUIRE(script.LoadText(text, sizeof(text) - 1).has_value());
+
+  g_trace.clear();
+  CHECK(script.Run() == 0);
+  CHECK(script.Run() == 0);
+  CHECK(g_trace == "trace abc;trace abc;");
+}
+
+TEST_CASE("Script: lines with pipe operators run as pipelines", "[script]") {
+  RegisterTestCommands();
+  const char text[] = "trace a|trace b\nhelp | grep -c 'Run commands from a script'\n";
+  embsh::Script script;
+  REQUIRE(script.LoadText(text, sizeof(text) - 1).has_value());
+
+  g_trace.clear();
+  char buf[64];
+  embsh::OutputSink sink(buf, sizeof(buf));
+  {
+    embsh::ScopedSinkOutput bind(sink);
+    CHECK(script.Run() == 0);
+  }
+  CHECK(g_trace == "trace a;trace b;");
+  CHECK(sink.view() == "1\r\n");
+}
+
+TEST_CASE("Script: oversized lines are rejected with their line number", "[script]") {
+  std::string text = "trace ok\n";
+  for (int i = 0; i < EMBSH_MAX_ARGS + 1; ++i) {
+    text += "a ";
+  }
+  text += "\n";
+  embsh::Script script;
+  auto r = script.LoadText(text.data(), text.size());
+  REQUIRE_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kInvalidArgument);
+  CHECK(script.ErrorLine() == 2);
+  CHECK(script.LineCount() == 0);
+
+  std::string many;
+  for (int i = 0; i < EMBSH_SCRIPT_MAX_LINES + 1; ++i) {
+    many += "trace\n";
+  }
+  r = script.LoadText(many.data(), many.size());
+  REQUIRE_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kScriptTooLarge);
+}
+
+TEST_CASE("Script: file load and Refresh after the file changes", "[script]") {
+  RegisterTestCommands();
+  TempScript file;
+  file.Write("trace one\n");
+  embsh::Script script;
+  REQUIRE(script.LoadFile(file.path).has_value());
+  CHECK_FALSE(script.Changed());
+
+  file.Write("trace two\ntrace three\n");
+  CHECK(script.Changed());
+  REQUIRE(script.Refresh().has_value());
+  CHECK(script.LineCount() == 2);
+  g_trace.clear();
+  CHECK(script.Run() == 0);
+  CHECK(g_trace == "trace two;trace three;");
+
+  auto r = script.LoadFile("/nonexistent/embsh.script");
+  REQUIRE_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kFileOpenFailed);
+}
+
+TEST_CASE("Script: file ending exactly on a page boundary", "[script]") {
+  RegisterTestCommands();
+  const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+  // A comment filling the page, then "trace end" with no trailing newline.
+  std::string text = std::string(page - 10, '#') + "\ntrace end";
+  REQUIRE(text.size() == page);
+  TempScript file;
+  file.Write(text.c_str());
+
+  embsh::Script script;
+  REQUIRE(script.LoadFile(file.path).has_value());
+  g_trace.clear();
+  CHECK(script.Run() == 0);
+  CHECK(g_trace == "trace end;");
+}
+
+// ============================================================================
+// ScriptCache and source
+// ============================================================================
+
+TEST_CASE("ScriptCache: reuses the compiled script until the file changes", "[script]") {
+  RegisterTestCommands();
+  TempScript file;
+  file.Write("trace v1\n");
+  auto& cache = embsh::ScriptCache::Instance();
+
+  g_trace.clear();
+  auto r = cache.Run(file.path);
+  REQUIRE(r.has_value());
+  CHECK(r.value() == 0);
+  r = cache.Run(file.path);
+  REQUIRE(r.has_value());
+  CHECK(g_trace == "trace v1;trace v1;");
+
+  file.Write("trace version2\n");
+  g_trace.clear();
+  r = cache.Run(file.path);
+  REQUIRE(r.has_value());
+  CHECK(g_trace == "trace version2;");
+
+  r = cache.Run("/nonexistent/embsh.script");
+  REQUIRE_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kFileOpenFailed);
+  cache.Clear();
+}
+
+TEST_CASE("ScriptCache: source command runs a script from a session", "[script]") {
+  RegisterTestCommands();
+  TempScript file;
+  file.Write("trace from file\nfail7\n");
+
+  PipePair out;
+  embsh::WakeEvent done;
+  REQUIRE(done.Open());
+  embsh::Session s;
+  s.write_fd = out.write_fd;
+  s.write_fn = embsh::io::PosixWrite;
+  s.telnet_mode = false;
+  s.notify = &done;
+  s.active.store(true, std::memory_order_relaxed);
+
+  std::string line = std::string("source ") + file.path + "\r";
+  g_trace.clear();
+  embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(line.data()), line.size(), "> ");
+  struct pollfd pfd = {done.fd(), POLLIN, 0};
+  REQUIRE(::poll(&pfd, 1, 1000) == 1);
+  embsh::editor::WaitIdle(s);
+
+  CHECK(g_trace == "trace from file;");
+  const std::string text = ReadAll(out.read_fd);
+  CHECK(text.find(":2: exit status 7\r\n> ") != std::string::npos);
+}
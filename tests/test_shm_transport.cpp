@@ -0,0 +1,247 @@
+/**
+ * @file test_shm_transport.cpp
+ * @brief Unit tests for the shared-memory ring transport (ShmShell / ShmClient).
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "test_support.hpp"
+
+#include "embsh/shm_transport.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+/// Unique socket path per test, removed on destruction.
+struct ShmPath {
+  char path[64];
+
+  ShmPath() { std::snprintf(path, sizeof(path), "/tmp/embsh_shm_test_%d.sock", static_cast<int>(::getpid())); }
+  ~ShmPath() { ::unlink(path); }
+};
+
+/// Read until @p want appears, the shell closes or the timeout passes.
+static std::string ReadUntil(embsh::ShmClient& c, const char* want, int timeout_ms = 1000) {
+  std::string result;
+  char buf[512];
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (result.find(want) == std::string::npos && std::chrono::steady_clock::now() < deadline) {
+    ssize_t n = c.Read(buf, sizeof(buf), 20);
+    if (n == 0)
+      break;
+    if (n > 0)
+      result.append(buf, static_cast<size_t>(n));
+  }
+  return result;
+}
+
+static void SendLine(embsh::ShmClient& c, const char* line) {
+  REQUIRE(c.Write(line, std::strlen(line)) == static_cast<ssize_t>(std::strlen(line)));
+}
+
+static int ShmEchoCmd(int argc, char* argv[], void* /*ctx*/) {
+  for (int i = 1; i < argc; ++i) {
+    embsh::ShellPrintf("[%s]", argv[i]);
+  }
+  embsh::ShellPrintf("\r\n");
+  return 0;
+}
+
+static int ShmFloodCmd(int argc, char* argv[], void* /*ctx*/) {
+  const int lines = (argc > 1) ? std::atoi(argv[1]) : 100;
+  for (int i = 0; i < lines; ++i) {
+    embsh::ShellPrintf("flood line %05d ..........................................\r\n", i);
+  }
+  embsh::ShellPrintf("flood end\r\n");
+  return 0;
+}
+
+static void RegisterShmCommands() {
+  RequireRegister("shm_echo", ShmEchoCmd, "echo args in brackets");
+  RequireRegister("shm_flood", ShmFloodCmd, "print many lines");
+}
+
+static embsh::ShmShell::Config ShmConfig(const char* path) {
+  embsh::ShmShell::Config cfg;
+  cfg.path = path;
+  cfg.prompt = "shm> ";
+  cfg.ring_bytes = 1024;
+  return cfg;
+}
+
+// ============================================================================
+// ShmShell / ShmClient
+// ============================================================================
+
+TEST_CASE("ShmShell: command round trip through the rings", "[shm]") {
+  RegisterShmCommands();
+  ShmPath sp;
+  embsh::ShmShell shell(ShmConfig(sp.path));
+  REQUIRE(shell.Start().has_value());
+
+  embsh::ShmClient client;
+  REQUIRE(client.Connect(sp.path).has_value());
+  CHECK(ReadUntil(client, "shm> ").find("shm> ") != std::string::npos);
+  CHECK(shell.HasClient());
+
+  SendLine(client, "shm_echo alpha beta\r");
+  std::string out = ReadUntil(client, "shm> ");
+  CHECK(out.find("shm_echo alpha beta") != std::string::npos);  // Echo of the typed line.
+  CHECK(out.find("[alpha][beta]") != std::string::npos);
+
+  client.Close();
+  shell.Stop();
+  CHECK_FALSE(shell.IsRunning());
+  CHECK(::access(sp.path, F_OK) != 0);
+}
+
+TEST_CASE("ShmShell: output larger than the ring waits for the reader", "[shm]") {
+  RegisterShmCommands();
+  ShmPath sp;
+  embsh::ShmShell shell(ShmConfig(sp.path));
+  REQUIRE(shell.Start().has_value());
+  embsh::ShmClient client;
+  REQUIRE(client.Connect(sp.path).has_value());
+  (void)ReadUntil(client, "shm> ");
+
+  SendLine(client, "shm_flood 200\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));  // Let the shell fill the ring and wait.
+  std::string out = ReadUntil(client, "flood end", 3000);
+  CHECK(out.find("flood line 00000") != std::string::npos);
+  CHECK(out.find("flood line 00199") != std::string::npos);
+  CHECK(out.find("flood end") != std::string::npos);
+
+  // A full-length line written in one go.
+  std::string line = "shm_echo " + std::string(EMBSH_LINE_BUF_SIZE - 16, 'x') + "\r";
+  REQUIRE(client.Write(line.data(), line.size()) == static_cast<ssize_t>(line.size()));
+  CHECK(ReadUntil(client, "]").find("[xxx") != std::string::npos);
+  shell.Stop();
+}
+
+TEST_CASE("ShmShell: exit and client close end the session", "[shm]") {
+  RegisterShmCommands();
+  ShmPath sp;
+  embsh::ShmShell shell(ShmConfig(sp.path));
+  REQUIRE(shell.Start().has_value());
+
+  {
+    embsh::ShmClient client;
+    REQUIRE(client.Connect(sp.path).has_value());
+    (void)ReadUntil(client, "shm> ");
+    SendLine(client, "exit\r");
+    char buf[256];
+    ssize_t n = 1;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (n != 0 && std::chrono::steady_clock::now() < deadline) {
+      n = client.Read(buf, sizeof(buf), 20);
+    }
+    CHECK(n == 0);  // Shell side closed.
+  }
+
+  // Reconnect after exit; then hang up without exit.
+  for (int round = 0; round < 2; ++round) {
+    embsh::ShmClient client;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while (shell.HasClient() && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    REQUIRE(client.Connect(sp.path).has_value());
+    SendLine(client, "shm_echo again\r");
+    CHECK(ReadUntil(client, "[again]").find("[again]") != std::string::npos);
+  }
+  shell.Stop();
+}
+
+TEST_CASE("ShmShell: a second client is refused while one is connected", "[shm]") {
+  ShmPath sp;
+  embsh::ShmShell shell(ShmConfig(sp.path));
+  REQUIRE(shell.Start().has_value());
+  embsh::ShmClient first;
+  REQUIRE(first.Connect(sp.path).has_value());
+  (void)ReadUntil(first, "shm> ");
+
+  embsh::ShmClient second;
+  CHECK(second.Connect(sp.path, 200).error_value() == embsh::ShellError::kDeviceOpenFailed);
+  CHECK_FALSE(second.IsOpen());
+  CHECK(first.Connect(sp.path).error_value() == embsh::ShellError::kAlreadyRunning);
+  shell.Stop();
+}
+
+TEST_CASE("ShmShell: start errors", "[shm]") {
+  ShmPath sp;
+  embsh::ShmShell shell(ShmConfig(sp.path));
+  REQUIRE(shell.Start().has_value());
+  CHECK(shell.Start().error_value() == embsh::ShellError::kAlreadyRunning);
+
+  embsh::ShmShell other(ShmConfig(sp.path));
+  CHECK(other.Start().error_value() == embsh::ShellError::kPortInUse);
+  shell.Stop();
+
+  // A stale socket left by a crashed server is replaced.
+  int stale = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  REQUIRE(embsh::detail::ShmSocketAddr(sp.path, addr));
+  REQUIRE(::bind(stale, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+  ::close(stale);
+  REQUIRE(other.Start().has_value());
+  other.Stop();
+
+  const std::string long_path(200, 'p');
+  embsh::ShmShell bad(ShmConfig(long_path.c_str()));
+  CHECK(bad.Start().error_value() == embsh::ShellError::kInvalidArgument);
+
+  embsh::ShmClient client;
+  CHECK(client.Connect(sp.path).error_value() == embsh::ShellError::kDeviceOpenFailed);
+}
+
+TEST_CASE("ShmShell: a ring with a corrupt tail is not written past its end", "[shm]") {
+  constexpr uint32_t kCap = 64;
+  alignas(64) static uint8_t mem[sizeof(embsh::detail::ShmLayout) + 2 * kCap + 64];
+  std::memset(mem, 0, sizeof(mem));
+  auto* layout = new (mem) embsh::detail::ShmLayout();
+  layout->ring_bytes = kCap;
+  uint8_t* guard = mem + embsh::detail::ShmMapSize(kCap);
+  std::memset(guard, 0xA5, 64);
+  embsh::WakeEvent own;
+  embsh::WakeEvent peer;
+  REQUIRE(own.Open());
+  REQUIRE(peer.Open());
+  embsh::detail::ShmEndpoint ep;
+  ep.Bind(layout, true, own.fd(), peer.fd());
+  ep.timeout_ms = 0;
+
+  // The client moves the tail of the shell's output ring ahead of its head.
+  layout->out.head.store(16);
+  layout->out.tail.store(48);
+  char data[200];
+  std::memset(data, 'x', sizeof(data));
+  struct iovec iov = {data, sizeof(data)};
+  errno = 0;
+  CHECK(embsh::detail::ShmWrite(ep, &iov, 1) == -1);
+  CHECK(errno == EPIPE);
+  CHECK(layout->out.head.load() == 16);
+  for (int i = 0; i < 64; ++i) {
+    REQUIRE(guard[i] == 0xA5);
+  }
+
+  // Sane indices still work.
+  layout->out.tail.store(16);
+  iov.iov_len = kCap;
+  CHECK(embsh::detail::ShmWrite(ep, &iov, 1) == static_cast<ssize_t>(kCap));
+  CHECK(guard[0] == 0xA5);
+  layout->~ShmLayout();
+}
@@ -0,0 +1,213 @@
+/**
+ * @file test_stats.cpp
+ * @brief Unit tests for EMBSH_ENABLE_STATS counters and the stats command.
+ *
+ * Built as a separate executable with EMBSH_ENABLE_STATS=1 so the session and
+ * registry layouts never mix with the default build.
+ */
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "test_support.hpp"
+
+#include "embsh/telnet_server.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static_assert(EMBSH_ENABLE_STATS, "test_stats.cpp must be built with EMBSH_ENABLE_STATS=1");
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+struct PipePair {
+  int read_fd = -1;
+  int write_fd = -1;
+
+  PipePair() {
+    int fds[2];
+    if (::pipe(fds) == 0) {
+      read_fd = fds[0];
+      write_fd = fds[1];
+    }
+  }
+
+  ~PipePair() {
+    if (read_fd >= 0)
+      ::close(read_fd);
+    if (write_fd >= 0)
+      ::close(write_fd);
+  }
+};
+
+static void InitTestSession(embsh::Session& s, PipePair& output) {
+  s.read_fd = -1;
+  s.write_fd = output.write_fd;
+  s.write_fn = embsh::io::PosixWrite;
+  s.read_fn = embsh::io::PosixRead;
+  s.telnet_mode = false;
+  s.active.store(true, std::memory_order_relaxed);
+}
+
+static std::string ReadAll(int fd) {
+  std::string result;
+  char buf[256];
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (::poll(&pfd, 1, 0) == 1) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0)
+      break;
+    result.append(buf, static_cast<size_t>(n));
+  }
+  return result;
+}
+
+static size_t Feed(embsh::Session& s, const char* input) {
+  return embsh::editor::ProcessBytes(s, reinterpret_cast<const uint8_t*>(input), std::strlen(input), "> ");
+}
+
+static int TcpConnect(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static std::string TcpRecv(int fd, int timeout_ms = 300) {
+  std::string result;
+  char buf[512];
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+  while (std::chrono::steady_clock::now() < deadline) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (::poll(&pfd, 1, 50) > 0) {
+      ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+      if (n <= 0)
+        break;
+      result.append(buf, static_cast<size_t>(n));
+    }
+  }
+  return result;
+}
+
+static int SleepCmd(int /*argc*/, char* /*argv*/[], void* /*ctx*/) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  return 0;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+TEST_CASE("Stats: histogram buckets are powers of four microseconds", "[stats]") {
+  CHECK(embsh::CmdStats::Bucket(0) == 0);
+  CHECK(embsh::CmdStats::Bucket(999) == 0);
+  CHECK(embsh::CmdStats::Bucket(1000) == 1);
+  CHECK(embsh::CmdStats::Bucket(3999) == 1);
+  CHECK(embsh::CmdStats::Bucket(4000) == 2);
+  CHECK(embsh::CmdStats::Bucket(UINT64_MAX) == embsh::kStatsBuckets - 1);
+  CHECK(embsh::CmdStats::BucketLimitUs(0) == 1);
+  CHECK(embsh::CmdStats::BucketLimitUs(2) == 16);
+  CHECK(embsh::CmdStats::BucketLimitUs(embsh::kStatsBuckets - 1) == 0);
+}
+
+TEST_CASE("Stats: Record accumulates calls, total and max", "[stats]") {
+  embsh::CmdStats st;
+  st.Record(500);
+  st.Record(5000);
+  st.Record(2000);
+  CHECK(st.calls.load() == 3);
+  CHECK(st.total_ns.load() == 7500);
+  CHECK(st.max_ns.load() == 5000);
+  CHECK(st.hist[0].load() == 1);
+  CHECK(st.hist[1].load() == 1);
+  CHECK(st.hist[2].load() == 1);
+}
+
+TEST_CASE("Stats: executed commands are timed", "[stats]") {
+  auto& reg = embsh::CommandRegistry::Instance();
+  REQUIRE(reg.Register("stat_sleep", SleepCmd, "sleeps 2 ms").has_value());
+  const embsh::CmdEntry* cmd = reg.Find("stat_sleep");
+  REQUIRE(cmd != nullptr);
+
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  Feed(s, "stat_sleep\rstat_sleep\r");
+
+  const embsh::CmdStats* st = reg.StatsFor(cmd);
+  REQUIRE(st != nullptr);
+  CHECK(st->calls.load() == 2);
+  CHECK(st->max_ns.load() >= 2000000U);
+  CHECK(st->total_ns.load() >= 4000000U);
+}
+
+TEST_CASE("Stats: session counts lines and output bytes", "[stats]") {
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  Feed(s, "help\r\r");
+  embsh::SessionFlush(s);
+
+  const std::string text = ReadAll(out.read_fd);
+  CHECK(s.stats.lines.load() == 1);  // Empty lines are not counted.
+  CHECK(s.stats.bytes_out.load() == text.size());
+  CHECK(s.stats.write_calls.load() >= 1);
+}
+
+TEST_CASE("Stats: stats command prints commands and session counters", "[stats]") {
+  RequireRegister("stat_sleep", SleepCmd, "sleeps 2 ms");
+  PipePair out;
+  embsh::Session s;
+  InitTestSession(s, out);
+  Feed(s, "stat_sleep\rstats\r");
+  embsh::SessionFlush(s);
+
+  const std::string text = ReadAll(out.read_fd);
+  CHECK(text.find("stat_sleep") != std::string::npos);
+  CHECK(text.find("  hist") != std::string::npos);
+  CHECK(text.find("session: in=") != std::string::npos);
+  CHECK(text.find("telnet: accepts=") != std::string::npos);
+}
+
+TEST_CASE("Stats: telnet server counts accepts and rejects", "[stats]") {
+  const uint64_t accepts0 = embsh::TelnetStats().accepts.load();
+  const uint64_t rejects0 = embsh::TelnetStats().rejects.load();
+
+  embsh::ServerConfig cfg;
+  cfg.port = 23248;
+  cfg.max_sessions = 1;
+  cfg.banner = nullptr;
+  embsh::TelnetServer server(cfg);
+  REQUIRE(server.Start().has_value());
+
+  int fd1 = TcpConnect(cfg.port);
+  REQUIRE(fd1 >= 0);
+  (void)TcpRecv(fd1);
+  int fd2 = TcpConnect(cfg.port);
+  REQUIRE(fd2 >= 0);
+  CHECK(TcpRecv(fd2).find("Too many connections") != std::string::npos);
+
+  CHECK(embsh::TelnetStats().accepts.load() - accepts0 == 2);
+  CHECK(embsh::TelnetStats().rejects.load() - rejects0 == 1);
+
+  ::close(fd2);
+  ::close(fd1);
+  server.Stop();
+}
@@ -0,0 +1,30 @@
+/**
+ * @file test_support.hpp
+ * @brief Helpers shared by the test files.
+ */
+
+#ifndef EMBSH_TESTS_TEST_SUPPORT_HPP_
+#define EMBSH_TESTS_TEST_SUPPORT_HPP_
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "embsh/command_registry.hpp"
+
+/**
+ * @brief Register a test command in the global registry, failing the test if that fails.
+ *
+ * A name an earlier case already registered in this process (the whole
+ * suite run as one binary) counts as registered; a full or frozen table
+ * does not, so running out of EMBSH_MAX_COMMANDS shows up where it happens.
+ */
+inline void RequireRegister(const char* name, embsh::CmdFn fn, void* ctx, const char* desc, uint8_t flags = 0) {
+  auto r = embsh::CommandRegistry::Instance().Register(name, fn, ctx, desc, flags);
+  INFO("registering " << name);
+  REQUIRE((r.has_value() || r.error_value() == embsh::ShellError::kDuplicateName));
+}
+
+inline void RequireRegister(const char* name, embsh::CmdFn fn, const char* desc) {
+  RequireRegister(name, fn, nullptr, desc);
+}
+
+#endif  // EMBSH_TESTS_TEST_SUPPORT_HPP_
@@ -5,15 +5,22 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+#include "test_support.hpp"
+
 #include "embsh/telnet_server.hpp"
 
+#include <atomic>
 #include <chrono>
 #include <cstring>
+#include <string>
 #include <thread>
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <unistd.h>
 
 // ============================================================================
@@ -51,10 +58,9 @@ static std::string TcpRecv(int fd, int timeout_ms = 500) {
     pfd.events = POLLIN;
     int pr = ::poll(&pfd, 1, 50);
     if (pr > 0) {
-      ssize_t n = ::recv(fd, buf, sizeof(buf) - 1, 0);
+      ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
       if (n > 0) {
-        buf[n] = '\0';
-        result += buf;
+        result.append(buf, static_cast<size_t>(n));  // Binary-safe: telnet data may hold NULs.
       } else {
         break;
       }
@@ -137,7 +143,7 @@ TEST_CASE("TelnetServer: command execution via telnet", "[telnet_server]") {
     cmd_executed = true;
     return 0;
   };
-  embsh::CommandRegistry::Instance().Register("telnet_test_cmd", test_fn, "test cmd");
+  RequireRegister("telnet_test_cmd", test_fn, "test cmd");
 
   embsh::ServerConfig cfg;
   cfg.port = 23234;
@@ -276,3 +282,604 @@ TEST_CASE("TelnetServer: reject connection when full", "[telnet_server]") {
   ::close(client1);
   server.Stop();
 }
+
+// ============================================================================
+// Reactor mode
+// ============================================================================
+
+TEST_CASE("TelnetServer: reactor mode command execution", "[telnet_server]") {
+  static bool reactor_cmd_ran = false;
+  reactor_cmd_ran = false;
+  auto test_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    reactor_cmd_ran = true;
+    embsh::ShellPrintf("reactor ok\r\n");
+    return 0;
+  };
+  RequireRegister("reactor_test_cmd", test_fn, "reactor test cmd");
+
+  embsh::ServerConfig cfg;
+  cfg.port = 23239;
+  cfg.banner = nullptr;
+  cfg.reactor_mode = true;
+  embsh::TelnetServer server(cfg);
+
+  auto r = server.Start();
+  REQUIRE(r.has_value());
+
+  int client = TcpConnect(cfg.port);
+  REQUIRE(client >= 0);
+  std::string data = TcpRecv(client, 300);
+  CHECK(data.find("embsh>") != std::string::npos);
+
+  TcpSend(client, "reactor_test_cmd\r\n");
+  data = TcpRecv(client, 300);
+  CHECK(reactor_cmd_ran == true);
+  CHECK(data.find("reactor ok") != std::string::npos);
+
+  TcpSend(client, "exit\r\n");
+  data = TcpRecv(client, 300);
+  CHECK(data.find("Bye") != std::string::npos);
+
+  ::close(client);
+  server.Stop();
+  CHECK_FALSE(server.IsRunning());
+}
+
+TEST_CASE("TelnetServer: reactor mode exceeds EMBSH_MAX_SESSIONS", "[telnet_server]") {
+  constexpr uint32_t kClients = EMBSH_MAX_SESSIONS * 2;
+
+  embsh::ServerConfig cfg;
+  cfg.port = 23240;
+  cfg.banner = nullptr;
+  cfg.reactor_mode = true;
+  cfg.max_sessions = kClients;
+  embsh::TelnetServer server(cfg);
+
+  auto r = server.Start();
+  REQUIRE(r.has_value());
+
+  int clients[kClients];
+  for (uint32_t i = 0; i < kClients; ++i) {
+    clients[i] = TcpConnect(cfg.port);
+    REQUIRE(clients[i] >= 0);
+  }
+  for (uint32_t i = 0; i < kClients; ++i) {
+    std::string data = TcpRecv(clients[i], 200);
+    CHECK(data.find("embsh>") != std::string::npos);
+  }
+
+  // One more than max_sessions is rejected.
+  int extra = TcpConnect(cfg.port);
+  if (extra >= 0) {
+    std::string data = TcpRecv(extra, 300);
+    CHECK(data.find("Too many") != std::string::npos);
+    ::close(extra);
+  }
+
+  for (uint32_t i = 0; i < kClients; ++i) {
+    ::close(clients[i]);
+  }
+  server.Stop();
+}
+
+TEST_CASE("TelnetServer: reactor mode authentication", "[telnet_server]") {
+  embsh::ServerConfig cfg;
+  cfg.port = 23241;
+  cfg.banner = nullptr;
+  cfg.username = "admin";
+  cfg.password = "secret";
+  cfg.reactor_mode = true;
+  embsh::TelnetServer server(cfg);
+
+  auto r = server.Start();
+  REQUIRE(r.has_value());
+
+  int client = TcpConnect(cfg.port);
+  REQUIRE(client >= 0);
+
+  std::string data = TcpRecv(client, 300);
+  CHECK(data.find("Username:") != std::string::npos);
+
+  TcpSend(client, "admin\r\n");
+  data = TcpRecv(client, 300);
+  CHECK(data.find("Password:") != std::string::npos);
+
+  TcpSend(client, "secret\r\n");
+  data = TcpRecv(client, 300);
+  CHECK(data.find("Login successful") != std::string::npos);
+  CHECK(data.find("embsh>") != std::string::npos);
+
+  ::close(client);
+  server.Stop();
+}
+
+TEST_CASE("TelnetServer: zero max_sessions is rejected", "[telnet_server]") {
+  embsh::ServerConfig cfg;
+  cfg.port = 23242;
+  cfg.max_sessions = 0;
+  embsh::TelnetServer server(cfg);
+
+  auto r = server.Start();
+  CHECK_FALSE(r.has_value());
+  CHECK(r.error_value() == embsh::ShellError::kInvalidArgument);
+}
+
+TEST_CASE("TelnetServer: Stop wakes idle accept and session threads", "[telnet_server]") {
+  for (bool reactor : {false, true}) {
+    embsh::ServerConfig cfg;
+    cfg.port = reactor ? 23244 : 23243;
+    cfg.banner = nullptr;
+    cfg.reactor_mode = reactor;
+    embsh::TelnetServer server(cfg);
+    REQUIRE(server.Start().has_value());
+
+    int fd = TcpConnect(cfg.port);
+    REQUIRE(fd >= 0);
+    (void)TcpRecv(fd, 100);  // Session is now idle in poll.
+
+    auto t0 = std::chrono::steady_clock::now();
+    server.Stop();
+    CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50));
+    CHECK_FALSE(server.IsRunning());
+    ::close(fd);
+  }
+}
+
+TEST_CASE("TelnetServer: async command does not stall other sessions", "[telnet_server]") {
+  static std::atomic<bool> release{false};
+  auto slow_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    while (!release.load() && !embsh::ShellCancelled()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    embsh::ShellPrintf("slow done\r\n");
+    return 0;
+  };
+  auto fast_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    embsh::ShellPrintf("fast ok\r\n");
+    return 0;
+  };
+  RequireRegister("slow_cmd", slow_fn, nullptr, "slow async", embsh::kCmdAsync);
+  RequireRegister("fast_cmd", fast_fn, "fast sync");
+
+  for (bool reactor : {false, true}) {
+    release = false;
+    embsh::ServerConfig cfg;
+    cfg.port = reactor ? 23246 : 23245;
+    cfg.banner = nullptr;
+    cfg.reactor_mode = reactor;
+    embsh::TelnetServer server(cfg);
+    REQUIRE(server.Start().has_value());
+
+    int a = TcpConnect(cfg.port);
+    int b = TcpConnect(cfg.port);
+    REQUIRE(a >= 0);
+    REQUIRE(b >= 0);
+    (void)TcpRecv(a, 100);
+    (void)TcpRecv(b, 100);
+
+    // Session A is busy; its next line is parked, session B still runs.
+    TcpSend(a, "slow_cmd\r\nfast_cmd\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    TcpSend(b, "fast_cmd\r\n");
+    CHECK(TcpRecv(b, 200).find("fast ok") != std::string::npos);
+    CHECK(TcpRecv(a, 100).find("fast ok") == std::string::npos);
+
+    release = true;
+    std::string data = TcpRecv(a, 300);
+    auto slow = data.find("slow done");
+    CHECK(slow != std::string::npos);
+    CHECK(data.find("fast ok", slow) != std::string::npos);
+
+    ::close(a);
+    ::close(b);
+    server.Stop();
+  }
+}
+
+TEST_CASE("TelnetServer: reactor closes a busy session without waiting for its command", "[telnet_server]") {
+  static std::atomic<bool> release{false};
+  static std::atomic<bool> saw_cancel{false};
+  auto stubborn_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    // Ignores cancellation until released, like a command stuck in a syscall.
+    for (int i = 0; i < 2000 && !release.load(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    saw_cancel = embsh::ShellCancelled();
+    return 0;
+  };
+  auto ping_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    embsh::ShellPrintf("pong\r\n");
+    return 0;
+  };
+  RequireRegister("stubborn", stubborn_fn, nullptr, "ignores ^C", embsh::kCmdAsync);
+  RequireRegister("ping", ping_fn, "reply pong");
+
+  embsh::ServerConfig cfg;
+  cfg.port = 23260;
+  cfg.banner = nullptr;
+  cfg.reactor_mode = true;
+  cfg.max_sessions = 2;
+  embsh::TelnetServer server(cfg);
+  REQUIRE(server.Start().has_value());
+
+  int a = TcpConnect(cfg.port);
+  int b = TcpConnect(cfg.port);
+  REQUIRE(a >= 0);
+  REQUIRE(b >= 0);
+  (void)TcpRecv(a, 100);
+  (void)TcpRecv(b, 100);
+
+  // A hangs up mid-command; the reactor must keep serving B meanwhile.
+  TcpSend(a, "stubborn\r\n");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ::close(a);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto t0 = std::chrono::steady_clock::now();
+  TcpSend(b, "ping\r\n");
+  CHECK(TcpRecv(b, 300).find("pong") != std::string::npos);
+  CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(400));
+
+  // A's slot is held until the command returns, then freed for a new client.
+  release = true;
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  CHECK(saw_cancel.load());
+  int c = TcpConnect(cfg.port);
+  REQUIRE(c >= 0);
+  std::string data = TcpRecv(c, 200);
+  CHECK(data.find("Too many") == std::string::npos);
+  CHECK(data.find("embsh>") != std::string::npos);
+
+  ::close(b);
+  ::close(c);
+  server.Stop();
+}
+
+TEST_CASE("TelnetServer: binary bulk output after BINARY negotiation", "[telnet_server]") {
+  auto dump_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    uint8_t data[256];
+    for (int i = 0; i < 256; ++i)
+      data[i] = static_cast<uint8_t>(i);
+    embsh::ShellPrintf("<");
+    (void)embsh::ShellWriteBinary(data, sizeof(data));
+    embsh::ShellPrintf(">");
+    return 0;
+  };
+  RequireRegister("bin_dump", dump_fn, "binary dump");
+
+  embsh::ServerConfig cfg;
+  cfg.port = 23247;
+  cfg.banner = nullptr;
+  cfg.binary = true;
+  embsh::TelnetServer server(cfg);
+  REQUIRE(server.Start().has_value());
+
+  int client = TcpConnect(cfg.port);
+  REQUIRE(client >= 0);
+  std::string data = TcpRecv(client, 200);
+  CHECK(data.find("\xFF\xFB\x00", 0, 3) != std::string::npos);  // WILL BINARY
+
+  TcpSend(client, "\xFF\xFD");  // DO BINARY (option byte 0 sent separately).
+  const char opt = '\0';
+  (void)::send(client, &opt, 1, MSG_NOSIGNAL);
+  TcpSend(client, "bin_dump\r\n");
+  data = TcpRecv(client, 300);
+  auto start = data.find('<');
+  auto end = data.rfind(">embsh> ");  // Closing marker, then the prompt.
+  REQUIRE(start != std::string::npos);
+  REQUIRE(end != std::string::npos);
+  std::string payload = data.substr(start + 1, end - start - 1);
+  REQUIRE(payload.size() == 257);  // 0xFF doubled, no CR NUL stuffing.
+  for (int i = 0; i < 255; ++i) {
+    CHECK(static_cast<uint8_t>(payload[i]) == i);
+  }
+  CHECK(payload.substr(255) == "\xFF\xFF");
+
+  ::close(client);
+  server.Stop();
+}
+
+TEST_CASE("TelnetServer: stalled client does not block the reactor", "[telnet_server]") {
+  auto flood_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    char chunk[1024];
+    std::memset(chunk, 'z', sizeof(chunk));
+    for (int i = 0; i < 4096; ++i) {
+      embsh::ShellWrite(chunk, sizeof(chunk));
+    }
+    return 0;
+  };
+  auto ping_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    embsh::ShellPrintf("pong\r\n");
+    return 0;
+  };
+  RequireRegister("flood", flood_fn, "4 MiB of output");
+  RequireRegister("ping", ping_fn, "reply pong");
+
+  // kBlock (the default) must not wait on the reactor thread: it acts as kDisconnect there.
+  for (embsh::TxPolicy policy : {embsh::TxPolicy::kDrop, embsh::TxPolicy::kDisconnect, embsh::TxPolicy::kBlock}) {
+    embsh::ServerConfig cfg;
+    cfg.port = (policy == embsh::TxPolicy::kDrop) ? 23249 : (policy == embsh::TxPolicy::kDisconnect) ? 23250 : 23259;
+    cfg.banner = nullptr;
+    cfg.reactor_mode = true;
+    cfg.tx_policy = policy;
+    embsh::TelnetServer server(cfg);
+    REQUIRE(server.Start().has_value());
+
+    int a = TcpConnect(cfg.port);
+    int b = TcpConnect(cfg.port);
+    REQUIRE(a >= 0);
+    REQUIRE(b >= 0);
+    (void)TcpRecv(a, 100);
+    (void)TcpRecv(b, 100);
+
+    // A floods and never reads; the reactor must keep serving B.
+    TcpSend(a, "flood\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto t0 = std::chrono::steady_clock::now();
+    TcpSend(b, "ping\r\n");
+    CHECK(TcpRecv(b, 300).find("pong") != std::string::npos);
+    CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(400));
+
+    // Dropping keeps A usable; disconnecting closes it (EOF after the backlog).
+    (void)TcpRecv(a, 300);
+    TcpSend(a, "ping\r\n");
+    std::string tail = TcpRecv(a, 300);
+    if (policy == embsh::TxPolicy::kDrop) {
+      CHECK(tail.find("pong") != std::string::npos);
+    } else {
+      CHECK(tail.find("pong") == std::string::npos);
+    }
+
+    ::close(a);
+    ::close(b);
+    server.Stop();
+  }
+}
+
+TEST_CASE("TelnetServer: blocked client times out in thread mode", "[telnet_server]") {
+  auto flood_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    char chunk[1024];
+    std::memset(chunk, 'z', sizeof(chunk));
+    for (int i = 0; i < 4096; ++i) {
+      embsh::ShellWrite(chunk, sizeof(chunk));
+    }
+    return 0;
+  };
+  RequireRegister("flood", flood_fn, "4 MiB of output");
+
+  embsh::ServerConfig cfg;
+  cfg.port = 23251;
+  cfg.banner = nullptr;
+  cfg.tx_policy = embsh::TxPolicy::kBlock;
+  cfg.tx_timeout_ms = 100;
+  embsh::TelnetServer server(cfg);
+  REQUIRE(server.Start().has_value());
+
+  int a = TcpConnect(cfg.port);
+  REQUIRE(a >= 0);
+  (void)TcpRecv(a, 100);
+  TcpSend(a, "flood\r\n");
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+
+  // The server gave up on A: reading now drains the backlog and hits EOF.
+  // A receive timeout turns a session that stayed open into a failure, not a hang.
+  struct timeval tv = {1, 0};
+  REQUIRE(::setsockopt(a, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == 0);
+  char buf[65536];
+  ssize_t n;
+  size_t total = 0;
+  while ((n = ::recv(a, buf, sizeof(buf), 0)) > 0)
+    total += static_cast<size_t>(n);
+  CHECK(n == 0);  // EOF, not -1 / EAGAIN from the timeout.
+  CHECK(total < 4096U * 1024U);
+
+  ::close(a);
+  server.Stop();
+}
+
+TEST_CASE("TelnetServer: pre-spawned sessions serve repeated reconnects", "[telnet_server]") {
+  embsh::ServerConfig cfg;
+  cfg.port = 23252;
+  cfg.banner = nullptr;
+  cfg.max_sessions = 2;
+  cfg.prespawn = true;
+  embsh::TelnetServer server(cfg);
+  REQUIRE(server.Start().has_value());
+
+  for (int round = 0; round < 5; ++round) {
+    int a = TcpConnect(cfg.port);
+    int b = TcpConnect(cfg.port);
+    REQUIRE(a >= 0);
+    REQUIRE(b >= 0);
+    CHECK(TcpRecv(a, 100).find("embsh> ") != std::string::npos);
+    CHECK(TcpRecv(b, 100).find("embsh> ") != std::string::npos);
+    TcpSend(a, "help\r\n");
+    CHECK(TcpRecv(a, 100).find("help") != std::string::npos);
+    TcpSend(a, "exit\r\n");
+    TcpSend(b, "exit\r\n");
+    CHECK(TcpRecv(a, 100).find("Bye.") != std::string::npos);
+    CHECK(TcpRecv(b, 100).find("Bye.") != std::string::npos);
+    ::close(a);
+    ::close(b);
+  }
+  server.Stop();
+  CHECK_FALSE(server.IsRunning());
+}
+
+TEST_CASE("TelnetServer: connection burst within the backlog is answered", "[telnet_server]") {
+  embsh::ServerConfig cfg;
+  cfg.port = 23253;
+  cfg.banner = nullptr;
+  cfg.max_sessions = 4;
+  cfg.backlog = 64;
+  cfg.prespawn = true;
+  embsh::TelnetServer server(cfg);
+  REQUIRE(server.Start().has_value());
+
+  constexpr int kClients = 32;
+  int fds[kClients];
+  for (int& fd : fds) {
+    fd = TcpConnect(cfg.port);
+    REQUIRE(fd >= 0);
+  }
+  // Every client hears back: a prompt for the first four, a refusal for the rest.
+  int served = 0;
+  int refused = 0;
+  for (int fd : fds) {
+    std::string r = TcpRecv(fd, 150);
+    served += (r.find("embsh> ") != std::string::npos) ? 1 : 0;
+    refused += (r.find("Too many connections") != std::string::npos) ? 1 : 0;
+  }
+  CHECK(served == 4);
+  CHECK(refused == kClients - 4);
+  for (int fd : fds)
+    ::close(fd);
+  server.Stop();
+}
+
+TEST_CASE("TelnetServer: command rate limit spaces out a burst", "[telnet_server]") {
+  static std::atomic<int> runs{0};
+  auto count_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    runs.fetch_add(1);
+    return 0;
+  };
+  RequireRegister("rl_count", count_fn, "count runs");
+
+  for (bool reactor : {false, true}) {
+    runs = 0;
+    embsh::ServerConfig cfg;
+    cfg.port = reactor ? 23255 : 23254;
+    cfg.banner = nullptr;
+    cfg.reactor_mode = reactor;
+    cfg.session_cmds.per_sec = 10;
+    cfg.session_cmds.burst = 2;
+    embsh::TelnetServer server(cfg);
+    REQUIRE(server.Start().has_value());
+    int fd = TcpConnect(cfg.port);
+    REQUIRE(fd >= 0);
+    (void)TcpRecv(fd, 100);
+
+    // The burst runs at once, the rest one per 100 ms.
+    auto t0 = std::chrono::steady_clock::now();
+    TcpSend(fd, "rl_count\r\nrl_count\r\nrl_count\r\nrl_count\r\nrl_count\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(runs.load() == 2);
+    while (runs.load() < 5 && std::chrono::steady_clock::now() - t0 < std::chrono::seconds(2)) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    CHECK(runs.load() == 5);
+    CHECK(std::chrono::steady_clock::now() - t0 >= std::chrono::milliseconds(250));
+
+    // Idle time refills the bucket.
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    TcpSend(fd, "rl_count\r\nrl_count\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(runs.load() == 7);
+    ::close(fd);
+    server.Stop();
+  }
+}
+
+TEST_CASE("TelnetServer: byte budget and max_running hold input back", "[telnet_server]") {
+  static std::atomic<bool> release{false};
+  static std::atomic<int> runs{0};
+  auto hold_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    while (!release.load() && !embsh::ShellCancelled()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return 0;
+  };
+  auto count_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    runs.fetch_add(1);
+    embsh::ShellPrintf("counted\r\n");
+    return 0;
+  };
+  RequireRegister("rl_hold", hold_fn, nullptr, "hold a slot", embsh::kCmdAsync);
+  RequireRegister("rl_bytes", count_fn, "count runs");
+
+  for (bool reactor : {false, true}) {
+    embsh::ServerConfig cfg;
+    cfg.port = reactor ? 23257 : 23256;
+    cfg.banner = nullptr;
+    cfg.reactor_mode = reactor;
+    cfg.max_running = 1;
+    cfg.session_bytes.per_sec = 200;
+    cfg.session_bytes.burst = 20;
+    embsh::TelnetServer server(cfg);
+    REQUIRE(server.Start().has_value());
+    int a = TcpConnect(cfg.port);
+    int b = TcpConnect(cfg.port);
+    REQUIRE(a >= 0);
+    REQUIRE(b >= 0);
+    (void)TcpRecv(a, 100);
+    (void)TcpRecv(b, 100);
+
+    // 60 bytes at 200 B/s after a 20-byte burst: the line ends about 200 ms later.
+    runs = 0;
+    const std::string line = "rl_bytes " + std::string(49, 'x') + "\r\n";
+    auto t0 = std::chrono::steady_clock::now();
+    TcpSend(a, line.c_str());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(runs.load() == 0);
+    CHECK(TcpRecv(a, 1000).find("counted") != std::string::npos);
+    CHECK(std::chrono::steady_clock::now() - t0 >= std::chrono::milliseconds(150));
+
+    // A's async command takes the only execution slot; B's line waits for it.
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));  // Refill A's and B's byte buckets.
+    release = false;
+    runs = 0;
+    TcpSend(a, "rl_hold\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    TcpSend(b, "rl_bytes\r\n");
+    CHECK(TcpRecv(b, 150).find("counted") == std::string::npos);
+    CHECK(runs.load() == 0);
+    release = true;
+    CHECK(TcpRecv(b, 500).find("counted") != std::string::npos);
+    CHECK(runs.load() == 1);
+    ::close(a);
+    ::close(b);
+    server.Stop();
+  }
+}
+
+TEST_CASE("TelnetServer: thread options place the server threads", "[telnet_server]") {
+  static std::atomic<int> cpus{-1};
+  auto affinity_fn = [](int /*argc*/, char* /*argv*/[], void* /*ctx*/) -> int {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    (void)::pthread_getaffinity_np(::pthread_self(), sizeof(set), &set);
+    cpus = CPU_ISSET(0, &set) ? CPU_COUNT(&set) : 0;
+    return 0;
+  };
+  RequireRegister("rl_affinity", affinity_fn, "report the thread's CPUs");
+
+  embsh::ServerConfig cfg;
+  cfg.port = 23258;
+  cfg.banner = nullptr;
+  cfg.threads.cpu_mask = 1;  // CPU 0 only.
+  cfg.threads.stack_size = 64 * 1024;
+  cfg.threads.nice = 5;
+  {
+    embsh::TelnetServer server(cfg);
+    REQUIRE(server.Start().has_value());
+    int fd = TcpConnect(cfg.port);
+    REQUIRE(fd >= 0);
+    (void)TcpRecv(fd, 100);
+    TcpSend(fd, "rl_affinity\r\n");
+    CHECK(TcpRecv(fd, 200).find("embsh> ") != std::string::npos);
+    CHECK(cpus.load() == 1);
+    ::close(fd);
+    server.Stop();
+  }
+
+  // An impossible request fails Start() instead of running without it.
+  cfg.threads = embsh::ThreadOptions{};
+  cfg.threads.policy = SCHED_FIFO;
+  cfg.threads.priority = 1000;
+  for (bool reactor : {false, true}) {
+    cfg.reactor_mode = reactor;
+    cfg.prespawn = !reactor;
+    embsh::TelnetServer server(cfg);
+    CHECK(server.Start().error_value() == embsh::ShellError::kThreadStartFailed);
+    CHECK_FALSE(server.IsRunning());
+  }
+}
@@ -5,6 +5,8 @@
 
 #include <catch2/catch_test_macros.hpp>
 
+#include "test_support.hpp"
+
 #include "embsh/uart_shell.hpp"
 
 #include <chrono>
@@ -14,6 +16,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <pty.h>
+#include <termios.h>
 #include <unistd.h>
 
 // ============================================================================
@@ -94,7 +97,7 @@ TEST_CASE("UartShell: command execution via PTY", "[uart_shell]") {
     uart_cmd_ran = true;
     return 0;
   };
-  embsh::CommandRegistry::Instance().Register("uart_test", cmd_fn, "uart test");
+  RequireRegister("uart_test", cmd_fn, "uart test");
 
   PtyPair pty;
   REQUIRE(pty.slave >= 0);
@@ -118,6 +121,22 @@ TEST_CASE("UartShell: command execution via PTY", "[uart_shell]") {
   shell.Stop();
 }
 
+TEST_CASE("UartShell: Stop interrupts an idle shell immediately", "[uart_shell]") {
+  PtyPair pty;
+  REQUIRE(pty.slave >= 0);
+
+  embsh::UartShell::Config cfg;
+  cfg.override_fd = pty.slave;
+  embsh::UartShell shell(cfg);
+  REQUIRE(shell.Start().has_value());
+  (void)pty.ReadFromSlave(100);
+
+  auto t0 = std::chrono::steady_clock::now();
+  shell.Stop();
+  CHECK(std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50));
+  CHECK_FALSE(shell.IsRunning());
+}
+
 TEST_CASE("UartShell: start is idempotent", "[uart_shell]") {
   PtyPair pty;
   REQUIRE(pty.slave >= 0);
@@ -153,3 +172,63 @@ TEST_CASE("UartShell: stop when not running is safe", "[uart_shell]") {
   shell.Stop();  // Should not crash.
   CHECK_FALSE(shell.IsRunning());
 }
+
+TEST_CASE("UartShell: termios follows the config on a device path", "[uart_shell]") {
+  PtyPair pty;
+  REQUIRE(pty.slave >= 0);
+  const char* dev = ::ttyname(pty.slave);
+  REQUIRE(dev != nullptr);
+
+  embsh::UartShell::Config cfg;
+  cfg.device = dev;
+  cfg.baudrate = 3000000;
+  cfg.rts_cts = true;
+  cfg.vmin = 32;
+  cfg.vtime = 1;
+  {
+    embsh::UartShell shell(cfg);
+    REQUIRE(shell.Start().has_value());
+    struct termios tty = {};
+    REQUIRE(::tcgetattr(pty.slave, &tty) == 0);
+    CHECK(::cfgetospeed(&tty) == B3000000);
+    CHECK((tty.c_cflag & CRTSCTS) != 0);
+    CHECK(tty.c_cc[VMIN] == 32);
+    CHECK(tty.c_cc[VTIME] == 1);
+
+    // A burst is still read and executed with batched reads.
+    pty.SendToSlave("help\r");
+    CHECK(pty.ReadFromSlave(300).find("help") != std::string::npos);
+    shell.Stop();
+  }
+
+#if EMBSH_UART_TERMIOS2
+  cfg.baudrate = 250000;  // No Bxxx constant: set through termios2 / BOTHER.
+  cfg.rts_cts = false;
+  embsh::UartShell shell(cfg);
+  REQUIRE(shell.Start().has_value());
+  embsh::detail::UartTermios2 tio = {};
+  REQUIRE(::ioctl(pty.slave, _IOR('T', 0x2A, embsh::detail::UartTermios2), &tio) == 0);
+  CHECK((tio.c_cflag & CBAUD) == embsh::detail::kUartBother);
+  CHECK(tio.c_ospeed == 250000);
+  CHECK((tio.c_cflag & CRTSCTS) == 0);
+  shell.Stop();
+#endif
+}
+
+TEST_CASE("UartShell: unusable baud and read settings are rejected", "[uart_shell]") {
+  PtyPair pty;
+  REQUIRE(pty.slave >= 0);
+  embsh::UartShell::Config cfg;
+  cfg.device = ::ttyname(pty.slave);
+
+  cfg.baudrate = 0;
+  embsh::UartShell zero(cfg);
+  CHECK(zero.Start().error_value() == embsh::ShellError::kInvalidArgument);
+
+  cfg.baudrate = 115200;
+  cfg.vmin = 16;  // Would hold single keystrokes back forever.
+  cfg.vtime = 0;
+  embsh::UartShell stuck(cfg);
+  CHECK(stuck.Start().error_value() == embsh::ShellError::kInvalidArgument);
+  CHECK_FALSE(stuck.IsRunning());
+}